@@ -0,0 +1,10 @@
+#version 330 core
+
+flat in vec3 BgCol;
+
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(BgCol, 1.);
+}
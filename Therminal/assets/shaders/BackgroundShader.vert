@@ -0,0 +1,48 @@
+#version 330 core
+
+layout (location = 0) in vec2 aUnitVert;
+// first column - lower 16 bits, one past the last column - upper 16 bits
+layout (location = 1) in uint aCols;
+// row slot - lower 16 bits, style index - upper 16 bits
+layout (location = 2) in uint aSlotStyle;
+
+flat out vec3 BgCol;
+
+uniform uvec2 ScreenResPix;
+uniform uint  RowStridePix;
+uniform uint  ColumnStridePix;
+
+// row slot -> screen row, negative for slots out of view
+uniform isamplerBuffer RowLookup;
+// style index -> (fg, bg), colors packed as 0xBBGGRR
+uniform usamplerBuffer StyleLookup;
+
+vec3 unpackColor(uint c)
+{
+	return vec3(uvec3(c, c >> 8u, c >> 16u) & 0xFFu) / 255.;
+}
+
+void main() 
+{
+	int screen_row = texelFetch(RowLookup, int(aSlotStyle & 0xFFFFu)).r;
+
+	if (screen_row < 0) {
+		BgCol = vec3(0.);
+		gl_Position = vec4(2., 2., 0., 1.);
+		return;
+	}
+
+	uint begin = aCols & 0xFFFFu;
+	uint end = aCols >> 16u;
+
+	// runs cover the gaps between cells as well
+	vec2 origin = vec2(begin * ColumnStridePix, uint(screen_row) * RowStridePix);
+	vec2 size = vec2((end - begin) * ColumnStridePix, RowStridePix);
+
+	vec2 pix_pos = origin + size * aUnitVert;
+	vec2 norm_pos = vec2(1., -1.) * (2. * pix_pos - ScreenResPix) / ScreenResPix;
+
+	BgCol = unpackColor(texelFetch(StyleLookup, int(aSlotStyle >> 16u)).g);
+
+	gl_Position = vec4(norm_pos, 0.0, 1.0);
+}
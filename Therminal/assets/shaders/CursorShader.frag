@@ -0,0 +1,17 @@
+#version 330 core
+
+out vec4 FragColor;
+
+// time into the blink period and length of its halves, in seconds
+uniform float BlinkTime;
+uniform float BlinkInterval;
+
+void main()
+{
+	// hidden for the second half of the period
+	if (BlinkTime >= BlinkInterval)
+		discard;
+
+	// inverts the pixels below with the blend function
+	FragColor = vec4(1.);
+}
@@ -0,0 +1,34 @@
+#version 330 core
+
+layout (location = 0) in vec2 aUnitVert;
+
+uniform uvec2 ScreenResPix;
+uniform uvec2 CellSizePix;
+uniform uint  RowStridePix;
+uniform uint  ColumnStridePix;
+
+// column, screen row
+uniform uvec2 CursorCell;
+// 0 - block, 1 - underline, 2 - bar
+uniform uint  CursorShape;
+
+void main() 
+{
+	vec2 origin = vec2(CursorCell.x * ColumnStridePix, CursorCell.y * RowStridePix);
+	vec2 size = vec2(CellSizePix);
+
+	float thickness = float(max(CellSizePix.y / 12u, 1u));
+
+	if (CursorShape == 1u) {
+		origin.y += size.y - thickness;
+		size.y = thickness;
+	}
+	else if (CursorShape == 2u) {
+		size.x = thickness;
+	}
+
+	vec2 pix_pos = origin + size * aUnitVert;
+	vec2 norm_pos = vec2(1., -1.) * (2. * pix_pos - ScreenResPix) / ScreenResPix;
+
+	gl_Position = vec4(norm_pos, 0.0, 1.0);
+}
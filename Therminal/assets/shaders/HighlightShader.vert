@@ -0,0 +1,14 @@
+#version 330 core
+
+layout (location = 0) in vec2  aUnitVert;
+layout (location = 1) in uvec4 aRect;
+
+uniform uvec2 ScreenResPix;
+
+void main() 
+{
+	vec2 pix_pos = aRect.xy + aRect.zw * aUnitVert;
+	vec2 norm_pos = vec2(1., -1.) * (2. * pix_pos - ScreenResPix) / ScreenResPix;
+
+	gl_Position = vec4(norm_pos, 0.0, 1.0);
+}
@@ -1,13 +1,21 @@
 #version 330 core
 
 in vec2 TexCoords;
+flat in int AtlasLayer;
+flat in vec3 FgCol;
 
 out vec4 FragColor;
 
-uniform sampler2D AtlasTexture;
+uniform sampler2DArray AtlasTexture;
 
 void main()
 {
-	float alpha = texture(AtlasTexture, TexCoords).r;
-	FragColor = alpha > 0. ? vec4(1., 1., 1., 1.0) : vec4(0., 0., 0., 1.); 
+	// glyphs are drawn 1:1, fetch the texel under the fragment
+	float alpha = texelFetch(AtlasTexture, ivec3(ivec2(TexCoords), AtlasLayer), 0).r;
+
+	// background is drawn by its own pass
+	if (alpha == 0.)
+		discard;
+
+	FragColor = vec4(FgCol, 1.);
 }
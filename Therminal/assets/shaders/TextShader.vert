@@ -1,30 +1,64 @@
 #version 330 core
 
-layout (location = 0) in vec2  aUnitVert;
-layout (location = 1) in uvec2 aPos;
-layout (location = 2) in uint  aId;
-layout (location = 3) in uvec3 aFgCol;
-layout (location = 4) in uvec3 aBgCol;
+layout (location = 0) in vec2 aUnitVert;
+// glyph id - lower 20 bits, column - upper 12 bits
+layout (location = 1) in uint aGlyph;
+// row slot - lower 16 bits, style index - upper 16 bits
+layout (location = 2) in uint aSlotStyle;
 
+// pixel of the atlas page
 out vec2 TexCoords;
+flat out int AtlasLayer;
+flat out vec3 FgCol;
 
 uniform uvec2 ScreenResPix;
 uniform uvec2 CellSizePix;
+uniform uint  RowStridePix;
+uniform uint  ColumnStridePix;
 
-uniform samplerBuffer AtlasUVsLookup;
+// glyph id -> (x, y, page) of the glyph in the atlas
+uniform isamplerBuffer AtlasPosLookup;
 uniform isamplerBuffer CharFormatLookup;
+// row slot -> screen row, negative for slots out of view
+uniform isamplerBuffer RowLookup;
+// style index -> (fg, bg), colors packed as 0xBBGGRR
+uniform usamplerBuffer StyleLookup;
+
+vec3 unpackColor(uint c)
+{
+	return vec3(uvec3(c, c >> 8u, c >> 16u) & 0xFFu) / 255.;
+}
 
 void main() 
 {
-	ivec4 format = texelFetch(CharFormatLookup, int(aId));
+	uint id = aGlyph & 0xFFFFFu;
+	uint col = aGlyph >> 20u;
+	uint slot = aSlotStyle & 0xFFFFu;
+
+	int screen_row = texelFetch(RowLookup, int(slot)).r;
+
+	if (screen_row < 0) {
+		TexCoords = vec2(0.);
+		AtlasLayer = 0;
+		FgCol = vec3(0.);
+		gl_Position = vec4(2., 2., 0., 1.);
+		return;
+	}
+
+	vec2 cell_pos = vec2(col * ColumnStridePix, uint(screen_row) * RowStridePix);
+
+	ivec4 format = texelFetch(CharFormatLookup, int(id));
 	ivec2 char_size = format.xy;
 	ivec2 char_bearing = format.zw;
 
-	vec2 pix_pos = char_size * aUnitVert + aPos + vec2(char_bearing.x, int(CellSizePix.y) - char_bearing.y);
+	vec2 pix_pos = char_size * aUnitVert + cell_pos + vec2(char_bearing.x, int(CellSizePix.y) - char_bearing.y);
 	vec2 norm_pos = vec2(1., -1.) * (2. * pix_pos - ScreenResPix) / ScreenResPix;
 	
-	vec4 atlas_uv_bords = texelFetch(AtlasUVsLookup, int(aId));
-	TexCoords = mix(atlas_uv_bords.xy, atlas_uv_bords.zw, aUnitVert);
+	ivec4 atlas_pos = texelFetch(AtlasPosLookup, int(id));
+	TexCoords = atlas_pos.xy + char_size * aUnitVert;
+	AtlasLayer = atlas_pos.z;
+
+	FgCol = unpackColor(texelFetch(StyleLookup, int(aSlotStyle >> 16u)).r);
 
 	gl_Position = vec4(norm_pos, 0.0, 1.0);
 }
@@ -1,8 +1,16 @@
 #include "application/Application.hpp"
+#include "application/HeadlessApp.hpp"
 #include "memory/Memory.hpp"
 
 int main(int argc, char* argv[]) 
 {
+	for (int i = 1; i < argc; i++) {
+		if (std::string_view(argv[i]) == "--headless") {
+			std::unique_ptr<Thr::HeadlessApp> app = std::make_unique<Thr::HeadlessApp>(argc, argv);
+			return app->run();
+		}
+	}
+
 	std::unique_ptr<Thr::Application> app = std::make_unique<Thr::Application>(argc, argv);
 	app->run();
 }
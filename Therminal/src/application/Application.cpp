@@ -4,6 +4,7 @@
 #include "core/pty.h"
 #include "core/tty_man.h"
 #include "gl/Utils.hpp"
+#include "io/Keymap.hpp"
 #include <atomic>
 
 //#define LOG_KEY_EV
@@ -12,6 +13,109 @@ namespace Thr
 {
 
 IOAppClient Application::_client;
+Application::PendingResize Application::_pending_resize;
+Application::SearchInput Application::_search_input;
+Application::PendingScroll Application::_pending_scroll;
+Application::PendingCommandAction Application::_pending_command;
+Application::PendingExport Application::_pending_export;
+std::atomic<bool> Application::_idle_waiting{ false };
+
+bool Application::handleScrollKey(int keycode, int mods)
+{
+	if (mods != THR_MOD_SHIFT)
+		return false;
+
+	switch (keycode) {
+	case THR_KEY_PAGE_UP:
+		_pending_scroll.pages++;
+		return true;
+	case THR_KEY_PAGE_DOWN:
+		_pending_scroll.pages--;
+		return true;
+	case THR_KEY_UP:
+		_pending_scroll.rows += 1.;
+		return true;
+	case THR_KEY_DOWN:
+		_pending_scroll.rows -= 1.;
+		return true;
+	case THR_KEY_HOME:
+		_pending_scroll = PendingScroll{};
+		_pending_scroll.to_top = true;
+		return true;
+	case THR_KEY_END:
+		_pending_scroll = PendingScroll{};
+		_pending_scroll.to_bottom = true;
+		return true;
+	}
+
+	return false;
+}
+
+bool Application::handleCommandKey(int keycode, int mods)
+{
+	if (mods != (THR_MOD_CONTROL | THR_MOD_SHIFT))
+		return false;
+
+	switch (keycode) {
+	case THR_KEY_UP:
+		_pending_command.jump--;
+		return true;
+	case THR_KEY_DOWN:
+		_pending_command.jump++;
+		return true;
+	case THR_KEY_O:
+		_pending_command.copy_output = true;
+		return true;
+	case THR_KEY_K:
+		_pending_command.toggle_fold = true;
+		return true;
+	}
+
+	return false;
+}
+
+bool Application::handleExportKey(int keycode, int mods)
+{
+	if (keycode != THR_KEY_E ||
+		!(mods & THR_MOD_CONTROL) || !(mods & THR_MOD_SHIFT))
+		return false;
+
+	_pending_export.requested = true;
+	_pending_export.format = (mods & THR_MOD_ALT) ? EXPORT_FORMAT_SGR : EXPORT_FORMAT_PLAIN;
+
+	return true;
+}
+
+bool Application::handleSearchKey(int keycode, int mods)
+{
+	if (keycode == THR_KEY_F && 
+		(mods & THR_MOD_CONTROL) && (mods & THR_MOD_SHIFT)) {
+		_search_input.editing = true;
+		return true;
+	}
+
+	if (!_search_input.editing)
+		return false;
+
+	switch (keycode) {
+	case THR_KEY_ESCAPE:
+		_search_input.query.clear();
+		_search_input.editing = false;
+		_search_input.changed = true;
+		break;
+	case THR_KEY_ENTER:
+		_search_input.editing = false;
+		break;
+	case THR_KEY_BACKSPACE:
+		if (!_search_input.query.empty()) {
+			_search_input.query.pop_back();
+			_search_input.changed = true;
+		}
+		break;
+	}
+
+	return true;
+}
 
 void Application::winErrorCallback(ErrorEvent ev)
 {
@@ -23,6 +127,14 @@ void Application::winResizeCallback(WindowResizeEvent ev)
 {
 	const auto& winsize = ev.getWindowSizeParams();
 	THR_LOG_DEBUG("Window resize callback: width {}, height {}", winsize.width, winsize.height);
+
+	// minimized window, keep the last usable size
+	if (winsize.width <= 0 || winsize.height <= 0)
+		return;
+
+	_pending_resize.width = winsize.width;
+	_pending_resize.height = winsize.height;
+	_pending_resize.pending = true;
 }
 
 void Application::winMoveCallback(WindowMoveEvent ev)
@@ -49,6 +161,18 @@ void Application::winKeyPressCallback(KeyPressEvent ev)
 	THR_LOG_DEBUG("Event press callback: keycode {}, mods {}", state.keycode, state.mods);
 #endif
 
+	const auto& params = ev.getKeyParams();
+
+	if (handleSearchKey(params.keycode, params.mods) ||
+		handleScrollKey(params.keycode, params.mods) ||
+		handleCommandKey(params.keycode, params.mods) ||
+		handleExportKey(params.keycode, params.mods))
+		return;
+
+	// typing into the shell brings the viewport back to the prompt
+	_pending_scroll = PendingScroll{};
+	_pending_scroll.to_bottom = true;
+
 	_client.sendEvent(ev);
 }
 
@@ -64,6 +188,18 @@ void Application::winKeyRepeatCallback(KeyRepeatEvent ev)
 	THR_LOG_DEBUG("Event repeat callback: keycode {}, mods {}", state.keycode, state.mods);
 #endif
 
+	const auto& params = ev.getKeyParams();
+
+	if (handleSearchKey(params.keycode, params.mods) ||
+		handleScrollKey(params.keycode, params.mods) ||
+		handleCommandKey(params.keycode, params.mods) ||
+		handleExportKey(params.keycode, params.mods))
+		return;
+
+	// typing into the shell brings the viewport back to the prompt
+	_pending_scroll = PendingScroll{};
+	_pending_scroll.to_bottom = true;
+
 	_client.sendEvent(ev);
 }
 
@@ -74,6 +210,12 @@ void Application::winKeyTypeCallback(KeyTypeEvent ev)
 	THR_LOG_DEBUG("Event type callback: keycode {}, mods {}", state.keycode, state.mods);
 #endif
 
+	if (_search_input.editing) {
+		_search_input.query.push_back(static_cast<char32_t>(ev.getKeyParams().keycode));
+		_search_input.changed = true;
+		return;
+	}
+
 	_client.sendEvent(ev);
 }
 
@@ -92,9 +234,16 @@ void Application::winMouseMoveCallback(MouseMoveEvent ev)
 	markUnused(ev);
 }
 
+void Application::wakeCallback()
+{
+	if (_idle_waiting.exchange(false))
+		Window::postEmptyEvent();
+}
+
 void Application::winMouseScrollCallback(MouseScrollEvent ev)
 {
-	markUnused(ev);
+	const auto& offset = ev.getScrollParams();
+	_pending_scroll.rows += offset.yoff * _ScrollRowsPerNotch;
 }
 
 Application::Application(int argc, char* argv[]) 
@@ -111,16 +260,51 @@ Application::Application(int argc, char* argv[])
 			1,
 			1
 		)
+	, _text_render(std::make_unique<TextRender>())
+	, _frame_timer()
 	, _io_bridge(std::make_shared<IOBridge>(512, 4096))
+	, _frame_stats(false)
+	, _frame_overlay(false)
+	, _stats_logged()
+	, _overlay_updated()
+	, _overlay_lines()
+	, _rendered_generation(0)
+	, _visible_matches()
+	, _search_version(0)
+	, _frame_dirty(false)
+	, _sync_held(false)
+	, _sync_begin()
 {
-   init();
-
    std::stringstream ss;
 
+   const char* home = std::getenv("HOME");
+   const FilePath home_dir = home != nullptr ? FilePath(home) : _cwd;
+
+   _glyph_cache_path = home_dir / FilePath(std::string(_GlyphCacheFileName));
+   _shader_cache_path = home_dir / FilePath(std::string(_ShaderCacheFileName));
+
    for (int i = 0; i < argc; i++) {
 	  ss << argv[i] << ' ';
+
+	  if (std::string_view(argv[i]) == "--search-index")
+		 _grid->enableSearchIndex(_SearchIndexMemoryLimit);
+
+	  if (std::string_view(argv[i]) == "--session")
+		 _session_path = home_dir / FilePath(std::string(_SessionFileName));
+
+	  // GL of VNC and virtual displays is emulated on the CPU, compose there directly
+	  if (std::string_view(argv[i]) == "--software")
+		 _text_render = std::make_unique<SoftRender>();
+
+	  if (std::string_view(argv[i]) == "--frame-stats")
+		 _frame_stats = true;
+
+	  if (std::string_view(argv[i]) == "--frame-overlay")
+		 _frame_overlay = true;
    }
 
+   init();
+
    THR_LOG_DEBUG("Got from cmd: {}", ss.str());
 }
 
@@ -129,24 +313,90 @@ void Application::run()
 	THR_LOG_INFO("Welcome to Therminal!");
 
 	while (_window->isOpen() && _shell.running()) {
-		_text_render.clearScreen(Color4f{ 0.1f, 0.1f, 0.1f, 1.f });
+		_frame_timer.beginFrame();
+
+		applyPendingResize();
+		_shell.update();
+
+		_text_render->clearScreen(Color4f{ 0.1f, 0.1f, 0.1f, 1.f });
 
 		BytesBuf buf = { nullptr, 0 };
+
+		_frame_timer.beginPhase(FRAME_PHASE_READ_BYTES);
 		_client.readBytes(buf);
+		_frame_timer.endPhase(FRAME_PHASE_READ_BYTES);
 
 		if (buf.n > 0) {
+			_frame_timer.beginPhase(FRAME_PHASE_PARSE);
 			_parser.parseToGrid(buf.ptr, buf.n);
+			_frame_timer.endPhase(FRAME_PHASE_PARSE);
+
+			_frame_dirty = true;
+		}
+
+		updateSearch();
+		applyPendingCommand();
+		applyPendingExport();
+		applyPendingScroll();
+
+		/* While the application is in the middle of synchronized update,
+		*  keep presenting the last complete frame.
+		*/
+		_frame_timer.beginPhase(FRAME_PHASE_SNAPSHOT);
+
+		if (_frame_dirty && !isFrameSyncHeld()) {
+			_grid->publishSnapshot();
+			_frame_dirty = false;
+		}
+
+		/* Render side - takes the most recent snapshot,
+		*  never touching the Grid lines directly.
+		*/
+		const ScreenSnapshot& snapshot = _grid->acquireSnapshot();
+
+		_frame_timer.endPhase(FRAME_PHASE_SNAPSHOT);
 
+		if (snapshot.generation != _rendered_generation || _text_render->hasNewGlyphs()) {
 			const RenderFramePacket packet = {
-				_grid->getVisibleLines()
+				std::addressof(snapshot)
 			};
 
-			_text_render.submitCurrFrame(packet);
+			_text_render->submitCurrFrame(packet);
+			_rendered_generation = snapshot.generation;
+
+			updateHighlights(snapshot);
+		}
+		/* New matches found, the glyphs stay as they are */
+		else if (_search_version != _grid->getSearch().getVersion()) {
+			updateHighlights(snapshot);
 		}
-		
-		_text_render.renderText();
-		_window->update();
+
+		// moving or blinking cursor doesn't touch the submitted rows
+		_text_render->submitCursor(snapshot.cursor);
+
+		updateFrameStats();
+
+		_text_render->renderText();
+
+		_frame_timer.beginPhase(FRAME_PHASE_SWAP);
+		_window->swapBuffers();
+		_frame_timer.endPhase(FRAME_PHASE_SWAP);
+
+		/* Output written or glyphs rasterized after the check wake
+		*  the wait up through the callback, as the flag is already set
+		*/
+		_idle_waiting.store(true);
+
+		const double timeout = _client.hasBytes() ? 0. : getIdleTimeout();
+		_window->processEvents(timeout);
+
+		_idle_waiting.store(false);
 	}
+
+	if (_session_path.isValid())
+		GridSession::save(*_grid, _session_path);
+
+	_text_render->saveGlyphCache();
 }
 
 void Application::init() 
@@ -187,20 +437,253 @@ void Application::init()
 	_render_fmt.setWindowSize(glm::ivec2(_window->getWidth(),
 										 _window->getHeight()));
 										
-	_text_render.init(_render_fmt);
+	_text_render->setGlyphReadyCallback(wakeCallback);
+	_text_render->init(_render_fmt, _glyph_cache_path, _shader_cache_path);
 
 	/* Get true text render format. */
-	_text_render.getRenderFormat(_render_fmt);
+	_text_render->getRenderFormat(_render_fmt);
+
+	/* Phases aren't measured unless asked for */
+	if (_frame_stats || _frame_overlay) {
+		_frame_timer.init();
+		_text_render->setFrameTimer(std::addressof(_frame_timer));
+		_stats_logged = std::chrono::steady_clock::now();
+	}
+
+	/* Restore before the first layout, so the lines are laid out once */
+	if (_session_path.isValid())
+		GridSession::restore(*_grid, _session_path);
 	
 	_grid->specifyRenderFormat(_render_fmt);
 
 	/* Create shell stream workflow */
+	_io_bridge->setOutputCallback(wakeCallback);
 	_client.bindBridge(_io_bridge);
 	_shell.init(_io_bridge, _render_fmt);
 
 	_shell.createFork();
 }
 
+bool Application::isFrameSyncHeld()
+{
+	if (!_grid->isModeSet(TERM_MODE_SYNC_UPDATE)) {
+		_sync_held = false;
+		return false;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+
+	if (!_sync_held) {
+		_sync_held = true;
+		_sync_begin = now;
+	}
+
+	if (now - _sync_begin < _SyncUpdateTimeout)
+		return true;
+
+	THR_LOG_DEBUG("Synchronized update timed out, forcing frame");
+
+	_grid->setMode(TERM_MODE_SYNC_UPDATE, false);
+	_sync_held = false;
+
+	return false;
+}
+
+void Application::applyPendingResize()
+{
+	if (!_pending_resize.pending || _window->isSuspended())
+		return;
+
+	_pending_resize.pending = false;
+
+	const glm::ivec2 window_size(_pending_resize.width, _pending_resize.height);
+
+	if (window_size == _render_fmt.getWindowSize())
+		return;
+
+	_render_fmt.setWindowSize(window_size);
+	glViewport(0, 0, window_size.x, window_size.y);
+
+	_text_render->resize(_render_fmt);
+	_text_render->getRenderFormat(_render_fmt);
+
+	_grid->specifyRenderFormat(_render_fmt);
+	_shell.resize(_render_fmt);
+
+	_frame_dirty = true;
+}
+
+void Application::applyPendingScroll()
+{
+	PendingScroll& scroll = _pending_scroll;
+
+	if (scroll.to_top) {
+		_grid->scrollToLine(_grid->getFirstLine());
+		_frame_dirty = true;
+	}
+
+	if (scroll.to_bottom && !_grid->isViewAtBottom()) {
+		_grid->scrollToBottom();
+		_frame_dirty = true;
+	}
+
+	/* Keep the fractional part of the scroll (touchpads),
+	*  it adds up in the next frames
+	*/
+	const long rows = static_cast<long>(scroll.rows) + 
+					  scroll.pages * static_cast<long>(_render_fmt.getCellCountHorizontal());
+
+	if (rows != 0) {
+		_grid->scrollView(rows);
+		_frame_dirty = true;
+	}
+
+	scroll.rows -= static_cast<long>(scroll.rows);
+	scroll.pages = 0;
+	scroll.to_top = false;
+	scroll.to_bottom = false;
+}
+
+void Application::applyPendingCommand()
+{
+	PendingCommandAction& action = _pending_command;
+
+	for (; action.jump < 0; action.jump++)
+		_frame_dirty |= _grid->scrollToPrompt(-1);
+
+	for (; action.jump > 0; action.jump--)
+		_frame_dirty |= _grid->scrollToPrompt(1) || _grid->isViewAtBottom();
+
+	if (action.toggle_fold) {
+		action.toggle_fold = false;
+		_frame_dirty |= _grid->toggleFold();
+	}
+
+	if (action.copy_output) {
+		action.copy_output = false;
+
+		std::u32string output;
+
+		if (!_grid->copyLastOutput(output)) {
+			THR_LOG_DEBUG("No finished command to copy the output of");
+			return;
+		}
+
+		std::string text;
+		text.reserve(output.size());
+
+		for (const char32_t ch : output)
+			appendUTF8(ch, text);
+
+		_window->setClipboardText(text);
+		THR_LOG_DEBUG("Copied {} bytes of the last command output", text.size());
+	}
+}
+
+void Application::applyPendingExport()
+{
+	if (!_pending_export.requested)
+		return;
+
+	_pending_export.requested = false;
+
+	const auto secs = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	const bool sgr = (_pending_export.format == EXPORT_FORMAT_SGR);
+	const std::string name = "therminal-scrollback-" + std::to_string(secs) + (sgr ? ".ans" : ".txt");
+
+	size_t first_ln, last_ln;
+
+	{
+		std::lock_guard<Grid> lock(*_grid);
+		first_ln = _grid->getFirstLine();
+		last_ln = _grid->getLastLine();
+	}
+
+	_grid->getExport().start(_cwd / FilePath(name), first_ln, last_ln, _pending_export.format);
+}
+
+void Application::updateFrameStats()
+{
+	if (!_frame_timer.isInitialized())
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	if (_frame_stats && now - _stats_logged >= _FrameStatsLogInterval) {
+		_frame_timer.logStats();
+		_stats_logged = now;
+	}
+
+	if (_frame_overlay && now - _overlay_updated >= _FrameOverlayInterval) {
+		_frame_timer.formatStats(_overlay_lines);
+		_text_render->submitOverlay(_overlay_lines);
+		_overlay_updated = now;
+	}
+}
+
+double Application::getIdleTimeout() const
+{
+	/* Frame in progress, glyphs arrived or search results coming in -
+	*  keep drawing frames. Glyphs still being rasterized wake the wait up
+	*  through the callback once they're ready.
+	*/
+	const GridSearch& search = _grid->getSearch();
+	const bool frame_held = _frame_dirty && _sync_held;
+
+	if ((_frame_dirty && !frame_held) || _text_render->hasNewGlyphs() ||
+		(_pending_resize.pending && !_window->isSuspended()) ||
+		search.isScanning() || _search_version != search.getVersion())
+		return 0.;
+
+	const auto now = std::chrono::steady_clock::now();
+	auto deadline = std::min(_text_render->getNextCursorEdge(), now + _MaxIdleWait);
+
+	/* Frame held by synchronized update - the end of the update arrives
+	*  as shell output and wakes the wait, otherwise the update times out
+	*/
+	if (frame_held)
+		deadline = std::min(deadline, _sync_begin + _SyncUpdateTimeout);
+
+	// window size held back while resizing settles
+	deadline = std::min(deadline, _shell.getWinsizeDeadline());
+
+	if (_frame_overlay)
+		deadline = std::min(deadline, _overlay_updated + _FrameOverlayInterval);
+
+	return std::max(std::chrono::duration<double>(deadline - now).count(), 0.);
+}
+
+void Application::updateSearch()
+{
+	if (!_search_input.changed)
+		return;
+
+	_search_input.changed = false;
+
+	GridSearch& search = _grid->getSearch();
+
+	if (_search_input.query.empty())
+		search.stop();
+	else
+		search.start(_search_input.query);
+}
+
+void Application::updateHighlights(const ScreenSnapshot& snapshot)
+{
+	const GridSearch& search = _grid->getSearch();
+	_search_version = search.getVersion();
+
+	const auto& rows = snapshot.rows;
+	_visible_matches.clear();
+
+	if (search.isActive() && !rows.empty())
+		search.getMatches(rows.front()->ln_num, rows.back()->ln_num, _visible_matches);
+
+	_text_render->submitHighlights(snapshot, _visible_matches);
+}
+
 void Application::getPrimaryMonitorRes(int& width, int& height)
 {
 	width = -1;
@@ -9,10 +9,14 @@
 #include "io/InputTranslator.hpp"
 #include "io/Worker.hpp"
 #include "screen/Grid.hpp"
+#include "screen/GridSession.hpp"
 #include "io/OutputParser.hpp"
 #include "gl/TextRender.hpp"
+#include "gl/SoftRender.hpp"
 #include "gl/RenderFormat.hpp"
 #include "shell/Shell.hpp"
+#include <chrono>
+#include <atomic>
 
 namespace Thr 
 {
@@ -28,6 +32,17 @@ public:
 private:
 	void init();
 	void getPrimaryMonitorRes(int& width, int& height);
+	bool isFrameSyncHeld();
+	void applyPendingResize();
+	void updateSearch();
+	void updateHighlights(const ScreenSnapshot& snapshot);
+	void applyPendingScroll();
+	void applyPendingCommand();
+	void applyPendingExport();
+	void updateFrameStats();
+	double getIdleTimeout() const;
+	// shell output or glyphs arrived, wakes up the idle wait
+	static void wakeCallback();
 
 	/* custom event callbacks */
 	static void winErrorCallback(ErrorEvent ev);
@@ -51,10 +66,131 @@ private:
 	std::shared_ptr<Grid>     _grid;
 	OutputParser			  _parser;
 	RenderFormat 			  _render_fmt;
-	TextRender				  _text_render;
+	std::unique_ptr<Renderer> _text_render;
+	FrameTimer				  _frame_timer;
 	Shell 				      _shell;
 	std::shared_ptr<IOBridge> _io_bridge;
 	static IOAppClient		  _client;
+
+	/* Window resize events come in storms while the window is being dragged
+	*  (and twice per change - for window and framebuffer size).
+	*  Only the last size is kept and applied once per frame.
+	*/
+	struct PendingResize
+	{
+		int  width   = 0;
+		int  height  = 0;
+		bool pending = false;
+	};
+
+	static PendingResize      _pending_resize;
+
+	/* Scrollback search query, typed after Ctrl+Shift+F.
+	*  While editing, key events are not forwarded to the shell.
+	*/
+	struct SearchInput
+	{
+		std::u32string query;
+		bool           editing = false;
+		bool           changed = false;
+	};
+
+	static SearchInput        _search_input;
+
+	// enabled by '--search-index' command line option
+	static constexpr size_t   _SearchIndexMemoryLimit = 0x4000000;
+
+	/* With '--session' command line option the scrollback is restored
+	*  on start and saved on exit, in the home directory.
+	*/
+	static constexpr std::string_view _SessionFileName = ".therminal-session";
+	FilePath                  _session_path;
+
+	/* Rasterized glyphs are cached in the home directory,
+	*  so the next start doesn't have to render them again.
+	*/
+	static constexpr std::string_view _GlyphCacheFileName = ".therminal-glyphs";
+	FilePath                  _glyph_cache_path;
+
+	/* Linked shader programs are cached next to the glyphs.
+	*/
+	static constexpr std::string_view _ShaderCacheFileName = ".therminal-shaders";
+	FilePath                  _shader_cache_path;
+	static bool handleSearchKey(int keycode, int mods);
+
+	/* Viewport scrolling requested by mouse wheel and Shift+(PageUp/PageDown/Up/Down/Home/End),
+	*  applied once per frame.
+	*/
+	struct PendingScroll
+	{
+		double rows      = 0.;
+		long   pages     = 0;
+		bool   to_top    = false;
+		bool   to_bottom = false;
+	};
+
+	static constexpr double   _ScrollRowsPerNotch = 3.;
+
+	static PendingScroll      _pending_scroll;
+	static bool handleScrollKey(int keycode, int mods);
+
+	/* Shell integration actions - Ctrl+Shift+Up/Down jumps between the prompts,
+	*  Ctrl+Shift+O copies output of the last command, Ctrl+Shift+K folds it.
+	*/
+	struct PendingCommandAction
+	{
+		long jump        = 0;
+		bool copy_output = false;
+		bool toggle_fold = false;
+	};
+
+	static PendingCommandAction _pending_command;
+	static bool handleCommandKey(int keycode, int mods);
+
+	/* Scrollback export into the working directory, Ctrl+Shift+E for plain text,
+	*  with Alt for colors encoded as SGR sequences. Runs in background.
+	*/
+	struct PendingExport
+	{
+		bool         requested = false;
+		ExportFormat format    = EXPORT_FORMAT_PLAIN;
+	};
+
+	static PendingExport      _pending_export;
+	static bool handleExportKey(int keycode, int mods);
+
+	/* Synchronized output (DECSET 2026) state.
+	*  Some applications never end the update, so we hold
+	*  the frame for limited amount of time only.
+	*/
+	static constexpr std::chrono::milliseconds _SyncUpdateTimeout{ 150 };
+
+	/* Frame phase timings - '--frame-stats' logs them periodically,
+	*  '--frame-overlay' shows them over the top right corner of the screen.
+	*/
+	static constexpr std::chrono::seconds      _FrameStatsLogInterval{ 5 };
+	static constexpr std::chrono::milliseconds _FrameOverlayInterval{ 500 };
+
+	bool                                  _frame_stats;
+	bool                                  _frame_overlay;
+	std::chrono::steady_clock::time_point _stats_logged;
+	std::chrono::steady_clock::time_point _overlay_updated;
+	Vec<std::string>                      _overlay_lines;
+
+	uint64_t                              _rendered_generation;
+	Vec<SearchMatch>                      _visible_matches;
+	uint64_t                              _search_version;
+
+	/* Nothing to draw until an event arrives, the shell writes something
+	*  or the cursor blinks. Waits are capped, in case the shell exits quietly.
+	*/
+	static constexpr std::chrono::milliseconds _MaxIdleWait{ 1000 };
+	// set while the loop waits, so the shell thread wakes it up only then
+	static std::atomic<bool>              _idle_waiting;
+
+	bool                                  _frame_dirty;
+	bool                                  _sync_held;
+	std::chrono::steady_clock::time_point _sync_begin;
 };
 
 } // namespace Thr
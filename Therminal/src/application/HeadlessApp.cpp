@@ -0,0 +1,362 @@
+#include "HeadlessApp.hpp"
+#include "logger/Log.hpp"
+#include "filesys/ReadFile.hpp"
+#include "filesys/ImageFile.hpp"
+#include "char/Char.hpp"
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <cstdio>
+
+namespace Thr
+{
+
+HeadlessApp::HeadlessApp(int argc, char* argv[])
+	: _context()
+	, _grid(std::make_shared<Grid>())
+	, _render_fmt(
+			0,
+			0,
+			0,
+			_FontHeight,
+			1,
+			1
+		)
+	, _text_render(std::make_unique<TextRender>())
+	, _frame_timer()
+	, _overlay_lines()
+	, _rendered_generation(0)
+	, _pixels()
+	, _width(_DefaultWidth)
+	, _height(_DefaultHeight)
+	, _chunk_size(_DefaultChunkSize)
+	, _repeat(1)
+	, _glyph_stress(0)
+	, _args_valid(false)
+	, _software(false)
+	, _frame_stats(false)
+	, _frame_overlay(false)
+	, _show_cursor(false)
+	, _glyph_wait(Clock::duration::zero())
+	, _dump_time(Clock::duration::zero())
+	, _check_time(Clock::duration::zero())
+{
+	_args_valid = parseArgs(argc, argv);
+}
+
+bool HeadlessApp::parseArgs(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string_view arg(argv[i]);
+
+		if (arg == "--headless")
+			continue;
+
+		if (arg == "--software") {
+			_software = true;
+			_text_render = makeRenderer();
+			continue;
+		}
+
+		if (arg == "--frame-stats" || arg == "--frame-overlay") {
+			(arg == "--frame-stats" ? _frame_stats : _frame_overlay) = true;
+			continue;
+		}
+
+		if (arg == "--cursor") {
+			_show_cursor = true;
+			continue;
+		}
+
+		if (i + 1 >= argc) {
+			THR_LOG_ERROR("Unknown headless option or missing value: {}", arg);
+			return false;
+		}
+
+		const char* value = argv[++i];
+
+		if (arg == "--size") {
+			if (std::sscanf(value, "%ux%u", &_width, &_height) != 2 || _width == 0 || _height == 0) {
+				THR_LOG_ERROR("Invalid frame size {}, expected WIDTHxHEIGHT", value);
+				return false;
+			}
+		}
+		else if (arg == "--chunk" || arg == "--repeat" || arg == "--glyph-stress") {
+			size_t& target = (arg == "--chunk") ? _chunk_size : (arg == "--repeat") ? _repeat : _glyph_stress;
+
+			if (std::sscanf(value, "%zu", &target) != 1 || target == 0) {
+				THR_LOG_ERROR("Invalid value of {}: {}", arg, value);
+				return false;
+			}
+		}
+		else if (arg == "--input") {
+			_input_path = FilePath(value);
+		}
+		else if (arg == "--dump") {
+			_dump_path = FilePath(value);
+		}
+		else if (arg == "--dump-dir") {
+			_dump_dir = FilePath(value);
+		}
+		else {
+			THR_LOG_ERROR("Unknown headless option: {}", arg);
+			return false;
+		}
+	}
+
+	// overlay differs from frame to frame, the checked frames would never match
+	if (_glyph_stress > 0 && _frame_overlay) {
+		THR_LOG_ERROR("--glyph-stress can't be combined with --frame-overlay");
+		return false;
+	}
+
+	return true;
+}
+
+bool HeadlessApp::readInput(std::string& input) const
+{
+	if (_glyph_stress > 0) {
+		makeGlyphStressInput(input);
+		return true;
+	}
+
+	if (_input_path.isValid()) {
+		input = readFile(_input_path);
+		return !input.empty();
+	}
+
+	input.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+
+	if (input.empty()) {
+		THR_LOG_ERROR("No input to render on stdin");
+		return false;
+	}
+
+	return true;
+}
+
+void HeadlessApp::makeGlyphStressInput(std::string& input) const
+{
+	/* Single cell printable codepoints from U+0100 up - the fonts cover just
+	*  a part of them, missing ones take a slot of the atlas all the same
+	*/
+	char32_t cp = 0x100;
+
+	for (size_t i = 0; i < _glyph_stress; i++) {
+		while (!Char32(cp).isPrintable() || Char32(cp).getWidth() != 1 || (cp >= 0xD800 && cp <= 0xDFFF))
+			cp++;
+
+		appendUTF8(cp++, input);
+
+		if ((i + 1) % _GlyphStressLineLen == 0)
+			input += '\n';
+	}
+
+	input += '\n';
+}
+
+std::unique_ptr<Renderer> HeadlessApp::makeRenderer() const
+{
+	if (_software)
+		return std::make_unique<SoftRender>();
+
+	return std::make_unique<TextRender>();
+}
+
+bool HeadlessApp::init()
+{
+	if (!_context.init(_width, _height))
+		return false;
+
+	_parser.writeTo(_grid);
+
+	_render_fmt.setWindowSize(glm::ivec2(_context.getWidth(), _context.getHeight()));
+	_text_render->init(_render_fmt);
+	_text_render->getRenderFormat(_render_fmt);
+
+	if (_frame_stats || _frame_overlay) {
+		_frame_timer.init();
+		_text_render->setFrameTimer(std::addressof(_frame_timer));
+	}
+
+	_grid->specifyRenderFormat(_render_fmt);
+
+	return true;
+}
+
+int HeadlessApp::run()
+{
+	std::string input;
+
+	if (!_args_valid || !readInput(input) || !init())
+		return 1;
+
+	const auto start = Clock::now();
+	size_t frame_cnt = 0;
+
+	for (size_t pass = 0; pass < _repeat; pass++) {
+		for (size_t offset = 0; offset < input.size(); offset += _chunk_size) {
+			const size_t n = std::min(_chunk_size, input.size() - offset);
+
+			_frame_timer.beginFrame();
+
+			_frame_timer.beginPhase(FRAME_PHASE_PARSE);
+			_parser.parseToGrid(reinterpret_cast<const byte*>(input.data() + offset), n);
+			_frame_timer.endPhase(FRAME_PHASE_PARSE);
+
+			_frame_timer.beginPhase(FRAME_PHASE_SNAPSHOT);
+			_grid->publishSnapshot();
+
+			const ScreenSnapshot& snapshot = _grid->acquireSnapshot();
+			_frame_timer.endPhase(FRAME_PHASE_SNAPSHOT);
+
+			if (_frame_overlay) {
+				_frame_timer.formatStats(_overlay_lines);
+				_text_render->submitOverlay(_overlay_lines);
+			}
+
+			renderFrame(snapshot);
+
+			const auto wait_start = Clock::now();
+			waitForGlyphs(*_text_render, snapshot);
+			_glyph_wait += Clock::now() - wait_start;
+
+			if (_glyph_stress > 0 && !checkFrame(snapshot)) {
+				THR_LOG_ERROR("Frame {} differs from the one drawn by a fresh renderer", frame_cnt);
+				return 1;
+			}
+
+			if (_dump_dir.isValid()) {
+				Arr<char, 32> name;
+				std::snprintf(name.data(), name.size(), "frame-%06zu.png", frame_cnt);
+
+				if (!dumpFrame(_dump_dir / FilePath(name.data())))
+					return 1;
+			}
+
+			frame_cnt++;
+		}
+	}
+
+	// frames are queued by the driver, count them as presented only once done
+	glFinish();
+
+	const auto elapsed = Clock::now() - start - _glyph_wait - _dump_time - _check_time;
+	const double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+	const double wait_ms = std::chrono::duration<double, std::milli>(_glyph_wait).count();
+	const double dump_ms = std::chrono::duration<double, std::milli>(_dump_time).count();
+	const double mb = static_cast<double>(input.size()) * _repeat / (1024. * 1024.);
+
+	THR_LOG_INFO("Rendered {} frames, {} MB in {} ms: {} ms/frame, {} MB/s, {} ms waiting for glyphs, {} ms saving frames",
+				 frame_cnt, mb, ms, ms / std::max<size_t>(frame_cnt, 1), mb * 1000. / std::max(ms, 1e-3), wait_ms, dump_ms);
+
+	if (_glyph_stress > 0) {
+		THR_LOG_INFO("Glyph stress: {} frames of {} distinct codepoints match, atlas holds {} pages",
+					 frame_cnt, _glyph_stress, _text_render->getAtlasPageCount());
+	}
+
+	if (_frame_stats) {
+		// queries of the last frames are done after glFinish
+		_frame_timer.beginFrame();
+		_frame_timer.logStats();
+	}
+
+	if (_dump_path.isValid() && !dumpFrame(_dump_path))
+		return 1;
+
+	return 0;
+}
+
+void HeadlessApp::renderFrame(const ScreenSnapshot& snapshot)
+{
+	const bool submit = snapshot.generation != _rendered_generation || _text_render->hasNewGlyphs();
+
+	drawFrame(*_text_render, snapshot, submit);
+	_rendered_generation = snapshot.generation;
+}
+
+void HeadlessApp::drawFrame(Renderer& renderer, const ScreenSnapshot& snapshot, bool submit)
+{
+	renderer.clearScreen(_ClearColor);
+
+	if (submit) {
+		const RenderFramePacket packet = {
+			std::addressof(snapshot)
+		};
+
+		renderer.submitCurrFrame(packet);
+	}
+
+	if (_show_cursor) {
+		SnapshotCursor cursor = snapshot.cursor;
+		cursor.blink = false;
+
+		renderer.submitCursor(cursor);
+	}
+
+	renderer.renderText();
+}
+
+void HeadlessApp::waitForGlyphs(Renderer& renderer, const ScreenSnapshot& snapshot)
+{
+	/* Glyphs arriving are shown by redrawing the frame, as the windowed
+	*  application would in its next frames
+	*/
+	size_t redraw_cnt = 0;
+
+	while (renderer.hasPendingGlyphs()) {
+		if (!renderer.hasNewGlyphs()) {
+			std::this_thread::sleep_for(_GlyphPollInterval);
+			continue;
+		}
+
+		// atlas evicts glyphs of the screen to place the arriving ones, see FontAtlas
+		if (redraw_cnt++ == _MaxGlyphRedraws) {
+			THR_LOG_ERROR("Screen has more glyphs than the atlas holds, drawn without some of them");
+			break;
+		}
+
+		drawFrame(renderer, snapshot, true);
+	}
+}
+
+bool HeadlessApp::checkFrame(const ScreenSnapshot& snapshot)
+{
+	const auto start = Clock::now();
+	const uint page_cnt = _text_render->getAtlasPageCount();
+
+	if (page_cnt > FontAtlas::MaxPages) {
+		THR_LOG_ERROR("Glyph atlas grew to {} pages, at most {} expected", page_cnt, FontAtlas::MaxPages);
+		return false;
+	}
+
+	_context.readPixels(_pixels);
+
+	/* Fresh renderer has never evicted a glyph, so anything the evictions
+	*  left behind - stale ids, lookup buffers or pages - shows up as a difference
+	*/
+	std::unique_ptr<Renderer> reference = makeRenderer();
+	RenderFormat fmt = _render_fmt;
+
+	reference->init(fmt);
+	drawFrame(*reference, snapshot, true);
+	waitForGlyphs(*reference, snapshot);
+
+	_context.readPixels(_check_pixels);
+
+	_check_time += Clock::now() - start;
+	return _pixels == _check_pixels;
+}
+
+bool HeadlessApp::dumpFrame(const FilePath& path)
+{
+	const auto start = Clock::now();
+
+	_context.readPixels(_pixels);
+	const bool ok = ImageFile::write(path, _pixels.data(), _context.getWidth(), _context.getHeight());
+
+	_dump_time += Clock::now() - start;
+	return ok;
+}
+
+} // namespace Thr
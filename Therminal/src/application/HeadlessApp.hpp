@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Common.hpp"
+#include "window/OffscreenContext.hpp"
+#include "filesys/Filepath.hpp"
+#include "screen/Grid.hpp"
+#include "io/OutputParser.hpp"
+#include "gl/TextRender.hpp"
+#include "gl/SoftRender.hpp"
+#include "gl/RenderFormat.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+/* Renders recorded terminal output without a window or a shell, for render
+*  benchmarks and pixel regression tests on machines without a display:
+*
+*    Therminal --headless [--input FILE] [--size WxH] [--chunk BYTES] [--repeat N]
+*              [--dump FILE.png|ppm] [--dump-dir DIR] [--software]
+*              [--frame-stats] [--frame-overlay] [--cursor] [--glyph-stress N]
+*
+*  Input (stdin by default) is fed to the parser in chunks, as if read from the shell,
+*  every chunk is followed by a frame drawn into an offscreen framebuffer. Frames wait
+*  for all their glyphs, so the dumped images don't depend on the rasterizer timing.
+*  No caches are read or written. '--software' composes the frames with SoftRender.
+*  '--frame-stats' logs the frame phase timings at the end, '--frame-overlay' draws
+*  the timings so far over every frame. '--cursor' draws the cursor, without blinking,
+*  so the images stay reproducible.
+*
+*  '--glyph-stress' replaces the input with N distinct codepoints, so the glyph atlas
+*  fills up and evicts glyphs. Every frame is checked against the same snapshot drawn
+*  by a fresh renderer, the run fails on the first frame that differs or when
+*  the atlas exceeds FontAtlas::MaxPages. Screen has to hold fewer cells than
+*  the atlas glyphs (2312 at the default font, --size 1280x600 fits), otherwise
+*  it can't be drawn in full - see FontAtlas.
+*/
+class HeadlessApp
+{
+public:
+	HeadlessApp() = delete;
+	HeadlessApp(int argc, char* argv[]);
+	~HeadlessApp() = default;
+
+	/* Returns the process exit code.
+	*/
+	int run();
+private:
+	using Clock = std::chrono::steady_clock;
+
+	bool parseArgs(int argc, char* argv[]);
+	bool readInput(std::string& input) const;
+	void makeGlyphStressInput(std::string& input) const;
+	std::unique_ptr<Renderer> makeRenderer() const;
+	bool init();
+	void renderFrame(const ScreenSnapshot& snapshot);
+	void drawFrame(Renderer& renderer, const ScreenSnapshot& snapshot, bool submit);
+	void waitForGlyphs(Renderer& renderer, const ScreenSnapshot& snapshot);
+	bool checkFrame(const ScreenSnapshot& snapshot);
+	bool dumpFrame(const FilePath& path);
+
+	static constexpr uint     _DefaultWidth = 1280;
+	static constexpr uint     _DefaultHeight = 720;
+	static constexpr size_t   _DefaultChunkSize = 4096;
+	static constexpr int      _FontHeight = 24;
+	static constexpr Color4f  _ClearColor = { 0.1f, 0.1f, 0.1f, 1.f };
+	static constexpr std::chrono::microseconds _GlyphPollInterval{ 100 };
+	// screen with more glyphs than the atlas holds never gets all of them
+	static constexpr size_t   _MaxGlyphRedraws = 256;
+	static constexpr size_t   _GlyphStressLineLen = 1000;
+
+	OffscreenContext	  _context;
+	std::shared_ptr<Grid> _grid;
+	OutputParser		  _parser;
+	RenderFormat		  _render_fmt;
+	std::unique_ptr<Renderer> _text_render;
+	FrameTimer			  _frame_timer;
+	Vec<std::string>	  _overlay_lines;
+	uint64_t			  _rendered_generation;
+	Vec<byte>			  _pixels;
+	Vec<byte>			  _check_pixels;
+
+	uint				  _width;
+	uint				  _height;
+	size_t				  _chunk_size;
+	size_t				  _repeat;
+	size_t				  _glyph_stress;
+	FilePath			  _input_path;
+	FilePath			  _dump_path;
+	FilePath			  _dump_dir;
+	bool				  _args_valid;
+	bool				  _software;
+	bool				  _frame_stats;
+	bool				  _frame_overlay;
+	bool				  _show_cursor;
+
+	// left out of the frame times
+	Clock::duration		  _glyph_wait;
+	Clock::duration		  _dump_time;
+	Clock::duration		  _check_time;
+};
+
+} // namespace Thr
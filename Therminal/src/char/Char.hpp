@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Common.hpp"
+#include <string>
 
 namespace Thr
 {
@@ -35,6 +36,11 @@ using Char8 = Char<char8_t>;
 using Char16 = Char<char16_t>;
 using Char32 = Char<char32_t>;
 
+/* Append UTF-8 encoding of the codepoint to 'out'.
+*  Invalid codepoints are replaced with U+FFFD.
+*/
+THR_INLINE void appendUTF8(char32_t cp, std::string& out);
+
 } // namespace Thr
 
 #include "Char.inl"
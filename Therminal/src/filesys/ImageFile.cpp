@@ -0,0 +1,279 @@
+#include "ImageFile.hpp"
+#include "WriteFile.hpp"
+#include "logger/Log.hpp"
+
+namespace Thr
+{
+
+static constexpr Arr<uint32_t, 256> makeCrcTable()
+{
+	Arr<uint32_t, 256> table = {};
+
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (0xEDB88320u ^ (crc >> 1)) : (crc >> 1);
+
+		table[i] = crc;
+	}
+
+	return table;
+}
+
+static constexpr Arr<uint32_t, 256> CrcTable = makeCrcTable();
+
+THR_INTERNAL uint32_t updateCrc(uint32_t crc, const byte* data, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		crc = CrcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return crc;
+}
+
+THR_INTERNAL uint32_t adler32(const byte* data, size_t n)
+{
+	static constexpr uint32_t Modulus = 65521;
+	// largest block whose sums can't overflow before the modulo
+	static constexpr size_t BlockSize = 5552;
+
+	uint32_t a = 1;
+	uint32_t b = 0;
+
+	while (n > 0) {
+		const size_t block = std::min(n, BlockSize);
+
+		for (size_t i = 0; i < block; i++) {
+			a += data[i];
+			b += a;
+		}
+
+		a %= Modulus;
+		b %= Modulus;
+		data += block;
+		n -= block;
+	}
+
+	return (b << 16) | a;
+}
+
+THR_INTERNAL void appendBigEndian(Vec<byte>& out, uint32_t v)
+{
+	out.push_back(static_cast<byte>(v >> 24));
+	out.push_back(static_cast<byte>(v >> 16));
+	out.push_back(static_cast<byte>(v >> 8));
+	out.push_back(static_cast<byte>(v));
+}
+
+/* Deflate bit stream - values are packed from the least significant bit,
+*  Huffman codes from the most significant one.
+*/
+class ImageFile::BitWriter
+{
+public:
+	explicit BitWriter(Vec<byte>& out)
+		: _out(out)
+		, _bits(0)
+		, _bit_cnt(0)
+	{}
+
+	void putBits(uint32_t value, uint count)
+	{
+		_bits |= static_cast<uint64_t>(value) << _bit_cnt;
+		_bit_cnt += count;
+
+		while (_bit_cnt >= 8) {
+			_out.push_back(static_cast<byte>(_bits));
+			_bits >>= 8;
+			_bit_cnt -= 8;
+		}
+	}
+
+	void putCode(uint32_t code, uint length)
+	{
+		uint32_t reversed = 0;
+
+		for (uint i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+
+		putBits(reversed, length);
+	}
+
+	/* Fixed Huffman code of a literal/length symbol */
+	void putSymbol(uint symbol)
+	{
+		if (symbol < 144)
+			putCode(0x30 + symbol, 8);
+		else if (symbol < 256)
+			putCode(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			putCode(symbol - 256, 7);
+		else
+			putCode(0xC0 + symbol - 280, 8);
+	}
+
+	void flush()
+	{
+		if (_bit_cnt > 0)
+			_out.push_back(static_cast<byte>(_bits));
+
+		_bits = 0;
+		_bit_cnt = 0;
+	}
+private:
+	Vec<byte>& _out;
+	uint64_t   _bits;
+	uint	   _bit_cnt;
+};
+
+void ImageFile::deflate(const Vec<byte>& data, Vec<byte>& out)
+{
+	static constexpr Arr<uint16_t, 29> LengthBase = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+
+	static constexpr Arr<byte, 29> LengthExtraBits = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+
+	static constexpr size_t MinMatch = 3;
+	static constexpr size_t MaxMatch = 258;
+	static constexpr uint EndOfBlock = 256;
+
+	// zlib header - deflate, 32K window, no dictionary
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	BitWriter bits(out);
+
+	// single final block with the fixed codes
+	bits.putBits(1, 1);
+	bits.putBits(1, 2);
+
+	/* Only matches at distance 1 - runs of the previous byte
+	*/
+	for (size_t i = 0; i < data.size(); ) {
+		size_t run = 0;
+
+		if (i > 0) {
+			const byte prev = data[i - 1];
+
+			while (run < MaxMatch && i + run < data.size() && data[i + run] == prev)
+				run++;
+		}
+
+		if (run < MinMatch) {
+			bits.putSymbol(data[i]);
+			i++;
+			continue;
+		}
+
+		const size_t code = std::upper_bound(LengthBase.begin(), LengthBase.end(), run) - LengthBase.begin() - 1;
+
+		bits.putSymbol(static_cast<uint>(257 + code));
+		bits.putBits(static_cast<uint32_t>(run - LengthBase[code]), LengthExtraBits[code]);
+		// distance 1
+		bits.putCode(0, 5);
+
+		i += run;
+	}
+
+	bits.putSymbol(EndOfBlock);
+	bits.flush();
+
+	appendBigEndian(out, adler32(data.data(), data.size()));
+}
+
+void ImageFile::appendChunk(Vec<byte>& png, const char* type, const Vec<byte>& data)
+{
+	appendBigEndian(png, static_cast<uint32_t>(data.size()));
+
+	const size_t type_pos = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data.begin(), data.end());
+
+	const uint32_t crc = updateCrc(0xFFFFFFFFu, png.data() + type_pos, 4 + data.size()) ^ 0xFFFFFFFFu;
+	appendBigEndian(png, crc);
+}
+
+bool ImageFile::writePNG(const FilePath& path, const byte* rgba, uint width, uint height)
+{
+	static constexpr byte FilterSub = 1;
+
+	const size_t row_bytes = static_cast<size_t>(width) * _Channels;
+
+	/* Filtered rows, each starting with its filter type
+	*/
+	Vec<byte> filtered((row_bytes + 1) * height);
+	byte* dst = filtered.data();
+
+	for (uint y = 0; y < height; y++) {
+		const byte* src = rgba + static_cast<size_t>(y) * width * 4;
+		*dst++ = FilterSub;
+
+		for (uint x = 0; x < width; x++) {
+			for (uint c = 0; c < _Channels; c++) {
+				const byte left = x > 0 ? src[(x - 1) * 4 + c] : 0;
+				*dst++ = static_cast<byte>(src[x * 4 + c] - left);
+			}
+		}
+	}
+
+	Vec<byte> header;
+	appendBigEndian(header, width);
+	appendBigEndian(header, height);
+	// 8 bits per channel, RGB, deflate, default filters, no interlace
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });
+
+	Vec<byte> compressed;
+	deflate(filtered, compressed);
+
+	Vec<byte> png(_PngSignature.begin(), _PngSignature.end());
+	appendChunk(png, "IHDR", header);
+	appendChunk(png, "IDAT", compressed);
+	appendChunk(png, "IEND", {});
+
+	return writeFile(path, png);
+}
+
+bool ImageFile::writePPM(const FilePath& path, const byte* rgba, uint width, uint height)
+{
+	const std::string header = "P6\n" + std::to_string(width) + ' ' + std::to_string(height) + "\n255\n";
+	const size_t pixel_cnt = static_cast<size_t>(width) * height;
+
+	Vec<byte> ppm(header.begin(), header.end());
+	ppm.reserve(header.size() + pixel_cnt * _Channels);
+
+	for (size_t i = 0; i < pixel_cnt; i++)
+		ppm.insert(ppm.end(), rgba + i * 4, rgba + i * 4 + _Channels);
+
+	return writeFile(path, ppm);
+}
+
+bool ImageFile::write(const FilePath& path, const byte* rgba, uint width, uint height)
+{
+	const std::string& str = path.toStr();
+	const bool ppm = str.size() >= 4 && str.compare(str.size() - 4, 4, ".ppm") == 0;
+
+	return ppm ? writePPM(path, rgba, width, height) : writePNG(path, rgba, width, height);
+}
+
+bool ImageFile::writeFile(const FilePath& path, const Vec<byte>& data)
+{
+	WriteFile file;
+
+	if (!file.open(path))
+		return false;
+
+	bool ok = file.write(data.data(), data.size());
+	ok = file.close() && ok;
+
+	if (!ok)
+		THR_LOG_ERROR("Failed to write image into {}", path.toStr());
+
+	return ok;
+}
+
+} // namespace Thr
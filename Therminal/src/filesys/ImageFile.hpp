@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Filepath.hpp"
+
+namespace Thr
+{
+
+/* Writes rendered frames for pixel comparisons. Pixels are RGBA8, rows
+*  from top to bottom, alpha is dropped - images are stored as 8-bit RGB.
+*
+*  PNG is compressed just enough for terminal frames - rows are 'Sub' filtered,
+*  so flat backgrounds become runs of zeros, encoded as repeats of the previous
+*  byte with the fixed Huffman codes. No zlib needed.
+*/
+class ImageFile
+{
+public:
+	/* Format chosen by the extension of 'path' - '.ppm' for binary PPM, PNG otherwise.
+	*/
+	static bool write(const FilePath& path, const byte* rgba, uint width, uint height);
+
+	static bool writePPM(const FilePath& path, const byte* rgba, uint width, uint height);
+	static bool writePNG(const FilePath& path, const byte* rgba, uint width, uint height);
+private:
+	class BitWriter;
+
+	static bool writeFile(const FilePath& path, const Vec<byte>& data);
+	static void deflate(const Vec<byte>& data, Vec<byte>& out);
+	static void appendChunk(Vec<byte>& png, const char* type, const Vec<byte>& data);
+
+	static constexpr Arr<byte, 8> _PngSignature = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	// bytes of a pixel in the stored images
+	static constexpr uint _Channels = 3;
+};
+
+} // namespace Thr
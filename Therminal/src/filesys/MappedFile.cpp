@@ -0,0 +1,124 @@
+#include "MappedFile.hpp"
+#include "logger/Log.hpp"
+#include <cstring>
+#include <cerrno>
+
+#if defined(THR_PLATFORM_WINDOWS)
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+namespace Thr
+{
+
+MappedFile::MappedFile()
+	: _data(nullptr)
+	, _size(0)
+{}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const FilePath& path)
+{
+	close();
+
+#if defined(THR_PLATFORM_WINDOWS)
+	const HANDLE file = ::CreateFileA(path.toCStr(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+									  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+
+	if (!::GetFileSizeEx(file, std::addressof(file_size)) || file_size.QuadPart <= 0) {
+		::CloseHandle(file);
+		return false;
+	}
+
+	// copy-on-write pages, as MAP_PRIVATE
+	const HANDLE section = ::CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	void* data = section != nullptr ? ::MapViewOfFile(section, FILE_MAP_COPY, 0, 0, 0) : nullptr;
+	const DWORD err = ::GetLastError();
+
+	// the view stays valid after closing the handles
+	if (section != nullptr)
+		::CloseHandle(section);
+
+	::CloseHandle(file);
+
+	if (data == nullptr) {
+		THR_LOG_ERROR("Failed to map file: {}, err: {}", path.toStr(), err);
+		return false;
+	}
+
+	const size_t size = static_cast<size_t>(file_size.QuadPart);
+#else
+	const int fd = ::open(path.toCStr(), O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+
+	if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+
+	const size_t size = static_cast<size_t>(st.st_size);
+	void* data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+	// the mapping stays valid after closing the descriptor
+	::close(fd);
+
+	if (data == MAP_FAILED) {
+		THR_LOG_ERROR("Failed to map file: {}, err: {}", path.toStr(), std::strerror(errno));
+		return false;
+	}
+#endif
+
+	_data = static_cast<byte*>(data);
+	_size = size;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data == nullptr)
+		return;
+
+#if defined(THR_PLATFORM_WINDOWS)
+	::UnmapViewOfFile(_data);
+#else
+	::munmap(_data, _size);
+#endif
+
+	_data = nullptr;
+	_size = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+	return _data != nullptr;
+}
+
+byte* MappedFile::getData() const
+{
+	return _data;
+}
+
+size_t MappedFile::getSize() const
+{
+	return _size;
+}
+
+} // namespace Thr
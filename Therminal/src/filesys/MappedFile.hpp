@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Filepath.hpp"
+
+namespace Thr
+{
+
+/* Private, copy-on-write mapping of the whole file.
+*  Pages are loaded lazily by the system as they are touched,
+*  writes to the mapping never reach the file.
+*/
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const FilePath& path);
+	void close();
+
+	bool isOpen() const;
+	byte* getData() const;
+	size_t getSize() const;
+private:
+	byte*  _data;
+	size_t _size;
+};
+
+} // namespace Thr
@@ -3,7 +3,6 @@
 #include "Filepath.hpp"
 #include "logger/Log.hpp"
 #include <fstream>
-#include <sstream>
 
 namespace Thr
 {
@@ -17,14 +16,14 @@ THR_INTERNAL std::string readFile(const FilePath& fp)
 	std::string cont;
 
 	try {
-		file.open(fp.toStr());
+		file.open(fp.toStr(), std::ios::binary | std::ios::ate);
 
-		std::stringstream ss;
-		ss << file.rdbuf();
+		// read at once into the string, without going through a stream buffer copy
+		cont.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(cont.data(), static_cast<std::streamsize>(cont.size()));
 
 		file.close();
-
-		cont = ss.str();
 	}
 	catch (const std::ifstream::failure& e) {
 		THR_LOG_ERROR("Failed to read file: {}, err: {}", fp.toStr(), e.what());
@@ -0,0 +1,148 @@
+#include "WriteFile.hpp"
+#include "logger/Log.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+
+#if defined(THR_PLATFORM_WINDOWS)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#  include <io.h>
+#  include <fcntl.h>
+#  include <sys/stat.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace Thr
+{
+
+WriteFile::WriteFile()
+	: _fd(-1)
+	, _offset(0)
+{}
+
+WriteFile::~WriteFile()
+{
+	close();
+}
+
+bool WriteFile::open(const FilePath& path)
+{
+	close();
+	_offset = 0;
+
+#if defined(THR_PLATFORM_WINDOWS)
+	_fd = ::_open(path.toCStr(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY | _O_NOINHERIT,
+				  _S_IREAD | _S_IWRITE);
+#else
+	_fd = ::open(path.toCStr(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+
+	if (_fd < 0) {
+		THR_LOG_ERROR("Failed to create file: {}, err: {}", path.toStr(), std::strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+bool WriteFile::write(const void* data, size_t n)
+{
+	THR_ASSERT(isOpen());
+
+	const char* p = static_cast<const char*>(data);
+
+	while (n > 0) {
+#if defined(THR_PLATFORM_WINDOWS)
+		const int written = ::_write(_fd, p, static_cast<unsigned>(std::min<size_t>(n, INT_MAX)));
+#else
+		const ssize_t written = ::write(_fd, p, n);
+#endif
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+
+			THR_LOG_ERROR("Failed to write file, err: {}", std::strerror(errno));
+			return false;
+		}
+
+		p += written;
+		n -= static_cast<size_t>(written);
+		_offset += static_cast<uint64_t>(written);
+	}
+
+	return true;
+}
+
+bool WriteFile::padTo(uint64_t offset)
+{
+	static constexpr Arr<byte, 4096> Zeros = {};
+
+	THR_ASSERT(offset >= _offset);
+
+	while (_offset < offset) {
+		if (!write(Zeros.data(), static_cast<size_t>(std::min<uint64_t>(offset - _offset, Zeros.size()))))
+			return false;
+	}
+
+	return true;
+}
+
+uint64_t WriteFile::getOffset() const
+{
+	return _offset;
+}
+
+bool WriteFile::close()
+{
+	if (_fd < 0)
+		return true;
+
+#if defined(THR_PLATFORM_WINDOWS)
+	const bool ok = ::_close(_fd) == 0;
+#else
+	const bool ok = ::close(_fd) == 0;
+#endif
+
+	_fd = -1;
+
+	return ok;
+}
+
+bool WriteFile::isOpen() const
+{
+	return _fd >= 0;
+}
+
+bool writeFileAtomic(const FilePath& path, const std::function<bool(WriteFile&)>& write_contents)
+{
+	const std::string tmp_path = path.toStr() + ".tmp";
+	WriteFile file;
+
+	if (!file.open(FilePath(tmp_path)))
+		return false;
+
+	bool ok = write_contents(file);
+	ok = file.close() && ok;
+
+#if defined(THR_PLATFORM_WINDOWS)
+	// unlike rename, replaces the existing file
+	ok = ok && ::MoveFileExA(tmp_path.c_str(), path.toCStr(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	ok = ok && std::rename(tmp_path.c_str(), path.toCStr()) == 0;
+#endif
+
+	if (!ok)
+		std::remove(tmp_path.c_str());
+
+	return ok;
+}
+
+} // namespace Thr
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Filepath.hpp"
+#include <functional>
+
+namespace Thr
+{
+
+/* Offset of the next section of a file, sections start at multiples of 'alignment'.
+*/
+THR_FORCEINLINE constexpr uint64_t alignUp(uint64_t v, uint64_t alignment)
+{
+	return (v + alignment - 1) / alignment * alignment;
+}
+
+/* File created, or truncated, for writing. Writes go straight to the system,
+*  callers gather small pieces into larger buffers themselves.
+*  Closed on destruction, close() explicitly to learn whether it succeeded.
+*/
+class WriteFile
+{
+public:
+	WriteFile();
+	~WriteFile();
+
+	WriteFile(const WriteFile&) = delete;
+	WriteFile& operator=(const WriteFile&) = delete;
+
+	bool open(const FilePath& path);
+
+	/* Write the whole buffer, retrying partial and interrupted writes.
+	*/
+	bool write(const void* data, size_t n);
+
+	/* Fill the file with zeros up to 'offset', which can't be behind
+	*  the bytes written so far.
+	*/
+	bool padTo(uint64_t offset);
+
+	/* Bytes written since the file was opened.
+	*/
+	uint64_t getOffset() const;
+
+	/* False when some of the written data may not have reached the file.
+	*/
+	bool close();
+
+	bool isOpen() const;
+private:
+	int		 _fd;
+	uint64_t _offset;
+};
+
+/* Write the file through 'write_contents' into a temporary file next to 'path',
+*  which replaces 'path' only once it's complete - readers see either the old
+*  file or the new one, never a partial one. Temporary file is removed
+*  when writing fails. On POSIX systems mappings of the old file stay valid,
+*  Windows can't replace a file while it's mapped.
+*/
+bool writeFileAtomic(const FilePath& path, const std::function<bool(WriteFile&)>& write_contents);
+
+} // namespace Thr
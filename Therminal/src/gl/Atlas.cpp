@@ -1,71 +1,44 @@
 #include "Atlas.hpp"
+#include "AtlasCache.hpp"
 #include "logger/Log.hpp"
 #include "memory/Memory.hpp"
 #include "Utils.hpp"
+#include <chrono>
 
 namespace Thr
 {
 
-/* Store UV coordinates for further lookup using texture buffer object
-*  inside actual shader program.
-*/
-struct GlyphTextureUVs 
-{
-	THR_FORCEINLINE GlyphTextureUVs(float32_t u0, 
-									float32_t v0, 
-									float32_t u1, 
-									float32_t v1);
-	glm::vec4 v;
-};
-
-/* Store character-specific format data inside lookup texture buffer 
-*  object for shader program.
-*/
-struct GlyphFormatData
-{
-	THR_FORCEINLINE GlyphFormatData(int u0, 
-									int v0, 
-									int u1, 
-									int v1);
-	glm::ivec4 v;
-};
-
-THR_FORCEINLINE GlyphTextureUVs::GlyphTextureUVs(float32_t u0, 
-												 float32_t v0, 
-												 float32_t u1, 
-												 float32_t v1)
-	: v(u0, v0, u1, v1)
-{}
-
-THR_FORCEINLINE GlyphFormatData::GlyphFormatData(int width, 
-												 int height, 
-												 int bearing_x, 
-												 int bearing_y)
-	: v(width, height, bearing_x, bearing_y)
-{}
-
 FontAtlas::FontAtlas()
-	: FontAtlas(DefaultAtlasWidth, 
+	: FontAtlas(DefaultAtlasWidth,
 				DefaultAtlasHeight)
 {}
 
-FontAtlas::FontAtlas(uint atlas_width, 
+FontAtlas::FontAtlas(uint atlas_width,
 					 uint atlas_height)
 	: _atlas_tex_id(0)
-	, _tb_buf_uvs_id(0)
-	, _tb_tex_uvs_id(0)
+	, _tb_buf_pos_id(0)
+	, _tb_tex_pos_id(0)
 	, _tb_buf_form_id(0)
 	, _tb_tex_form_id(0)
-	, _ft_lib(nullptr)
-	, _ft_face(nullptr)
-	, _glyph_id(0)
+	, _fonts(nullptr)
 	, _atlas_width(atlas_width)
 	, _atlas_height(atlas_height)
 	, _glyph_width(0)
 	, _glyph_height(0)
-	, _glyph_per_tb(0)
-	, _atlas_x_offset(0)
-	, _atlas_y_offset(0)
+	, _slot_width(0)
+	, _slot_height(0)
+	, _slots_per_row(0)
+	, _slots_per_page(0)
+	, _page_cnt(0)
+	, _frame(0)
+	, _evicted_cnt(0)
+	, _dirty_rects{}
+	, _dirty_first(static_cast<uint32_t>(-1))
+	, _dirty_last(0)
+	, _rasterizer(nullptr)
+	, _cache_path()
+	, _font_hash(0)
+	, _cache_dirty(false)
 	, _vao(nullptr)
 	, _initialized(false)
 {}
@@ -76,63 +49,98 @@ FontAtlas::~FontAtlas()
 }
 
 FontAtlas::FontAtlas(FontAtlas&& atlas)
-	: _glyph_map(std::move(atlas._glyph_map))
+	: _glyph_ids(std::move(atlas._glyph_ids))
 	, _atlas_tex_id(atlas._atlas_tex_id)
-	, _tb_buf_uvs_id(atlas._tb_buf_uvs_id)
-	, _tb_tex_uvs_id(atlas._tb_tex_uvs_id)
+	, _tb_buf_pos_id(atlas._tb_buf_pos_id)
+	, _tb_tex_pos_id(atlas._tb_tex_pos_id)
 	, _tb_buf_form_id(atlas._tb_buf_form_id)
 	, _tb_tex_form_id(atlas._tb_tex_form_id)
-	, _ft_lib(atlas._ft_lib)
-	, _ft_face(atlas._ft_face)
-	, _glyph_id(atlas._glyph_id)
+	, _fonts(std::move(atlas._fonts))
 	, _atlas_width(atlas._atlas_width)
 	, _atlas_height(atlas._atlas_height)
-	, _glyph_width(0)
+	, _glyph_width(atlas._glyph_width)
 	, _glyph_height(atlas._glyph_height)
-	, _glyph_per_tb(atlas._glyph_per_tb)
-	, _atlas_x_offset(atlas._atlas_x_offset)
-	, _atlas_y_offset(atlas._atlas_y_offset)
+	, _slot_width(atlas._slot_width)
+	, _slot_height(atlas._slot_height)
+	, _slots_per_row(atlas._slots_per_row)
+	, _slots_per_page(atlas._slots_per_page)
+	, _page_cnt(atlas._page_cnt)
+	, _pages(std::move(atlas._pages))
+	, _slots(std::move(atlas._slots))
+	, _slot_info(std::move(atlas._slot_info))
+	, _slot_pos(std::move(atlas._slot_pos))
+	, _slot_format(std::move(atlas._slot_format))
+	, _free_slots(std::move(atlas._free_slots))
+	, _evict_order()
+	, _frame(atlas._frame)
+	, _evicted_cnt(atlas._evicted_cnt)
+	, _dirty_rects(atlas._dirty_rects)
+	, _dirty_first(atlas._dirty_first)
+	, _dirty_last(atlas._dirty_last)
+	, _rasterizer(std::move(atlas._rasterizer))
+	, _ready_callback(std::move(atlas._ready_callback))
+	, _requested(std::move(atlas._requested))
+	, _raster_glyphs()
+	, _raster_pixels()
+	, _cache_path(std::move(atlas._cache_path))
+	, _font_hash(atlas._font_hash)
+	, _cache_dirty(atlas._cache_dirty)
 	, _vao(std::move(atlas._vao))
-	, _initialized(false)
+	, _initialized(atlas._initialized)
 {
 	atlas._atlas_tex_id = 0;
-	atlas._tb_buf_uvs_id = 0;
-	atlas._tb_tex_uvs_id = 0;
-	atlas._ft_lib = nullptr;
-	atlas._ft_face = nullptr;
-	atlas._glyph_id = 0;
+	atlas._tb_buf_pos_id = 0;
+	atlas._tb_tex_pos_id = 0;
+	atlas._tb_buf_form_id = 0;
+	atlas._tb_tex_form_id = 0;
+	atlas._page_cnt = 0;
 	atlas._vao = nullptr;
+	atlas._initialized = false;
 }
 
 FontAtlas& FontAtlas::operator=(FontAtlas&& atlas)
 {
 	clear();
-	_glyph_map = std::move(atlas._glyph_map);
+	_glyph_ids = std::move(atlas._glyph_ids);
 	_atlas_tex_id = atlas._atlas_tex_id;
 	atlas._atlas_tex_id = 0;
-	_tb_buf_uvs_id = atlas._tb_buf_uvs_id;
-	atlas._tb_buf_uvs_id = 0;
-	_tb_tex_uvs_id = atlas._tb_tex_uvs_id;
-	atlas._tb_tex_uvs_id = 0;
+	_tb_buf_pos_id = atlas._tb_buf_pos_id;
+	atlas._tb_buf_pos_id = 0;
+	_tb_tex_pos_id = atlas._tb_tex_pos_id;
+	atlas._tb_tex_pos_id = 0;
 	_tb_buf_form_id = atlas._tb_buf_form_id;
 	atlas._tb_buf_form_id = 0;
 	_tb_tex_form_id = atlas._tb_tex_form_id;
 	atlas._tb_tex_form_id = 0;
-	_ft_lib = atlas._ft_lib;
-	atlas._ft_lib = nullptr;
-	_ft_face = atlas._ft_face;
-	atlas._ft_face = nullptr;
-	_glyph_id = atlas._glyph_id;
-	atlas._glyph_id = 0;
+	_fonts = std::move(atlas._fonts);
 	THR_HARD_ASSERT(_atlas_width == atlas._atlas_width);
 	THR_HARD_ASSERT(_atlas_height == atlas._atlas_height);
-	THR_HARD_ASSERT(_glyph_per_tb == atlas._glyph_per_tb);
-	_atlas_x_offset = atlas._atlas_x_offset;
-	atlas._atlas_x_offset = 0;
-	_atlas_y_offset = atlas._atlas_y_offset;
-	atlas._atlas_y_offset = 0;
-	THR_HARD_ASSERT(_glyph_width == atlas._glyph_width);
-	THR_HARD_ASSERT(_glyph_height == atlas._glyph_height);
+	_glyph_width = atlas._glyph_width;
+	_glyph_height = atlas._glyph_height;
+	_slot_width = atlas._slot_width;
+	_slot_height = atlas._slot_height;
+	_slots_per_row = atlas._slots_per_row;
+	_slots_per_page = atlas._slots_per_page;
+	_page_cnt = atlas._page_cnt;
+	atlas._page_cnt = 0;
+	_pages = std::move(atlas._pages);
+	_slots = std::move(atlas._slots);
+	_slot_info = std::move(atlas._slot_info);
+	_slot_pos = std::move(atlas._slot_pos);
+	_slot_format = std::move(atlas._slot_format);
+	_free_slots = std::move(atlas._free_slots);
+	_frame = atlas._frame;
+	_evicted_cnt = atlas._evicted_cnt;
+	_dirty_rects = atlas._dirty_rects;
+	_dirty_first = atlas._dirty_first;
+	_dirty_last = atlas._dirty_last;
+	_rasterizer = std::move(atlas._rasterizer);
+	_ready_callback = std::move(atlas._ready_callback);
+	_requested = std::move(atlas._requested);
+	_cache_path = std::move(atlas._cache_path);
+	_font_hash = atlas._font_hash;
+	_cache_dirty = atlas._cache_dirty;
+	atlas._cache_dirty = false;
 	_vao = std::move(atlas._vao);
 	atlas._vao = nullptr;
 	_initialized = atlas._initialized;
@@ -140,6 +148,128 @@ FontAtlas& FontAtlas::operator=(FontAtlas&& atlas)
 	return *this;
 }
 
+bool FontAtlas::allocPages(uint page_cnt)
+{
+	THR_ASSERT(page_cnt > _page_cnt && page_cnt <= MaxPages);
+
+	THR_LOG_DEBUG("Font atlas grows from {} to {} pages", _page_cnt, page_cnt);
+
+	/* Texture storage is immutable - allocate a new one and upload all the pages
+	*  from the copy, glyph positions stay the same.
+	*/
+	GLuint tex_id = 0;
+	glGenTextures(1, std::addressof(tex_id));
+	glBindTexture(GL_TEXTURE_2D_ARRAY, tex_id);
+
+	if (tex_id == 0 || glIsTexture(tex_id) != GL_TRUE) {
+		THR_LOG_ERROR("Failed to create font atlas texture");
+		return false;
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_R8, _atlas_width, _atlas_height, page_cnt);
+
+	const size_t page_bytes = static_cast<size_t>(_atlas_width) * _atlas_height;
+	_pages.resize(page_bytes * page_cnt, 0);
+
+	/* Glyphs are sampled only within their own rect, nothing to copy
+	*  into the very first storage.
+	*/
+	if (_page_cnt > 0) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+						0,
+						0, 0, 0,
+						_atlas_width, _atlas_height, _page_cnt,
+						GL_RED,
+						GL_UNSIGNED_BYTE,
+						reinterpret_cast<const GLvoid*>(_pages.data()));
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	if (_atlas_tex_id != 0)
+		glDeleteTextures(1, std::addressof(_atlas_tex_id));
+
+	_atlas_tex_id = tex_id;
+
+	/* Slots of the new pages, pushed in reverse so the lower ids are used first */
+	const uint32_t first = _page_cnt * _slots_per_page;
+	const uint32_t last = page_cnt * _slots_per_page;
+
+	_slots.resize(last, AtlasSlot{ 0, 0, false });
+	_slot_info.resize(last, GlyphInfo{ 0, 0, 0, 0, 0, 0 });
+	_slot_pos.resize(last, glm::ivec4(0));
+	_slot_format.resize(last, glm::ivec4(0));
+
+	for (uint32_t id = last; id-- > first; )
+		_free_slots.push_back(id);
+
+	_page_cnt = page_cnt;
+	return true;
+}
+
+uint32_t FontAtlas::allocSlot()
+{
+	if (_free_slots.empty()) {
+		if (_page_cnt < MaxPages)
+			allocPages(std::min(2 * _page_cnt, MaxPages));
+
+		if (_free_slots.empty())
+			evictGlyphs();
+	}
+
+	THR_ASSERT(!_free_slots.empty());
+
+	const uint32_t id = _free_slots.back();
+	_free_slots.pop_back();
+
+	return id;
+}
+
+void FontAtlas::evictGlyphs()
+{
+	_evict_order.clear();
+
+	/* Glyphs used in the current frame are likely on the screen */
+	for (uint32_t id = 0; id < _slots.size(); id++) {
+		if (_slots[id].used && _slots[id].stamp != _frame)
+			_evict_order.push_back(id);
+	}
+
+	if (_evict_order.empty()) {
+		THR_LOG_ERROR("Font atlas can't hold all the glyphs of a single frame, evicting glyphs in use");
+
+		for (uint32_t id = 0; id < _slots.size(); id++)
+			_evict_order.push_back(id);
+	}
+
+	/* Evict a batch at once, so the slots aren't sorted on every new glyph */
+	const size_t cnt = std::min<size_t>(_evict_order.size(), std::max<size_t>(_slots.size() / _EvictDivisor, 1));
+
+	std::nth_element(_evict_order.begin(), _evict_order.begin() + (cnt - 1), _evict_order.end(),
+		[this](uint32_t a, uint32_t b) {
+			return _slots[a].stamp < _slots[b].stamp;
+		});
+
+	for (size_t i = 0; i < cnt; i++) {
+		AtlasSlot& slot = _slots[_evict_order[i]];
+
+		_glyph_ids.erase(slot.codepoint);
+		slot.used = false;
+		_free_slots.push_back(_evict_order[i]);
+	}
+
+	_evicted_cnt += cnt;
+
+	THR_LOG_DEBUG("Font atlas evicted {} glyphs unused since frame {}",
+				  cnt, _slots[_evict_order[cnt - 1]].stamp);
+}
+
 void FontAtlas::addGlyph(char32_t codepoint)
 {
 	if (!_initialized) {
@@ -147,122 +277,369 @@ void FontAtlas::addGlyph(char32_t codepoint)
 		return;
 	}
 
-	THR_HARD_ASSERT(_vao != nullptr && glIsVertexArray(*_vao) == GL_TRUE);
+	if (_glyph_ids.find(codepoint) != GlyphTable::NoGlyph)
+		return;
 
-	glBindVertexArray(*_vao);
+	RasterGlyph glyph;
+	Vec<byte> pixels;
 
-	if (_glyph_map.count(codepoint))
-		return;
+	_fonts->render(codepoint, glyph, pixels);
 
-	if (_ft_face == nullptr || 
-		FT_Load_Char(_ft_face, codepoint, FT_LOAD_RENDER)) {
+	// kept as an empty glyph, so it isn't rendered over and over again
+	if (!glyph.loaded) {
 		THR_LOG_ERROR("Failed to load glyph with codepoint {}", codepoint);
+	}
+
+	const GlyphInfo metrics = {
+		glyph.width,
+		glyph.height,
+		glyph.bearing_x,
+		glyph.bearing_y,
+		glyph.advance,
+		0
+	};
+
+	placeGlyph(codepoint, metrics, pixels.data() + glyph.offset, glyph.width);
+	flushUploads();
+}
+
+void FontAtlas::requestGlyph(char32_t codepoint)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("FontAtlas subsystem is not initialized, can't request glyph");
 		return;
 	}
 
-	const FT_GlyphSlot g = _ft_face->glyph;
+	if (_glyph_ids.find(codepoint) != GlyphTable::NoGlyph)
+		return;
 
-	if (_atlas_y_offset + g->bitmap.rows >= _atlas_height) {
-		THR_LOG_ERROR("Font atlas is full, cannot add more glyphs");
+	// no thread to render it, the glyph is there on the next probe
+	if (_rasterizer == nullptr) {
+		addGlyph(codepoint);
 		return;
 	}
 
-	if (_atlas_x_offset + g->bitmap.width >= _atlas_width) {
-		_atlas_x_offset = 0;
-		_atlas_y_offset += _glyph_height + 1;
+	if (_requested.insert(codepoint).second)
+		_rasterizer->request(codepoint);
+}
+
+bool FontAtlas::hasReadyGlyphs() const
+{
+	return _rasterizer != nullptr && _rasterizer->getReadyCount() > 0;
+}
+
+void FontAtlas::setReadyCallback(std::function<void()> callback)
+{
+	_ready_callback = std::move(callback);
+
+	if (_rasterizer != nullptr)
+		_rasterizer->setReadyCallback(_ready_callback);
+}
+
+size_t FontAtlas::getRequestedCount() const
+{
+	return _requested.size();
+}
+
+size_t FontAtlas::uploadReadyGlyphs()
+{
+	if (!hasReadyGlyphs())
+		return 0;
+
+	_rasterizer->collect(_raster_glyphs, _raster_pixels);
+
+	for (const RasterGlyph& glyph : _raster_glyphs) {
+		_requested.erase(glyph.codepoint);
+
+		if (_glyph_ids.find(glyph.codepoint) != GlyphTable::NoGlyph)
+			continue;
+
+		if (!glyph.loaded) {
+			THR_LOG_ERROR("Failed to load glyph with codepoint {}", glyph.codepoint);
+		}
+
+		/* Glyph that failed to load is kept as an empty one,
+		*  so it isn't requested over and over again.
+		*/
+		const GlyphInfo metrics = {
+			glyph.width,
+			glyph.height,
+			glyph.bearing_x,
+			glyph.bearing_y,
+			glyph.advance,
+			0
+		};
+
+		placeGlyph(glyph.codepoint, metrics, _raster_pixels.data() + glyph.offset, glyph.width);
+	}
+
+	flushUploads();
+
+	THR_LOG_DEBUG("Font atlas received {} glyphs from the rasterizer, {} still requested",
+				  _raster_glyphs.size(), _requested.size());
+
+	return _raster_glyphs.size();
+}
+
+void FontAtlas::placeGlyph(char32_t codepoint, const GlyphInfo& metrics, const byte* bitmap, int pitch)
+{
+	// monospaced font, every glyph advances by a single cell
+	THR_ASSERT(metrics.advance == static_cast<int>(_glyph_width));
+
+	const uint32_t id = allocSlot();
+	const glm::ivec4 origin = getSlotOrigin(id);
+	const uint x = static_cast<uint>(origin.x);
+	const uint y = static_cast<uint>(origin.y);
+	const uint page = static_cast<uint>(origin.z);
+
+	/* Slot leaves a pixel of spacing, so the glyphs never touch.
+	*  Glyph larger than the slot is cut.
+	*/
+	const uint width = std::min<uint>(metrics.width, _slot_width - 1);
+	const uint height = std::min<uint>(metrics.height, _slot_height - 1);
+
+	if (width < static_cast<uint>(metrics.width) || height < static_cast<uint>(metrics.height)) {
+		THR_LOG_DEBUG("Glyph of codepoint {} ({}x{}) doesn't fit into atlas slot",
+					  codepoint, metrics.width, metrics.height);
 	}
 
+	/* Render new glyph onto the page copy */
+	byte* const dst = _pages.data() + (static_cast<size_t>(page) * _atlas_height + y) * _atlas_width + x;
+
+	for (uint row = 0; row < height; row++)
+		memCpy(dst + static_cast<size_t>(row) * _atlas_width, bitmap + static_cast<ptrdiff_t>(row) * pitch, width);
+
+	_slot_pos[id] = origin;
+	_slot_format[id] = glm::ivec4(width, height, metrics.bearing_x, metrics.bearing_y);
+
+	glm::uvec4& rect = _dirty_rects[page];
+
+	if (rect.z == 0) {
+		rect = glm::uvec4(x, y, x + width, y + height);
+	}
+	else {
+		rect = glm::uvec4(std::min(rect.x, x), std::min(rect.y, y),
+						  std::max(rect.z, x + width), std::max(rect.w, y + height));
+	}
+
+	_dirty_first = std::min(_dirty_first, id);
+	_dirty_last = std::max(_dirty_last, id);
+
+	GlyphInfo info = metrics;
+	info.width = static_cast<int>(width);
+	info.height = static_cast<int>(height);
+	info.id = id;
+
+	_glyph_ids.insert(codepoint, id);
+	_slot_info[id] = info;
+	_slots[id] = AtlasSlot{ codepoint, _frame, true };
+	_cache_dirty = true;
+}
+
+const byte* FontAtlas::getGlyphBitmap(uint32_t id, glm::ivec4& format) const
+{
+	THR_ASSERT(id < _slots.size() && _slots[id].used);
+
+	const glm::ivec4& origin = _slot_pos[id];
+	format = _slot_format[id];
+
+	return _pages.data() + (static_cast<size_t>(origin.z) * _atlas_height + origin.y) * _atlas_width + origin.x;
+}
+
+uint FontAtlas::getPagePitch() const
+{
+	return _atlas_width;
+}
+
+glm::ivec4 FontAtlas::getSlotOrigin(uint32_t id) const
+{
+	const uint32_t idx = id % _slots_per_page;
+
+	return glm::ivec4(idx % _slots_per_row * _slot_width,
+					  idx / _slots_per_row * _slot_height,
+					  id / _slots_per_page,
+					  0);
+}
+
+void FontAtlas::saveCache()
+{
+	if (!_initialized || !_cache_dirty || !_cache_path.isValid())
+		return;
+
+	if (AtlasCache::save(*this, _cache_path))
+		_cache_dirty = false;
+}
+
+void FontAtlas::flushUploads()
+{
+	if (_dirty_first > _dirty_last)
+		return;
+
+	THR_HARD_ASSERT(_vao != nullptr && glIsVertexArray(*_vao) == GL_TRUE);
 	THR_HARD_ASSERT(_atlas_tex_id != 0 && glIsTexture(_atlas_tex_id) == GL_TRUE);
 
-	/* Render new glyph onto the atlas */
-	glBindTexture(GL_TEXTURE_2D, _atlas_tex_id);
+	glBindVertexArray(*_vao);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _atlas_tex_id);
 
+	/* Single upload of the changed part of every page */
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glTexSubImage2D(GL_TEXTURE_2D, 
-					0, 
-					_atlas_x_offset, 
-					_atlas_y_offset,
-					g->bitmap.width, 
-					g->bitmap.rows, 
-					GL_RED, 
-					GL_UNSIGNED_BYTE,
-					reinterpret_cast<const GLvoid*>(g->bitmap.buffer));
-
-	/* Update UVs texture buffer */
-
-	const GlyphTextureUVs glyph_uv(
-		static_cast<float32_t>(_atlas_x_offset) / _atlas_width,
-		static_cast<float32_t>(_atlas_y_offset) / _atlas_height,
-		static_cast<float32_t>(_atlas_x_offset + g->bitmap.width) / _atlas_width,
-		static_cast<float32_t>(_atlas_y_offset + g->bitmap.rows) / _atlas_height
-	);
-
-	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_uvs_id);
-
-	const uint32_t glyph_index = _glyph_id;
-
-	glBufferSubData(GL_TEXTURE_BUFFER, 
-				    glyph_index * sizeof(GlyphTextureUVs),
-					sizeof(GlyphTextureUVs), 
-					reinterpret_cast<const GLvoid*>(std::addressof(glyph_uv)));
-
-	/* Update Character Format texture buffer */
-
-	const GlyphFormatData glyph_format(
-		static_cast<int>(g->bitmap.width), 
-		static_cast<int>(g->bitmap.rows), 
-		g->bitmap_left,
-		g->bitmap_top
-	);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, _atlas_width);
+
+	for (uint page = 0; page < _page_cnt; page++) {
+		glm::uvec4& rect = _dirty_rects[page];
+
+		if (rect.z == 0)
+			continue;
+
+		const byte* src = _pages.data() + (static_cast<size_t>(page) * _atlas_height + rect.y) * _atlas_width + rect.x;
+
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+						0,
+						rect.x, rect.y, page,
+						rect.z - rect.x, rect.w - rect.y, 1,
+						GL_RED,
+						GL_UNSIGNED_BYTE,
+						reinterpret_cast<const GLvoid*>(src));
+
+		rect = glm::uvec4(0);
+	}
+
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+	/* Lookup entries of the changed slots in one go, slots in between
+	*  are uploaded again as they are.
+	*/
+	const size_t cnt = _dirty_last - _dirty_first + 1;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_pos_id);
+	glBufferSubData(GL_TEXTURE_BUFFER,
+				    _dirty_first * sizeof(glm::ivec4),
+					cnt * sizeof(glm::ivec4),
+					reinterpret_cast<const GLvoid*>(_slot_pos.data() + _dirty_first));
 
 	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_form_id);
-	glBufferSubData(GL_TEXTURE_BUFFER, 
-				    glyph_index * sizeof(GlyphFormatData),
-					sizeof(GlyphFormatData), 
-					reinterpret_cast<const GLvoid*>(std::addressof(glyph_format)));	
-
-	const GlyphInfo glyph_info = {
-		static_cast<int>(g->bitmap.width), 
-		static_cast<int>(g->bitmap.rows), 
-		g->bitmap_left,
-		g->bitmap_top,
-		static_cast<int>(g->advance.x >> 6),
-		_glyph_id++
-	};
+	glBufferSubData(GL_TEXTURE_BUFFER,
+				    _dirty_first * sizeof(glm::ivec4),
+					cnt * sizeof(glm::ivec4),
+					reinterpret_cast<const GLvoid*>(_slot_format.data() + _dirty_first));
 
-	_glyph_map[codepoint] = glyph_info;
-	_atlas_x_offset += g->bitmap.width + 1;
+	_dirty_first = static_cast<uint32_t>(-1);
+	_dirty_last = 0;
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 	glBindVertexArray(0);
 
 	const GLenum err = pollGlErrors([](GLenum err) {
-		THR_LOG_ERROR("OpenGL error while adding a new glyph to FontAtlas: {}", getGlErrorStr(err));
+		THR_LOG_ERROR("OpenGL error while uploading glyphs to FontAtlas: {}", getGlErrorStr(err));
 	});
 
 	if (err != GL_NO_ERROR) {
-		THR_LOG_DEBUG("FontAtlas adding glyph resulted in OpenGL error");
+		THR_LOG_DEBUG("FontAtlas glyph upload resulted in OpenGL error");
+	}
+}
+
+void FontAtlas::prewarmGlyphs(const Vec<CodepointRange>& ranges)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	/* Only the glyphs some of the faces have, there is no point
+	*  in filling the atlas with copies of the missing glyph.
+	*/
+	Vec<char32_t> codepoints;
+
+	for (const CodepointRange& range : ranges) {
+		for (char32_t cp = range.first; cp <= range.last; cp++) {
+			if (_fonts->resolve(cp) != FontChain::NoFace && _glyph_ids.find(cp) == GlyphTable::NoGlyph)
+				codepoints.push_back(cp);
+		}
 	}
+
+	// grow once, instead of copying the pages on every growth step
+	uint page_cnt = _page_cnt;
+
+	while (page_cnt < MaxPages && static_cast<size_t>(page_cnt) * _slots_per_page < codepoints.size())
+		page_cnt *= 2;
+
+	if (page_cnt > _page_cnt)
+		allocPages(std::min(page_cnt, MaxPages));
+
+	if (codepoints.size() > static_cast<size_t>(_page_cnt) * _slots_per_page) {
+		THR_LOG_ERROR("Font atlas can't hold {} pre-warmed glyphs, rest is rendered on demand",
+					  codepoints.size());
+		codepoints.resize(static_cast<size_t>(_page_cnt) * _slots_per_page);
+	}
+
+	RasterGlyph glyph;
+	Vec<byte> pixels;
+
+	for (const char32_t cp : codepoints) {
+		pixels.clear();
+		_fonts->render(cp, glyph, pixels);
+
+		if (!glyph.loaded) {
+			THR_LOG_ERROR("Failed to load glyph with codepoint {}", cp);
+			continue;
+		}
+
+		const GlyphInfo metrics = {
+			glyph.width,
+			glyph.height,
+			glyph.bearing_x,
+			glyph.bearing_y,
+			glyph.advance,
+			0
+		};
+
+		placeGlyph(cp, metrics, pixels.data(), glyph.width);
+	}
+
+	flushUploads();
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Font atlas pre-warmed {} glyphs in {} us", codepoints.size(), elapsed.count());
 }
 
-uint32_t FontAtlas::getGlyphInfo(char32_t codepoint, GlyphInfo& info) const
+uint32_t FontAtlas::getGlyphInfo(char32_t codepoint, GlyphInfo& info)
 {
 	if (!_initialized) {
 		THR_LOG_ERROR("FontAtlas subsystem is not initialized, can't get glyph info");
 		return (info.id = static_cast<uint32_t>(-1));
 	}
 
-	const auto it = _glyph_map.find(codepoint);
+	const uint32_t id = getGlyphId(codepoint);
 
-	if (it != _glyph_map.end()) { // found
-		info = it->second;
-		return info.id;
+	if (id != GlyphTable::NoGlyph) { // found
+		info = _slot_info[id];
+		return id;
 	}
-	
+
 	memSet(std::addressof(info), 0, sizeof(GlyphInfo));
 	return (info.id = static_cast<uint32_t>(-1));
 }
 
+void FontAtlas::beginFrame()
+{
+	_frame++;
+}
+
+size_t FontAtlas::getEvictionCount() const
+{
+	return _evicted_cnt;
+}
+
+size_t FontAtlas::getGlyphCount() const
+{
+	return _glyph_ids.size();
+}
+
+uint FontAtlas::getPageCount() const
+{
+	return _page_cnt;
+}
+
 void FontAtlas::bindAtlas() const
 {
 	if (!_initialized) {
@@ -284,11 +661,11 @@ void FontAtlas::bindAtlas() const
 
 	THR_HARD_ASSERT(_atlas_tex_id != 0 && glIsTexture(_atlas_tex_id) == GL_TRUE);
 	glActiveTexture(getAtlasTexUnit());
-	glBindTexture(GL_TEXTURE_2D, _atlas_tex_id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, _atlas_tex_id);
 
-	THR_HARD_ASSERT(_tb_tex_uvs_id != 0 && glIsTexture(_tb_tex_uvs_id) == GL_TRUE);
+	THR_HARD_ASSERT(_tb_tex_pos_id != 0 && glIsTexture(_tb_tex_pos_id) == GL_TRUE);
 	glActiveTexture(getAtlasTexBufUnit());
-	glBindTexture(GL_TEXTURE_BUFFER, _tb_tex_uvs_id);
+	glBindTexture(GL_TEXTURE_BUFFER, _tb_tex_pos_id);
 
 	THR_HARD_ASSERT(_tb_tex_form_id != 0 && glIsTexture(_tb_tex_form_id) == GL_TRUE);
 	glActiveTexture(getCharFormatBufUnit());
@@ -303,13 +680,14 @@ void FontAtlas::bindAtlas() const
 
 void FontAtlas::unbindAtlas() const
 {
-	static std::array<GLuint, 3> TexIds = {
-		_atlas_tex_id,
-		_tb_tex_uvs_id,
-		_tb_tex_form_id
-	};
+	glActiveTexture(getAtlasTexUnit());
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glActiveTexture(getAtlasTexBufUnit());
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-	glBindTextures(0, 3, TexIds.data());
+	glActiveTexture(getCharFormatBufUnit());
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 }
 
 GLenum FontAtlas::getAtlasTexUnit() const
@@ -340,42 +718,48 @@ void FontAtlas::getGlyphPixSize(int& width, int& height) const
 	height = static_cast<int>(_glyph_height);
 }
 
-void FontAtlas::init(std::shared_ptr<GLuint> vao, int glyph_height)
+void FontAtlas::init(std::shared_ptr<GLuint> vao,
+					 int glyph_height,
+					 const Vec<CodepointRange>& prewarm,
+					 const FilePath& cache_path,
+					 const Vec<FontFallback>& fallbacks)
 {
 	if (_initialized) {
 		THR_LOG_ERROR("FontAtlas subsystem is already initialized, can't initialize again");
 		return;
 	}
 
-	if (FT_Init_FreeType(std::addressof(_ft_lib)) != 0) {
-		THR_LOG_ERROR("Failed to initialize FreeType library");
-		return;
-	}
+	_glyph_height = static_cast<uint>(glyph_height);
+	_fonts = std::make_unique<FontChain>();
+
+	const Vec<std::string> font_paths = FontChain::findFaces(_FontPath, fallbacks);
 
-	if (FT_New_Face(_ft_lib, "Therminal/assets/fonts/DejaVuSansMono.ttf", 0, std::addressof(_ft_face)) != 0) {
-		THR_LOG_ERROR("Failed to load font face");
+	if (!_fonts->open(font_paths, _glyph_height)) {
+		THR_LOG_ERROR("Failed to load font faces");
+		_fonts.reset();
 		return;
 	}
 
-	const bool mono = (_ft_face->face_flags & FT_FACE_FLAG_FIXED_WIDTH);
+	THR_LOG_INFO("Loaded {} font faces, including fallbacks", _fonts->getFaceCount());
 
-	if (!mono) {
-		THR_LOG_ERROR("Loaded font is not monospaced");
-		return;
-	}
+	_glyph_width = _fonts->getCellWidth();
 
-	_glyph_height = static_cast<uint>(glyph_height);
+	/* Slots hold double width glyphs and the whole line height,
+	*  plus a pixel of spacing.
+	*/
+	const uint line_height = _fonts->getLineHeight();
+
+	_slot_width = 2 * _glyph_width + 1;
+	_slot_height = std::max(_glyph_height, line_height) + 1;
+	_slots_per_row = _atlas_width / _slot_width;
+	_slots_per_page = _slots_per_row * (_atlas_height / _slot_height);
 
-	if (FT_Set_Pixel_Sizes(_ft_face, 0, _glyph_height)) {
-		THR_LOG_ERROR("Failed to set pixel size for font face");
+	if (_slots_per_page == 0) {
+		THR_LOG_ERROR("Font atlas page of {}x{} can't hold glyphs of size {}",
+					  _atlas_width, _atlas_height, _glyph_height);
 		return;
 	}
 
-	_glyph_width = _ft_face->size->metrics.max_advance >> 6;
-
-	_glyph_per_tb = static_cast<uint>(_atlas_width / _glyph_width) *
-					static_cast<uint>(_atlas_height / _glyph_height);
-
 	THR_ASSERT(vao != nullptr);
 
 	GLint vao_bound = 0;
@@ -391,43 +775,41 @@ void FontAtlas::init(std::shared_ptr<GLuint> vao, int glyph_height)
 	glBindVertexArray(*_vao);
 	THR_HARD_ASSERT(glIsVertexArray(*_vao) == GL_TRUE);
 
-	/* Initialize atlas texture */
-	glGenTextures(1, std::addressof(_atlas_tex_id));
-	glBindTexture(GL_TEXTURE_2D, _atlas_tex_id);
-	THR_HARD_ASSERT(_atlas_tex_id != 0 && glIsTexture(_atlas_tex_id) == GL_TRUE);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	/* Initialize atlas texture with a single page */
+	if (!allocPages(1))
+		return;
 
-	glTexStorage2D(GL_TEXTURE_2D, 1, GL_R8, _atlas_width, _atlas_height);
+	/* Lookup buffers are sized for all the pages up front,
+	*  so growing the atlas touches the texture only.
+	*/
+	const size_t max_glyphs = static_cast<size_t>(_slots_per_page) * MaxPages;
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	THR_LOG_DEBUG("Font atlas slot {}x{}, {} glyphs per page, at most {} glyphs",
+				  _slot_width, _slot_height, _slots_per_page, max_glyphs);
 
-	/* Generate and specify texture buffers for UVs codepoint lookup */
-	glGenBuffers(1, std::addressof(_tb_buf_uvs_id));
-	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_uvs_id);
-	THR_HARD_ASSERT(_tb_buf_uvs_id != 0 && glIsBuffer(_tb_buf_uvs_id) == GL_TRUE);
+	/* Generate and specify texture buffers for glyph position lookup */
+	glGenBuffers(1, std::addressof(_tb_buf_pos_id));
+	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_pos_id);
+	THR_HARD_ASSERT(_tb_buf_pos_id != 0 && glIsBuffer(_tb_buf_pos_id) == GL_TRUE);
 
-	glBufferData(GL_TEXTURE_BUFFER, 
-				 _glyph_per_tb * sizeof(GlyphTextureUVs), 
-				 nullptr, 
+	glBufferData(GL_TEXTURE_BUFFER,
+				 max_glyphs * sizeof(glm::ivec4),
+				 nullptr,
 				 GL_DYNAMIC_DRAW);
 
 	// Associate new texture with previous buffer
-	glGenTextures(1, std::addressof(_tb_tex_uvs_id));
-	glBindTexture(GL_TEXTURE_BUFFER, _tb_tex_uvs_id);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _tb_buf_uvs_id);
+	glGenTextures(1, std::addressof(_tb_tex_pos_id));
+	glBindTexture(GL_TEXTURE_BUFFER, _tb_tex_pos_id);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, _tb_buf_pos_id);
 
 	/* Generate and specify texture buffer for format specs */
 	glGenBuffers(1, std::addressof(_tb_buf_form_id));
 	glBindBuffer(GL_TEXTURE_BUFFER, _tb_buf_form_id);
 	THR_HARD_ASSERT(_tb_buf_form_id != 0 && glIsBuffer(_tb_buf_form_id) == GL_TRUE);
 
-	glBufferData(GL_TEXTURE_BUFFER, 
-				 _glyph_per_tb * sizeof(GlyphFormatData), 
-				 nullptr, 
+	glBufferData(GL_TEXTURE_BUFFER,
+				 max_glyphs * sizeof(glm::ivec4),
+				 nullptr,
 				 GL_DYNAMIC_DRAW);
 
 	// Associate with buffer
@@ -446,31 +828,57 @@ void FontAtlas::init(std::shared_ptr<GLuint> vao, int glyph_height)
 		THR_LOG_DEBUG("FontAtlas initializing resulted in OpenGL error");
 	}
 
+	/* Cached glyphs first, only the ranges missing in the cache are rasterized then
+	*/
+	if (cache_path.isValid()) {
+		_cache_path = cache_path;
+		_font_hash = _fonts->hashFaces();
+
+		if (AtlasCache::restore(*this, _cache_path))
+			_cache_dirty = false;
+	}
+
+	prewarmGlyphs(prewarm);
+
+	/* Without the thread, requested glyphs are rendered right away */
+	_rasterizer = std::make_unique<GlyphRasterizer>();
+	_rasterizer->setReadyCallback(_ready_callback);
+
+	if (!_rasterizer->start(_fonts->getPaths(), _glyph_height)) {
+		THR_LOG_ERROR("Failed to start glyph rasterizer thread, glyphs will be rendered synchronously");
+		_rasterizer.reset();
+	}
+
 	_initialized = true;
 }
 
 THR_INLINE void FontAtlas::clear()
 {
+	// thread has its own face, stop it before the GL objects go away
+	_rasterizer.reset();
+	_requested.clear();
+
 	if (_atlas_tex_id != 0 && glIsTexture(_atlas_tex_id) == GL_TRUE) {
 		glDeleteTextures(1, std::addressof(_atlas_tex_id));
 	}
 
-	if (_tb_buf_uvs_id != 0 && glIsBuffer(_tb_buf_uvs_id) == GL_TRUE) {
-		glDeleteBuffers(1, std::addressof(_tb_buf_uvs_id));
+	if (_tb_tex_pos_id != 0 && glIsTexture(_tb_tex_pos_id) == GL_TRUE) {
+		glDeleteTextures(1, std::addressof(_tb_tex_pos_id));
 	}
 
-	if (_tb_buf_form_id != 0 && glIsBuffer(_tb_buf_form_id) == GL_TRUE) {
-		glDeleteBuffers(1, std::addressof(_tb_buf_form_id));
+	if (_tb_tex_form_id != 0 && glIsTexture(_tb_tex_form_id) == GL_TRUE) {
+		glDeleteTextures(1, std::addressof(_tb_tex_form_id));
 	}
 
-	if (_ft_face != nullptr) {
-		FT_Done_Face(_ft_face);
+	if (_tb_buf_pos_id != 0 && glIsBuffer(_tb_buf_pos_id) == GL_TRUE) {
+		glDeleteBuffers(1, std::addressof(_tb_buf_pos_id));
 	}
 
-	if (_ft_lib != nullptr) {
-		FT_Done_FreeType(_ft_lib);
+	if (_tb_buf_form_id != 0 && glIsBuffer(_tb_buf_form_id) == GL_TRUE) {
+		glDeleteBuffers(1, std::addressof(_tb_buf_form_id));
 	}
 
+	_fonts.reset();
 	_initialized = false;
 }
 
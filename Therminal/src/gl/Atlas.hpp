@@ -2,7 +2,10 @@
 
 #include "Common.hpp"
 #include "memory/Memory.hpp"
-#include <unordered_map>
+#include "GlyphRasterizer.hpp"
+#include "GlyphTable.hpp"
+#include "filesys/Filepath.hpp"
+#include <unordered_set>
 
 namespace Thr
 {
@@ -17,31 +20,113 @@ struct GlyphInfo
 	uint32_t id;
 };
 
+/* Inclusive range of codepoints
+*/
+struct CodepointRange
+{
+	char32_t first;
+	char32_t last;
+};
+
+/* Glyphs are kept in pages of a 2D array texture, every page split into
+*  fixed size slots, so any glyph fits into a slot freed by another one.
+*  Glyph id is the index of its slot.
+*
+*  Pages are added as the atlas fills up, up to MaxPages. Beyond that the least
+*  recently used glyphs are evicted - every lookup stamps the glyph with
+*  the current frame, glyphs used in the current frame are kept as long as possible.
+*  Ids of the evicted glyphs are reused, so whoever stores the ids
+*  has to check 'getEvictionCount'.
+*
+*  Screen needing more distinct glyphs than MaxPages hold evicts glyphs of its own
+*  rows - they're requested again, arrive and evict others, so such a screen
+*  is drawn again on every batch of glyphs, with some cells blank, until
+*  the content changes. It takes thousands of distinct glyphs on a single screen.
+*
+*  Glyphs are rendered either right away by 'addGlyph', or requested
+*  from the rasterizer thread and placed in a single batch by 'uploadReadyGlyphs'.
+*/
 class FontAtlas
 {
 public:
+	static constexpr uint MaxPages = 8;
+	// bump whenever rasterization or slot layout changes, cached glyphs are dropped then
+	static constexpr uint32_t RendererVersion = 3;
+
+	// ASCII, Latin-1 and box drawing
+	static inline const Vec<CodepointRange> DefaultPrewarmRanges = {
+		{ U' ',    U'~'    },
+		{ 0x00A0,  0x00FF  },
+		{ 0x2500,  0x257F  }
+	};
+
 	FontAtlas();
-	/* Specify size of atlas texture in pixels.
+	/* Specify size of a single atlas page in pixels.
 	*/
-	FontAtlas(uint atlas_width, 
+	FontAtlas(uint atlas_width,
 			  uint atlas_height);
 	~FontAtlas();
 
 	FontAtlas(const FontAtlas&) = delete;
 	FontAtlas(FontAtlas&& atlas);
 
-	/* Initialize Atlas resources and 
+	/* Initialize Atlas resources and
 	*  provide active vao.
 	*  Glyph width will be adjusted automaticaly and can be obtained later.
+	*  Glyphs of 'prewarm' ranges covered by the font are rendered up front
+	*  and uploaded at once. With valid 'cache_path', glyphs cached there
+	*  by 'saveCache' are loaded instead of being rasterized again.
+	*  Glyphs missing in the primary font are looked up in 'fallbacks', in order.
+	*/
+	void init(std::shared_ptr<GLuint> vao,
+			  int glyph_height,
+			  const Vec<CodepointRange>& prewarm = DefaultPrewarmRanges,
+			  const FilePath& cache_path = UndefFilePath,
+			  const Vec<FontFallback>& fallbacks = FontChain::DefaultFallbacks);
+
+	/* Write the glyphs into the cache file given at init,
+	*  if any were added since it was loaded.
 	*/
-	void init(std::shared_ptr<GLuint> vao, int glyph_height);
+	void saveCache();
 
 	FontAtlas& operator=(const FontAtlas&) = delete;
 	FontAtlas& operator=(FontAtlas&& atlas);
-	
-	/* Add/probe UNICODE glyph */
+
+	/* Add/probe UNICODE glyph.
+	*  Probing marks the glyph as used in the current frame.
+	*/
 	void addGlyph(char32_t codepoint);
-	uint32_t getGlyphInfo(char32_t codepoint, GlyphInfo& info) const;
+	uint32_t getGlyphInfo(char32_t codepoint, GlyphInfo& info);
+
+	/* Probe for the glyph id only, GlyphTable::NoGlyph if the glyph is missing.
+	*/
+	THR_FORCEINLINE uint32_t getGlyphId(char32_t codepoint);
+
+	/* Queue glyph for the rasterizer thread, requesting it again
+	*  before it arrives does nothing.
+	*/
+	void requestGlyph(char32_t codepoint);
+	bool hasReadyGlyphs() const;
+
+	/* Called on the rasterizer thread once requested glyphs are ready,
+	*  can be set before 'init'.
+	*/
+	void setReadyCallback(std::function<void()> callback);
+	// glyphs requested and not uploaded yet
+	size_t getRequestedCount() const;
+
+	/* Place the glyphs finished by the rasterizer and upload them at once.
+	*  Returns number of glyphs added.
+	*/
+	size_t uploadReadyGlyphs();
+
+	/* Start a new frame of glyph usage.
+	*/
+	void beginFrame();
+	// number of glyphs evicted since the atlas was initialized
+	size_t getEvictionCount() const;
+	size_t getGlyphCount() const;
+	uint getPageCount() const;
 
 	/* Bind underlaying textures and texture buffers.
 	*  Active textures can be obtained using 'getAtlasTexUnit',
@@ -56,31 +141,99 @@ public:
 
 	/* Get single glyph size in pixels */
 	void getGlyphPixSize(int& width, int& height) const;
+
+	/* Bitmap of the glyph in the copy of the pages, for drawing on the CPU.
+	*  Rows are 'getPagePitch' bytes apart, 'format' is (width, height, bearing x, bearing y)
+	*  as drawn. Pointer is valid until more glyphs are placed.
+	*/
+	const byte* getGlyphBitmap(uint32_t id, glm::ivec4& format) const;
+	uint getPagePitch() const;
 private:
+	friend class AtlasCache;
+
+	struct AtlasSlot
+	{
+		char32_t codepoint;
+		uint32_t stamp;
+		bool     used;
+	};
+
 	THR_INLINE void clear();
 
+	bool allocPages(uint page_cnt);
+	uint32_t allocSlot();
+	void evictGlyphs();
+
+	/* Copy glyph bitmap into a free slot of the page copy, only width, height,
+	*  bearing and advance of 'metrics' are used. Textures and lookup buffers
+	*  are updated by 'flushUploads'.
+	*/
+	// (x, y, page) of the slot
+	glm::ivec4 getSlotOrigin(uint32_t id) const;
+	void placeGlyph(char32_t codepoint, const GlyphInfo& metrics, const byte* bitmap, int pitch);
+	void flushUploads();
+	void prewarmGlyphs(const Vec<CodepointRange>& ranges);
+
 	static constexpr uint DefaultAtlasWidth  = 1024;
 	static constexpr uint DefaultAtlasHeight = 1024;
 	static constexpr uint DefaultGlyphHeight = 48;
+	static constexpr const char* _FontPath = "Therminal/assets/fonts/DejaVuSansMono.ttf";
+	// part of all the slots evicted at once when the atlas is full
+	static constexpr uint _EvictDivisor = 8;
 
-	std::unordered_map<char32_t, GlyphInfo> _glyph_map;
+	GlyphTable								_glyph_ids;
 	GLuint								    _atlas_tex_id;
-	GLuint 								    _tb_buf_uvs_id;
-	GLuint								    _tb_tex_uvs_id;
+	GLuint 								    _tb_buf_pos_id;
+	GLuint								    _tb_tex_pos_id;
 	GLuint 									_tb_buf_form_id;
 	GLuint 									_tb_tex_form_id;
-	FT_Library							    _ft_lib;
-	FT_Face								    _ft_face;
-	uint32_t							    _glyph_id;
+	// faces used on this thread, the rasterizer has its own
+	std::unique_ptr<FontChain>				_fonts;
 	const uint 							    _atlas_width;
 	const uint 							    _atlas_height;
 	uint									_glyph_width;
 	uint 							        _glyph_height;
-	uint 									_glyph_per_tb;
-	int									    _atlas_x_offset;
-	int									    _atlas_y_offset;
+	uint									_slot_width;
+	uint									_slot_height;
+	uint									_slots_per_row;
+	uint 									_slots_per_page;
+	uint									_page_cnt;
+	// copy of the pages, so they survive reallocation of the texture
+	Vec<byte>								_pages;
+	Vec<AtlasSlot>							_slots;
+	Vec<GlyphInfo>							_slot_info;
+	// copy of the lookup buffers - (x, y, page) and (size, bearing) of every slot
+	Vec<glm::ivec4>							_slot_pos;
+	Vec<glm::ivec4>							_slot_format;
+	Vec<uint32_t>							_free_slots;
+	Vec<uint32_t>							_evict_order;
+	uint32_t								_frame;
+	size_t									_evicted_cnt;
+	// pixel rect (x0, y0, x1, y1) of every page and range of slots not uploaded yet
+	Arr<glm::uvec4, MaxPages>				_dirty_rects;
+	uint32_t								_dirty_first;
+	uint32_t								_dirty_last;
+	std::unique_ptr<GlyphRasterizer>		_rasterizer;
+	std::function<void()>					_ready_callback;
+	std::unordered_set<char32_t>			_requested;
+	Vec<RasterGlyph>						_raster_glyphs;
+	Vec<byte>								_raster_pixels;
+	FilePath								_cache_path;
+	uint64_t								_font_hash;
+	// glyphs added since the cache was loaded
+	bool									_cache_dirty;
 	std::shared_ptr<GLuint> 				_vao;
 	bool								    _initialized;
 };
 
+THR_FORCEINLINE uint32_t FontAtlas::getGlyphId(char32_t codepoint)
+{
+	const uint32_t id = _glyph_ids.find(codepoint);
+
+	if (id != GlyphTable::NoGlyph)
+		_slots[id].stamp = _frame;
+
+	return id;
+}
+
 } // namespace Thr
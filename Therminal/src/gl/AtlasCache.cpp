@@ -0,0 +1,189 @@
+#include "AtlasCache.hpp"
+#include "Atlas.hpp"
+#include "logger/Log.hpp"
+#include "filesys/MappedFile.hpp"
+#include "filesys/WriteFile.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+static constexpr uint32_t FreeTypeVersion = (FREETYPE_MAJOR << 16) | (FREETYPE_MINOR << 8) | FREETYPE_PATCH;
+
+bool AtlasCache::save(const FontAtlas& atlas, const FilePath& path)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	if (!atlas._initialized || atlas._font_hash == 0)
+		return false;
+
+	Vec<AtlasCacheGlyph> glyphs;
+	glyphs.reserve(atlas._glyph_ids.size());
+
+	for (uint32_t id = 0; id < atlas._slots.size(); id++) {
+		if (!atlas._slots[id].used)
+			continue;
+
+		const GlyphInfo& info = atlas._slot_info[id];
+
+		glyphs.push_back(AtlasCacheGlyph{
+			atlas._slots[id].codepoint, id,
+			info.width, info.height, info.bearing_x, info.bearing_y, info.advance,
+			0
+		});
+	}
+
+	AtlasCacheHeader header = {};
+	header.magic = _Magic;
+	header.version = _Version;
+	header.byte_order = _ByteOrder;
+	header.font_hash = atlas._font_hash;
+	header.pixel_height = atlas._glyph_height;
+	header.renderer_version = FontAtlas::RendererVersion;
+	header.freetype_version = FreeTypeVersion;
+	header.page_width = atlas._atlas_width;
+	header.page_height = atlas._atlas_height;
+	header.page_cnt = atlas._page_cnt;
+	header.glyph_cnt = glyphs.size();
+	header.glyphs_offset = alignUp(sizeof(AtlasCacheHeader), _SectionAlignment);
+	header.pixels_offset = alignUp(header.glyphs_offset + glyphs.size() * sizeof(AtlasCacheGlyph), _SectionAlignment);
+	header.file_size = header.pixels_offset + atlas._pages.size();
+
+	THR_ASSERT(atlas._pages.size() == static_cast<size_t>(header.page_cnt) * header.page_width * header.page_height);
+
+	const bool ok = writeFileAtomic(path, [&](WriteFile& file) {
+		return file.write(&header, sizeof(header)) &&
+			   file.padTo(header.glyphs_offset) &&
+			   file.write(glyphs.data(), glyphs.size() * sizeof(AtlasCacheGlyph)) &&
+			   file.padTo(header.pixels_offset) &&
+			   file.write(atlas._pages.data(), atlas._pages.size());
+	});
+
+	if (!ok) {
+		THR_LOG_ERROR("Failed to save glyph cache into {}", path.toStr());
+		return false;
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Glyph cache saved: {} glyphs, {} pages, {} KB in {} ms",
+				  header.glyph_cnt, header.page_cnt, header.file_size / 1024, elapsed.count());
+
+	return true;
+}
+
+bool AtlasCache::restore(FontAtlas& atlas, const FilePath& path)
+{
+	const auto start = std::chrono::steady_clock::now();
+	MappedFile mapping;
+
+	if (!mapping.open(path)) {
+		THR_LOG_DEBUG("No glyph cache in {}", path.toStr());
+		return false;
+	}
+
+	const byte* const data = mapping.getData();
+	const size_t size = mapping.getSize();
+
+	AtlasCacheHeader header;
+
+	if (size < sizeof(header)) {
+		THR_LOG_ERROR("Glyph cache file {} is truncated", path.toStr());
+		return false;
+	}
+
+	memCpy(&header, data, sizeof(header));
+
+	if (header.magic != _Magic || header.byte_order != _ByteOrder || header.version != _Version) {
+		THR_LOG_ERROR("File {} is not a glyph cache of this version", path.toStr());
+		return false;
+	}
+
+	if (header.font_hash != atlas._font_hash ||
+		header.pixel_height != atlas._glyph_height ||
+		header.renderer_version != FontAtlas::RendererVersion ||
+		header.freetype_version != FreeTypeVersion ||
+		header.page_width != atlas._atlas_width ||
+		header.page_height != atlas._atlas_height) {
+		THR_LOG_DEBUG("Glyph cache in {} was made for another font, size or renderer", path.toStr());
+		return false;
+	}
+
+	const size_t page_bytes = static_cast<size_t>(header.page_width) * header.page_height;
+
+	/* Validate the layout before touching the atlas
+	*/
+	const bool valid_layout =
+		header.file_size == size &&
+		header.page_cnt > 0 &&
+		header.page_cnt <= FontAtlas::MaxPages &&
+		header.glyph_cnt <= static_cast<uint64_t>(header.page_cnt) * atlas._slots_per_page &&
+		header.glyphs_offset % alignof(AtlasCacheGlyph) == 0 &&
+		header.glyphs_offset + header.glyph_cnt * sizeof(AtlasCacheGlyph) <= header.pixels_offset &&
+		header.pixels_offset + header.page_cnt * page_bytes == size;
+
+	const AtlasCacheGlyph* const glyphs = reinterpret_cast<const AtlasCacheGlyph*>(data + header.glyphs_offset);
+	bool valid_glyphs = valid_layout;
+
+	for (size_t i = 0; i < header.glyph_cnt && valid_glyphs; i++) {
+		const AtlasCacheGlyph& glyph = glyphs[i];
+
+		valid_glyphs = glyph.id < header.page_cnt * atlas._slots_per_page &&
+					   glyph.width >= 0 && static_cast<uint>(glyph.width) < atlas._slot_width &&
+					   glyph.height >= 0 && static_cast<uint>(glyph.height) < atlas._slot_height &&
+					   glyph.advance == static_cast<int32_t>(atlas._glyph_width);
+	}
+
+	if (!valid_glyphs) {
+		THR_LOG_ERROR("Glyph cache file {} is corrupted", path.toStr());
+		return false;
+	}
+
+	if (atlas._page_cnt < header.page_cnt && !atlas.allocPages(header.page_cnt))
+		return false;
+
+	memCpy(atlas._pages.data(), data + header.pixels_offset, header.page_cnt * page_bytes);
+
+	for (uint page = 0; page < header.page_cnt; page++)
+		atlas._dirty_rects[page] = glm::uvec4(0, 0, atlas._atlas_width, atlas._atlas_height);
+
+	for (size_t i = 0; i < header.glyph_cnt; i++) {
+		const AtlasCacheGlyph& glyph = glyphs[i];
+
+		// duplicate slot means the file is broken, the first glyph wins
+		if (atlas._slots[glyph.id].used || atlas._glyph_ids.find(glyph.codepoint) != GlyphTable::NoGlyph)
+			continue;
+
+		atlas._glyph_ids.insert(glyph.codepoint, glyph.id);
+		atlas._slots[glyph.id] = FontAtlas::AtlasSlot{ glyph.codepoint, atlas._frame, true };
+		atlas._slot_info[glyph.id] = GlyphInfo{
+			glyph.width, glyph.height, glyph.bearing_x, glyph.bearing_y, glyph.advance, glyph.id
+		};
+		atlas._slot_pos[glyph.id] = atlas.getSlotOrigin(glyph.id);
+		atlas._slot_format[glyph.id] = glm::ivec4(glyph.width, glyph.height, glyph.bearing_x, glyph.bearing_y);
+	}
+
+	/* Free slots in the same order as for the fresh pages
+	*/
+	atlas._free_slots.clear();
+
+	for (uint32_t id = static_cast<uint32_t>(atlas._slots.size()); id-- > 0; ) {
+		if (!atlas._slots[id].used)
+			atlas._free_slots.push_back(id);
+	}
+
+	atlas._dirty_first = 0;
+	atlas._dirty_last = static_cast<uint32_t>(atlas._slots.size() - 1);
+	atlas.flushUploads();
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Glyph cache restored: {} glyphs, {} pages in {} us",
+				  atlas._glyph_ids.size(), header.page_cnt, elapsed.count());
+
+	return true;
+}
+
+} // namespace Thr
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.hpp"
+#include "filesys/Filepath.hpp"
+
+namespace Thr
+{
+
+class FontAtlas;
+
+/* Glyph cache layout, pages are stored exactly as they're kept in memory:
+*
+*  AtlasCacheHeader | AtlasCacheGlyph[glyph_cnt] | byte[page_cnt * page_width * page_height]
+*
+*  Cached glyphs are valid only for the same font files, pixel size, page size,
+*  FreeType and renderer version - any mismatch of the key and the glyphs
+*  are rasterized again. The format is native-endian.
+*/
+struct AtlasCacheHeader
+{
+	Arr<char, 8> magic;
+	uint32_t     version;
+	uint32_t     byte_order;
+	// key
+	uint64_t     font_hash;
+	uint32_t     pixel_height;
+	uint32_t     renderer_version;
+	uint32_t     freetype_version;
+	uint32_t     page_width;
+	uint32_t     page_height;
+	// contents
+	uint32_t     page_cnt;
+	uint64_t     glyph_cnt;
+	uint64_t     glyphs_offset;
+	uint64_t     pixels_offset;
+	uint64_t     file_size;
+};
+
+struct AtlasCacheGlyph
+{
+	char32_t codepoint;
+	uint32_t id;
+	int32_t  width;
+	int32_t  height;
+	int32_t  bearing_x;
+	int32_t  bearing_y;
+	int32_t  advance;
+	uint32_t reserved;
+};
+
+/* Saves and restores rasterized glyphs of the FontAtlas.
+*/
+class AtlasCache
+{
+public:
+	/* Write the atlas pages and glyphs into 'path', replacing it atomically.
+	*/
+	static bool save(const FontAtlas& atlas, const FilePath& path);
+
+	/* Fill the freshly initialized atlas with glyphs cached in 'path'.
+	*  Returns false, leaving the atlas untouched, if there's no valid cache
+	*  for the atlas key.
+	*/
+	static bool restore(FontAtlas& atlas, const FilePath& path);
+private:
+	static constexpr Arr<char, 8> _Magic = { 'T', 'H', 'R', 'G', 'L', 'Y', 'P', 'H' };
+	static constexpr uint32_t     _Version = 1;
+	static constexpr uint32_t     _ByteOrder = 0x01020304;
+	static constexpr size_t       _SectionAlignment = 64;
+};
+
+} // namespace Thr
@@ -0,0 +1,376 @@
+#include "FontChain.hpp"
+#include "logger/Log.hpp"
+#include "memory/Hash.hpp"
+#include "filesys/MappedFile.hpp"
+#include <cmath>
+
+namespace Thr
+{
+
+FontChain::FontChain()
+	: _ft_lib(nullptr)
+	, _faces()
+	, _paths()
+	, _coverage()
+	, _scratch()
+	, _cell_width(0)
+	, _line_height(0)
+{}
+
+FontChain::~FontChain()
+{
+	clear();
+}
+
+void FontChain::clear()
+{
+	for (Face& face : _faces)
+		FT_Done_Face(face.face);
+
+	if (_ft_lib != nullptr) {
+		FT_Done_FreeType(_ft_lib);
+	}
+
+	_ft_lib = nullptr;
+	_faces.clear();
+	_paths.clear();
+	_coverage.clear();
+}
+
+Vec<std::string> FontChain::findFaces(const char* primary, const Vec<FontFallback>& fallbacks)
+{
+	Vec<std::string> paths = { primary };
+
+	for (const FontFallback& fallback : fallbacks) {
+		const auto it = std::find_if(fallback.paths.begin(), fallback.paths.end(),
+			[](const char* path) {
+				std::error_code err;
+				return std::filesystem::is_regular_file(path, err);
+			});
+
+		if (it == fallback.paths.end()) {
+			THR_LOG_DEBUG("No {} fallback font found", fallback.name);
+			continue;
+		}
+
+		THR_LOG_DEBUG("Using {} as the {} fallback font", *it, fallback.name);
+		paths.push_back(*it);
+	}
+
+	return paths;
+}
+
+bool FontChain::open(const Vec<std::string>& paths, uint pixel_height)
+{
+	THR_ASSERT(!paths.empty());
+
+	clear();
+
+	if (FT_Init_FreeType(std::addressof(_ft_lib)) != 0) {
+		THR_LOG_ERROR("Failed to initialize FreeType library");
+		return false;
+	}
+
+	FT_Face primary = nullptr;
+
+	if (FT_New_Face(_ft_lib, paths[0].c_str(), 0, std::addressof(primary)) != 0) {
+		THR_LOG_ERROR("Failed to load font face {}", paths[0]);
+		return false;
+	}
+
+	_faces.push_back(Face{ primary, 1.f });
+	_paths.push_back(paths[0]);
+
+	const bool mono = (primary->face_flags & FT_FACE_FLAG_FIXED_WIDTH);
+
+	if (!mono) {
+		THR_LOG_ERROR("Loaded font is not monospaced");
+		return false;
+	}
+
+	if (FT_Set_Pixel_Sizes(primary, 0, pixel_height)) {
+		THR_LOG_ERROR("Failed to set pixel size for font face");
+		return false;
+	}
+
+	_cell_width = static_cast<uint>(primary->size->metrics.max_advance >> 6);
+	_line_height = static_cast<uint>(
+		(primary->size->metrics.ascender - primary->size->metrics.descender) >> 6);
+
+	for (size_t i = 1; i < paths.size() && _faces.size() < NoFace; i++) {
+		if (openFallback(paths[i], pixel_height))
+			_paths.push_back(paths[i]);
+	}
+
+	return true;
+}
+
+bool FontChain::openFallback(const std::string& path, uint pixel_height)
+{
+	FT_Face face = nullptr;
+
+	if (FT_New_Face(_ft_lib, path.c_str(), 0, std::addressof(face)) != 0) {
+		THR_LOG_ERROR("Failed to load fallback font face {}", path);
+		return false;
+	}
+
+	/* Color bitmap faces (CBDT emoji) would be drawn as gray silhouettes,
+	*  the atlas holds coverage only
+	*/
+	if (FT_HAS_COLOR(face) && !FT_IS_SCALABLE(face)) {
+		THR_LOG_DEBUG("Skipping fallback font face {}, color glyphs aren't supported", path);
+		FT_Done_Face(face);
+		return false;
+	}
+
+	float scale = 1.f;
+	bool sized = false;
+
+	if (FT_IS_SCALABLE(face)) {
+		/* Same pixel size as the primary face, unless the lines of the face
+		*  are taller than the cell.
+		*/
+		const FT_Long line_units = face->ascender - face->descender;
+		uint size = pixel_height;
+
+		if (line_units > 0) {
+			const uint fit = static_cast<uint>(static_cast<uint64_t>(_line_height) * face->units_per_EM / line_units);
+			size = std::max(1u, std::min(size, fit));
+		}
+
+		sized = FT_Set_Pixel_Sizes(face, 0, size) == 0;
+	}
+	else if (face->num_fixed_sizes > 0) {
+		/* Bitmap strikes can't be rendered at any size - take the smallest one
+		*  not below the cell, scale the bitmaps down when they are rendered.
+		*/
+		FT_Int best = 0;
+
+		for (FT_Int i = 1; i < face->num_fixed_sizes; i++) {
+			const FT_Short h = face->available_sizes[i].height;
+			const FT_Short best_h = face->available_sizes[best].height;
+
+			if ((best_h < static_cast<FT_Short>(_line_height) && h > best_h) ||
+				(h >= static_cast<FT_Short>(_line_height) && h < best_h))
+				best = i;
+		}
+
+		const FT_Bitmap_Size& strike = face->available_sizes[best];
+		sized = FT_Select_Size(face, best) == 0;
+
+		if (strike.height > 0)
+			scale = std::min(1.f, static_cast<float>(_line_height) / strike.height);
+
+		// glyph advances by a single cell
+		if (strike.width > 0)
+			scale = std::min(scale, static_cast<float>(_cell_width) / strike.width);
+	}
+
+	if (!sized) {
+		THR_LOG_ERROR("Failed to set pixel size for fallback font face {}", path);
+		FT_Done_Face(face);
+		return false;
+	}
+
+	_faces.push_back(Face{ face, scale });
+	return true;
+}
+
+uint32_t FontChain::resolve(char32_t codepoint)
+{
+	uint32_t idx = _coverage.find(codepoint);
+
+	if (idx != GlyphTable::NoGlyph)
+		return idx;
+
+	idx = NoFace;
+
+	for (uint32_t i = 0; i < _faces.size(); i++) {
+		if (FT_Get_Char_Index(_faces[i].face, codepoint) != 0) {
+			idx = i;
+			break;
+		}
+	}
+
+	_coverage.insert(codepoint, idx);
+	return idx;
+}
+
+void FontChain::render(char32_t codepoint, RasterGlyph& glyph, Vec<byte>& pixels)
+{
+	glyph = RasterGlyph{ codepoint, 0, 0, 0, 0, static_cast<int>(_cell_width), pixels.size(), false };
+
+	if (_faces.empty())
+		return;
+
+	const uint32_t idx = resolve(codepoint);
+	const Face& face = _faces[idx == NoFace ? 0 : idx];
+
+	/* Glyphs of the scalable fallbacks advancing past the cell (CJK ideographs
+	*  are a full em wide) are shrunk to fit it, transforming the outline
+	*/
+	bool transformed = false;
+
+	if (idx != 0 && idx != NoFace && FT_IS_SCALABLE(face.face)) {
+		if (FT_Load_Char(face.face, codepoint, FT_LOAD_DEFAULT) != 0)
+			return;
+
+		// ink may reach past the advance
+		const FT_Glyph_Metrics& metrics = face.face->glyph->metrics;
+		const FT_Pos extent = std::max(face.face->glyph->advance.x, metrics.horiBearingX + metrics.width);
+		const FT_Pos cell = static_cast<FT_Pos>(_cell_width) << 6;
+
+		if (extent > cell) {
+			FT_Matrix matrix;
+			matrix.xx = static_cast<FT_Fixed>((static_cast<int64_t>(cell) << 16) / extent);
+			matrix.yy = matrix.xx;
+			matrix.xy = 0;
+			matrix.yx = 0;
+
+			FT_Set_Transform(face.face, std::addressof(matrix), nullptr);
+			transformed = true;
+		}
+	}
+
+	const FT_Error error = FT_Load_Char(face.face, codepoint, FT_LOAD_RENDER);
+
+	if (transformed)
+		FT_Set_Transform(face.face, nullptr, nullptr);
+
+	if (error != 0)
+		return;
+
+	const FT_GlyphSlot g = face.face->glyph;
+	const FT_Bitmap& bitmap = g->bitmap;
+
+	// gray and mono bitmaps only, color faces are skipped by openFallback
+	if (bitmap.pixel_mode != FT_PIXEL_MODE_GRAY && bitmap.pixel_mode != FT_PIXEL_MODE_MONO)
+		return;
+
+	const int width = static_cast<int>(bitmap.width);
+	const int height = static_cast<int>(bitmap.rows);
+
+	if (face.scale >= 1.f || width == 0 || height == 0) {
+		glyph.width = width;
+		glyph.height = height;
+		glyph.bearing_x = g->bitmap_left;
+		glyph.bearing_y = g->bitmap_top;
+
+		pixels.resize(glyph.offset + static_cast<size_t>(width) * height);
+		copyBitmap(bitmap, pixels.data() + glyph.offset);
+	}
+	else {
+		_scratch.resize(static_cast<size_t>(width) * height);
+		copyBitmap(bitmap, _scratch.data());
+
+		glyph.width = std::max(1, static_cast<int>(std::lround(width * face.scale)));
+		glyph.height = std::max(1, static_cast<int>(std::lround(height * face.scale)));
+		glyph.bearing_x = static_cast<int>(std::lround(g->bitmap_left * face.scale));
+		glyph.bearing_y = static_cast<int>(std::lround(g->bitmap_top * face.scale));
+
+		pixels.resize(glyph.offset + static_cast<size_t>(glyph.width) * glyph.height);
+		scaleBitmap(_scratch.data(), width, height, pixels.data() + glyph.offset, glyph.width, glyph.height);
+	}
+
+	glyph.loaded = true;
+}
+
+void FontChain::copyBitmap(const FT_Bitmap& bitmap, byte* dst)
+{
+	const int width = static_cast<int>(bitmap.width);
+	const int height = static_cast<int>(bitmap.rows);
+
+	for (int row = 0; row < height; row++) {
+		const byte* src = bitmap.buffer + static_cast<ptrdiff_t>(row) * bitmap.pitch;
+		byte* const out = dst + static_cast<size_t>(row) * width;
+
+		if (bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+			memCpy(out, src, width);
+			continue;
+		}
+
+		// 1 bit per pixel, most significant bit first
+		for (int x = 0; x < width; x++)
+			out[x] = (src[x >> 3] & (0x80 >> (x & 7))) ? 0xFF : 0x00;
+	}
+}
+
+void FontChain::scaleBitmap(const byte* src, int src_width, int src_height,
+							byte* dst, int dst_width, int dst_height)
+{
+	/* Box filter - every target pixel averages the source pixels it covers
+	*/
+	for (int y = 0; y < dst_height; y++) {
+		const int y0 = y * src_height / dst_height;
+		const int y1 = std::max(y0 + 1, (y + 1) * src_height / dst_height);
+
+		for (int x = 0; x < dst_width; x++) {
+			const int x0 = x * src_width / dst_width;
+			const int x1 = std::max(x0 + 1, (x + 1) * src_width / dst_width);
+
+			uint sum = 0;
+
+			for (int sy = y0; sy < y1; sy++) {
+				for (int sx = x0; sx < x1; sx++)
+					sum += src[static_cast<size_t>(sy) * src_width + sx];
+			}
+
+			dst[static_cast<size_t>(y) * dst_width + x] = static_cast<byte>(sum / ((y1 - y0) * (x1 - x0)));
+		}
+	}
+}
+
+uint64_t FontChain::hashFaces() const
+{
+	if (_paths.empty())
+		return 0;
+
+	MappedFile mapping;
+
+	if (!mapping.open(FilePath(_paths[0])))
+		return 0;
+
+	uint64_t hash = hashBytes(mapping.getData(), mapping.getSize());
+
+	/* Fallbacks are large, their contents are not read
+	*/
+	for (size_t i = 1; i < _paths.size(); i++) {
+		std::error_code size_err, time_err;
+
+		const auto size = std::filesystem::file_size(_paths[i], size_err);
+		const auto time = std::filesystem::last_write_time(_paths[i], time_err);
+
+		if (size_err || time_err)
+			continue;
+
+		const Arr<int64_t, 2> key = { static_cast<int64_t>(size),
+									  static_cast<int64_t>(time.time_since_epoch().count()) };
+
+		hash = hashBytes(_paths[i].data(), _paths[i].size(), hash);
+		hash = hashBytes(key.data(), sizeof(key), hash);
+	}
+
+	return hash;
+}
+
+const Vec<std::string>& FontChain::getPaths() const
+{
+	return _paths;
+}
+
+size_t FontChain::getFaceCount() const
+{
+	return _faces.size();
+}
+
+uint FontChain::getCellWidth() const
+{
+	return _cell_width;
+}
+
+uint FontChain::getLineHeight() const
+{
+	return _line_height;
+}
+
+} // namespace Thr
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Common.hpp"
+#include "GlyphTable.hpp"
+
+namespace Thr
+{
+
+/* Glyph bitmap rendered by FontChain. Bitmap rows are tightly packed,
+*  'offset' points into the pixel buffer the glyph was rendered into.
+*/
+struct RasterGlyph
+{
+	char32_t codepoint;
+	int      width;
+	int      height;
+	int      bearing_x;
+	int      bearing_y;
+	int      advance;
+	size_t   offset;
+	bool     loaded;
+};
+
+/* Face looked up when the faces before it lack a glyph,
+*  the first of 'paths' that exists is loaded.
+*/
+struct FontFallback
+{
+	const char*		  name;
+	Vec<const char*>  paths;
+};
+
+/* Ordered chain of faces - the primary one defining the cell grid, followed
+*  by the fallbacks. Codepoint is rendered from the first face that has it,
+*  codepoints no face has are rendered as the missing glyph of the primary face.
+*
+*  Face of every codepoint is resolved once and remembered, missing ones included,
+*  so each codepoint costs at most a single lookup in every face.
+*
+*  Glyphs of the fallback faces are fit into the grid of the primary face:
+*  scalable faces are sized to the same line height and glyphs wider than the cell
+*  are shrunk to its width, bitmap-only faces are scaled down from their nearest
+*  strike. Every glyph advances by a single cell. Color bitmap faces (CBDT emoji)
+*  are skipped - the atlas holds coverage only, so emoji come from the outline
+*  faces, in gray.
+*
+*  FreeType objects can't be shared between threads, every thread rendering
+*  glyphs opens its own chain.
+*/
+class FontChain
+{
+public:
+	static inline const Vec<FontFallback> DefaultFallbacks = {
+#if defined(THR_PLATFORM_WINDOWS)
+		{ "symbols", { "C:/Windows/Fonts/seguisym.ttf" } },
+		{ "CJK",     { "C:/Windows/Fonts/msgothic.ttc", "C:/Windows/Fonts/msyh.ttc" } },
+		// outlines of the color glyphs are drawn
+		{ "emoji",   { "C:/Windows/Fonts/seguiemj.ttf" } }
+#else
+		{ "symbols", { "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+					   "/usr/share/fonts/TTF/DejaVuSans.ttf",
+					   "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+					   "/usr/share/fonts/truetype/noto/NotoSansSymbols2-Regular.ttf",
+					   "/usr/share/fonts/noto/NotoSansSymbols2-Regular.ttf" } },
+		{ "CJK",     { "/usr/share/fonts/opentype/noto/NotoSansCJK-Regular.ttc",
+					   "/usr/share/fonts/noto-cjk/NotoSansCJK-Regular.ttc",
+					   "/usr/share/fonts/google-noto-cjk/NotoSansCJK-Regular.ttc",
+					   "/usr/share/fonts/truetype/droid/DroidSansFallbackFull.ttf",
+					   "/usr/share/fonts/wenquanyi/wqy-microhei/wqy-microhei.ttc" } },
+		{ "emoji",   { "/usr/share/fonts/truetype/ancient-scripts/Symbola_hint.ttf",
+					   "/usr/share/fonts/TTF/Symbola.ttf",
+					   "/usr/share/fonts/gdouros-symbola/Symbola.ttf" } }
+#endif
+	};
+
+	// face index of codepoints covered by none of the faces
+	static constexpr uint32_t NoFace = 0xFF;
+
+	FontChain();
+	~FontChain();
+
+	FontChain(const FontChain&) = delete;
+	FontChain& operator=(const FontChain&) = delete;
+
+	/* Paths of the primary face and the fallbacks found on this system.
+	*/
+	static Vec<std::string> findFaces(const char* primary, const Vec<FontFallback>& fallbacks);
+
+	/* Load the faces, 'paths[0]' is the primary one and has to be monospaced.
+	*  Fallbacks failing to load are skipped.
+	*/
+	bool open(const Vec<std::string>& paths, uint pixel_height);
+
+	/* Index of the face rendering the codepoint, NoFace if none has it.
+	*/
+	uint32_t resolve(char32_t codepoint);
+
+	/* Render the glyph, appending its bitmap to 'pixels'.
+	*  'glyph.loaded' is false if it couldn't be rendered.
+	*/
+	void render(char32_t codepoint, RasterGlyph& glyph, Vec<byte>& pixels);
+
+	/* Hash identifying rendered glyphs - contents of the primary face,
+	*  paths, sizes and modification times of the fallbacks.
+	*/
+	uint64_t hashFaces() const;
+
+	const Vec<std::string>& getPaths() const;
+	size_t getFaceCount() const;
+
+	/* Cell of the primary face, in pixels */
+	uint getCellWidth() const;
+	uint getLineHeight() const;
+private:
+	struct Face
+	{
+		FT_Face face;
+		// bitmap scale of faces without outlines, 1 otherwise
+		float	scale;
+	};
+
+	bool openFallback(const std::string& path, uint pixel_height);
+	void clear();
+
+	static void copyBitmap(const FT_Bitmap& bitmap, byte* dst);
+	static void scaleBitmap(const byte* src, int src_width, int src_height,
+							byte* dst, int dst_width, int dst_height);
+
+	FT_Library		 _ft_lib;
+	Vec<Face>		 _faces;
+	Vec<std::string> _paths;
+	// codepoint -> face index or NoFace
+	GlyphTable		 _coverage;
+	Vec<byte>		 _scratch;
+	uint			 _cell_width;
+	uint			 _line_height;
+};
+
+} // namespace Thr
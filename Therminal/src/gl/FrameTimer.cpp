@@ -0,0 +1,275 @@
+#include "FrameTimer.hpp"
+#include "logger/Log.hpp"
+#include "Utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace Thr
+{
+
+TimeHistogram::TimeHistogram()
+	: _counts()
+	, _samples()
+	, _next(0)
+	, _count(0)
+{}
+
+uint TimeHistogram::getBucket(uint64_t ns)
+{
+	const uint64_t us = ns / 1000;
+
+	if (us < _SubBuckets)
+		return static_cast<uint>(us);
+
+	// highest set bit picks the octave, three bits below it the sub-bucket
+	uint octave = 0;
+
+	for (uint step = 32; step > 0; step >>= 1) {
+		if ((us >> (octave + step)) != 0)
+			octave += step;
+	}
+
+	const uint sub = static_cast<uint>(us >> (octave - 3)) & (_SubBuckets - 1);
+	return std::min(_SubBuckets * (octave - 2) + sub, _BucketCount - 1);
+}
+
+uint64_t TimeHistogram::getBucketLimit(uint bucket)
+{
+	if (bucket < _SubBuckets)
+		return (bucket + 1) * 1000ull;
+
+	const uint octave = bucket / _SubBuckets + 2;
+	const uint64_t sub = bucket % _SubBuckets;
+
+	return ((_SubBuckets + sub + 1) << (octave - 3)) * 1000ull;
+}
+
+void TimeHistogram::add(uint64_t ns)
+{
+	if (_count == WindowSize)
+		_counts[getBucket(_samples[_next])]--;
+	else
+		_count++;
+
+	_samples[_next] = ns;
+	_counts[getBucket(ns)]++;
+	_next = (_next + 1) % WindowSize;
+}
+
+void TimeHistogram::clear()
+{
+	_counts.fill(0);
+	_next = 0;
+	_count = 0;
+}
+
+uint64_t TimeHistogram::getPercentile(double p) const
+{
+	if (_count == 0)
+		return 0;
+
+	const size_t rank = std::max<size_t>(static_cast<size_t>(std::ceil(p * static_cast<double>(_count))), 1);
+	size_t seen = 0;
+
+	for (uint b = 0; b < _BucketCount; b++) {
+		seen += _counts[b];
+
+		if (seen >= rank)
+			return std::min(getBucketLimit(b), getMax());
+	}
+
+	return getMax();
+}
+
+uint64_t TimeHistogram::getMax() const
+{
+	// samples fill the ring from the start until it wraps
+	return _count == 0 ? 0 : *std::max_element(_samples.begin(), _samples.begin() + _count);
+}
+
+size_t TimeHistogram::getCount() const
+{
+	return _count;
+}
+
+FrameTimer::FrameTimer()
+	: _cpu()
+	, _gpu()
+	, _begin()
+	, _queries()
+	, _gpu_phase(_NoPhase)
+	, _dropped_cnt(0)
+	, _gpu_timing(false)
+	, _initialized(false)
+{}
+
+FrameTimer::~FrameTimer()
+{
+	if (!_gpu_timing)
+		return;
+
+	for (PhaseQueries& queries : _queries) {
+		if (queries.ids[0] != 0)
+			glDeleteQueries(_QueryLatency, queries.ids.data());
+	}
+}
+
+void FrameTimer::init()
+{
+	if (_initialized) {
+		THR_LOG_ERROR("FrameTimer is already initialized, can't initialize again");
+		return;
+	}
+
+	// timer queries are core since GL 3.3
+	_gpu_timing = glGenQueries != nullptr &&
+				  (GLAD_GL_VERSION_3_3 || hasGlExtension("GL_ARB_timer_query"));
+
+	if (_gpu_timing) {
+		for (uint32_t phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+			if (isGpuPhase(static_cast<FramePhase>(phase)))
+				glGenQueries(_QueryLatency, _queries[phase].ids.data());
+		}
+	}
+
+	THR_LOG_INFO("Frame timing enabled, GPU time {}", _gpu_timing ? "from timer queries" : "not available");
+
+	_initialized = true;
+}
+
+bool FrameTimer::isInitialized() const
+{
+	return _initialized;
+}
+
+void FrameTimer::beginFrame()
+{
+	if (!_initialized || !_gpu_timing)
+		return;
+
+	for (uint32_t phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+		PhaseQueries& queries = _queries[phase];
+
+		for (uint slot = 0; slot < _QueryLatency; slot++) {
+			if (!queries.issued[slot])
+				continue;
+
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv(queries.ids[slot], GL_QUERY_RESULT_AVAILABLE, std::addressof(available));
+
+			if (available == GL_FALSE)
+				continue;
+
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries.ids[slot], GL_QUERY_RESULT, std::addressof(ns));
+
+			_gpu[phase].add(ns);
+			queries.issued[slot] = false;
+		}
+	}
+}
+
+void FrameTimer::beginPhase(FramePhase phase)
+{
+	THR_ASSERT(phase < FRAME_PHASE_COUNT);
+
+	if (!_initialized)
+		return;
+
+	_begin[phase] = Clock::now();
+
+	if (!_gpu_timing || !isGpuPhase(phase) || _gpu_phase != _NoPhase)
+		return;
+
+	PhaseQueries& queries = _queries[phase];
+
+	// result of the slot never arrived in time, it's overwritten
+	if (queries.issued[queries.next]) {
+		queries.issued[queries.next] = false;
+		_dropped_cnt++;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries.ids[queries.next]);
+	_gpu_phase = phase;
+}
+
+void FrameTimer::endPhase(FramePhase phase)
+{
+	THR_ASSERT(phase < FRAME_PHASE_COUNT);
+
+	if (!_initialized)
+		return;
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _begin[phase]);
+	_cpu[phase].add(static_cast<uint64_t>(elapsed.count()));
+
+	if (_gpu_phase != phase)
+		return;
+
+	PhaseQueries& queries = _queries[phase];
+
+	glEndQuery(GL_TIME_ELAPSED);
+	queries.issued[queries.next] = true;
+	queries.next = (queries.next + 1) % _QueryLatency;
+
+	_gpu_phase = _NoPhase;
+}
+
+const TimeHistogram& FrameTimer::getCpuHistogram(FramePhase phase) const
+{
+	THR_ASSERT(phase < FRAME_PHASE_COUNT);
+	return _cpu[phase];
+}
+
+const TimeHistogram& FrameTimer::getGpuHistogram(FramePhase phase) const
+{
+	THR_ASSERT(phase < FRAME_PHASE_COUNT);
+	return _gpu[phase];
+}
+
+void FrameTimer::formatStats(Vec<std::string>& lines) const
+{
+	const auto ms = [](uint64_t ns) {
+		return static_cast<double>(ns) / 1e6;
+	};
+
+	lines.clear();
+
+	Arr<char, 128> line;
+	std::snprintf(line.data(), line.size(), "%-8s %7s %7s %7s %7s %7s %7s",
+				  "ms", "cpu p50", "p99", "max", "gpu p50", "p99", "max");
+	lines.emplace_back(line.data());
+
+	for (uint32_t phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+		const TimeHistogram& cpu = _cpu[phase];
+		const TimeHistogram& gpu = _gpu[phase];
+
+		if (cpu.getCount() == 0)
+			continue;
+
+		int n = std::snprintf(line.data(), line.size(), "%-8s %7.3f %7.3f %7.3f", _PhaseNames[phase],
+							  ms(cpu.getPercentile(0.5)), ms(cpu.getPercentile(0.99)), ms(cpu.getMax()));
+
+		if (gpu.getCount() > 0 && n > 0) {
+			std::snprintf(line.data() + n, line.size() - n, " %7.3f %7.3f %7.3f",
+						  ms(gpu.getPercentile(0.5)), ms(gpu.getPercentile(0.99)), ms(gpu.getMax()));
+		}
+
+		lines.emplace_back(line.data());
+	}
+}
+
+void FrameTimer::logStats() const
+{
+	Vec<std::string> lines;
+	formatStats(lines);
+
+	for (const std::string& line : lines)
+		THR_LOG_INFO("Frame timing: {}", line);
+
+	if (_dropped_cnt > 0)
+		THR_LOG_DEBUG("Frame timing: {} GPU samples dropped, results arrived too late", _dropped_cnt);
+}
+
+} // namespace Thr
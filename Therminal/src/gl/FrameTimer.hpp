@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Common.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+/* Phases of a frame, in the order they run
+*/
+enum FramePhase : uint32_t
+{
+	FRAME_PHASE_READ_BYTES = 0,
+	FRAME_PHASE_PARSE,
+	FRAME_PHASE_SNAPSHOT,
+	FRAME_PHASE_PACK,
+	FRAME_PHASE_UPLOAD,
+	FRAME_PHASE_DRAW,
+	FRAME_PHASE_SWAP,
+	FRAME_PHASE_COUNT
+};
+
+/* Durations of the last WindowSize samples, counted in log scaled buckets -
+*  exact below 8 us, 8 buckets per power of two above, so percentiles
+*  are within 12.5 %. Maximum is exact.
+*/
+class TimeHistogram
+{
+public:
+	static constexpr size_t WindowSize = 1024;
+
+	TimeHistogram();
+
+	void add(uint64_t ns);
+	void clear();
+
+	/* Upper bound of the bucket holding the 'p'-th percentile, 0 <= p <= 1,
+	*  never above the maximum.
+	*/
+	uint64_t getPercentile(double p) const;
+	uint64_t getMax() const;
+	size_t getCount() const;
+private:
+	static constexpr uint _SubBuckets = 8;
+	static constexpr uint _OctaveCount = 24;
+	static constexpr uint _BucketCount = _SubBuckets * (_OctaveCount + 1);
+
+	static uint getBucket(uint64_t ns);
+	static uint64_t getBucketLimit(uint bucket);
+
+	Arr<uint32_t, _BucketCount> _counts;
+	// ring of the samples in the window, oldest is dropped from its bucket
+	Arr<uint64_t, WindowSize>   _samples;
+	size_t						_next;
+	size_t						_count;
+};
+
+/* Measures the phases of every frame. CPU time comes from the monotonic clock,
+*  GPU time of the phases issuing GL commands from GL_TIME_ELAPSED queries.
+*  Query results are collected frames later, once available, so measuring
+*  never stalls the pipeline. Samples are kept in rolling histograms,
+*  phases not run in a frame add no sample.
+*
+*  Only a single GPU phase may be measured at a time, phases don't nest.
+*  Nothing is measured until initialized.
+*/
+class FrameTimer
+{
+public:
+	FrameTimer();
+	~FrameTimer();
+
+	FrameTimer(const FrameTimer&) = delete;
+	FrameTimer& operator=(const FrameTimer&) = delete;
+
+	/* GL context has to be current, GPU phases aren't measured without
+	*  timer queries.
+	*/
+	void init();
+	bool isInitialized() const;
+
+	/* Collect results of the finished GPU queries.
+	*/
+	void beginFrame();
+
+	void beginPhase(FramePhase phase);
+	void endPhase(FramePhase phase);
+
+	const TimeHistogram& getCpuHistogram(FramePhase phase) const;
+	const TimeHistogram& getGpuHistogram(FramePhase phase) const;
+
+	/* Table of p50/p99/max of every phase measured so far, in milliseconds.
+	*/
+	void formatStats(Vec<std::string>& lines) const;
+	void logStats() const;
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// frames a query may stay in flight before its slot is reused
+	static constexpr uint _QueryLatency = 4;
+	static constexpr uint32_t _NoPhase = FRAME_PHASE_COUNT;
+
+	static constexpr Arr<const char*, FRAME_PHASE_COUNT> _PhaseNames = {
+		"read", "parse", "snapshot", "pack", "upload", "draw", "swap"
+	};
+
+	/* Phases issuing GL commands. Packing writes mapped memory only, swap time
+	*  is mostly spent waiting for the display.
+	*/
+	static constexpr bool isGpuPhase(FramePhase phase)
+	{
+		return phase == FRAME_PHASE_UPLOAD || phase == FRAME_PHASE_DRAW;
+	}
+
+	struct PhaseQueries
+	{
+		Arr<GLuint, _QueryLatency> ids    = {};
+		Arr<bool, _QueryLatency>   issued = {};
+		uint32_t				   next   = 0;
+	};
+
+	Arr<TimeHistogram, FRAME_PHASE_COUNT>  _cpu;
+	Arr<TimeHistogram, FRAME_PHASE_COUNT>  _gpu;
+	Arr<Clock::time_point, FRAME_PHASE_COUNT> _begin;
+	Arr<PhaseQueries, FRAME_PHASE_COUNT>   _queries;
+	// phase the running query measures
+	uint32_t							   _gpu_phase;
+	// query results lost to slots reused before the result arrived
+	size_t								   _dropped_cnt;
+	bool								   _gpu_timing;
+	bool								   _initialized;
+};
+
+} // namespace Thr
@@ -0,0 +1,141 @@
+#include "GlyphRasterizer.hpp"
+#include "logger/Log.hpp"
+#include "memory/Memory.hpp"
+
+namespace Thr
+{
+
+GlyphRasterizer::GlyphRasterizer()
+	: _fonts()
+	, _ready_cnt(0)
+	, _stop(false)
+{}
+
+GlyphRasterizer::~GlyphRasterizer()
+{
+	stop();
+}
+
+bool GlyphRasterizer::start(const Vec<std::string>& font_paths, uint pixel_height)
+{
+	THR_ASSERT(!_thr.joinable());
+
+	if (!_fonts.open(font_paths, pixel_height)) {
+		THR_LOG_ERROR("Failed to load font faces for glyph rasterizer");
+		return false;
+	}
+
+	_stop = false;
+
+	_thr = std::thread(
+		[this]() {
+			this->thrExecution();
+		});
+
+	return true;
+}
+
+void GlyphRasterizer::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		_wake_cv.notify_all();
+	}
+
+	if (_thr.joinable())
+		_thr.join();
+}
+
+void GlyphRasterizer::request(char32_t codepoint)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_requests.push_back(codepoint);
+
+	// woken once per batch of requests, the thread takes all of them
+	if (_requests.size() == 1)
+		_wake_cv.notify_one();
+}
+
+void GlyphRasterizer::setReadyCallback(std::function<void()> callback)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_ready_callback = std::move(callback);
+}
+
+size_t GlyphRasterizer::getReadyCount() const
+{
+	return _ready_cnt.load(std::memory_order_relaxed);
+}
+
+void GlyphRasterizer::collect(Vec<RasterGlyph>& glyphs, Vec<byte>& pixels)
+{
+	glyphs.clear();
+	pixels.clear();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// hand over the buffers, capacity of the old ones gets reused
+	glyphs.swap(_ready);
+	pixels.swap(_ready_pixels);
+
+	_ready_cnt.store(0, std::memory_order_relaxed);
+}
+
+void GlyphRasterizer::thrExecution()
+{
+	Vec<char32_t>    todo;
+	Vec<RasterGlyph> done;
+	Vec<byte>        pixels;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+
+			_wake_cv.wait(lock, [this]() {
+				return _stop || !_requests.empty();
+			});
+
+			if (_stop)
+				return;
+
+			todo.swap(_requests);
+		}
+
+		for (size_t i = 0; i < todo.size(); i++) {
+			RasterGlyph glyph;
+			_fonts.render(todo[i], glyph, pixels);
+
+			done.push_back(glyph);
+
+			if (done.size() < _BatchSize && i + 1 < todo.size())
+				continue;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			if (_stop)
+				return;
+
+			const size_t base = _ready_pixels.size();
+
+			for (RasterGlyph& ready : done) {
+				ready.offset += base;
+				_ready.push_back(ready);
+			}
+
+			_ready_pixels.insert(_ready_pixels.end(), pixels.begin(), pixels.end());
+			_ready_cnt.store(_ready.size(), std::memory_order_relaxed);
+
+			if (_ready_callback)
+				_ready_callback();
+
+			done.clear();
+			pixels.clear();
+		}
+
+		todo.clear();
+	}
+}
+
+} // namespace Thr
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Common.hpp"
+#include "FontChain.hpp"
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace Thr
+{
+
+/* Renders glyph bitmaps on a background thread. The thread has its own chain
+*  of faces - FreeType objects can't be used from two threads at once.
+*
+*  Requested codepoints are queued, finished bitmaps are published in small
+*  batches, so the first glyphs of a large request arrive early.
+*/
+class GlyphRasterizer
+{
+public:
+	GlyphRasterizer();
+	~GlyphRasterizer();
+
+	GlyphRasterizer(const GlyphRasterizer&) = delete;
+	GlyphRasterizer& operator=(const GlyphRasterizer&) = delete;
+
+	/* Load the faces and start the thread.
+	*/
+	bool start(const Vec<std::string>& font_paths, uint pixel_height);
+	void stop();
+
+	void request(char32_t codepoint);
+
+	/* Called on the rasterizer thread whenever a batch of glyphs is published.
+	*/
+	void setReadyCallback(std::function<void()> callback);
+
+	/* Number of glyphs finished and not collected yet.
+	*/
+	size_t getReadyCount() const;
+
+	/* Move the finished glyphs into 'glyphs' and their bitmaps into 'pixels',
+	*  previous content of both is dropped.
+	*/
+	void collect(Vec<RasterGlyph>& glyphs, Vec<byte>& pixels);
+private:
+	void thrExecution();
+
+	// glyphs rendered before the batch is published
+	static constexpr size_t _BatchSize = 32;
+
+	FontChain				_fonts;
+	mutable std::mutex		_mutex;
+	std::condition_variable _wake_cv;
+	Vec<char32_t>			_requests;
+	Vec<RasterGlyph>		_ready;
+	Vec<byte>				_ready_pixels;
+	std::atomic<size_t>		_ready_cnt;
+	std::function<void()>	_ready_callback;
+	bool					_stop;
+	std::thread				_thr;
+};
+
+} // namespace Thr
@@ -0,0 +1,150 @@
+#include "GlyphTable.hpp"
+
+namespace Thr
+{
+
+GlyphTable::GlyphTable()
+	: _pages()
+	, _astral()
+	, _astral_cnt(0)
+	, _cnt(0)
+{}
+
+uint32_t GlyphTable::findAstral(char32_t codepoint) const
+{
+	if (_astral.empty())
+		return NoGlyph;
+
+	const size_t mask = _astral.size() - 1;
+
+	for (size_t i = hashAstral(codepoint) & mask; ; i = (i + 1) & mask) {
+		const AstralEntry& entry = _astral[i];
+
+		if (entry.codepoint == codepoint)
+			return entry.id;
+
+		if (entry.codepoint == _NoCodepoint)
+			return NoGlyph;
+	}
+}
+
+void GlyphTable::growAstral()
+{
+	Vec<AstralEntry> old(std::max(2 * _astral.size(), _MinAstralCapacity),
+						 AstralEntry{ _NoCodepoint, NoGlyph });
+	old.swap(_astral);
+
+	const size_t mask = _astral.size() - 1;
+
+	for (const AstralEntry& entry : old) {
+		if (entry.codepoint == _NoCodepoint)
+			continue;
+
+		size_t i = hashAstral(entry.codepoint) & mask;
+
+		while (_astral[i].codepoint != _NoCodepoint)
+			i = (i + 1) & mask;
+
+		_astral[i] = entry;
+	}
+}
+
+void GlyphTable::insert(char32_t codepoint, uint32_t id)
+{
+	THR_ASSERT(id != NoGlyph && codepoint != _NoCodepoint);
+
+	if (codepoint < 0x10000) {
+		std::unique_ptr<uint32_t[]>& page = _pages[codepoint >> _PageBits];
+
+		if (page == nullptr) {
+			page = std::make_unique<uint32_t[]>(_PageSize);
+			std::fill(page.get(), page.get() + _PageSize, NoGlyph);
+		}
+
+		uint32_t& slot = page[codepoint & (_PageSize - 1)];
+
+		_cnt += slot == NoGlyph;
+		slot = id;
+		return;
+	}
+
+	if (2 * (_astral_cnt + 1) > _astral.size())
+		growAstral();
+
+	const size_t mask = _astral.size() - 1;
+	size_t i = hashAstral(codepoint) & mask;
+
+	while (_astral[i].codepoint != _NoCodepoint && _astral[i].codepoint != codepoint)
+		i = (i + 1) & mask;
+
+	if (_astral[i].codepoint == _NoCodepoint) {
+		_astral_cnt++;
+		_cnt++;
+	}
+
+	_astral[i] = AstralEntry{ codepoint, id };
+}
+
+void GlyphTable::erase(char32_t codepoint)
+{
+	if (codepoint < 0x10000) {
+		uint32_t* page = _pages[codepoint >> _PageBits].get();
+
+		if (page == nullptr || page[codepoint & (_PageSize - 1)] == NoGlyph)
+			return;
+
+		page[codepoint & (_PageSize - 1)] = NoGlyph;
+		_cnt--;
+		return;
+	}
+
+	if (_astral.empty())
+		return;
+
+	const size_t mask = _astral.size() - 1;
+	size_t i = hashAstral(codepoint) & mask;
+
+	while (_astral[i].codepoint != codepoint) {
+		if (_astral[i].codepoint == _NoCodepoint)
+			return;
+
+		i = (i + 1) & mask;
+	}
+
+	/* Shift the following entries of the probe sequence back,
+	*  so no tombstones are needed.
+	*/
+	for (size_t j = (i + 1) & mask; _astral[j].codepoint != _NoCodepoint; j = (j + 1) & mask) {
+		const size_t home = hashAstral(_astral[j].codepoint) & mask;
+
+		// entry can move to 'i' only if 'i' lies between its home and 'j'
+		const bool movable = i <= j ? (home <= i || home > j)
+									: (home <= i && home > j);
+
+		if (movable) {
+			_astral[i] = _astral[j];
+			i = j;
+		}
+	}
+
+	_astral[i] = AstralEntry{ _NoCodepoint, NoGlyph };
+	_astral_cnt--;
+	_cnt--;
+}
+
+void GlyphTable::clear()
+{
+	for (std::unique_ptr<uint32_t[]>& page : _pages)
+		page.reset();
+
+	_astral.clear();
+	_astral_cnt = 0;
+	_cnt = 0;
+}
+
+size_t GlyphTable::size() const
+{
+	return _cnt;
+}
+
+} // namespace Thr
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Common.hpp"
+#include <memory>
+
+namespace Thr
+{
+
+/* Codepoint -> glyph id table, probed for every cell of every row written.
+*
+*  Basic Multilingual Plane is indexed directly - 256 pages of 256 ids, a page
+*  is allocated once the first of its codepoints is inserted. Rest of the planes
+*  is rare, these codepoints go to a small open-addressing hash table
+*  with linear probing.
+*/
+class GlyphTable
+{
+public:
+	static constexpr uint32_t NoGlyph = static_cast<uint32_t>(-1);
+
+	GlyphTable();
+
+	GlyphTable(const GlyphTable&) = delete;
+	GlyphTable(GlyphTable&&) = default;
+
+	GlyphTable& operator=(const GlyphTable&) = delete;
+	GlyphTable& operator=(GlyphTable&&) = default;
+
+	/* NoGlyph if the codepoint is not present.
+	*/
+	THR_FORCEINLINE uint32_t find(char32_t codepoint) const;
+
+	void insert(char32_t codepoint, uint32_t id);
+	void erase(char32_t codepoint);
+	void clear();
+
+	size_t size() const;
+private:
+	struct AstralEntry
+	{
+		char32_t codepoint;
+		uint32_t id;
+	};
+
+	uint32_t findAstral(char32_t codepoint) const;
+	void growAstral();
+
+	THR_FORCEINLINE static size_t hashAstral(char32_t codepoint);
+
+	static constexpr uint32_t _PageBits = 8;
+	static constexpr uint32_t _PageSize = 1u << _PageBits;
+	static constexpr uint32_t _PageCount = 0x10000 >> _PageBits;
+	static constexpr size_t   _MinAstralCapacity = 64;
+	// empty entry of the astral table, never a valid codepoint
+	static constexpr char32_t _NoCodepoint = static_cast<char32_t>(-1);
+
+	Arr<std::unique_ptr<uint32_t[]>, _PageCount> _pages;
+	// capacity is a power of two, kept at most half full
+	Vec<AstralEntry>							 _astral;
+	size_t										 _astral_cnt;
+	size_t										 _cnt;
+};
+
+THR_FORCEINLINE uint32_t GlyphTable::find(char32_t codepoint) const
+{
+	if (codepoint < 0x10000) {
+		const uint32_t* page = _pages[codepoint >> _PageBits].get();
+		return page != nullptr ? page[codepoint & (_PageSize - 1)] : NoGlyph;
+	}
+
+	return findAstral(codepoint);
+}
+
+THR_FORCEINLINE size_t GlyphTable::hashAstral(char32_t codepoint)
+{
+	// Fibonacci hashing, upper bits are masked off by the caller
+	return static_cast<size_t>((static_cast<uint32_t>(codepoint) * 0x9E3779B1u) >> 7);
+}
+
+} // namespace Thr
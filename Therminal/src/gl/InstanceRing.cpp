@@ -0,0 +1,226 @@
+#include "InstanceRing.hpp"
+#include "logger/Log.hpp"
+#include "Utils.hpp"
+
+namespace Thr
+{
+
+InstanceRing::InstanceRing()
+	: _buf_id(0)
+	, _stride(0)
+	, _capacity(0)
+	, _persistent_ptr(nullptr)
+	, _fences{}
+	, _region(0)
+	, _persistent(false)
+	, _mapped(false)
+	, _stall_cnt(0)
+{}
+
+InstanceRing::~InstanceRing()
+{
+	destroyBuffer();
+}
+
+void InstanceRing::init(size_t stride)
+{
+	THR_ASSERT(stride > 0);
+	_stride = stride;
+
+	/* Function pointer is loaded only when the context exposes it -
+	*  either as a part of GL 4.4 or through the extension.
+	*/
+	_persistent = glBufferStorage != nullptr &&
+				  (GLAD_GL_VERSION_4_4 || hasGlExtension("GL_ARB_buffer_storage"));
+
+	THR_LOG_INFO("Instance buffer: {} regions, {} mapping", RegionCount,
+				 _persistent ? "persistent" : "unsynchronized");
+}
+
+bool InstanceRing::reserve(size_t instances)
+{
+	if (instances <= _capacity && _buf_id != 0)
+		return false;
+
+	/* Leave some headroom, so growing the window by a few cells
+	*  at a time (drag-resize) doesn't reallocate on every step.
+	*/
+	const size_t capacity = std::max<size_t>(instances + instances / 2, 1);
+
+	THR_LOG_DEBUG("Instance buffer reallocation from capacity of {} to {} instances per region",
+				  _capacity, capacity);
+
+	// regions of the old buffer are released along with it
+	destroyBuffer();
+
+	glGenBuffers(1, std::addressof(_buf_id));
+	glBindBuffer(GL_ARRAY_BUFFER, _buf_id);
+	THR_HARD_ASSERT(_buf_id != 0 && glIsBuffer(_buf_id) == GL_TRUE);
+
+	const GLsizeiptr bytes = static_cast<GLsizeiptr>(capacity * _stride * RegionCount);
+
+	if (_persistent) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		_persistent_ptr = static_cast<byte*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+
+		if (_persistent_ptr == nullptr) {
+			THR_LOG_ERROR("Failed to map instance buffer persistently, falling back to unsynchronized mapping");
+
+			glDeleteBuffers(1, std::addressof(_buf_id));
+			_buf_id = 0;
+			_persistent = false;
+
+			return reserve(instances);
+		}
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	_capacity = capacity;
+	_region = 0;
+
+	return true;
+}
+
+void InstanceRing::destroyBuffer()
+{
+	for (GLsync& fence : _fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+
+	if (_buf_id == 0)
+		return;
+
+	if (_persistent_ptr != nullptr || _mapped) {
+		glBindBuffer(GL_ARRAY_BUFFER, _buf_id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	glDeleteBuffers(1, std::addressof(_buf_id));
+
+	_buf_id = 0;
+	_persistent_ptr = nullptr;
+	_mapped = false;
+}
+
+void InstanceRing::waitRegion(uint32_t region)
+{
+	GLsync& fence = _fences[region];
+
+	if (fence == nullptr)
+		return;
+
+	GLenum status = glClientWaitSync(fence, 0, 0);
+
+	if (status == GL_TIMEOUT_EXPIRED) {
+		_stall_cnt++;
+
+		THR_LOG_DEBUG("Instance buffer region {} still in use by GPU, waiting ({} stalls so far)",
+					  region, _stall_cnt);
+
+		// flush on the first wait, so the fence is guaranteed to signal
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+
+		do {
+			status = glClientWaitSync(fence, flags, _FenceWaitNs);
+			flags = 0;
+		} while (status == GL_TIMEOUT_EXPIRED);
+	}
+
+	if (status == GL_WAIT_FAILED)
+		THR_LOG_ERROR("Waiting for instance buffer region {} failed", region);
+
+	glDeleteSync(fence);
+	fence = nullptr;
+}
+
+byte* InstanceRing::beginWrite()
+{
+	THR_ASSERT(_buf_id != 0 && !_mapped);
+
+	/* Current region moves on only once the next one is mapped -
+	*  on failure the frame keeps drawing the region its fence guards
+	*/
+	const uint32_t region = (_region + 1) % RegionCount;
+	waitRegion(region);
+
+	const size_t region_bytes = _capacity * _stride;
+
+	if (_persistent) {
+		_region = region;
+		return _persistent_ptr + region * region_bytes;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, _buf_id);
+
+	byte* ptr = static_cast<byte*>(glMapBufferRange(GL_ARRAY_BUFFER,
+													static_cast<GLintptr>(region * region_bytes),
+													static_cast<GLsizeiptr>(region_bytes),
+													GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+
+	if (ptr == nullptr) {
+		THR_LOG_ERROR("Failed to map instance buffer region {}", region);
+		return nullptr;
+	}
+
+	_region = region;
+	_mapped = true;
+	return ptr;
+}
+
+void InstanceRing::endWrite()
+{
+	if (!_mapped)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _buf_id);
+
+	if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE)
+		THR_LOG_ERROR("Instance buffer region {} got corrupted while mapped", _region);
+
+	_mapped = false;
+}
+
+void InstanceRing::fenceCurrent()
+{
+	GLsync& fence = _fences[_region];
+
+	// region drawn again, only the last draw matters
+	if (fence != nullptr)
+		glDeleteSync(fence);
+
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+uint32_t InstanceRing::getCurrentRegion() const
+{
+	return _region;
+}
+
+GLuint InstanceRing::getBaseInstance() const
+{
+	return static_cast<GLuint>(_region * _capacity);
+}
+
+GLuint InstanceRing::getBufferId() const
+{
+	return _buf_id;
+}
+
+size_t InstanceRing::getCapacity() const
+{
+	return _capacity;
+}
+
+bool InstanceRing::isPersistent() const
+{
+	return _persistent;
+}
+
+} // namespace Thr
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Common.hpp"
+
+namespace Thr
+{
+
+/* Instance buffer split into RegionCount regions used in round robin.
+*  CPU writes the next region while the GPU may still draw from the previous ones,
+*  every region is guarded by a fence inserted after the last draw reading it.
+*
+*  With buffer storage (GL 4.4 / ARB_buffer_storage) the whole buffer is mapped
+*  persistently and coherently once, so writes go straight into GPU visible memory.
+*  Otherwise the region is mapped unsynchronized for each write - the fence
+*  already guarantees the GPU is done with it.
+*/
+class InstanceRing
+{
+public:
+	static constexpr uint32_t RegionCount = 3;
+
+	InstanceRing();
+	~InstanceRing();
+
+	InstanceRing(const InstanceRing&) = delete;
+	InstanceRing& operator=(const InstanceRing&) = delete;
+
+	/* 'stride' - size of a single instance in bytes.
+	*/
+	void init(size_t stride);
+
+	/* Make every region hold at least 'instances' instances.
+	*  Returns true if the buffer was recreated - vertex attributes
+	*  have to be pointed to the new buffer and previous content is gone.
+	*/
+	bool reserve(size_t instances);
+
+	/* Switch to the next region, waiting until the GPU is done with it.
+	*  Returns memory of the whole region, nullptr on failure -
+	*  the current region is left as it was then.
+	*  Must be followed by 'endWrite' before drawing.
+	*/
+	byte* beginWrite();
+	void endWrite();
+
+	/* Guard the current region, call after the draw using it was issued.
+	*/
+	void fenceCurrent();
+
+	uint32_t getCurrentRegion() const;
+	// first instance of the current region, for base instance of the draw
+	GLuint getBaseInstance() const;
+	GLuint getBufferId() const;
+	size_t getCapacity() const;
+	bool isPersistent() const;
+private:
+	void destroyBuffer();
+	void waitRegion(uint32_t region);
+
+	// single wait step, waiting is repeated until the fence signals
+	static constexpr GLuint64 _FenceWaitNs = 1000000;
+
+	GLuint					 _buf_id;
+	size_t					 _stride;
+	size_t					 _capacity;
+	byte*					 _persistent_ptr;
+	Arr<GLsync, RegionCount> _fences;
+	uint32_t				 _region;
+	bool					 _persistent;
+	bool					 _mapped;
+	size_t					 _stall_cnt;
+};
+
+} // namespace Thr
@@ -0,0 +1,236 @@
+#include "ProgramCache.hpp"
+#include "Utils.hpp"
+#include "logger/Log.hpp"
+#include "filesys/MappedFile.hpp"
+#include "filesys/WriteFile.hpp"
+#include "memory/Hash.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+ProgramCache::ProgramCache()
+	: _path(UndefFilePath)
+	, _driver_hash(0)
+	, _programs()
+	, _enabled(false)
+	, _dirty(false)
+{}
+
+bool ProgramCache::isSupported()
+{
+	if (!GLAD_GL_VERSION_4_1 && !hasGlExtension("GL_ARB_get_program_binary"))
+		return false;
+
+	GLint format_cnt = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, std::addressof(format_cnt));
+
+	return format_cnt > 0;
+}
+
+uint64_t ProgramCache::hashDriver()
+{
+	uint64_t hash = FnvOffsetBasis;
+
+	for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION }) {
+		const char* str = reinterpret_cast<const char*>(glGetString(name));
+		const std::string_view view = str != nullptr ? std::string_view(str) : std::string_view();
+
+		hash = hashBytes(view.data(), view.size(), hash);
+	}
+
+	return hash;
+}
+
+void ProgramCache::open(const FilePath& path)
+{
+	_path = path;
+	_programs.clear();
+	_dirty = false;
+	_enabled = path.isValid() && isSupported();
+
+	if (!_enabled) {
+		THR_LOG_DEBUG("Program binaries are not cached");
+		return;
+	}
+
+	_driver_hash = hashDriver();
+
+	MappedFile mapping;
+
+	if (!mapping.open(path)) {
+		THR_LOG_DEBUG("No program cache in {}", path.toStr());
+		return;
+	}
+
+	const byte* const data = mapping.getData();
+	const size_t size = mapping.getSize();
+
+	ProgramCacheHeader header;
+
+	if (size < sizeof(header)) {
+		THR_LOG_ERROR("Program cache file {} is truncated", path.toStr());
+		return;
+	}
+
+	memCpy(&header, data, sizeof(header));
+
+	if (header.magic != _Magic || header.byte_order != _ByteOrder || header.version != _Version) {
+		THR_LOG_ERROR("File {} is not a program cache of this version", path.toStr());
+		return;
+	}
+
+	if (header.driver_hash != _driver_hash) {
+		THR_LOG_DEBUG("Program cache in {} was made by another driver", path.toStr());
+		return;
+	}
+
+	const bool valid_layout =
+		header.file_size == size &&
+		header.programs_offset % alignof(ProgramCacheEntry) == 0 &&
+		header.programs_offset <= size &&
+		header.program_cnt <= (size - header.programs_offset) / sizeof(ProgramCacheEntry);
+
+	if (!valid_layout) {
+		THR_LOG_ERROR("Program cache file {} is corrupted", path.toStr());
+		return;
+	}
+
+	const ProgramCacheEntry* const entries = reinterpret_cast<const ProgramCacheEntry*>(data + header.programs_offset);
+	const uint64_t entries_end = header.programs_offset + header.program_cnt * sizeof(ProgramCacheEntry);
+
+	for (size_t i = 0; i < header.program_cnt; i++) {
+		const ProgramCacheEntry& entry = entries[i];
+
+		if (entry.offset < entries_end || entry.offset > size || entry.size > size - entry.offset || entry.size == 0) {
+			THR_LOG_ERROR("Program cache file {} is corrupted", path.toStr());
+			_programs.clear();
+			return;
+		}
+
+		const byte* const binary = data + entry.offset;
+		_programs[entry.source_hash] = CachedProgram{ entry.format, Vec<byte>(binary, binary + entry.size), false };
+	}
+
+	THR_LOG_DEBUG("Program cache opened: {} programs", _programs.size());
+}
+
+bool ProgramCache::load(GLShader& prog, uint64_t source_hash)
+{
+	if (!_enabled)
+		return false;
+
+	const auto it = _programs.find(source_hash);
+
+	if (it == _programs.end())
+		return false;
+
+	CachedProgram& cached = it->second;
+
+	if (!prog.linkBinary(cached.format, cached.binary.data(), cached.binary.size())) {
+		// outdated binary is replaced once the program is linked from sources
+		_programs.erase(it);
+		_dirty = true;
+		return false;
+	}
+
+	cached.used = true;
+	return true;
+}
+
+void ProgramCache::store(const GLShader& prog, uint64_t source_hash)
+{
+	if (!_enabled)
+		return;
+
+	CachedProgram cached = { 0, Vec<byte>(), true };
+
+	if (!prog.getBinary(cached.format, cached.binary)) {
+		THR_LOG_DEBUG("Binary of shader program {} is not available", prog.getID());
+		return;
+	}
+
+	_programs[source_hash] = std::move(cached);
+	_dirty = true;
+}
+
+bool ProgramCache::save()
+{
+	if (!_enabled)
+		return false;
+
+	size_t used_cnt = 0;
+
+	for (const auto& [hash, cached] : _programs)
+		used_cnt += cached.used;
+
+	// nothing new and nothing to drop
+	if (!_dirty && used_cnt == _programs.size())
+		return true;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	ProgramCacheHeader header = {};
+	header.magic = _Magic;
+	header.version = _Version;
+	header.byte_order = _ByteOrder;
+	header.driver_hash = _driver_hash;
+	header.program_cnt = used_cnt;
+	header.programs_offset = alignUp(sizeof(ProgramCacheHeader), _SectionAlignment);
+
+	Vec<ProgramCacheEntry> entries;
+	Vec<const CachedProgram*> programs;
+
+	entries.reserve(used_cnt);
+	programs.reserve(used_cnt);
+
+	uint64_t offset = header.programs_offset + used_cnt * sizeof(ProgramCacheEntry);
+
+	for (const auto& [hash, cached] : _programs) {
+		if (!cached.used)
+			continue;
+
+		offset = alignUp(offset, _SectionAlignment);
+		entries.push_back(ProgramCacheEntry{ hash, cached.format, 0, offset, cached.binary.size() });
+		programs.push_back(std::addressof(cached));
+		offset += cached.binary.size();
+	}
+
+	header.file_size = offset;
+
+	const bool ok = writeFileAtomic(_path, [&](WriteFile& file) {
+		bool ok = file.write(&header, sizeof(header)) &&
+				  file.padTo(header.programs_offset) &&
+				  file.write(entries.data(), entries.size() * sizeof(ProgramCacheEntry));
+
+		for (size_t i = 0; i < entries.size() && ok; i++) {
+			ok = file.padTo(entries[i].offset) &&
+				 file.write(programs[i]->binary.data(), entries[i].size);
+		}
+
+		return ok;
+	});
+
+	if (!ok) {
+		THR_LOG_ERROR("Failed to save program cache into {}", _path.toStr());
+		return false;
+	}
+
+	for (auto it = _programs.begin(); it != _programs.end(); ) {
+		if (!it->second.used)
+			it = _programs.erase(it);
+		else ++it;
+	}
+
+	_dirty = false;
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Program cache saved: {} programs, {} KB in {} ms",
+				  header.program_cnt, header.file_size / 1024, elapsed.count());
+
+	return true;
+}
+
+} // namespace Thr
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Shader.hpp"
+#include <unordered_map>
+
+namespace Thr
+{
+
+/* Program cache layout, binaries follow the entry table:
+*
+*  ProgramCacheHeader | ProgramCacheEntry[program_cnt] | byte[...]
+*
+*  Binaries are valid only for the driver that produced them - the whole
+*  cache is dropped once vendor, renderer or version string changes.
+*  Programs are keyed by the hash of their sources. The format is native-endian.
+*/
+struct ProgramCacheHeader
+{
+	Arr<char, 8> magic;
+	uint32_t     version;
+	uint32_t     byte_order;
+	uint64_t     driver_hash;
+	uint64_t     program_cnt;
+	uint64_t     programs_offset;
+	uint64_t     file_size;
+};
+
+struct ProgramCacheEntry
+{
+	uint64_t source_hash;
+	uint32_t format;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+/* Linked shader programs kept between runs as driver binaries
+*  (glGetProgramBinary/glProgramBinary), so starting up doesn't
+*  compile and link them again.
+*/
+class ProgramCache
+{
+public:
+	ProgramCache();
+
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+
+	/* Load binaries cached in 'path'. Without program binary support
+	*  of the driver the cache stays disabled and programs are always built
+	*  from sources.
+	*/
+	void open(const FilePath& path);
+
+	/* Link 'prog' from the binary cached for 'source_hash'.
+	*/
+	bool load(GLShader& prog, uint64_t source_hash);
+
+	/* Remember binary of freshly linked 'prog',
+	*  setBinaryRetrievable() has to be called before it was linked.
+	*/
+	void store(const GLShader& prog, uint64_t source_hash);
+
+	/* Write programs loaded or stored since open() back into the file,
+	*  replacing it atomically. Binaries left unused are dropped.
+	*/
+	bool save();
+
+	THR_NODISCARD THR_INLINE bool isEnabled() const;
+private:
+	struct CachedProgram
+	{
+		GLenum	  format;
+		Vec<byte> binary;
+		bool	  used;
+	};
+
+	static bool isSupported();
+	static uint64_t hashDriver();
+
+	static constexpr Arr<char, 8> _Magic = { 'T', 'H', 'R', 'P', 'R', 'O', 'G', 'S' };
+	static constexpr uint32_t     _Version = 1;
+	static constexpr uint32_t     _ByteOrder = 0x01020304;
+	static constexpr size_t       _SectionAlignment = 64;
+
+	FilePath										 _path;
+	uint64_t										 _driver_hash;
+	std::unordered_map<uint64_t, CachedProgram>		 _programs;
+	bool											 _enabled;
+	bool											 _dirty;
+};
+
+THR_INLINE bool ProgramCache::isEnabled() const { return _enabled; }
+
+} // namespace Thr
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Common.hpp"
+#include "RenderFormat.hpp"
+#include "FrameTimer.hpp"
+#include "col/Color.hpp"
+#include "screen/Grid.hpp"
+#include "filesys/Filepath.hpp"
+#include <chrono>
+#include <functional>
+
+namespace Thr
+{
+
+/* Rendering frame data
+*/
+struct RenderFramePacket
+{
+	const ScreenSnapshot* snapshot;
+};
+
+/* Draws snapshots of the screen into the bound framebuffer. Implemented by
+*  TextRender on the GPU and by SoftRender on the CPU, for hosts where GL is
+*  slow software emulation. See TextRender for the contract of the methods.
+*/
+class Renderer
+{
+public:
+	virtual ~Renderer() = default;
+
+	virtual void init(const RenderFormat& fmt, const FilePath& glyph_cache = UndefFilePath,
+					  const FilePath& shader_cache = UndefFilePath) = 0;
+	virtual void getRenderFormat(RenderFormat& fmt) = 0;
+	virtual void saveGlyphCache() = 0;
+	virtual void resize(const RenderFormat& fmt) = 0;
+
+	virtual void submitCurrFrame(const RenderFramePacket& packet) = 0;
+	virtual bool hasNewGlyphs() const = 0;
+	virtual bool hasPendingGlyphs() const = 0;
+	virtual void setGlyphReadyCallback(std::function<void()> callback) = 0;
+	virtual size_t getUploadedRowCount() const = 0;
+	virtual uint getAtlasPageCount() const = 0;
+
+	virtual void submitHighlights(const ScreenSnapshot& snapshot, const Vec<SearchMatch>& matches) = 0;
+
+	/* Lines drawn right aligned over the top rows of the screen, above everything
+	*  else. Empty 'lines' remove the overlay.
+	*/
+	virtual void submitOverlay(const Vec<std::string>& lines) = 0;
+	virtual void renderText() = 0;
+	virtual void clearScreen(Color4f col) = 0;
+
+	/* Cursor is drawn by its own tiny draw over the text, submitted frames and
+	*  their instances are left intact. Any change restarts blinking with the
+	*  cursor shown.
+	*/
+	void submitCursor(const SnapshotCursor& cursor)
+	{
+		if (isSameCursor(cursor, _cursor))
+			return;
+
+		_cursor = cursor;
+		_blink_origin = Clock::now();
+	}
+
+	/* Time the blinking cursor is shown or hidden next - the frame
+	*  has to be drawn again then. Never, when the cursor doesn't blink.
+	*/
+	std::chrono::steady_clock::time_point getNextCursorEdge() const
+	{
+		if (!_cursor.visible || !_cursor.blink)
+			return Clock::time_point::max();
+
+		const auto phases = (Clock::now() - _blink_origin) / CursorBlinkInterval;
+		return _blink_origin + (phases + 1) * CursorBlinkInterval;
+	}
+
+	// cursor is shown, then hidden, for the same time
+	static constexpr std::chrono::milliseconds CursorBlinkInterval{ 500 };
+
+	/* Pack, upload and draw phases are measured by 'timer', none by default.
+	*/
+	void setFrameTimer(FrameTimer* timer)
+	{
+		_timer = timer;
+	}
+protected:
+	using Clock = std::chrono::steady_clock;
+
+	/* Time into the current blink period, shown during the first interval of it
+	*/
+	Clock::duration getCursorBlinkTime() const
+	{
+		return _cursor.blink ? (Clock::now() - _blink_origin) % (2 * CursorBlinkInterval)
+							 : Clock::duration::zero();
+	}
+
+	bool isCursorShown() const
+	{
+		return _cursor.visible && getCursorBlinkTime() < CursorBlinkInterval;
+	}
+
+	void beginPhase(FramePhase phase)
+	{
+		if (_timer != nullptr)
+			_timer->beginPhase(phase);
+	}
+
+	void endPhase(FramePhase phase)
+	{
+		if (_timer != nullptr)
+			_timer->endPhase(phase);
+	}
+
+	FrameTimer*       _timer = nullptr;
+	SnapshotCursor    _cursor;
+	Clock::time_point _blink_origin;
+};
+
+} // namespace Thr
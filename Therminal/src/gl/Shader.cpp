@@ -124,6 +124,12 @@ THR_INLINE void GLShaderStage::init()
 	THR_HARD_ASSERT_LOG(glIsShader(_id) == GL_TRUE, "Failed to create shader stage");
 }
 
+GLShader::GLShader()
+	: _id(0)
+	, _linked(false)
+	, _uniforms()
+{}
+
 GLShader::~GLShader()
 {
 	if (_id != 0 && glIsProgram(_id) == GL_TRUE) {
@@ -134,7 +140,10 @@ GLShader::~GLShader()
 GLShader::GLShader(GLShader&& shader)
 {
 	_id = shader._id;
+	_linked = shader._linked;
+	_uniforms = std::move(shader._uniforms);
 	shader._id = 0;
+	shader._linked = false;
 }
 
 void GLShader::init()
@@ -172,8 +181,113 @@ void GLShader::linkProgram()
 
 	if (err != GL_NO_ERROR) {
 		THR_LOG_ERROR("Failed to link shader program of id: {}", _id);
+		return;
 	} 
-	else _linked = true;
+
+	_linked = true;
+	resolveUniforms();
+}
+
+bool GLShader::linkBinary(GLenum format, const void* data, size_t size)
+{
+	THR_HARD_ASSERT(_id != 0 && glIsProgram(_id) == GL_TRUE);
+	glProgramBinary(_id, format, data, static_cast<GLsizei>(size));
+
+	GLint status = 0;
+	glGetProgramiv(_id, GL_LINK_STATUS, std::addressof(status));
+
+	// rejected binary may leave an error behind, it's not fatal
+	while (glGetError() != GL_NO_ERROR);
+
+	if (!status) {
+		THR_LOG_DEBUG("Program binary of shader {} rejected by the driver", _id);
+		return false;
+	}
+
+	_linked = true;
+	resolveUniforms();
+
+	return true;
+}
+
+bool GLShader::getBinary(GLenum& format, Vec<byte>& binary) const
+{
+	THR_HARD_ASSERT(_id != 0 && glIsProgram(_id) == GL_TRUE);
+
+	if (!_linked)
+		return false;
+
+	GLint len = 0;
+	glGetProgramiv(_id, GL_PROGRAM_BINARY_LENGTH, std::addressof(len));
+
+	if (len <= 0)
+		return false;
+
+	binary.resize(static_cast<size_t>(len));
+
+	GLsizei written = 0;
+	glGetProgramBinary(_id, len, std::addressof(written), std::addressof(format), binary.data());
+
+	const GLenum err = pollGlErrors([&](GLenum err) {
+		THR_LOG_ERROR("Failed to get binary of shader program of id: {}", _id);
+		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
+	});
+
+	if (err != GL_NO_ERROR || written <= 0)
+		return false;
+
+	binary.resize(static_cast<size_t>(written));
+	return true;
+}
+
+void GLShader::setBinaryRetrievable() const
+{
+	THR_HARD_ASSERT(_id != 0 && glIsProgram(_id) == GL_TRUE);
+	glProgramParameteri(_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void GLShader::resolveUniforms()
+{
+	_uniforms.clear();
+
+	GLint count = 0, max_len = 0;
+	glGetProgramiv(_id, GL_ACTIVE_UNIFORMS, std::addressof(count));
+	glGetProgramiv(_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, std::addressof(max_len));
+
+	std::string name(static_cast<size_t>(std::max(max_len, 1)), '\0');
+
+	for (GLint i = 0; i < count; i++) {
+		GLsizei len = 0;
+		GLint size = 0;
+		GLenum type = 0;
+
+		glGetActiveUniform(_id, static_cast<GLuint>(i), max_len, std::addressof(len),
+						   std::addressof(size), std::addressof(type), name.data());
+
+		const GLint location = glGetUniformLocation(_id, name.c_str());
+
+		// members of uniform blocks have no location
+		if (location < 0)
+			continue;
+
+		std::string_view base(name.data(), static_cast<size_t>(len));
+
+		// arrays are reported as 'name[0]', they're set through the base name
+		if (base.size() > 3 && base.substr(base.size() - 3) == "[0]")
+			base.remove_suffix(3);
+
+		_uniforms.push_back(UniformLocation{ std::string(base), location });
+	}
+}
+
+GLint GLShader::getUniformLocation(std::string_view name) const
+{
+	for (const UniformLocation& uniform : _uniforms) {
+		if (uniform.name == name)
+			return uniform.location;
+	}
+
+	return -1;
 }
 
 void GLShader::useProgram() const 
@@ -217,171 +331,187 @@ void GLShader::attachStage(const GLShaderStage& stage) const
 }
 
 template <typename T>
-void GLShader::setUniform1(std::string_view name, 
+void GLShader::setUniform1(GLint location,
 						   const T val) const
 {
 	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
 					   is_same_v<T, GLuint> ||
 					   is_same_v<T, GLfloat>));
 
-	const GLint l = glGetUniformLocation(_id, name.data());
-
-	if (l >= 0) {
-		if constexpr (is_same_v<T, GLint>) {
-			glUniform1i(l, val);
-		}
-		else if constexpr (is_same_v<T, GLuint>) {
-			glUniform1ui(l, val);
-		}
-		else if constexpr (is_same_v<T, GLfloat>) {
-			glUniform1f(l, val);
-		}
+	if (location < 0)
+		return;
+
+	if constexpr (is_same_v<T, GLint>) {
+		glUniform1i(location, val);
+	}
+	else if constexpr (is_same_v<T, GLuint>) {
+		glUniform1ui(location, val);
+	}
+	else if constexpr (is_same_v<T, GLfloat>) {
+		glUniform1f(location, val);
 	}
 
 	pollGlErrors([&](GLenum err) {
-		THR_LOG_ERROR("Failed to set uniform: {}", name);
+		THR_LOG_ERROR("Failed to set uniform at location: {}", location);
 		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
 	});
 }
 
 template <typename T>
-void GLShader::setUniform1(std::string_view name,
-						   const T* ptr) const
+void GLShader::setUniform2(GLint location,
+						   const T val0, const T val1) const
 {
 	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
 					   is_same_v<T, GLuint> ||
 					   is_same_v<T, GLfloat>));
 
-	THR_HARD_ASSERT(ptr != nullptr);
+	if (location < 0)
+		return;
 
-	setUniform1(name, ptr[0]);
+	if constexpr (is_same_v<T, GLint>) {
+		glUniform2i(location, val0, val1);
+	}
+	else if constexpr (is_same_v<T, GLuint>) {
+		glUniform2ui(location, val0, val1);
+	}
+	else if constexpr (is_same_v<T, GLfloat>) {
+		glUniform2f(location, val0, val1);
+	}
+
+	pollGlErrors([&](GLenum err) {
+		THR_LOG_ERROR("Failed to set uniform at location: {}", location);
+		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
+	});
 }
 
 template <typename T>
-void GLShader::setUniform2(std::string_view name, 
-						   const T val0, const T val1) const
+void GLShader::setUniform3(GLint location,
+						   const T val0, const T val1, const T val2) const
 {
 	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
 					   is_same_v<T, GLuint> ||
 					   is_same_v<T, GLfloat>));
 
-	const GLint l = glGetUniformLocation(_id, name.data());
-
-	if (l >= 0) {
-		if constexpr (is_same_v<T, int>) {
-			glUniform2i(l, val0, val1);
-		}
-		else if constexpr (is_same_v<T, uint>) {
-			glUniform2ui(l, val0, val1);
-		}
-		else if constexpr (is_same_v<T, float>) {
-			glUniform2f(l, val0, val1);
-		}
+	if (location < 0)
+		return;
+
+	if constexpr (is_same_v<T, GLint>) {
+		glUniform3i(location, val0, val1, val2);
+	}
+	else if constexpr (is_same_v<T, GLuint>) {
+		glUniform3ui(location, val0, val1, val2);
+	}
+	else if constexpr (is_same_v<T, GLfloat>) {
+		glUniform3f(location, val0, val1, val2);
 	}
 
 	pollGlErrors([&](GLenum err) {
-		THR_LOG_ERROR("Failed to set uniform: {}", name);
+		THR_LOG_ERROR("Failed to set uniform at location: {}", location);
 		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
 	});
 }
 
 template <typename T>
-void GLShader::setUniform2(std::string_view name,
-						   const T* ptr) const
+void GLShader::setUniform4(GLint location,
+						   const T val0, const T val1, const T val2, const T val3) const
 {
 	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
 					   is_same_v<T, GLuint> ||
 					   is_same_v<T, GLfloat>));
 
+	if (location < 0)
+		return;
+
+	if constexpr (is_same_v<T, GLint>) {
+		glUniform4i(location, val0, val1, val2, val3);
+	}
+	else if constexpr (is_same_v<T, GLuint>) {
+		glUniform4ui(location, val0, val1, val2, val3);
+	}
+	else if constexpr (is_same_v<T, GLfloat>) {
+		glUniform4f(location, val0, val1, val2, val3);
+	}
+
+	pollGlErrors([&](GLenum err) {
+		THR_LOG_ERROR("Failed to set uniform at location: {}", location);
+		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
+	});
+}
+
+template <typename T>
+void GLShader::setUniform1(std::string_view name, 
+						   const T val) const
+{
+	setUniform1(getUniformLocation(name), val);
+}
+
+template <typename T>
+void GLShader::setUniform1(std::string_view name,
+						   const T* ptr) const
+{
 	THR_HARD_ASSERT(ptr != nullptr);
+	setUniform1(getUniformLocation(name), ptr[0]);
+}
 
-	setUniform1(name, ptr[0], ptr[1]);
+template <typename T>
+void GLShader::setUniform2(std::string_view name, 
+						   const T val0, const T val1) const
+{
+	setUniform2(getUniformLocation(name), val0, val1);
+}
+
+template <typename T>
+void GLShader::setUniform2(std::string_view name,
+						   const T* ptr) const
+{
+	THR_HARD_ASSERT(ptr != nullptr);
+	setUniform2(getUniformLocation(name), ptr[0], ptr[1]);
 }
 
 template <typename T>
 void GLShader::setUniform3(std::string_view name,
 						   const T val0, const T val1, const T val2) const
 {
-	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
-					   is_same_v<T, GLuint> ||
-					   is_same_v<T, GLfloat>));
-
-	const GLint l = glGetUniformLocation(_id, name.data());
-
-	if (l >= 0) {
-		if constexpr (is_same_v<T, int>) {
-			glUniform3i(l, val0, val1, val2);
-		}
-		else if constexpr (is_same_v<T, uint>) {
-			glUniform3ui(l, val0, val1, val2);
-		}
-		else if constexpr (is_same_v<T, float>) {
-			glUniform3f(l, val0, val1, val2);
-		}
-	}
-
-	pollGlErrors([&](GLenum err) {
-		THR_LOG_ERROR("Failed to set uniform: {}", name);
-		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
-	});
+	setUniform3(getUniformLocation(name), val0, val1, val2);
 }
 
 template <typename T>
 void GLShader::setUniform3(std::string_view name,
 						   const T* ptr) const
 {
-	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
-					   is_same_v<T, GLuint> ||
-					   is_same_v<T, GLfloat>));
-
 	THR_HARD_ASSERT(ptr != nullptr);
-
-	setUniform1(name, ptr[0], ptr[1], ptr[2]);
+	setUniform3(getUniformLocation(name), ptr[0], ptr[1], ptr[2]);
 }
 
 template <typename T>
 void GLShader::setUniform4(std::string_view name,
 						   const T val0, const T val1, const T val2, const T val3) const
 {
-	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
-					   is_same_v<T, GLuint> ||
-					   is_same_v<T, GLfloat>));
-
-	const GLint l = glGetUniformLocation(_id, name.data());
-
-	if (l >= 0) {
-		if constexpr (is_same_v<T, int>) {
-			glUniform4i(l, val0, val1, val2, val3);
-		}
-		else if constexpr (is_same_v<T, uint>) {
-			glUniform4ui(l, val0, val1, val2, val3);
-		}
-		else if constexpr (is_same_v<T, float>) {
-			glUniform4f(l, val0, val1, val2, val3);
-		}
-	}
-
-	pollGlErrors([&](GLenum err) {
-		THR_LOG_ERROR("Failed to set uniform: {}", name);
-		THR_LOG_ERROR("Error: {}", getGlErrorStr(err));
-	});
+	setUniform4(getUniformLocation(name), val0, val1, val2, val3);
 }
 
 template <typename T>
 void GLShader::setUniform4(std::string_view name,
 						   const T* ptr) const
 {
-	THR_STATIC_ASSERT((is_same_v<T, GLint> ||
-					   is_same_v<T, GLuint> ||
-					   is_same_v<T, GLfloat>));
-
 	THR_HARD_ASSERT(ptr != nullptr);
-
-	setUniform1(name,
-			    ptr[0], ptr[1],
-			    ptr[2], ptr[3]);
+	setUniform4(getUniformLocation(name),
+				ptr[0], ptr[1],
+				ptr[2], ptr[3]);
 }
 
+template void GLShader::setUniform1<GLint>(GLint, const GLint) const;
+template void GLShader::setUniform1<GLuint>(GLint, const GLuint) const;
+template void GLShader::setUniform1<GLfloat>(GLint, const GLfloat) const;
+template void GLShader::setUniform2<GLint>(GLint, const GLint, const GLint) const;
+template void GLShader::setUniform2<GLuint>(GLint, const GLuint, const GLuint) const;
+template void GLShader::setUniform2<GLfloat>(GLint, const GLfloat, const GLfloat) const;
+template void GLShader::setUniform3<GLint>(GLint, const GLint, const GLint, const GLint) const;
+template void GLShader::setUniform3<GLuint>(GLint, const GLuint, const GLuint, const GLuint) const;
+template void GLShader::setUniform3<GLfloat>(GLint, const GLfloat, const GLfloat, const GLfloat) const;
+template void GLShader::setUniform4<GLint>(GLint, const GLint, const GLint, const GLint, const GLint) const;
+template void GLShader::setUniform4<GLuint>(GLint, const GLuint, const GLuint, const GLuint, const GLuint) const;
+template void GLShader::setUniform4<GLfloat>(GLint, const GLfloat, const GLfloat, const GLfloat, const GLfloat) const;
 template void GLShader::setUniform1<GLint>(std::string_view, const GLint) const;
 template void GLShader::setUniform1<GLuint>(std::string_view, const GLuint) const;
 template void GLShader::setUniform1<GLfloat>(std::string_view, const GLfloat) const;
@@ -394,5 +524,17 @@ template void GLShader::setUniform3<GLfloat>(std::string_view, const GLfloat, co
 template void GLShader::setUniform4<GLint>(std::string_view, const GLint, const GLint, const GLint, const GLint) const;
 template void GLShader::setUniform4<GLuint>(std::string_view, const GLuint, const GLuint, const GLuint, const GLuint) const;
 template void GLShader::setUniform4<GLfloat>(std::string_view, const GLfloat, const GLfloat, const GLfloat, const GLfloat) const;
+template void GLShader::setUniform1<GLint>(std::string_view, const GLint*) const;
+template void GLShader::setUniform1<GLuint>(std::string_view, const GLuint*) const;
+template void GLShader::setUniform1<GLfloat>(std::string_view, const GLfloat*) const;
+template void GLShader::setUniform2<GLint>(std::string_view, const GLint*) const;
+template void GLShader::setUniform2<GLuint>(std::string_view, const GLuint*) const;
+template void GLShader::setUniform2<GLfloat>(std::string_view, const GLfloat*) const;
+template void GLShader::setUniform3<GLint>(std::string_view, const GLint*) const;
+template void GLShader::setUniform3<GLuint>(std::string_view, const GLuint*) const;
+template void GLShader::setUniform3<GLfloat>(std::string_view, const GLfloat*) const;
+template void GLShader::setUniform4<GLint>(std::string_view, const GLint*) const;
+template void GLShader::setUniform4<GLuint>(std::string_view, const GLuint*) const;
+template void GLShader::setUniform4<GLfloat>(std::string_view, const GLfloat*) const;
 
 } // namespace Thr
@@ -47,7 +47,7 @@ private:
 class GLShader
 {
 public:
-	GLShader() = default;
+	GLShader();
 	~GLShader();
 	GLShader(const GLShader&) = delete;
 	GLShader(GLShader&& shader);
@@ -58,10 +58,43 @@ public:
 	GLShader operator=(GLShader&&) = delete;
 
 	void linkProgram();
+
+	/* Link from a binary previously returned by getBinary(). Fails quietly -
+	*  binaries are rejected by a driver update, the program can still be linked
+	*  from the attached stages then.
+	*/
+	bool linkBinary(GLenum format, const void* data, size_t size);
+
+	/* Binary of the linked program. Available only if setBinaryRetrievable()
+	*  was called before linking.
+	*/
+	bool getBinary(GLenum& format, Vec<byte>& binary) const;
+	void setBinaryRetrievable() const;
+
+	/* Location resolved at link time, -1 if the program has no such active uniform.
+	*/
+	THR_NODISCARD GLint getUniformLocation(std::string_view name) const;
+
 	void useProgram() const;
 	void unuseProgram() const;
 	void attachStage(const GLShaderStage& stage) const;
 
+	template <typename T>
+	void setUniform1(GLint location,
+					 const T val) const;
+
+	template <typename T>
+	void setUniform2(GLint location,
+					 const T val0, const T val1) const;
+
+	template <typename T>
+	void setUniform3(GLint location,
+					 const T val0, const T val1, const T val2) const;
+
+	template <typename T>
+	void setUniform4(GLint location,
+					 const T val0, const T val1, const T val2, const T val3) const;
+
 	template <typename T>
 	void setUniform1(std::string_view name, 
 					 const T val) const;
@@ -97,8 +130,18 @@ public:
 	THR_NODISCARD THR_INLINE GLuint getID() const;
 	THR_NODISCARD THR_INLINE GLuint isLinked() const;
 private:
-	GLuint _id;
-	bool   _linked;
+	struct UniformLocation
+	{
+		std::string name;
+		GLint		location;
+	};
+
+	void resolveUniforms();
+
+	GLuint				 _id;
+	bool				 _linked;
+	// few uniforms per program, searched linearly
+	Vec<UniformLocation> _uniforms;
 };
 
 THR_INLINE GLuint GLShaderStage::getID() const { return _id; }
@@ -0,0 +1,1026 @@
+#include "SoftRender.hpp"
+#include "logger/Log.hpp"
+#include "Utils.hpp"
+#include "memory/Simd.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace Thr
+{
+
+#if !defined(THR_FORCE_PURE) && (defined(THR_SIMD_AVX512) || defined(THR_SIMD_AVX2))
+#	define THR_SOFT_AVX2
+#elif !defined(THR_FORCE_PURE) && (defined(THR_SIMD_AVX)    || \
+								   defined(THR_SIMD_SSE4_2) || \
+								   defined(THR_SIMD_SSE4_1) || \
+								   defined(THR_SIMD_SSSE3)  || \
+								   defined(THR_SIMD_SSE3)   || \
+								   defined(THR_SIMD_SSE2))
+#	define THR_SOFT_SSE2
+#endif
+
+static constexpr uint32_t NoCell = static_cast<uint32_t>(-1);
+static constexpr uint32_t OpaqueAlpha = 0xFF000000;
+
+THR_FORCEINLINE uint32_t packColor(Color3u8 c)
+{
+	return static_cast<uint32_t>(c.r) | (static_cast<uint32_t>(c.g) << 8) | (static_cast<uint32_t>(c.b) << 16);
+}
+
+/* Rounded x / 255 for x <= 255 * 255
+*/
+THR_FORCEINLINE uint32_t div255(uint32_t x)
+{
+	x += 128;
+	return (x + (x >> 8)) >> 8;
+}
+
+THR_FORCEINLINE uint32_t blendPixel(uint32_t dst, uint32_t src, uint32_t alpha)
+{
+	const uint32_t inv = 255 - alpha;
+	uint32_t out = OpaqueAlpha;
+
+	for (uint shift = 0; shift < 24; shift += 8) {
+		const uint32_t c = ((dst >> shift) & 0xFF) * inv + ((src >> shift) & 0xFF) * alpha;
+		out |= div255(c) << shift;
+	}
+
+	return out;
+}
+
+#if defined(THR_SOFT_AVX2)
+
+/* 16-bit channels, same rounding as div255
+*/
+THR_FORCEINLINE __m256i blendChannels(__m256i dst, __m256i src, __m256i alpha)
+{
+	const __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(dst, inv), _mm256_mullo_epi16(src, alpha));
+	t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+#elif defined(THR_SOFT_SSE2)
+
+THR_FORCEINLINE __m128i blendChannels(__m128i dst, __m128i src, __m128i alpha)
+{
+	const __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(dst, inv), _mm_mullo_epi16(src, alpha));
+	t = _mm_add_epi16(t, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+#endif
+
+/* Blend 'color' into 'n' pixels with coverage 'mask'. Glyph bitmaps are mostly
+*  empty or fully covered, those pixels are skipped or stored without blending.
+*/
+THR_INTERNAL void blendSpan(uint32_t* dst, const byte* mask, size_t n, uint32_t color)
+{
+	size_t i = 0;
+
+#if defined(THR_SOFT_AVX2)
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i src = _mm256_set1_epi32(static_cast<int>(color));
+	const __m256i src16 = _mm256_unpacklo_epi8(src, zero);
+
+	for (; i + 8 <= n; i += 8) {
+		uint64_t m;
+		std::memcpy(std::addressof(m), mask + i, sizeof(m));
+
+		if (m == 0)
+			continue;
+
+		__m256i* const p = reinterpret_cast<__m256i*>(dst + i);
+
+		if (m == ~uint64_t(0)) {
+			_mm256_storeu_si256(p, src);
+			continue;
+		}
+
+		// coverage of every pixel in all of its channels
+		const __m256i a = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(static_cast<long long>(m))),
+											 _mm256_set1_epi32(0x01010101));
+		const __m256i d = _mm256_loadu_si256(p);
+
+		const __m256i lo = blendChannels(_mm256_unpacklo_epi8(d, zero), src16, _mm256_unpacklo_epi8(a, zero));
+		const __m256i hi = blendChannels(_mm256_unpackhi_epi8(d, zero), src16, _mm256_unpackhi_epi8(a, zero));
+
+		_mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+	}
+#elif defined(THR_SOFT_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i src = _mm_set1_epi32(static_cast<int>(color));
+	const __m128i src16 = _mm_unpacklo_epi8(src, zero);
+
+	for (; i + 4 <= n; i += 4) {
+		uint32_t m;
+		std::memcpy(std::addressof(m), mask + i, sizeof(m));
+
+		if (m == 0)
+			continue;
+
+		__m128i* const p = reinterpret_cast<__m128i*>(dst + i);
+
+		if (m == ~uint32_t(0)) {
+			_mm_storeu_si128(p, src);
+			continue;
+		}
+
+		// coverage of every pixel in all of its channels
+		__m128i a = _mm_cvtsi32_si128(static_cast<int>(m));
+		a = _mm_unpacklo_epi8(a, a);
+		a = _mm_unpacklo_epi16(a, a);
+
+		const __m128i d = _mm_loadu_si128(p);
+
+		const __m128i lo = blendChannels(_mm_unpacklo_epi8(d, zero), src16, _mm_unpacklo_epi8(a, zero));
+		const __m128i hi = blendChannels(_mm_unpackhi_epi8(d, zero), src16, _mm_unpackhi_epi8(a, zero));
+
+		_mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+	}
+#endif
+
+	for (; i < n; i++) {
+		const uint32_t alpha = mask[i];
+
+		if (alpha == 0)
+			continue;
+
+		dst[i] = (alpha == 255) ? color : blendPixel(dst[i], color, alpha);
+	}
+}
+
+SoftRender::SoftRender()
+	: _atlas(DefaultAtlasWidth, DefaultAtlasHeight)
+	, _vao_id_ptr(nullptr)
+	, _fmt(0, 0, 0, 0, 0, 0)
+	, _cols(0)
+	, _rows(0)
+	, _width(0)
+	, _height(0)
+	, _row_stride(0)
+	, _col_stride(0)
+	, _cell_height(0)
+	, _band_cnt(0)
+	, _ring_height(0)
+	, _band_origin(0)
+	, _clear_color(OpaqueAlpha)
+	, _composed_bands(0)
+	, _fb_tex_id(0)
+	, _fb_read_id(0)
+	, _cursor_tex_id(0)
+	, _cursor_read_id(0)
+	, _cursor_stale(true)
+	, _stale(true)
+	, _initialized(false)
+{}
+
+SoftRender::~SoftRender()
+{
+	if (!_initialized)
+		return;
+
+	if (_fb_read_id != 0) {
+		glDeleteFramebuffers(1, std::addressof(_fb_read_id));
+	}
+
+	if (_fb_tex_id != 0) {
+		glDeleteTextures(1, std::addressof(_fb_tex_id));
+	}
+
+	if (_cursor_read_id != 0) {
+		glDeleteFramebuffers(1, std::addressof(_cursor_read_id));
+	}
+
+	if (_cursor_tex_id != 0) {
+		glDeleteTextures(1, std::addressof(_cursor_tex_id));
+	}
+
+	if (_vao_id_ptr != nullptr && glIsVertexArray(*_vao_id_ptr) == GL_TRUE) {
+		glDeleteVertexArrays(1, _vao_id_ptr.get());
+	}
+}
+
+void SoftRender::init(const RenderFormat& fmt, const FilePath& glyph_cache, THR_UNUSED const FilePath& shader_cache)
+{
+	if (_initialized) {
+		THR_LOG_ERROR("SoftRender subsystem is already initialized, can't initialize again");
+		return;
+	}
+
+	_fmt = fmt;
+
+	// the atlas keeps its GPU textures as well, only its page copy is drawn from
+	_vao_id_ptr = std::make_shared<GLuint>(0);
+	glGenVertexArrays(1, _vao_id_ptr.get());
+
+	_atlas.init(_vao_id_ptr, _fmt.getCellSize().y, FontAtlas::DefaultPrewarmRanges, glyph_cache);
+
+	glm::ivec2 res_cell_size;
+	_atlas.getGlyphPixSize(res_cell_size.x, res_cell_size.y);
+	_fmt.setCellSize(res_cell_size);
+
+	updateGridSize();
+
+	glGenTextures(1, std::addressof(_fb_tex_id));
+	glGenFramebuffers(1, std::addressof(_fb_read_id));
+	THR_HARD_ASSERT(_fb_tex_id != 0 && _fb_read_id != 0);
+
+	glGenTextures(1, std::addressof(_cursor_tex_id));
+	glGenFramebuffers(1, std::addressof(_cursor_read_id));
+	THR_HARD_ASSERT(_cursor_tex_id != 0 && _cursor_read_id != 0);
+
+	allocFramebuffer();
+
+	const GLenum err = pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during SoftRender initialization: {}", getGlErrorStr(err));
+	});
+
+	if (err == GL_NO_ERROR) {
+		THR_LOG_INFO("SoftRender subsystem initialization completed, {}x{} framebuffer in {} bands",
+					 _width, _height, _band_cnt);
+	}
+	else {
+		THR_LOG_ERROR("SoftRender subsystem initialization completed with errors");
+	}
+
+	_initialized = true;
+}
+
+void SoftRender::getRenderFormat(RenderFormat& fmt)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("Querying render format of unitialized SoftRender");
+		return;
+	}
+
+	fmt = _fmt;
+}
+
+void SoftRender::saveGlyphCache()
+{
+	if (!_initialized)
+		return;
+
+	_atlas.saveCache();
+}
+
+void SoftRender::resize(const RenderFormat& fmt)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("Resizing unitialized SoftRender");
+		return;
+	}
+
+	_fmt.setWindowSize(fmt.getWindowSize());
+	updateGridSize();
+
+	if (_frame_rows.size() > _rows)
+		_frame_rows.resize(_rows);
+
+	allocFramebuffer();
+
+	pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during SoftRender resize: {}", getGlErrorStr(err));
+	});
+}
+
+void SoftRender::updateGridSize()
+{
+	const glm::ivec2 window_size = _fmt.getWindowSize();
+	const glm::ivec2 cell_size = _fmt.getCellSize();
+	const glm::ivec2 cell_offset = _fmt.getCellOffset();
+
+	_cols = static_cast<uint>(std::max(_fmt.getCellCountVertical(), 0));
+	_rows = static_cast<uint>(std::max(_fmt.getCellCountHorizontal(), 0));
+	_width = std::max(window_size.x, 0);
+	_height = std::max(window_size.y, 0);
+	_col_stride = static_cast<uint>(cell_size.x + cell_offset.x);
+	_row_stride = static_cast<uint>(cell_size.y + cell_offset.y);
+	_cell_height = static_cast<uint>(cell_size.y);
+
+	THR_HARD_ASSERT(_col_stride > 0 && _row_stride > 0);
+
+	_band_cnt = (static_cast<uint>(_height) + _row_stride - 1) / _row_stride;
+	_ring_height = _band_cnt * _row_stride;
+}
+
+void SoftRender::allocFramebuffer()
+{
+	_pixels.assign(static_cast<size_t>(_width) * _ring_height, _clear_color);
+	_drawn.assign(_band_cnt, BandState{});
+	_highlights.assign(_band_cnt, BandHighlights{});
+	_slot_dirty.assign(_band_cnt, 0);
+	_band_origin = 0;
+	_stale = true;
+
+	if (_band_cnt == 0 || _width == 0)
+		return;
+
+	/* Texture of the same layout as the ring, every band a full row stride tall,
+	*  the part of the last band below the window is never presented
+	*/
+	glBindTexture(GL_TEXTURE_2D, _fb_tex_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+				 _width, static_cast<GLsizei>(_ring_height), 0,
+				 GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLint prev_read_id = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, std::addressof(prev_read_id));
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _fb_read_id);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _fb_tex_id, 0);
+
+	const GLenum status = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+		THR_LOG_ERROR("SoftRender framebuffer is incomplete, status: {}", status);
+
+	/* Cursor covers a single cell at most */
+	const glm::ivec2 cell_size = _fmt.getCellSize();
+
+	glBindTexture(GL_TEXTURE_2D, _cursor_tex_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8,
+				 cell_size.x, cell_size.y, 0,
+				 GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _cursor_read_id);
+	glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _cursor_tex_id, 0);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(prev_read_id));
+	_cursor_stale = true;
+}
+
+void SoftRender::invalidateBands()
+{
+	for (BandState& state : _drawn)
+		state.valid = false;
+
+	_stale = true;
+}
+
+uint32_t* SoftRender::getBandPixels(uint band)
+{
+	THR_ASSERT(band < _band_cnt);
+
+	const uint slot = (_band_origin + band) % _band_cnt;
+	return _pixels.data() + static_cast<size_t>(_ring_height - 1 - slot * _row_stride) * _width;
+}
+
+bool SoftRender::isSameRow(const BandState& state, const BandState& next)
+{
+	if (state.has_row != next.has_row)
+		return false;
+
+	return !state.has_row || (state.ln_num  == next.ln_num &&
+							  state.begin   == next.begin &&
+							  state.end     == next.end &&
+							  state.version == next.version);
+}
+
+void SoftRender::setBandStates()
+{
+	_next.assign(_band_cnt, BandState{});
+
+	for (uint b = 0; b < _band_cnt; b++) {
+		BandState& state = _next[b];
+		state.valid = true;
+
+		if (b >= _frame_rows.size())
+			continue;
+
+		const SnapshotRow& row = *_frame_rows[b];
+
+		state.ln_num = row.ln_num;
+		state.begin = row.begin;
+		state.end = row.end;
+		state.version = row.version;
+		state.has_row = true;
+	}
+}
+
+int SoftRender::findScroll() const
+{
+	if (_band_cnt < 2 || !_next[0].has_row)
+		return 0;
+
+	if (_drawn[0].valid && isSameRow(_drawn[0], _next[0]))
+		return 0;
+
+	/* Top row of the new frame still on screen - scrolled up,
+	*  top row drawn still on screen - scrolled down
+	*/
+	for (uint b = 1; b < _band_cnt; b++) {
+		if (_drawn[b].valid && _drawn[b].has_row && isSameRow(_drawn[b], _next[0]))
+			return static_cast<int>(b);
+	}
+
+	if (!_drawn[0].valid || !_drawn[0].has_row)
+		return 0;
+
+	for (uint b = 1; b < _band_cnt; b++) {
+		if (isSameRow(_drawn[0], _next[b]))
+			return -static_cast<int>(b);
+	}
+
+	return 0;
+}
+
+void SoftRender::scrollBands(int shift)
+{
+	const int n = static_cast<int>(_band_cnt);
+
+	THR_ASSERT(shift != 0 && shift > -n && shift < n);
+
+	// band 'b' now holds what band 'b + shift' used to
+	const uint rotation = static_cast<uint>((shift + n) % n);
+
+	_band_origin = (_band_origin + rotation) % _band_cnt;
+	std::rotate(_drawn.begin(), _drawn.begin() + rotation, _drawn.end());
+	std::rotate(_highlights.begin(), _highlights.begin() + rotation, _highlights.end());
+
+	/* Bands that came into view hold the ones scrolled out. Bands at the edges
+	*  of the moved ones lost the neighbour reaching into them.
+	*/
+	const uint first_new = shift > 0 ? static_cast<uint>(n - shift) : 0;
+	const uint last_new = shift > 0 ? _band_cnt : static_cast<uint>(-shift);
+
+	for (uint b = first_new; b < last_new; b++)
+		_drawn[b].valid = false;
+
+	_drawn[shift > 0 ? 0 : _band_cnt - 1].valid = false;
+}
+
+void SoftRender::updateBands()
+{
+	setBandStates();
+
+	const int shift = findScroll();
+
+	if (shift != 0)
+		scrollBands(shift);
+
+	/* Band shows glyphs of its row and of both its neighbours
+	*/
+	_compose.resize(_band_cnt);
+
+	for (uint b = 0; b < _band_cnt; b++)
+		_compose[b] = !_drawn[b].valid || !isSameRow(_drawn[b], _next[b]);
+
+	byte prev_changed = 0;
+
+	for (uint b = 0; b < _band_cnt; b++) {
+		const byte changed = _compose[b];
+		const byte next_changed = (b + 1 < _band_cnt) ? _compose[b + 1] : 0;
+
+		_compose[b] = prev_changed | changed | next_changed;
+		prev_changed = changed;
+	}
+
+	// glyphs still missing mark the rows pending while composing
+	for (uint b = 0; b < _band_cnt; b++) {
+		const bool pending = !_compose[b] && _drawn[b].pending;
+
+		_drawn[b] = _next[b];
+		_drawn[b].pending = pending;
+	}
+
+	for (uint b = 0; b < _band_cnt; b++) {
+		if (_compose[b])
+			composeBand(b);
+	}
+
+	_stale = false;
+}
+
+void SoftRender::resolveColumns(const SnapshotRow& row)
+{
+	/* Carriage return starts over from the first column, as in TextRender
+	*/
+	_col_cells.assign(_cols, NoCell);
+
+	uint col = 0;
+
+	for (size_t i = 0; i < row.chars.size(); i++) {
+		if (row.chars[i] == U'\r')
+			col = 0;
+		else if (col < _cols)
+			_col_cells[col++] = static_cast<uint32_t>(i);
+	}
+}
+
+uint32_t SoftRender::getGlyphId(char32_t codepoint)
+{
+	const uint32_t id = _atlas.getGlyphId(codepoint);
+
+	if (id != GlyphTable::NoGlyph)
+		return id;
+
+	_atlas.requestGlyph(codepoint);
+	return _atlas.getGlyphId(codepoint);
+}
+
+void SoftRender::composeBand(uint band)
+{
+	uint32_t* const dst = getBandPixels(band);
+	std::fill_n(dst - static_cast<size_t>(_row_stride - 1) * _width, static_cast<size_t>(_width) * _row_stride, _clear_color);
+
+	const size_t row_cnt = _frame_rows.size();
+
+	if (band < row_cnt)
+		drawBackgrounds(*_frame_rows[band], dst);
+
+	for (uint r = (band > 0) ? band - 1 : 0; r <= band + 1 && r < row_cnt; r++)
+		drawGlyphs(*_frame_rows[r], r, band, dst);
+
+	drawHighlights(band, dst);
+	drawOverlay(band, dst);
+
+	if (band == _cursor_built.row)
+		_cursor_stale = true;
+
+	_slot_dirty[(_band_origin + band) % _band_cnt] = 1;
+	_composed_bands++;
+}
+
+void SoftRender::drawBackgrounds(const SnapshotRow& row, uint32_t* dst)
+{
+	resolveColumns(row);
+
+	const auto fillRun = [this, dst](uint begin, uint end, uint32_t color) {
+		const uint x0 = std::min(begin * _col_stride, static_cast<uint>(_width));
+		const uint x1 = std::min(end * _col_stride, static_cast<uint>(_width));
+
+		uint32_t* out = dst;
+
+		// runs cover the gaps between cells as well
+		for (uint y = 0; y < _row_stride; y++, out -= _width)
+			std::fill(out + x0, out + x1, color);
+	};
+
+	uint run_begin = 0;
+	uint32_t run_bg = 0;
+
+	// one step past the last column closes the last run
+	for (uint col = 0; col <= _cols; col++) {
+		const uint32_t idx = col < _cols ? _col_cells[col] : NoCell;
+		const uint32_t bg = (idx != NoCell) ? packColor(row.attrs[idx].bg) : 0;
+
+		if (bg == run_bg)
+			continue;
+
+		// default background is the cleared screen
+		if (run_bg != 0)
+			fillRun(run_begin, col, OpaqueAlpha | run_bg);
+
+		run_begin = col;
+		run_bg = bg;
+	}
+}
+
+void SoftRender::drawGlyphs(const SnapshotRow& row, uint row_idx, uint band, uint32_t* dst)
+{
+	resolveColumns(row);
+
+	// top of the cell relative to the band, glyphs are placed by their bearing from there
+	const int cell_top = (static_cast<int>(row_idx) - static_cast<int>(band)) * static_cast<int>(_row_stride);
+
+	for (uint col = 0; col < _cols; col++) {
+		const uint32_t idx = _col_cells[col];
+
+		if (idx == NoCell || row.chars[idx] == U' ')
+			continue;
+
+		const uint32_t id = getGlyphId(row.chars[idx]);
+
+		// glyph not rasterized yet, cell stays blank
+		if (id == GlyphTable::NoGlyph) {
+			_drawn[row_idx].pending = true;
+			continue;
+		}
+
+		const uint32_t packed_fg = packColor(row.attrs[idx].fg);
+		const uint32_t fg = OpaqueAlpha | (packed_fg != 0 ? packed_fg : _DefaultFg);
+
+		drawGlyph(id, static_cast<int>(col * _col_stride), cell_top, fg, dst);
+	}
+}
+
+void SoftRender::drawGlyph(uint32_t id, int x, int cell_top, uint32_t fg, uint32_t* dst)
+{
+	const int pitch = static_cast<int>(_atlas.getPagePitch());
+	const int band_height = static_cast<int>(_row_stride);
+
+	glm::ivec4 format;
+	const byte* bitmap = _atlas.getGlyphBitmap(id, format);
+
+	const int x0 = x + format.z;
+	const int y0 = cell_top + static_cast<int>(_cell_height) - format.w;
+
+	// most glyphs of the neighbouring rows stay out of the band
+	const int top = std::max(y0, 0);
+	const int bottom = std::min(y0 + format.y, band_height);
+	const int left = std::max(x0, 0);
+	const int right = std::min(x0 + format.x, _width);
+
+	if (top >= bottom || left >= right)
+		return;
+
+	bitmap += static_cast<ptrdiff_t>(top - y0) * pitch + (left - x0);
+	uint32_t* out = dst - static_cast<ptrdiff_t>(top) * _width + left;
+
+	for (int y = top; y < bottom; y++) {
+		blendSpan(out, bitmap, static_cast<size_t>(right - left), fg);
+		bitmap += pitch;
+		out -= _width;
+	}
+}
+
+void SoftRender::drawHighlights(uint band, uint32_t* dst)
+{
+	if (band >= _frame_rows.size())
+		return;
+
+	const SnapshotRow& row = *_frame_rows[band];
+	const BandHighlights& hl = _highlights[band];
+
+	// spans computed for another row, it's composed again once they are updated
+	if (hl.spans.empty() || hl.ln_num != row.ln_num || hl.begin != row.begin)
+		return;
+
+	const uint32_t color = OpaqueAlpha | _HighlightColor;
+	const uint height = std::min(_cell_height, _row_stride);
+
+	for (const glm::uvec2& span : hl.spans) {
+		const uint x1 = std::min(span.y, static_cast<uint>(_width));
+
+		uint32_t* out = dst;
+
+		for (uint y = 0; y < height; y++, out -= _width) {
+			for (uint x = span.x; x < x1; x++)
+				out[x] = blendPixel(out[x], color, _HighlightAlpha);
+		}
+	}
+}
+
+void SoftRender::drawOverlay(uint band, uint32_t* dst)
+{
+	const uint line_cnt = static_cast<uint>(std::min<size_t>({ _overlay_lines.size(), _OverlayRows, _rows }));
+	size_t width = 0;
+
+	for (uint i = 0; i < line_cnt; i++)
+		width = std::max(width, _overlay_lines[i].size());
+
+	width = std::min<size_t>(width, _cols);
+
+	// glyphs of the line below may reach into the band
+	if (width == 0 || band > line_cnt)
+		return;
+
+	// lines are right aligned, padded to the widest one
+	const uint first_col = _cols - static_cast<uint>(width);
+
+	if (band < line_cnt) {
+		const uint x0 = std::min(first_col * _col_stride, static_cast<uint>(_width));
+		uint32_t* out = dst;
+
+		for (uint y = 0; y < _row_stride; y++, out -= _width)
+			std::fill(out + x0, out + _width, OpaqueAlpha | _OverlayBg);
+	}
+
+	for (uint r = (band > 0) ? band - 1 : 0; r <= band + 1 && r < line_cnt; r++) {
+		const std::string& line = _overlay_lines[r];
+		const int cell_top = (static_cast<int>(r) - static_cast<int>(band)) * static_cast<int>(_row_stride);
+
+		for (size_t c = 0; c < std::min(line.size(), width); c++) {
+			if (line[c] == ' ')
+				continue;
+
+			const uint32_t id = getGlyphId(static_cast<char32_t>(static_cast<uchar>(line[c])));
+
+			if (id != GlyphTable::NoGlyph)
+				drawGlyph(id, static_cast<int>((first_col + c) * _col_stride), cell_top, OpaqueAlpha | _OverlayFg, dst);
+		}
+	}
+}
+
+void SoftRender::submitOverlay(const Vec<std::string>& lines)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("SoftRender subsystem is not initialized, can't submit overlay");
+		return;
+	}
+
+	// bands under the old lines and the one below them lose the overlay
+	const size_t band_cnt = std::min<size_t>(std::max(lines.size(), _overlay_lines.size()) + 1, _band_cnt);
+
+	_overlay_lines = lines;
+
+	for (size_t b = 0; b < band_cnt; b++)
+		_drawn[b].valid = false;
+
+	_stale = true;
+}
+
+void SoftRender::submitCurrFrame(const RenderFramePacket& packet)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("SoftRender subsystem is not initialized, can't submit frame");
+		return;
+	}
+
+	THR_ASSERT(packet.snapshot != nullptr);
+
+	const auto& rows = packet.snapshot->rows;
+	const size_t row_cnt = std::min<size_t>(rows.size(), _rows);
+
+	_atlas.beginFrame();
+
+	/* Bands drawn without some of their glyphs are composed again
+	*  once the glyphs arrive. Composed pixels don't refer to the glyph ids,
+	*  so evictions need no care.
+	*/
+	if (_atlas.uploadReadyGlyphs() > 0) {
+		for (BandState& state : _drawn)
+			state.valid &= !state.pending;
+	}
+
+	_frame_rows.assign(rows.begin(), rows.begin() + row_cnt);
+	_composed_bands = 0;
+
+	beginPhase(FRAME_PHASE_PACK);
+	updateBands();
+	endPhase(FRAME_PHASE_PACK);
+}
+
+bool SoftRender::hasNewGlyphs() const
+{
+	return _initialized && _atlas.hasReadyGlyphs();
+}
+
+bool SoftRender::hasPendingGlyphs() const
+{
+	return _initialized && _atlas.getRequestedCount() > 0;
+}
+
+void SoftRender::setGlyphReadyCallback(std::function<void()> callback)
+{
+	_atlas.setReadyCallback(std::move(callback));
+}
+
+size_t SoftRender::getUploadedRowCount() const
+{
+	return _composed_bands;
+}
+
+uint SoftRender::getAtlasPageCount() const
+{
+	return _atlas.getPageCount();
+}
+
+uint SoftRender::getCellXPos(const SnapshotRow& row, uint32_t idx) const
+{
+	uint xpos = 0;
+
+	/* Follow the layout of resolveColumns */
+	for (uint32_t i = row.begin; i < idx; i++) {
+		if (row.chars[i - row.begin] == U'\r')
+			xpos = 0;
+		else
+			xpos += _col_stride;
+	}
+
+	return xpos;
+}
+
+void SoftRender::submitHighlights(const ScreenSnapshot& snapshot, const Vec<SearchMatch>& matches)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("SoftRender subsystem is not initialized, can't submit highlights");
+		return;
+	}
+
+	const size_t row_cnt = std::min<size_t>(snapshot.rows.size(), _band_cnt);
+	size_t first_match = 0;
+
+	/* Only the bands whose highlights changed are composed again
+	*/
+	for (uint b = 0; b < _band_cnt; b++) {
+		BandHighlights next;
+
+		if (b < row_cnt) {
+			const SnapshotRow& row = *snapshot.rows[b];
+
+			next.ln_num = row.ln_num;
+			next.begin = row.begin;
+
+			while (first_match < matches.size() && matches[first_match].ln < row.ln_num)
+				first_match++;
+
+			for (size_t i = first_match; i < matches.size() && matches[i].ln == row.ln_num; i++) {
+				const uint32_t begin = std::max(matches[i].begin, row.begin);
+				const uint32_t end = std::min(matches[i].end, row.end);
+
+				if (begin >= end)
+					continue;
+
+				const uint xbegin = getCellXPos(row, begin);
+				const uint xend = getCellXPos(row, end);
+
+				if (xend > xbegin)
+					next.spans.emplace_back(xbegin, xend);
+			}
+		}
+
+		BandHighlights& hl = _highlights[b];
+
+		if (hl.spans == next.spans &&
+			(next.spans.empty() || (hl.ln_num == next.ln_num && hl.begin == next.begin)))
+			continue;
+
+		hl = std::move(next);
+
+		// invalid bands are composed with the next frame anyway
+		if (_drawn[b].valid)
+			composeBand(b);
+	}
+}
+
+void SoftRender::renderText()
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("SoftRender subsystem is not initialized, can't render frame of text");
+		return;
+	}
+
+	if (_band_cnt == 0 || _width == 0)
+		return;
+
+	if (_stale) {
+		beginPhase(FRAME_PHASE_PACK);
+		updateBands();
+		endPhase(FRAME_PHASE_PACK);
+	}
+
+	beginPhase(FRAME_PHASE_UPLOAD);
+
+	/* Upload the composed bands, neighbouring ones at once.
+	*  Ring slot 's' is held by texture rows [ring height - (s + 1) * row stride, ring height - s * row stride).
+	*/
+	glBindTexture(GL_TEXTURE_2D, _fb_tex_id);
+
+	for (uint s = 0; s < _band_cnt; ) {
+		if (!_slot_dirty[s]) {
+			s++;
+			continue;
+		}
+
+		uint e = s;
+
+		while (e < _band_cnt && _slot_dirty[e])
+			_slot_dirty[e++] = 0;
+
+		const uint first_row = _ring_height - e * _row_stride;
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0,
+						0, static_cast<GLint>(first_row),
+						_width, static_cast<GLsizei>((e - s) * _row_stride),
+						GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
+						reinterpret_cast<const GLvoid*>(_pixels.data() + static_cast<size_t>(first_row) * _width));
+		s = e;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	endPhase(FRAME_PHASE_UPLOAD);
+	beginPhase(FRAME_PHASE_DRAW);
+
+	/* Ring from the origin on is the top of the window, the rest follows
+	*/
+	GLint prev_read_id = 0;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, std::addressof(prev_read_id));
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _fb_read_id);
+
+	const GLint origin_top = static_cast<GLint>(_ring_height - _band_origin * _row_stride);
+	const GLint top_height = std::min(static_cast<GLint>((_band_cnt - _band_origin) * _row_stride), _height);
+
+	glBlitFramebuffer(0, origin_top - top_height, _width, origin_top,
+					  0, _height - top_height, _width, _height,
+					  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+	if (top_height < _height) {
+		const GLint rest = _height - top_height;
+		const GLint ring_top = static_cast<GLint>(_ring_height);
+
+		glBlitFramebuffer(0, ring_top - rest, _width, ring_top,
+						  0, 0, _width, rest,
+						  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+
+	renderCursor();
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(prev_read_id));
+
+	endPhase(FRAME_PHASE_DRAW);
+
+	pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during SoftRender frame rendering: {}", getGlErrorStr(err));
+	});
+}
+
+bool SoftRender::getCursorRect(glm::uvec4& rect) const
+{
+	if (!_cursor.visible || _cursor.row >= _rows || _cursor.col >= _cols)
+		return false;
+
+	const glm::ivec2 cell_size = _fmt.getCellSize();
+	const uint thickness = std::max(_cell_height / 12, 1u);
+
+	rect = glm::uvec4(_cursor.col * _col_stride, _cursor.row * _row_stride, cell_size.x, cell_size.y);
+
+	// same shapes as drawn by CursorShader
+	if (_cursor.shape == CURSOR_SHAPE_UNDERLINE) {
+		rect.y += rect.w - thickness;
+		rect.w = thickness;
+	}
+	else if (_cursor.shape == CURSOR_SHAPE_BAR) {
+		rect.z = thickness;
+	}
+
+	rect.z = std::min(rect.z, static_cast<uint>(_width) - std::min(rect.x, static_cast<uint>(_width)));
+	rect.w = std::min(rect.w, static_cast<uint>(_height) - std::min(rect.y, static_cast<uint>(_height)));
+
+	return rect.z > 0 && rect.w > 0;
+}
+
+void SoftRender::updateCursorTexture(const glm::uvec4& rect)
+{
+	_cursor_pixels.resize(static_cast<size_t>(rect.z) * rect.w);
+
+	/* Inverted pixels of the composed bands, bottom row first
+	*  like the texture expects them
+	*/
+	uint32_t* out = _cursor_pixels.data();
+
+	for (uint y = rect.y + rect.w; y-- > rect.y; ) {
+		const uint32_t* src = getBandPixels(y / _row_stride) - static_cast<size_t>(y % _row_stride) * _width + rect.x;
+
+		for (uint x = 0; x < rect.z; x++)
+			*out++ = src[x] ^ 0x00FFFFFF;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, _cursor_tex_id);
+	glTexSubImage2D(GL_TEXTURE_2D, 0,
+					0, 0,
+					static_cast<GLsizei>(rect.z), static_cast<GLsizei>(rect.w),
+					GL_RGBA, GL_UNSIGNED_INT_8_8_8_8_REV,
+					reinterpret_cast<const GLvoid*>(_cursor_pixels.data()));
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	_cursor_built = _cursor;
+	_cursor_stale = false;
+}
+
+void SoftRender::renderCursor()
+{
+	glm::uvec4 rect;
+
+	if (!isCursorShown() || !getCursorRect(rect))
+		return;
+
+	if (_cursor_stale || !isSameCursor(_cursor, _cursor_built))
+		updateCursorTexture(rect);
+
+	const GLint x = static_cast<GLint>(rect.x);
+	const GLint y = _height - static_cast<GLint>(rect.y + rect.w);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, _cursor_read_id);
+	glBlitFramebuffer(0, 0, static_cast<GLint>(rect.z), static_cast<GLint>(rect.w),
+					  x, y, x + static_cast<GLint>(rect.z), y + static_cast<GLint>(rect.w),
+					  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
+void SoftRender::clearScreen(Color4f col)
+{
+	const auto channel = [](float c) {
+		return static_cast<uint32_t>(std::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+	};
+
+	const uint32_t color = OpaqueAlpha | channel(col.r) | (channel(col.g) << 8) | (channel(col.b) << 16);
+
+	// whole window is covered by the bands, nothing to clear
+	if (color == _clear_color)
+		return;
+
+	_clear_color = color;
+	invalidateBands();
+}
+
+} // namespace Thr
@@ -1,31 +1,91 @@
 #include "TextRender.hpp"
 #include "logger/Log.hpp"
 #include "Utils.hpp"
+#include "filesys/ReadFile.hpp"
+#include "memory/Hash.hpp"
+#include <chrono>
 
 namespace Thr {
 
+/* Glyph of a non-blank cell. Blank cells aren't drawn at all,
+*  so every instance carries its column and row slot.
+*  Colors are looked up through the style index.
+*/
 struct ShaderCellInfo 
 {
-	glm::u32vec2 pos;
-	uint32_t	 id;
-	Color3u8     fg;
-	Color3u8     bg;
+	// glyph id in the lower 20 bits, column in the upper 12 bits
+	uint32_t glyph;
+	// row slot in the lower 16 bits, style index in the upper 16 bits
+	uint32_t slot_style;
 };
 
+/* Run of cells with the same non-default background within a row.
+*/
+struct ShaderBgRunInfo
+{
+	// first column in the lower 16 bits, one past the last column in the upper 16 bits
+	uint32_t cols;
+	uint32_t slot_style;
+};
+
+THR_STATIC_ASSERT_LOG(sizeof(ShaderCellInfo) == 8, "Cell instance is expected to be tightly packed");
+THR_STATIC_ASSERT_LOG(sizeof(ShaderBgRunInfo) == sizeof(ShaderCellInfo), "Glyphs and runs share the slots of the instance ring");
+
+THR_FORCEINLINE uint32_t packColor(Color3u8 c)
+{
+	return static_cast<uint32_t>(c.r) | (static_cast<uint32_t>(c.g) << 8) | (static_cast<uint32_t>(c.b) << 16);
+}
+
+THR_FORCEINLINE bool isSameAttr(const CellAttr& a, const CellAttr& b)
+{
+	return packColor(a.fg) == packColor(b.fg) && packColor(a.bg) == packColor(b.bg);
+}
+
 TextRender::TextRender()
 	: _atlas(DefaultAtlasWidth, DefaultAtlasHeight)
 	, _vao_id_ptr(nullptr)
 	, _base_vbo_id(0)
-	, _vbo_id(0)
 	, _fmt(0, 0, 0, 0, 0, 0)
 	, _cols(0)
 	, _rows(0)
 	, _shader(std::make_unique<ShaderProgram>())
-	, _cell_count(0)
+	, _slot_stride(0)
+	, _instances()
+	, _slots()
+	, _bg_cmd_cnt(0)
+	, _cmd_buf_id(0)
+	, _cmd_capacity(0)
+	, _multi_draw(false)
+	, _glyph_cnt(0)
+	, _bg_run_cnt(0)
+	, _bg_vao_id(0)
+	, _bg_shader(std::make_unique<ShaderProgram>())
+	, _uploaded_rows(0)
+	, _row_lookup_buf_id(0)
+	, _row_lookup_tex_id(0)
+	, _blank_id(0)
+	, _styles_uploaded(0)
+	, _style_capacity(0)
+	, _style_buf_id(0)
+	, _style_tex_id(0)
+	, _hl_vao_id(0)
+	, _hl_vbo_id(0)
+	, _hl_shader(std::make_unique<ShaderProgram>())
+	, _hl_capacity(0)
+	, _hl_count(0)
+	, _cursor_vao_id(0)
+	, _cursor_shader(std::make_unique<ShaderProgram>())
+	, _cursor_cell_loc(-1)
+	, _cursor_shape_loc(-1)
+	, _blink_time_loc(-1)
+	, _overlay_vao_id(0)
+	, _overlay_vbo_id(0)
+	, _overlay_run_cnt(0)
+	, _overlay_glyph_cnt(0)
 	, _initialized(false)
 {}
 
-void TextRender::init(const RenderFormat& fmt)
+void TextRender::init(const RenderFormat& fmt, const FilePath& glyph_cache, const FilePath& shader_cache)
 {
 	if (_initialized) {
 		THR_LOG_ERROR("TextRender subsystem is already initialized, can't initialize again");
@@ -40,7 +100,7 @@ void TextRender::init(const RenderFormat& fmt)
 	glGenVertexArrays(1, _vao_id_ptr.get());
 
 	const glm::ivec2 g_cell_size = _fmt.getCellSize();
-	_atlas.init(_vao_id_ptr, g_cell_size.y);
+	_atlas.init(_vao_id_ptr, g_cell_size.y, FontAtlas::DefaultPrewarmRanges, glyph_cache);
 
 	glm::ivec2 res_cell_size;
 	_atlas.getGlyphPixSize(res_cell_size.x, res_cell_size.y);
@@ -48,8 +108,7 @@ void TextRender::init(const RenderFormat& fmt)
 	THR_LOG_INFO("Cell size at RenderFormat set to: {}", res_cell_size.x);
 	_fmt.setCellSize(res_cell_size);
 
-	_cols = _fmt.getCellCountVertical();
-	_rows = _fmt.getCellCountHorizontal();
+	updateGridSize();
 
 	glBindVertexArray(*_vao_id_ptr);
 	THR_HARD_ASSERT(*_vao_id_ptr != 0 && glIsVertexArray(*_vao_id_ptr) == GL_TRUE);
@@ -79,59 +138,61 @@ void TextRender::init(const RenderFormat& fmt)
 						  2 * sizeof(float), 
 						  nullptr);
 
-	glGenBuffers(1, std::addressof(_vbo_id));
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo_id);
-	THR_HARD_ASSERT(_vbo_id != 0 && glIsBuffer(_vbo_id) == GL_TRUE);
+	glBindVertexArray(0);
 
-	glBufferData(GL_ARRAY_BUFFER, 
-				 _cols * _rows * sizeof(ShaderCellInfo), 
-				 nullptr, 
-				 GL_DYNAMIC_DRAW);
+	const auto programs_start = std::chrono::steady_clock::now();
 
-	glEnableVertexAttribArray(1);
-	glVertexAttribDivisor(1, 1);
-	glVertexAttribIPointer(1,
-						   2, GL_UNSIGNED_INT,
-						   sizeof(ShaderCellInfo),
-						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, pos)));
+	ProgramCache program_cache;
+	program_cache.open(shader_cache);
 
-	glEnableVertexAttribArray(2);
-	glVertexAttribDivisor(2, 1);
-	glVertexAttribIPointer(2, 
-						   1, GL_UNSIGNED_INT, 
-						   sizeof(ShaderCellInfo), 
-						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, id)));
+	initBackgrounds(program_cache);
 
-	glEnableVertexAttribArray(3);
-	glVertexAttribDivisor(3, 1);
-	glVertexAttribIPointer(3, 
-						   3, GL_UNSIGNED_BYTE,
-						   sizeof(ShaderCellInfo), 
-						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, fg)));
+	_instances.init(sizeof(ShaderCellInfo));
+	_instances.reserve(static_cast<size_t>(_slot_stride) * _rows);
+	setupInstanceAttribs();
 
-	glEnableVertexAttribArray(4);
-	glVertexAttribDivisor(4, 1);
-	glVertexAttribIPointer(4, 
-						   3, GL_UNSIGNED_BYTE,
-						   sizeof(ShaderCellInfo), 
-						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, bg)));
+	/* All the rows are drawn with a single call per pass where it's possible,
+	*  otherwise every row is drawn separately.
+	*/
+	_multi_draw = glMultiDrawArraysIndirect != nullptr &&
+				  (GLAD_GL_VERSION_4_3 || hasGlExtension("GL_ARB_multi_draw_indirect"));
 
-	glBindVertexArray(0);
+	if (_multi_draw) {
+		glGenBuffers(1, std::addressof(_cmd_buf_id));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _cmd_buf_id);
+		THR_HARD_ASSERT(_cmd_buf_id != 0 && glIsBuffer(_cmd_buf_id) == GL_TRUE);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	THR_LOG_INFO("Rows are drawn with {}", _multi_draw ? "multi-draw indirect" : "draw per row");
+
+	/* Slot -> screen row lookup */
+	glGenBuffers(1, std::addressof(_row_lookup_buf_id));
+	glBindBuffer(GL_TEXTURE_BUFFER, _row_lookup_buf_id);
+	THR_HARD_ASSERT(_row_lookup_buf_id != 0 && glIsBuffer(_row_lookup_buf_id) == GL_TRUE);
 
-	_shader->vert.init();
-	_shader->frag.init();
-	_shader->prog.init();
+	glGenTextures(1, std::addressof(_row_lookup_tex_id));
+	glBindTexture(GL_TEXTURE_BUFFER, _row_lookup_tex_id);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, _row_lookup_buf_id);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-	_shader->vert.compileStage(FilePath("Therminal/assets/shaders/TextShader.vert"));
-	THR_HARD_ASSERT(_shader->vert.isCompiled());
+	/* Style index -> colors lookup */
+	glGenBuffers(1, std::addressof(_style_buf_id));
+	glBindBuffer(GL_TEXTURE_BUFFER, _style_buf_id);
+	THR_HARD_ASSERT(_style_buf_id != 0 && glIsBuffer(_style_buf_id) == GL_TRUE);
 
-	_shader->frag.compileStage(FilePath("Therminal/assets/shaders/TextShader.frag"));
-	THR_HARD_ASSERT(_shader->frag.isCompiled());
+	glGenTextures(1, std::addressof(_style_tex_id));
+	glBindTexture(GL_TEXTURE_BUFFER, _style_tex_id);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, _style_buf_id);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-	_shader->prog.attachStage(_shader->vert);
-	_shader->prog.attachStage(_shader->frag);
-	_shader->prog.linkProgram();
-	THR_HARD_ASSERT(_shader->prog.isLinked());
+	resetRowSlots();
+	resetStyles();
+
+	_atlas.addGlyph(U' ');
+	_blank_id = getGlyphId(U' ');
+
+	buildProgram(*_shader, "TextShader", program_cache);
 
 	/* Setup uniforms for textures and tex-buffers */
 	{
@@ -142,9 +203,13 @@ void TextRender::init(const RenderFormat& fmt)
 
 		_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
 		_shader->prog.setUniform2<GLuint>("CellSizePix",  cell_size.x, cell_size.y);
+		_shader->prog.setUniform1<GLuint>("RowStridePix", cell_size.y + _fmt.getCellOffset().y);
+		_shader->prog.setUniform1<GLuint>("ColumnStridePix", cell_size.x + _fmt.getCellOffset().x);
+		_shader->prog.setUniform1<GLint>("RowLookup", getGlActiveTexUniformVal(_RowLookupUnit));
+		_shader->prog.setUniform1<GLint>("StyleLookup", getGlActiveTexUniformVal(_StyleLookupUnit));
 
-		const GLint uvs_buf_unit = getGlActiveTexUniformVal(_atlas.getAtlasTexBufUnit());
-		_shader->prog.setUniform1<GLint>("AtlasUVsLookup", uvs_buf_unit);
+		const GLint pos_buf_unit = getGlActiveTexUniformVal(_atlas.getAtlasTexBufUnit());
+		_shader->prog.setUniform1<GLint>("AtlasPosLookup", pos_buf_unit);
 
 		const GLint format_buf_unit = getGlActiveTexUniformVal(_atlas.getCharFormatBufUnit());
 		_shader->prog.setUniform1<GLint>("CharFormatLookup", format_buf_unit);
@@ -155,6 +220,16 @@ void TextRender::init(const RenderFormat& fmt)
 		_shader->prog.unuseProgram();
 	}
 
+	initHighlights(program_cache);
+	initCursor(program_cache);
+	initOverlay();
+	program_cache.save();
+
+	const auto programs_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - programs_start);
+
+	THR_LOG_DEBUG("Shader programs ready in {} us", programs_elapsed.count());
+
 	const GLenum err = pollGlErrors([](GLenum err) {
 		THR_LOG_ERROR("OpenGL error during TextRender initialization: {}", getGlErrorStr(err));
 	});
@@ -179,17 +254,541 @@ void TextRender::getRenderFormat(RenderFormat& fmt)
 	fmt = _fmt;
 }
 
+void TextRender::resize(const RenderFormat& fmt)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("Resizing unitialized TextRender");
+		return;
+	}
+
+	const glm::ivec2 window_size = fmt.getWindowSize();
+	_fmt.setWindowSize(window_size);
+
+	updateGridSize();
+
+	if (_instances.reserve(static_cast<size_t>(_slot_stride) * _rows))
+		setupInstanceAttribs();
+
+	// slot layout depends on the number of columns
+	resetRowSlots();
+
+	_shader->prog.useProgram();
+	_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+	_shader->prog.unuseProgram();
+
+	_bg_shader->prog.useProgram();
+	_bg_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+	_bg_shader->prog.unuseProgram();
+
+	_hl_shader->prog.useProgram();
+	_hl_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+	_hl_shader->prog.unuseProgram();
+
+	_cursor_shader->prog.useProgram();
+	_cursor_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+	_cursor_shader->prog.unuseProgram();
+
+	pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during TextRender resize: {}", getGlErrorStr(err));
+	});
+}
+
+void TextRender::updateGridSize()
+{
+	_cols = _fmt.getCellCountVertical();
+	_rows = _fmt.getCellCountHorizontal();
+
+	if (_cols > _MaxColumns) {
+		THR_LOG_ERROR("Grid of {} columns is too wide, only {} are drawn", _cols, _MaxColumns);
+		_cols = _MaxColumns;
+	}
+
+	THR_HARD_ASSERT_LOG(_rows + _OverlayRows <= 0xFFFF, "Row slot has to fit in 16 bits of the instance");
+
+	// glyphs, then background runs
+	_slot_stride = 2 * _cols;
+}
+
+void TextRender::setupInstanceAttribs()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, _instances.getBufferId());
+
+	glBindVertexArray(*_vao_id_ptr);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribIPointer(1, 
+						   1, GL_UNSIGNED_INT, 
+						   sizeof(ShaderCellInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, glyph)));
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribIPointer(2, 
+						   1, GL_UNSIGNED_INT,
+						   sizeof(ShaderCellInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, slot_style)));
+
+	glBindVertexArray(_bg_vao_id);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribIPointer(1, 
+						   1, GL_UNSIGNED_INT, 
+						   sizeof(ShaderBgRunInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderBgRunInfo, cols)));
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribIPointer(2, 
+						   1, GL_UNSIGNED_INT,
+						   sizeof(ShaderBgRunInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderBgRunInfo, slot_style)));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// previous content is gone, wait for the next submission
+	_draw_cmds.clear();
+	_bg_cmd_cnt = 0;
+
+	for (Vec<RowSlot>& slots : _slots)
+		for (RowSlot& slot : slots)
+			slot.valid = false;
+}
+
+void TextRender::initBackgrounds(ProgramCache& program_cache)
+{
+	glGenVertexArrays(1, std::addressof(_bg_vao_id));
+	glBindVertexArray(_bg_vao_id);
+	THR_HARD_ASSERT(_bg_vao_id != 0 && glIsVertexArray(_bg_vao_id) == GL_TRUE);
+
+	// share the unit quad with text instances
+	glBindBuffer(GL_ARRAY_BUFFER, _base_vbo_id);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 
+						  2, GL_FLOAT, GL_FALSE, 
+						  2 * sizeof(float), 
+						  nullptr);
+
+	glBindVertexArray(0);
+
+	buildProgram(*_bg_shader, "BackgroundShader", program_cache);
+
+	{
+		_bg_shader->prog.useProgram();
+
+		const glm::ivec2 window_size = _fmt.getWindowSize();
+		const glm::ivec2 cell_size = _fmt.getCellSize();
+
+		_bg_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+		_bg_shader->prog.setUniform1<GLuint>("RowStridePix", cell_size.y + _fmt.getCellOffset().y);
+		_bg_shader->prog.setUniform1<GLuint>("ColumnStridePix", cell_size.x + _fmt.getCellOffset().x);
+		_bg_shader->prog.setUniform1<GLint>("RowLookup", getGlActiveTexUniformVal(_RowLookupUnit));
+		_bg_shader->prog.setUniform1<GLint>("StyleLookup", getGlActiveTexUniformVal(_StyleLookupUnit));
+
+		_bg_shader->prog.unuseProgram();
+	}
+}
+
+void TextRender::buildProgram(ShaderProgram& shader, std::string_view name, ProgramCache& program_cache)
+{
+	const FilePath dir("Therminal/assets/shaders");
+	const std::string vert_src = readFile(dir / FilePath(std::string(name) + ".vert"));
+	const std::string frag_src = readFile(dir / FilePath(std::string(name) + ".frag"));
+
+	THR_HARD_ASSERT(!vert_src.empty() && !frag_src.empty());
+
+	const uint64_t source_hash = hashBytes(frag_src.data(), frag_src.size(),
+										   hashBytes(vert_src.data(), vert_src.size()));
+
+	shader.prog.init();
+
+	if (program_cache.load(shader.prog, source_hash)) {
+		THR_LOG_DEBUG("Shader program {} loaded from the program cache", name);
+		return;
+	}
+
+	shader.vert.compileStage(vert_src);
+	THR_HARD_ASSERT(shader.vert.isCompiled());
+
+	shader.frag.compileStage(frag_src);
+	THR_HARD_ASSERT(shader.frag.isCompiled());
+
+	shader.prog.attachStage(shader.vert);
+	shader.prog.attachStage(shader.frag);
+
+	if (program_cache.isEnabled())
+		shader.prog.setBinaryRetrievable();
+
+	shader.prog.linkProgram();
+	THR_HARD_ASSERT(shader.prog.isLinked());
+
+	program_cache.store(shader.prog, source_hash);
+}
+
+void TextRender::initHighlights(ProgramCache& program_cache)
+{
+	glGenVertexArrays(1, std::addressof(_hl_vao_id));
+	glBindVertexArray(_hl_vao_id);
+	THR_HARD_ASSERT(_hl_vao_id != 0 && glIsVertexArray(_hl_vao_id) == GL_TRUE);
+
+	// share the unit quad with text instances
+	glBindBuffer(GL_ARRAY_BUFFER, _base_vbo_id);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 
+						  2, GL_FLOAT, GL_FALSE, 
+						  2 * sizeof(float), 
+						  nullptr);
+
+	glGenBuffers(1, std::addressof(_hl_vbo_id));
+	glBindBuffer(GL_ARRAY_BUFFER, _hl_vbo_id);
+	THR_HARD_ASSERT(_hl_vbo_id != 0 && glIsBuffer(_hl_vbo_id) == GL_TRUE);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribIPointer(1,
+						   4, GL_UNSIGNED_INT,
+						   sizeof(glm::u32vec4),
+						   nullptr);
+
+	glBindVertexArray(0);
+
+	buildProgram(*_hl_shader, "HighlightShader", program_cache);
+
+	{
+		_hl_shader->prog.useProgram();
+
+		const glm::ivec2 window_size = _fmt.getWindowSize();
+
+		_hl_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+		_hl_shader->prog.setUniform4<GLfloat>("HighlightColor", 1.f, 0.8f, 0.f, 0.4f);
+
+		_hl_shader->prog.unuseProgram();
+	}
+}
+
+void TextRender::resetRowSlots()
+{
+	for (Vec<RowSlot>& slots : _slots)
+		slots.assign(_rows, RowSlot{});
+
+	_row_lookup.assign(_rows + _OverlayRows, -1);
+	_draw_cmds.clear();
+	_bg_cmd_cnt = 0;
+
+	// overlay slots always map to the top rows
+	for (uint i = 0; i < _OverlayRows; i++)
+		_row_lookup[_rows + i] = static_cast<GLint>(i);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _row_lookup_buf_id);
+	glBufferData(GL_TEXTURE_BUFFER,
+				 _row_lookup.size() * sizeof(GLint),
+				 reinterpret_cast<GLvoid*>(_row_lookup.data()),
+				 GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	// overlay is laid out for the number of columns
+	if (!_overlay_lines.empty())
+		buildOverlay();
+}
+
+uint32_t TextRender::getGlyphId(char32_t codepoint)
+{
+	const uint32_t id = _atlas.getGlyphId(codepoint);
+
+	if (id != GlyphTable::NoGlyph)
+		return id;
+
+	/* Missing glyph is rendered by the atlas thread, unless the atlas
+	*  has to render it right away.
+	*/
+	_atlas.requestGlyph(codepoint);
+	return _atlas.getGlyphId(codepoint);
+}
+
+void TextRender::resetStyles()
+{
+	_style_map.clear();
+	_styles.clear();
+	_styles_uploaded = 0;
+
+	// index 0 - default colors, used by the blank cells
+	getStyleIdx(CellAttr{});
+}
+
+uint32_t TextRender::getStyleIdx(const CellAttr& attr)
+{
+	const uint32_t fg = packColor(attr.fg);
+	const uint32_t bg = packColor(attr.bg);
+	const uint64_t key = static_cast<uint64_t>(fg) | (static_cast<uint64_t>(bg) << 32);
+
+	const auto it = _style_map.find(key);
+
+	if (it != _style_map.end())
+		return it->second;
+
+	/* Table is rebuilt between the frames, only a single frame
+	*  with tens of thousands of new colors can get here.
+	*/
+	if (_styles.size() == _MaxStyles) {
+		THR_LOG_ERROR("Style table is full, falling back to the default style");
+		return 0;
+	}
+
+	const uint32_t idx = static_cast<uint32_t>(_styles.size());
+
+	_style_map.emplace(key, idx);
+	_styles.emplace_back(fg != 0 ? fg : _DefaultFg, 
+						 bg != 0 ? bg : _DefaultBg);
+
+	return idx;
+}
+
+void TextRender::uploadStyles()
+{
+	if (_styles_uploaded == _styles.size())
+		return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _style_buf_id);
+
+	/* Texture buffer keeps pointing to the buffer object,
+	*  reallocating its storage is fine.
+	*/
+	if (_styles.size() > _style_capacity) {
+		_style_capacity = std::max(_styles.size(), 2 * _style_capacity);
+		_styles_uploaded = 0;
+
+		glBufferData(GL_TEXTURE_BUFFER,
+					 _style_capacity * sizeof(glm::u32vec2),
+					 nullptr,
+					 GL_DYNAMIC_DRAW);
+	}
+
+	glBufferSubData(GL_TEXTURE_BUFFER,
+					_styles_uploaded * sizeof(glm::u32vec2),
+					(_styles.size() - _styles_uploaded) * sizeof(glm::u32vec2),
+					reinterpret_cast<GLvoid*>(_styles.data() + _styles_uploaded));
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	_styles_uploaded = _styles.size();
+}
+
+void TextRender::fillRowSlot(const SnapshotRow& row, uint32_t slot, ShaderCellInfo* dst)
+{
+	THR_ASSERT(slot < _rows);
+
+	static constexpr uint32_t NoCell = static_cast<uint32_t>(-1);
+
+	/* Resolve the cells to columns first - carriage return starts over
+	*  from the first column, overwriting the cells. Rows may also carry more cells
+	*  than there are columns (zero-width characters), those are dropped.
+	*/
+	_col_cells.assign(_cols, NoCell);
+
+	uint col = 0;
+
+	for (size_t i = 0; i < row.chars.size(); i++) {
+		if (row.chars[i] == U'\r')
+			col = 0;
+		else if (col < _cols)
+			_col_cells[col++] = static_cast<uint32_t>(i);
+	}
+
+	/* 'dst' points into write-combined mapped memory,
+	*  instances are written sequentially and never read back.
+	*  Glyphs go to the first half of the slot, background runs to the second one.
+	*/
+	ShaderBgRunInfo* const runs = reinterpret_cast<ShaderBgRunInfo*>(dst + _cols);
+
+	uint32_t glyph_cnt = 0;
+	uint32_t run_cnt = 0;
+	bool     pending = false;
+
+	// neighbouring cells usually share the style
+	CellAttr last_attr = {};
+	uint32_t last_style = 0;
+
+	uint     run_begin = 0;
+	uint32_t run_bg = 0;
+	uint32_t run_style = 0;
+
+	// one step past the last column closes the last run
+	for (col = 0; col <= _cols; col++) {
+		const uint32_t idx = col < _cols ? _col_cells[col] : NoCell;
+		uint32_t bg = 0;
+
+		if (idx != NoCell) {
+			const CellAttr& attr = row.attrs[idx];
+
+			if (!isSameAttr(attr, last_attr)) {
+				last_attr = attr;
+				last_style = getStyleIdx(attr);
+			}
+
+			bg = packColor(attr.bg);
+
+			const char32_t ch = row.chars[idx];
+
+			// blank cell is just its background
+			if (ch != U' ') {
+				const uint32_t id = getGlyphId(ch);
+
+				// glyph not rasterized yet, cell stays blank
+				if (id != GlyphTable::NoGlyph) {
+					THR_ASSERT(id <= _GlyphIdMask);
+					dst[glyph_cnt++] = ShaderCellInfo{ id | (col << 20), slot | (last_style << 16) };
+				}
+				else {
+					pending = true;
+				}
+			}
+		}
+
+		if (bg == run_bg)
+			continue;
+
+		// default background is the cleared screen
+		if (run_bg != 0)
+			runs[run_cnt++] = ShaderBgRunInfo{ run_begin | (col << 16), slot | (run_style << 16) };
+
+		run_begin = col;
+		run_bg = bg;
+		run_style = last_style;
+	}
+
+	_slots[_instances.getCurrentRegion()][slot] = RowSlot{ 
+		row.ln_num, row.begin, row.end, row.version, glyph_cnt, run_cnt, true, pending
+	};
+}
+
+void TextRender::buildDrawCommands(const Vec<RowSlot>& slots, size_t row_cnt)
+{
+	const GLuint base = _instances.getBaseInstance();
+
+	_draw_cmds.clear();
+	_bg_run_cnt = 0;
+	_glyph_cnt = 0;
+
+	for (size_t i = 0; i < row_cnt; i++) {
+		const uint32_t s = _screen_slots[i];
+
+		if (slots[s].run_cnt == 0)
+			continue;
+
+		_draw_cmds.push_back(DrawCommand{ 4, slots[s].run_cnt, 0, base + s * _slot_stride + _cols });
+		_bg_run_cnt += slots[s].run_cnt;
+	}
+
+	_bg_cmd_cnt = _draw_cmds.size();
+
+	for (size_t i = 0; i < row_cnt; i++) {
+		const uint32_t s = _screen_slots[i];
+
+		if (slots[s].glyph_cnt == 0)
+			continue;
+
+		_draw_cmds.push_back(DrawCommand{ 4, slots[s].glyph_cnt, 0, base + s * _slot_stride });
+		_glyph_cnt += slots[s].glyph_cnt;
+	}
+
+	if (!_multi_draw || _draw_cmds.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _cmd_buf_id);
+
+	if (_draw_cmds.size() > _cmd_capacity)
+		_cmd_capacity = std::max(_draw_cmds.size(), 2 * _cmd_capacity);
+
+	// orphan the previous commands, the GPU may still read them
+	glBufferData(GL_DRAW_INDIRECT_BUFFER,
+				 _cmd_capacity * sizeof(DrawCommand),
+				 nullptr,
+				 GL_STREAM_DRAW);
+
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+					_draw_cmds.size() * sizeof(DrawCommand),
+					reinterpret_cast<GLvoid*>(_draw_cmds.data()));
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void TextRender::drawCommands(size_t first, size_t count) const
+{
+	if (count == 0)
+		return;
+
+	if (_multi_draw) {
+		glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP,
+								  reinterpret_cast<const GLvoid*>(first * sizeof(DrawCommand)),
+								  static_cast<GLsizei>(count),
+								  0);
+		return;
+	}
+
+	for (size_t i = first; i < first + count; i++) {
+		const DrawCommand& cmd = _draw_cmds[i];
+
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 
+										  static_cast<GLint>(cmd.first), 
+										  static_cast<GLsizei>(cmd.count),
+										  static_cast<GLsizei>(cmd.instance_cnt), 
+										  cmd.base_instance);
+	}
+}
+
 TextRender::~TextRender() 
 {
 	if (!_initialized)
 		return;
 
-	if (_vao_id_ptr != nullptr && glIsVertexArray(*_vao_id_ptr) == GL_TRUE) {
-		glDeleteVertexArrays(1, _vao_id_ptr.get());
+	if (_row_lookup_tex_id != 0) {
+		glDeleteTextures(1, std::addressof(_row_lookup_tex_id));
+	}
+
+	if (_style_tex_id != 0) {
+		glDeleteTextures(1, std::addressof(_style_tex_id));
+	}
+
+	if (_cmd_buf_id != 0) {
+		glDeleteBuffers(1, std::addressof(_cmd_buf_id));
 	}
 
-	if (_vbo_id != 0) {
-		glDeleteBuffers(1, std::addressof(_vbo_id));
+	if (_bg_vao_id != 0) {
+		glDeleteVertexArrays(1, std::addressof(_bg_vao_id));
+	}
+
+	if (_style_buf_id != 0) {
+		glDeleteBuffers(1, std::addressof(_style_buf_id));
+	}
+
+	if (_row_lookup_buf_id != 0) {
+		glDeleteBuffers(1, std::addressof(_row_lookup_buf_id));
+	}
+
+	if (_hl_vao_id != 0) {
+		glDeleteVertexArrays(1, std::addressof(_hl_vao_id));
+	}
+
+	if (_hl_vbo_id != 0) {
+		glDeleteBuffers(1, std::addressof(_hl_vbo_id));
+	}
+
+	if (_cursor_vao_id != 0) {
+		glDeleteVertexArrays(1, std::addressof(_cursor_vao_id));
+	}
+
+	if (_overlay_vao_id != 0) {
+		glDeleteVertexArrays(1, std::addressof(_overlay_vao_id));
+	}
+
+	if (_overlay_vbo_id != 0) {
+		glDeleteBuffers(1, std::addressof(_overlay_vbo_id));
+	}
+
+	if (_vao_id_ptr != nullptr && glIsVertexArray(*_vao_id_ptr) == GL_TRUE) {
+		glDeleteVertexArrays(1, _vao_id_ptr.get());
 	}
 
 	if (_base_vbo_id != 0) {
@@ -204,73 +803,177 @@ void TextRender::submitCurrFrame(const RenderFramePacket& packet)
 		return;
 	}
 
-	const size_t total_cells = _cols * _rows;
+	static constexpr uint32_t NoSlot = static_cast<uint32_t>(-1);
 
-	Vec<ShaderCellInfo> buffer;
-	buffer.reserve(total_cells); // TODO: preallocate that and reuse every time we got here
+	THR_ASSERT(packet.snapshot != nullptr);
 
-	const glm::ivec2 cell_size = _fmt.getCellSize();
-	const glm::ivec2 offset = _fmt.getCellOffset();
-	const glm::ivec2 total_shift = cell_size + offset;
+	beginPhase(FRAME_PHASE_PACK);
 
-	uint xpos = 0;
-	uint ypos = 0;
+	const auto& rows = packet.snapshot->rows;
+	const size_t row_cnt = std::min<size_t>(rows.size(), _rows);
+
+	/* Glyphs probed from now on are the ones in use */
+	_atlas.beginFrame();
+	const size_t evicted_cnt = _atlas.getEvictionCount();
+
+	/* Rows drawn without some of their glyphs are written again
+	*  once the glyphs arrive.
+	*/
+	if (_atlas.uploadReadyGlyphs() > 0) {
+		for (Vec<RowSlot>& slots : _slots)
+			for (RowSlot& slot : slots)
+				slot.valid &= !slot.pending;
+	}
 
-	for (const auto& ln : packet.ln_ptrs->getVec()) {
-		THR_ASSERT(ln != nullptr);
+	const auto slotLess = [](const RowSlot& slot, const SnapshotRow& row) {
+		return slot.ln_num < row.ln_num || (slot.ln_num == row.ln_num && slot.begin < row.begin);
+	};
 
-		const Vec<Cell>& cells = ln->getVec();
+	/* Drop the styles no longer in use once in a while. Every slot references
+	*  the old indices, so all of them are written again.
+	*/
+	if (_styles.size() > _StyleLimit) {
+		THR_LOG_DEBUG("Style table reached {} entries, rebuilding", _styles.size());
+
+		resetStyles();
+
+		for (Vec<RowSlot>& slots : _slots)
+			for (RowSlot& slot : slots)
+				slot.valid = false;
+	}
+
+	/* Region the GPU is done with - it holds the screen of a few frames ago,
+	*  only the rows changed since then are written.
+	*/
+	ShaderCellInfo* const region = reinterpret_cast<ShaderCellInfo*>(_instances.beginWrite());
+
+	if (region == nullptr) {
+		endPhase(FRAME_PHASE_PACK);
+		THR_LOG_ERROR("Failed to submit frame of text to TextRender subsystem");
+		return;
+	}
 
-		for (const auto& cell : cells) {
-			const auto codepoint = cell.ch;
+	Vec<RowSlot>& slots = _slots[_instances.getCurrentRegion()];
 
-			bool add_character = true;
+	_screen_slots.assign(row_cnt, NoSlot);
+	_slot_used.assign(_rows, 0);
 
-			switch (codepoint) {
-			case U'\r':
-				xpos = 0;
-				add_character = false;
+	/* Both the visible rows and the valid slots sorted by (line, first cell),
+	*  so the rows still held by some slot are found in a single pass.
+	*/
+	_slot_order.clear();
+
+	for (uint32_t s = 0; s < _rows; s++) {
+		if (slots[s].valid)
+			_slot_order.push_back(s);
+	}
+
+	std::sort(_slot_order.begin(), _slot_order.end(), [&slots](uint32_t a, uint32_t b) {
+		const RowSlot& sa = slots[a];
+		const RowSlot& sb = slots[b];
+		return sa.ln_num < sb.ln_num || (sa.ln_num == sb.ln_num && sa.begin < sb.begin);
+	});
+
+	size_t k = 0;
+
+	for (size_t i = 0; i < row_cnt; i++) {
+		const SnapshotRow& row = *rows[i];
+
+		while (k < _slot_order.size() && slotLess(slots[_slot_order[k]], row))
+			k++;
+
+		for (; k < _slot_order.size(); k++) {
+			RowSlot& slot = slots[_slot_order[k]];
+
+			if (slot.ln_num != row.ln_num || slot.begin != row.begin)
 				break;
+
+			if (_screen_slots[i] == NoSlot &&
+				slot.end == row.end &&
+				slot.version == row.version) {
+				_screen_slots[i] = _slot_order[k];
+				_slot_used[_slot_order[k]] = 1;
 			}
-			
-			if (!add_character)
-				continue;
+			else {
+				slot.valid = false;
+			}
+		}
+	}
 
-			GlyphInfo info;
-			uint32_t id = _atlas.getGlyphInfo(codepoint, info);
+	/* Fill the rest of the rows into free slots, invalid ones first,
+	*  so the rows that just went out of view stay cached as long as possible.
+	*/
+	size_t uploaded = 0;
+	uint32_t free_invalid = 0;
+	uint32_t free_valid = 0;
 
-			if (id == static_cast<uint32_t>(-1)) {
-				_atlas.addGlyph(codepoint);
-				id = _atlas.getGlyphInfo(codepoint, info);
-			}
+	for (size_t i = 0; i < row_cnt; i++) {
+		if (_screen_slots[i] != NoSlot)
+			continue;
+
+		while (free_invalid < _rows && (_slot_used[free_invalid] || slots[free_invalid].valid))
+			free_invalid++;
 
-			THR_ASSERT(info.id == id);
-			THR_ASSERT(info.advance == static_cast<int>(cell_size.x));
+		uint32_t slot = free_invalid;
 
-			buffer.push_back(ShaderCellInfo{
-				glm::u32vec2{ xpos, ypos },
-				id,
-				cell.fg,
-				cell.bg
-			});
+		if (slot == _rows) {
+			while (free_valid < _rows && _slot_used[free_valid])
+				free_valid++;
 
-			xpos += total_shift.x;
+			slot = free_valid;
 		}
 
-		ypos += total_shift.y;
-		xpos = 0;
+		THR_ASSERT(slot < _rows);
+
+		fillRowSlot(*rows[i], slot, region + static_cast<size_t>(slot) * _slot_stride);
+		_screen_slots[i] = slot;
+		_slot_used[slot] = 1;
+		uploaded++;
 	}
 
-	THR_ASSERT(!buffer.empty());
+	if (!_overlay_lines.empty())
+		buildOverlay();
 
-	glBindVertexArray(*_vao_id_ptr);
+	/* Glyphs of the rows kept from the previous frames aren't probed, so the atlas
+	*  could evict some of them and hand their ids to other glyphs.
+	*  Evictions are rare - write all the visible rows again, slots of the other regions
+	*  get rewritten once reused.
+	*/
+	if (_atlas.getEvictionCount() != evicted_cnt) {
+		THR_LOG_DEBUG("Font atlas evicted glyphs, writing all the rows again");
+
+		for (Vec<RowSlot>& region_slots : _slots)
+			for (RowSlot& slot : region_slots)
+				slot.valid = false;
+
+		for (size_t i = 0; i < row_cnt; i++)
+			fillRowSlot(*rows[i], _screen_slots[i], region + static_cast<size_t>(_screen_slots[i]) * _slot_stride);
+
+		uploaded = row_cnt;
+	}
+
+	_instances.endWrite();
 
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo_id);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, 
-					buffer.size() * sizeof(ShaderCellInfo), 
-					reinterpret_cast<GLvoid*>(buffer.data()));
+	endPhase(FRAME_PHASE_PACK);
+	beginPhase(FRAME_PHASE_UPLOAD);
 
-	_cell_count = buffer.size();
+	uploadStyles();
+
+	std::fill_n(_row_lookup.begin(), _rows, -1);
+
+	for (size_t i = 0; i < row_cnt; i++)
+		_row_lookup[_screen_slots[i]] = static_cast<GLint>(i);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _row_lookup_buf_id);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0,
+					_row_lookup.size() * sizeof(GLint),
+					reinterpret_cast<GLvoid*>(_row_lookup.data()));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	buildDrawCommands(slots, row_cnt);
+	_uploaded_rows = uploaded;
+
+	endPhase(FRAME_PHASE_UPLOAD);
 
 	const GLenum err = pollGlErrors([](GLenum err) {
 		THR_LOG_ERROR("OpenGL error during TextRender frame submission: {}", getGlErrorStr(err));
@@ -281,23 +984,407 @@ void TextRender::submitCurrFrame(const RenderFramePacket& packet)
 	}
 }
 
-void TextRender::renderText() const
+void TextRender::saveGlyphCache()
+{
+	if (!_initialized)
+		return;
+
+	_atlas.saveCache();
+}
+
+bool TextRender::hasNewGlyphs() const
+{
+	return _initialized && _atlas.hasReadyGlyphs();
+}
+
+bool TextRender::hasPendingGlyphs() const
+{
+	return _initialized && _atlas.getRequestedCount() > 0;
+}
+
+void TextRender::setGlyphReadyCallback(std::function<void()> callback)
+{
+	_atlas.setReadyCallback(std::move(callback));
+}
+
+size_t TextRender::getUploadedRowCount() const
+{
+	return _uploaded_rows;
+}
+
+uint TextRender::getAtlasPageCount() const
+{
+	return _atlas.getPageCount();
+}
+
+size_t TextRender::getGlyphInstanceCount() const
+{
+	return _glyph_cnt;
+}
+
+size_t TextRender::getBackgroundRunCount() const
+{
+	return _bg_run_cnt;
+}
+
+uint TextRender::getCellXPos(const SnapshotRow& row, uint32_t idx) const
+{
+	const uint shift = _fmt.getCellSize().x + _fmt.getCellOffset().x;
+
+	uint xpos = 0;
+
+	/* Follow the layout of fillRowSlot */
+	for (uint32_t i = row.begin; i < idx; i++) {
+		if (row.chars[i - row.begin] == U'\r')
+			xpos = 0;
+		else
+			xpos += shift;
+	}
+
+	return xpos;
+}
+
+void TextRender::submitHighlights(const ScreenSnapshot& snapshot, const Vec<SearchMatch>& matches)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("TextRender subsystem is not initialized, can't submit highlights");
+		return;
+	}
+
+	_hl_rects.clear();
+
+	const glm::ivec2 cell_size = _fmt.getCellSize();
+	const glm::ivec2 total_shift = cell_size + _fmt.getCellOffset();
+
+	uint ypos = 0;
+	size_t first_match = 0;
+
+	for (const auto& row_ptr : snapshot.rows) {
+		const SnapshotRow& row = *row_ptr;
+
+		while (first_match < matches.size() && matches[first_match].ln < row.ln_num)
+			first_match++;
+
+		for (size_t i = first_match; i < matches.size() && matches[i].ln == row.ln_num; i++) {
+			const uint32_t begin = std::max(matches[i].begin, row.begin);
+			const uint32_t end = std::min(matches[i].end, row.end);
+
+			if (begin >= end)
+				continue;
+
+			const uint xbegin = getCellXPos(row, begin);
+			const uint xend = getCellXPos(row, end);
+
+			if (xend <= xbegin)
+				continue;
+
+			_hl_rects.emplace_back(xbegin, ypos, xend - xbegin, static_cast<uint>(cell_size.y));
+		}
+
+		ypos += total_shift.y;
+	}
+
+	_hl_count = _hl_rects.size();
+
+	if (_hl_rects.empty())
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _hl_vbo_id);
+
+	if (_hl_rects.size() > _hl_capacity) {
+		_hl_capacity = std::max(_hl_rects.size(), 2 * _hl_capacity);
+
+		glBufferData(GL_ARRAY_BUFFER,
+					 _hl_capacity * sizeof(glm::u32vec4),
+					 nullptr,
+					 GL_DYNAMIC_DRAW);
+	}
+
+	glBufferSubData(GL_ARRAY_BUFFER, 0,
+					_hl_rects.size() * sizeof(glm::u32vec4),
+					reinterpret_cast<GLvoid*>(_hl_rects.data()));
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during TextRender highlights submission: {}", getGlErrorStr(err));
+	});
+}
+
+void TextRender::renderHighlights() const
+{
+	if (_hl_count == 0)
+		return;
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindVertexArray(_hl_vao_id);
+	_hl_shader->prog.useProgram();
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(_hl_count));
+
+	glBindVertexArray(0);
+	_hl_shader->prog.unuseProgram();
+	glDisable(GL_BLEND);
+}
+
+void TextRender::initCursor(ProgramCache& program_cache)
+{
+	glGenVertexArrays(1, std::addressof(_cursor_vao_id));
+	glBindVertexArray(_cursor_vao_id);
+	THR_HARD_ASSERT(_cursor_vao_id != 0 && glIsVertexArray(_cursor_vao_id) == GL_TRUE);
+
+	// single unit quad, no instances
+	glBindBuffer(GL_ARRAY_BUFFER, _base_vbo_id);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 
+						  2, GL_FLOAT, GL_FALSE, 
+						  2 * sizeof(float), 
+						  nullptr);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	buildProgram(*_cursor_shader, "CursorShader", program_cache);
+
+	_cursor_cell_loc = _cursor_shader->prog.getUniformLocation("CursorCell");
+	_cursor_shape_loc = _cursor_shader->prog.getUniformLocation("CursorShape");
+	_blink_time_loc = _cursor_shader->prog.getUniformLocation("BlinkTime");
+
+	{
+		_cursor_shader->prog.useProgram();
+
+		const glm::ivec2 window_size = _fmt.getWindowSize();
+		const glm::ivec2 cell_size = _fmt.getCellSize();
+		const float interval = std::chrono::duration<float>(CursorBlinkInterval).count();
+
+		_cursor_shader->prog.setUniform2<GLuint>("ScreenResPix", window_size.x, window_size.y);
+		_cursor_shader->prog.setUniform2<GLuint>("CellSizePix", cell_size.x, cell_size.y);
+		_cursor_shader->prog.setUniform1<GLuint>("RowStridePix", cell_size.y + _fmt.getCellOffset().y);
+		_cursor_shader->prog.setUniform1<GLuint>("ColumnStridePix", cell_size.x + _fmt.getCellOffset().x);
+		_cursor_shader->prog.setUniform1<GLfloat>("BlinkInterval", interval);
+
+		_cursor_shader->prog.unuseProgram();
+	}
+}
+
+void TextRender::renderCursor() const
+{
+	if (!_cursor.visible || _cursor.row >= _rows || _cursor.col >= _cols)
+		return;
+
+	const float blink_time = std::chrono::duration<float>(getCursorBlinkTime()).count();
+
+	// white source inverts the destination
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
+
+	glBindVertexArray(_cursor_vao_id);
+	_cursor_shader->prog.useProgram();
+
+	_cursor_shader->prog.setUniform2<GLuint>(_cursor_cell_loc, _cursor.col, _cursor.row);
+	_cursor_shader->prog.setUniform1<GLuint>(_cursor_shape_loc, _cursor.shape);
+	_cursor_shader->prog.setUniform1<GLfloat>(_blink_time_loc, blink_time);
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+	glBindVertexArray(0);
+	_cursor_shader->prog.unuseProgram();
+	glDisable(GL_BLEND);
+}
+
+void TextRender::initOverlay()
+{
+	glGenVertexArrays(1, std::addressof(_overlay_vao_id));
+	glBindVertexArray(_overlay_vao_id);
+	THR_HARD_ASSERT(_overlay_vao_id != 0 && glIsVertexArray(_overlay_vao_id) == GL_TRUE);
+
+	// share the unit quad with text instances
+	glBindBuffer(GL_ARRAY_BUFFER, _base_vbo_id);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 
+						  2, GL_FLOAT, GL_FALSE, 
+						  2 * sizeof(float), 
+						  nullptr);
+
+	glGenBuffers(1, std::addressof(_overlay_vbo_id));
+	glBindBuffer(GL_ARRAY_BUFFER, _overlay_vbo_id);
+	THR_HARD_ASSERT(_overlay_vbo_id != 0 && glIsBuffer(_overlay_vbo_id) == GL_TRUE);
+
+	/* Glyphs and background runs share the layout,
+	*  both passes read the same attributes
+	*/
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribIPointer(1, 
+						   1, GL_UNSIGNED_INT, 
+						   sizeof(ShaderCellInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, glyph)));
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1);
+	glVertexAttribIPointer(2, 
+						   1, GL_UNSIGNED_INT,
+						   sizeof(ShaderCellInfo), 
+						   reinterpret_cast<GLvoid*>(offsetof(ShaderCellInfo, slot_style)));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TextRender::submitOverlay(const Vec<std::string>& lines)
+{
+	if (!_initialized) {
+		THR_LOG_ERROR("TextRender subsystem is not initialized, can't submit overlay");
+		return;
+	}
+
+	_overlay_lines = lines;
+	buildOverlay();
+	uploadStyles();
+
+	pollGlErrors([](GLenum err) {
+		THR_LOG_ERROR("OpenGL error during TextRender overlay submission: {}", getGlErrorStr(err));
+	});
+}
+
+void TextRender::buildOverlay()
+{
+	_overlay_instances.clear();
+	_overlay_run_cnt = 0;
+	_overlay_glyph_cnt = 0;
+
+	const size_t line_cnt = std::min<size_t>({ _overlay_lines.size(), _OverlayRows, _rows });
+	size_t width = 0;
+
+	for (size_t i = 0; i < line_cnt; i++)
+		width = std::max(width, _overlay_lines[i].size());
+
+	width = std::min<size_t>(width, _cols);
+
+	if (width == 0)
+		return;
+
+	CellAttr attr = {};
+	attr.fg.r = 255;
+	attr.fg.g = 220;
+	attr.fg.b = 0;
+	attr.bg.r = 40;
+	attr.bg.g = 40;
+	attr.bg.b = 40;
+
+	const uint32_t style = getStyleIdx(attr);
+	// lines are right aligned, padded to the widest one
+	const uint32_t first_col = static_cast<uint32_t>(_cols - width);
+
+	for (size_t i = 0; i < line_cnt; i++) {
+		const uint32_t slot = static_cast<uint32_t>(_rows + i);
+		_overlay_instances.push_back(ShaderCellInfo{ first_col | (_cols << 16), slot | (style << 16) });
+	}
+
+	_overlay_run_cnt = _overlay_instances.size();
+
+	for (size_t i = 0; i < line_cnt; i++) {
+		const std::string& line = _overlay_lines[i];
+		const uint32_t slot = static_cast<uint32_t>(_rows + i);
+
+		for (size_t c = 0; c < std::min(line.size(), width); c++) {
+			if (line[c] == ' ')
+				continue;
+
+			const uint32_t id = getGlyphId(static_cast<char32_t>(static_cast<uchar>(line[c])));
+
+			if (id == GlyphTable::NoGlyph)
+				continue;
+
+			const uint32_t col = first_col + static_cast<uint32_t>(c);
+			_overlay_instances.push_back(ShaderCellInfo{ id | (col << 20), slot | (style << 16) });
+		}
+	}
+
+	_overlay_glyph_cnt = _overlay_instances.size() - _overlay_run_cnt;
+
+	// few hundred instances at most, rewritten as a whole
+	glBindBuffer(GL_ARRAY_BUFFER, _overlay_vbo_id);
+	glBufferData(GL_ARRAY_BUFFER,
+				 _overlay_instances.size() * sizeof(ShaderCellInfo),
+				 reinterpret_cast<GLvoid*>(_overlay_instances.data()),
+				 GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TextRender::renderOverlay() const
+{
+	if (_overlay_lines.empty() || _overlay_run_cnt == 0)
+		return;
+
+	_atlas.bindAtlas();
+	glActiveTexture(_RowLookupUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, _row_lookup_tex_id);
+	glActiveTexture(_StyleLookupUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, _style_tex_id);
+
+	glBindVertexArray(_overlay_vao_id);
+
+	_bg_shader->prog.useProgram();
+	glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4,
+									  static_cast<GLsizei>(_overlay_run_cnt), 0);
+
+	if (_overlay_glyph_cnt > 0) {
+		_shader->prog.useProgram();
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4,
+										  static_cast<GLsizei>(_overlay_glyph_cnt),
+										  static_cast<GLuint>(_overlay_run_cnt));
+	}
+
+	glBindVertexArray(0);
+	_atlas.unbindAtlas();
+	_shader->prog.unuseProgram();
+}
+
+void TextRender::renderText()
 {
 	if (!_initialized) {
 		THR_LOG_ERROR("TextRender subsystem is not initialized, can't render frame of text");
 		return;
 	}
 
+	beginPhase(FRAME_PHASE_DRAW);
+
 	_atlas.bindAtlas();
+	glActiveTexture(_RowLookupUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, _row_lookup_tex_id);
+	glActiveTexture(_StyleLookupUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, _style_tex_id);
+
+	if (_multi_draw)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _cmd_buf_id);
+
+	/* Backgrounds first, glyphs are drawn over them */
+	glBindVertexArray(_bg_vao_id);
+	_bg_shader->prog.useProgram();
+	drawCommands(0, _bg_cmd_cnt);
+
 	glBindVertexArray(*_vao_id_ptr);
 	_shader->prog.useProgram();
+	drawCommands(_bg_cmd_cnt, _draw_cmds.size() - _bg_cmd_cnt);
 
-	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(_cell_count));
+	_instances.fenceCurrent();
+
+	if (_multi_draw)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
 	glBindVertexArray(0);
 	_atlas.unbindAtlas();
 	_shader->prog.unuseProgram();
 
+	renderHighlights();
+	renderCursor();
+	renderOverlay();
+
+	endPhase(FRAME_PHASE_DRAW);
+
 	pollGlErrors([](GLenum err) {
 		THR_LOG_ERROR("OpenGL error during TextRender frame rendering: {}", getGlErrorStr(err));
 	});
@@ -1,42 +1,131 @@
 #pragma once
 
+#include "Renderer.hpp"
 #include "Shader.hpp"
 #include "Atlas.hpp"
+#include "ProgramCache.hpp"
+#include "InstanceRing.hpp"
 #include "screen/Line.hpp"
 #include "RenderFormat.hpp"
 #include "screen/Grid.hpp"
+#include <unordered_map>
 
 namespace Thr
 {
 
-/* Rendering frame data
-*/
-struct RenderFramePacket
-{
-	std::shared_ptr<const LinePtrBuf> ln_ptrs;
-};
+struct ShaderCellInfo;
+struct ShaderBgRunInfo;
 
-class TextRender
+class TextRender : public Renderer
 {
 public:
 	TextRender();
-	~TextRender();
+	~TextRender() override;
 
 	TextRender(const TextRender&) = delete;
 	TextRender(TextRender&&) = delete;
 
-	void init(const RenderFormat& fmt);
-	void getRenderFormat(RenderFormat& fmt);
+	/* 'glyph_cache' - file rasterized glyphs are loaded from and saved to,
+	*  'shader_cache' - file linked shader programs are kept in,
+	*  none by default.
+	*/
+	void init(const RenderFormat& fmt, const FilePath& glyph_cache = UndefFilePath,
+			  const FilePath& shader_cache = UndefFilePath) override;
+	void getRenderFormat(RenderFormat& fmt) override;
+
+	/* Save glyphs rasterized so far into the cache file given at init.
+	*/
+	void saveGlyphCache() override;
+
+	/* Adapt to new window size. Cell size stays the one chosen at init.
+	*  Instance buffer is reallocated only when it can't hold the new grid.
+	*/
+	void resize(const RenderFormat& fmt) override;
 		
 	TextRender operator=(const TextRender&) = delete;
 	TextRender operator=(TextRender&&) = delete;
 
-	void submitCurrFrame(const RenderFramePacket& packet);
-	void renderText() const;
+	void submitCurrFrame(const RenderFramePacket& packet) override;
+
+	/* Glyphs missing in the submitted frames are rendered in the background,
+	*  cells wait blank until they arrive. True once some of them are ready -
+	*  the frame has to be submitted again to show them.
+	*/
+	bool hasNewGlyphs() const override;
+
+	/* True while some glyphs of the submitted frames are still being rasterized,
+	*  ready ones included.
+	*/
+	bool hasPendingGlyphs() const override;
+
+	/* Called from the rasterizer thread once glyphs requested by the submitted
+	*  frames are ready - 'hasNewGlyphs' is true then. Can be set before 'init'.
+	*/
+	void setGlyphReadyCallback(std::function<void()> callback) override;
+
+	/* Number of rows uploaded by the last submitted frame.
+	*/
+	size_t getUploadedRowCount() const override;
+
+	/* Pages of the glyph atlas, at most FontAtlas::MaxPages.
+	*/
+	uint getAtlasPageCount() const override;
+
+	/* Instances drawn for the last submitted frame - glyphs of the non-blank cells
+	*  and runs of cells with the same non-default background.
+	*/
+	size_t getGlyphInstanceCount() const;
+	size_t getBackgroundRunCount() const;
 
-	void clearScreen(Color4f col);
+	/* Upload search match highlights for rows of the last submitted snapshot.
+	*  Only the highlight rectangles are uploaded, glyph instances are left intact.
+	*  'matches' have to be sorted by line number.
+	*/
+	void submitHighlights(const ScreenSnapshot& snapshot, const Vec<SearchMatch>& matches) override;
+
+	/* Overlay lines are drawn from row slots past the grid, which map to the top
+	*  screen rows, and are built again with every frame so their glyphs are
+	*  probed like the glyphs of the grid.
+	*/
+	void submitOverlay(const Vec<std::string>& lines) override;
+
+	/* Draws the text, then the cursor over it. Cursor position, shape and blink
+	*  time are uniforms, the blink phase is resolved in the shader.
+	*/
+	void renderText() override;
+
+	void clearScreen(Color4f col) override;
 private:
 
+	/* Every region of the instance ring is split into slots of a single row -
+	*  _cols glyph instances followed by _cols background runs, only 'glyph_cnt'
+	*  and 'run_cnt' of them are used. Slot holding a row stays valid as long as
+	*  the row doesn't change, so scrolling writes only the rows that newly came
+	*  into view since the region was last written, together with the tiny
+	*  slot -> screen row lookup buffer.
+	*/
+	struct RowSlot
+	{
+		size_t   ln_num    = 0;
+		uint32_t begin     = 0;
+		uint32_t end       = 0;
+		uint32_t version   = 0;
+		uint32_t glyph_cnt = 0;
+		uint32_t run_cnt   = 0;
+		bool     valid     = false;
+		// some glyphs were still being rasterized
+		bool     pending   = false;
+	};
+
+	/* Layout of DrawArraysIndirectCommand */
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instance_cnt;
+		GLuint first;
+		GLuint base_instance;
+	};
+
 	struct ShaderProgram
 	{
 		GLShaderStage vert = GLShaderStage(SHADER_STAGE_VERTEX);
@@ -44,19 +133,109 @@ private:
 		GLShader	  prog;
 	};
 
-	static constexpr int DefaultAtlasWidth  = 256;
-	static constexpr int DefaultAtlasHeight = 256;
+	static constexpr int DefaultAtlasWidth  = 512;
+	static constexpr int DefaultAtlasHeight = 512;
+	// texture units 0-2 are used by the atlas
+	static constexpr GLenum _RowLookupUnit = GL_TEXTURE3;
+	static constexpr GLenum _StyleLookupUnit = GL_TEXTURE4;
+	/* Distinct styles kept before the table is rebuilt from scratch.
+	*  Single frame may still exceed it, the limit is checked between frames.
+	*/
+	static constexpr size_t _StyleLimit = 0x8000;
+	// style index is stored in 16 bits of the instance
+	static constexpr size_t _MaxStyles = 0x10000;
+	// column is stored in 12 bits of the glyph instance, glyph id in the rest
+	static constexpr uint _MaxColumns = 0x1000;
+	static constexpr uint32_t _GlyphIdMask = 0xFFFFF;
+	// zeroed color of the cell stands for the default one
+	static constexpr uint32_t _DefaultFg = 0xFFFFFF;
+	static constexpr uint32_t _DefaultBg = 0x000000;
+	// row slots reserved for the overlay, past the slots of the grid
+	static constexpr uint _OverlayRows = 16;
+
+	void setupInstanceAttribs();
+	void resetRowSlots();
+	void updateGridSize();
+	void fillRowSlot(const SnapshotRow& row, uint32_t slot, ShaderCellInfo* dst);
+	void buildDrawCommands(const Vec<RowSlot>& slots, size_t row_cnt);
+	void drawCommands(size_t first, size_t count) const;
+	void initBackgrounds(ProgramCache& program_cache);
+	void buildProgram(ShaderProgram& shader, std::string_view name, ProgramCache& program_cache);
+	uint32_t getGlyphId(char32_t codepoint);
+	uint32_t getStyleIdx(const CellAttr& attr);
+	void resetStyles();
+	void uploadStyles();
+	void initHighlights(ProgramCache& program_cache);
+	void renderHighlights() const;
+	void initCursor(ProgramCache& program_cache);
+	void renderCursor() const;
+	void initOverlay();
+	void buildOverlay();
+	void renderOverlay() const;
+	uint getCellXPos(const SnapshotRow& row, uint32_t idx) const;
 
 	FontAtlas					   _atlas;
 	// we share VAO that with atlas and other subsystems
 	std::shared_ptr<GLuint>		   _vao_id_ptr;
 	GLuint						   _base_vbo_id;
-	GLuint						   _vbo_id;
 	RenderFormat				   _fmt;
 	uint 						   _cols;
 	uint 						   _rows;
 	std::unique_ptr<ShaderProgram> _shader;
-	size_t						   _cell_count;
+	uint 						   _slot_stride;
+	InstanceRing				   _instances;
+	// slots of every region of the instance ring
+	Arr<Vec<RowSlot>, InstanceRing::RegionCount> _slots;
+	Vec<GLint>					   _row_lookup;
+	Vec<uint32_t>				   _screen_slots;
+	Vec<uint32_t>				   _slot_order;
+	Vec<byte>					   _slot_used;
+	// cells of the row being filled, resolved to columns
+	Vec<uint32_t>				   _col_cells;
+	/* Background runs, then glyphs of the rows on screen.
+	*  Drawn with a single multi-draw when it's supported.
+	*/
+	Vec<DrawCommand>			   _draw_cmds;
+	size_t						   _bg_cmd_cnt;
+	GLuint						   _cmd_buf_id;
+	size_t						   _cmd_capacity;
+	bool						   _multi_draw;
+	size_t						   _glyph_cnt;
+	size_t						   _bg_run_cnt;
+	GLuint						   _bg_vao_id;
+	std::unique_ptr<ShaderProgram> _bg_shader;
+	size_t						   _uploaded_rows;
+	GLuint						   _row_lookup_buf_id;
+	GLuint						   _row_lookup_tex_id;
+	uint32_t					   _blank_id;
+	/* Palette of (fg, bg) pairs referenced by the instances,
+	*  both colors packed as 0xBBGGRR.
+	*/
+	std::unordered_map<uint64_t, uint32_t> _style_map;
+	Vec<glm::u32vec2>			   _styles;
+	size_t						   _styles_uploaded;
+	size_t						   _style_capacity;
+	GLuint						   _style_buf_id;
+	GLuint						   _style_tex_id;
+	GLuint						   _hl_vao_id;
+	GLuint						   _hl_vbo_id;
+	std::unique_ptr<ShaderProgram> _hl_shader;
+	Vec<glm::u32vec4>			   _hl_rects;
+	size_t						   _hl_capacity;
+	size_t						   _hl_count;
+	GLuint						   _cursor_vao_id;
+	std::unique_ptr<ShaderProgram> _cursor_shader;
+	// uniforms set with every frame, looked up once
+	GLint						   _cursor_cell_loc;
+	GLint						   _cursor_shape_loc;
+	GLint						   _blink_time_loc;
+	// background runs, then glyphs of the overlay lines
+	GLuint						   _overlay_vao_id;
+	GLuint						   _overlay_vbo_id;
+	Vec<ShaderCellInfo>			   _overlay_instances;
+	Vec<std::string>			   _overlay_lines;
+	size_t						   _overlay_run_cnt;
+	size_t						   _overlay_glyph_cnt;
 	bool						   _initialized;
 };
 
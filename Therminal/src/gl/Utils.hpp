@@ -46,10 +46,25 @@ THR_INLINE GLenum pollGlErrors(std::function<void(GLenum)> policy)
 #endif
 }
 
-THR_FORCEINLINE GLint getGlActiveTexUniformVal(GLenum tex) 
+THR_FORCEINLINE GLint getGlActiveTexUniformVal(GLenum tex)
 {
 	THR_ASSERT(tex >= GL_TEXTURE0 && tex <= GL_TEXTURE31);
 	return tex - GL_TEXTURE0;
 }
 
+THR_INLINE bool hasGlExtension(std::string_view name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, std::addressof(count));
+
+	for (GLint i = 0; i < count; i++) {
+		const GLubyte* ext = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+
+		if (ext != nullptr && name == reinterpret_cast<const char*>(ext))
+			return true;
+	}
+
+	return false;
+}
+
 } // namespace Thr
@@ -53,6 +53,16 @@ void IOAppClient::readBytes(BytesBuf& buf)
 	_bridge->_output_buff.swap();
 }
 
+bool IOAppClient::hasBytes() const
+{
+	if (!_bridge) {
+		THR_LOG_FATAL("Unbounded IO bridge");
+		return false;
+	}
+
+	return _bridge->_output_buff.hasWritten();
+}
+
 void IOShellClient::writeBytes(BytesBuf buf)
 {
 	if (!_bridge) {
@@ -61,6 +71,9 @@ void IOShellClient::writeBytes(BytesBuf buf)
 	}
 
 	_bridge->_output_buff.write(buf.ptr, buf.n);
+
+	if (_bridge->_output_callback)
+		_bridge->_output_callback();
 }
 
 bool IOShellClient::readBytes(MutBytesBuf& buf)
@@ -110,6 +123,11 @@ const OutputBuffer& IOBridge::getOutputBuf() const
 	return _output_buff;
 }
 
+void IOBridge::setOutputCallback(std::function<void()> callback)
+{
+	_output_callback = std::move(callback);
+}
+
 IOBridge::IOBridge(size_t input_buf_size, size_t output_buf_size)
 	: _input_circ_buff(input_buf_size)
 	, _output_buff(output_buf_size)
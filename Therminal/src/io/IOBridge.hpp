@@ -5,6 +5,7 @@
 #include "io/InputBuffer.hpp"
 #include "io/OutputBuffer.hpp"
 #include "io/OutputTranslator.hpp"
+#include <functional>
 
 namespace Thr
 {
@@ -30,9 +31,15 @@ public:
 
 	OutputBuffer& getOutputBuf();
 	const OutputBuffer& getOutputBuf() const;
+
+	/* Called from the shell thread after new output is written, so the app
+	*  waiting for events can be woken up. Has to be set before the shell starts.
+	*/
+	void setOutputCallback(std::function<void()> callback);
 private:
-	InputRingBuffer _input_circ_buff;
-	OutputBuffer    _output_buff;
+	InputRingBuffer       _input_circ_buff;
+	OutputBuffer          _output_buff;
+	std::function<void()> _output_callback;
 };
 
 template <typename T>
@@ -79,6 +86,10 @@ public:
 	*  since last 'readBytes' call.
 	*/
 	void readBytes(BytesBuf& buf);
+
+	/* True when some bytes were written since last 'readBytes' call.
+	*/
+	bool hasBytes() const;
 private:
     InputEvTransl _input_ev_transl;
 };
@@ -38,6 +38,24 @@ bool WinInputQueue::waitEvents()
    return true;
 }
 
+bool WinInputQueue::waitEvents(double timeout)
+{
+   const Window* globwin;
+
+   if ((globwin = Window::getGlobWindow()) == nullptr) {
+      THR_LOG_ERROR("No window created for the window input queue");
+      return false;
+   }
+
+   if (!glfwIsInitialized()) {
+      THR_LOG_ERROR("GLFW is not initialized");
+      return false;
+   }
+
+   glfwWaitEventsTimeout(timeout);
+   return true;
+}
+
 bool WinInputQueue::pollEvents() 
 {
    const Window* globwin;
@@ -23,6 +23,12 @@ public:
    */
    bool waitEvents();
 
+   /* Wait for the next event at most 'timeout' seconds, then process
+   *  all received events.
+   *  Return value: true on success, false on failure.
+   */
+   bool waitEvents(double timeout);
+
    /* Poll received events only and return.
    *  Return value: true on success, false on failure.
    */
@@ -15,6 +15,7 @@ public:
 	THR_INLINE void swap();
 	THR_INLINE void write(const byte* buf, int n);
 	THR_INLINE const byte* read(int& n) const;
+	THR_INLINE bool hasWritten() const;
 	THR_INLINE size_t getSize() const;
 private:
 	struct _FlipBuff;
@@ -76,6 +77,12 @@ THR_INLINE const byte* OutputBuffer::read(int& n) const
 	return r;
 }
 
+THR_INLINE bool OutputBuffer::hasWritten() const
+{
+	std::lock_guard<std::mutex> lock(_write_mutex);
+	return _buff_ptr[_WriteSideBuff]->n > 0;
+}
+
 THR_INLINE size_t OutputBuffer::getSize() const
 {
 	return _buf_size;
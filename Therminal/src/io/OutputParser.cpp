@@ -1,7 +1,49 @@
 #include "OutputParser.hpp"
+#include <algorithm>
 
 namespace Thr
 {
+
+/* Zeroed color stands for the default one,
+*  explicit black is stored a step off it
+*/
+static Color3u8 toCellColor(int r, int g, int b)
+{
+    Color3u8 c;
+    c.r = static_cast<uint8_t>(std::min(r, 0xFF));
+    c.g = static_cast<uint8_t>(std::min(g, 0xFF));
+    c.b = static_cast<uint8_t>(std::min(b, 0xFF));
+
+    if (c.r == 0 && c.g == 0 && c.b == 0)
+        c.b = 1;
+
+    return c;
+}
+
+/* xterm 256 color palette - 16 system colors,
+*  6x6x6 color cube and 24 shades of gray
+*/
+static Color3u8 getPaletteColor(int idx)
+{
+    static constexpr Arr<uint8_t, 16 * 3> System = {
+        0,   0,   0,   205, 0,   0,   0,   205, 0,   205, 205, 0,
+        0,   0,   238, 205, 0,   205, 0,   205, 205, 229, 229, 229,
+        127, 127, 127, 255, 0,   0,   0,   255, 0,   255, 255, 0,
+        92,  92,  255, 255, 0,   255, 0,   255, 255, 255, 255, 255
+    };
+    static constexpr Arr<uint8_t, 6> CubeLevels = { 0, 95, 135, 175, 215, 255 };
+
+    if (idx < 16)
+        return toCellColor(System[idx * 3], System[idx * 3 + 1], System[idx * 3 + 2]);
+
+    if (idx < 232) {
+        idx -= 16;
+        return toCellColor(CubeLevels[idx / 36], CubeLevels[idx / 6 % 6], CubeLevels[idx % 6]);
+    }
+
+    const int gray = 8 + 10 * (std::min(idx, 255) - 232);
+    return toCellColor(gray, gray, gray);
+}
     
 OutputParser::OutputParser()
     : _grid(nullptr)
@@ -21,6 +63,8 @@ void OutputParser::parseToGrid(const byte* stream, size_t n)
         return;
     }
 
+    std::lock_guard<Grid> lock(*_grid);
+
     const std::string_view sv(reinterpret_cast<const char*>(stream), n);
     _utf8_to_utf32.setBuf(sv);
 
@@ -48,6 +92,11 @@ void OutputParser::processChar(char32_t ch)
             _control_buf.clear();
             break;
         }
+        if (ch == U']') {
+            _parse_state = enumParseState::OPERATING_SYSTEM_COMMAND;
+            _control_buf.clear();
+            break;
+        }
         _parse_state = enumParseState::RAW;
         break;
     }
@@ -60,6 +109,28 @@ void OutputParser::processChar(char32_t ch)
         _control_buf += static_cast<char>(ch);
         break;
     }
+    case enumParseState::OPERATING_SYSTEM_COMMAND: {
+        /* OSC is terminated either by BEL or by ST (ESC \) */
+        if (ch == U'\x07') {
+            processOSCCommand();
+            _parse_state = enumParseState::RAW;
+            break;
+        }
+        if (ch == U'\x1b') {
+            _parse_state = enumParseState::OPERATING_SYSTEM_COMMAND_ESCAPE;
+            break;
+        }
+        // we only care about short commands, don't let the buffer grow unbounded
+        if (_control_buf.size() < _OSCLenLimit)
+            _control_buf += static_cast<char>(ch);
+        break;
+    }
+    case enumParseState::OPERATING_SYSTEM_COMMAND_ESCAPE: {
+        if (ch == U'\\')
+            processOSCCommand();
+        _parse_state = enumParseState::RAW;
+        break;
+    }
     }
 }
 
@@ -67,7 +138,177 @@ void OutputParser::processCSICommand(char32_t ch)
 {
     switch (ch) {
     case 'm': { /* Select Graphic Rendition	*/
-        // TODO
+        processGraphicRendition();
+        break;
+    }
+    case 'h':   /* Set Mode */
+    case 'l': { /* Reset Mode */
+        /* We only support DEC private modes for now, 
+        *  that is sequences of form CSI ? Pm h / CSI ? Pm l.
+        */
+        if (_control_buf.empty() || _control_buf.front() != '?')
+            break;
+
+        const bool set = (ch == U'h');
+        int mode = 0;
+
+        for (size_t i = 1; i <= _control_buf.size(); i++) {
+            if (i == _control_buf.size() || _control_buf[i] == ';') {
+                processPrivateMode(mode, set);
+                mode = 0;
+            }
+            else if (_control_buf[i] >= '0' && _control_buf[i] <= '9') {
+                mode = mode * 10 + (_control_buf[i] - '0');
+            }
+        }
+        break;
+    }
+    case 'q': { /* Set Cursor Style (DECSCUSR) - CSI Ps SP q */
+        if (_control_buf.empty() || _control_buf.back() != ' ')
+            break;
+
+        int style = 0;
+
+        for (size_t i = 0; i + 1 < _control_buf.size(); i++) {
+            if (_control_buf[i] >= '0' && _control_buf[i] <= '9')
+                style = style * 10 + (_control_buf[i] - '0');
+        }
+
+        /* 0, 1 - blinking block, 2 - steady block, 3, 4 - underline, 5, 6 - bar,
+        *  odd styles blink
+        */
+        static constexpr Arr<CursorShape, 7> Shapes = {
+            CURSOR_SHAPE_BLOCK, CURSOR_SHAPE_BLOCK, CURSOR_SHAPE_BLOCK,
+            CURSOR_SHAPE_UNDERLINE, CURSOR_SHAPE_UNDERLINE,
+            CURSOR_SHAPE_BAR, CURSOR_SHAPE_BAR
+        };
+
+        if (style < static_cast<int>(Shapes.size()))
+            _grid->setCursorStyle(Shapes[style], style == 0 || (style & 1) != 0);
+        break;
+    }
+    case 'J': { /* Erase in Display */
+        /* Only erasing the saved lines (ED 3) is supported for now */
+        if (_control_buf == "3")
+            _grid->clearScrollback();
+        break;
+    }
+    default: break;
+    }
+}
+
+void OutputParser::processGraphicRendition()
+{
+    /* Private sequences sharing the final byte (CSI > Ps m) are not SGR */
+    if (!_control_buf.empty() && _control_buf.front() >= '<' && _control_buf.front() <= '?')
+        return;
+
+    /* Sub-parameters of the extended colors (38:2:r:g:b) are read
+    *  like the parameters, missing parameter is 0
+    */
+    Arr<int, _SGRParamLimit> params;
+    size_t cnt = 0;
+    int value = 0;
+
+    for (size_t i = 0; i <= _control_buf.size(); i++) {
+        if (i == _control_buf.size() || _control_buf[i] == ';' || _control_buf[i] == ':') {
+            if (cnt < params.size())
+                params[cnt++] = value;
+            value = 0;
+        }
+        else if (_control_buf[i] >= '0' && _control_buf[i] <= '9') {
+            value = std::min(value * 10 + (_control_buf[i] - '0'), 0xFFFF);
+        }
+    }
+
+    /* Only the colors are stored with the cells, other renditions are ignored
+    */
+    for (size_t i = 0; i < cnt; i++) {
+        const int p = params[i];
+
+        if (p == 0)
+            _control_state = EscapeState{};
+        else if (p >= 30 && p <= 37)
+            _control_state.fg = getPaletteColor(p - 30);
+        else if (p >= 90 && p <= 97)
+            _control_state.fg = getPaletteColor(p - 90 + 8);
+        else if (p == 39)
+            _control_state.fg = Color3u8{};
+        else if (p >= 40 && p <= 47)
+            _control_state.bg = getPaletteColor(p - 40);
+        else if (p >= 100 && p <= 107)
+            _control_state.bg = getPaletteColor(p - 100 + 8);
+        else if (p == 49)
+            _control_state.bg = Color3u8{};
+        else if (p == 38 || p == 48) {
+            Color3u8& color = (p == 38) ? _control_state.fg : _control_state.bg;
+
+            if (i + 2 < cnt && params[i + 1] == 5) {
+                color = getPaletteColor(params[i + 2]);
+                i += 2;
+            }
+            else if (i + 4 < cnt && params[i + 1] == 2) {
+                color = toCellColor(params[i + 2], params[i + 3], params[i + 4]);
+                i += 4;
+            }
+            else {
+                // rest of the sequence can't be told apart from the color
+                break;
+            }
+        }
+    }
+}
+
+void OutputParser::processOSCCommand()
+{
+    std::string_view cmd(_control_buf);
+
+    /* Shell integration marks - OSC 133 ; <A|B|C|D> [; params] */
+    static constexpr std::string_view ShellMarkPrefix = "133;";
+
+    if (cmd.substr(0, ShellMarkPrefix.size()) != ShellMarkPrefix)
+        return;
+
+    cmd.remove_prefix(ShellMarkPrefix.size());
+
+    if (cmd.empty())
+        return;
+
+    const char kind = cmd.front();
+    int exit_status = -1;
+
+    /* Exit status is the first parameter of 'D',
+    *  other parameters (key=value options) are ignored
+    */
+    if (kind == 'D' && cmd.size() > 2 && cmd[1] == ';') {
+        int status = 0;
+        size_t i = 2;
+
+        for (; i < cmd.size() && cmd[i] >= '0' && cmd[i] <= '9'; i++)
+            status = status * 10 + (cmd[i] - '0');
+
+        if (i > 2)
+            exit_status = status;
+    }
+
+    switch (kind) {
+    case 'A': _grid->putShellMark(SHELL_MARK_PROMPT, -1); break;
+    case 'B': _grid->putShellMark(SHELL_MARK_INPUT, -1); break;
+    case 'C': _grid->putShellMark(SHELL_MARK_OUTPUT, -1); break;
+    case 'D': _grid->putShellMark(SHELL_MARK_END, exit_status); break;
+    default: break;
+    }
+}
+
+void OutputParser::processPrivateMode(int mode, bool set)
+{
+    switch (mode) {
+    case 25: { /* Show Cursor (DECTCEM) */
+        _grid->setMode(TERM_MODE_CURSOR_HIDDEN, !set);
+        break;
+    }
+    case 2026: { /* Synchronized Output */
+        _grid->setMode(TERM_MODE_SYNC_UPDATE, set);
         break;
     }
     default: break;
@@ -7,6 +7,9 @@
 namespace Thr
 {
     
+/* Graphic rendition applied to the cells being written.
+*  Zeroed color stands for the default one.
+*/
 struct EscapeState
 {
     Color3u8 fg;
@@ -22,14 +25,24 @@ public:
 private:
     void processChar(char32_t ch);
     void processCSICommand(char32_t ch);
+    void processGraphicRendition();
+    void processPrivateMode(int mode, bool set);
+    void processOSCCommand();
 
     enum class enumParseState
     {
         RAW = 0,
         ESCAPE = 1,
         CONTROL_SEQUENCE_INTRODUCER = 2,
+        OPERATING_SYSTEM_COMMAND = 3,
+        // ESC inside of OSC, possibly the string terminator
+        OPERATING_SYSTEM_COMMAND_ESCAPE = 4,
     };
 
+    static constexpr size_t _OSCLenLimit = 0x1000;
+    // parameters of a single SGR sequence past the limit are ignored
+    static constexpr size_t _SGRParamLimit = 0x20;
+
     std::shared_ptr<Grid> _grid;
     OutputStreamTransl    _utf8_to_utf32;
     EscapeState           _control_state;
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Memory.hpp"
+
+namespace Thr
+{
+
+static constexpr uint64_t FnvOffsetBasis = 0xCBF29CE484222325ull;
+static constexpr uint64_t FnvPrime = 0x100000001B3ull;
+
+/* FNV-1a over 64-bit words, the tail is hashed bytewise. Not meant to resist
+*  collisions on purpose, only to tell cached contents apart.
+*  Hashes of several buffers are chained through 'seed'.
+*/
+THR_INLINE uint64_t hashBytes(const void* data, size_t size, uint64_t seed = FnvOffsetBasis)
+{
+	const byte* const bytes = static_cast<const byte*>(data);
+
+	uint64_t hash = seed ^ size;
+	size_t i = 0;
+
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memCpy(&word, bytes + i, sizeof(word));
+		hash = (hash ^ word) * FnvPrime;
+	}
+
+	for (; i < size; i++)
+		hash = (hash ^ bytes[i]) * FnvPrime;
+
+	return hash;
+}
+
+} // namespace Thr
@@ -46,7 +46,7 @@ THR_INLINE void* alignedMemset(void* dst, int ch, size_t cnt)
 	byte* d = reinterpret_cast<byte*>(dst);
 
 #if defined(THR_SIMD_AVX512)
-	THR_HARD_ASSERT(cnt % AlignmentBound == 0, "Size must be a multiple of 64");
+	THR_HARD_ASSERT_LOG(cnt % 64 == 0, "Size must be a multiple of 64");
 	__m512i pack8i_ch = _mm512_set1_epi8(ch);
 
 	for (size_t i = 0; i < cnt; i += 64) {
@@ -54,7 +54,7 @@ THR_INLINE void* alignedMemset(void* dst, int ch, size_t cnt)
 	}
 
 #elif defined(THR_SIMD_AVX2)
-	THR_HARD_ASSERT(cnt % AlignmentBound == 0, "Size must be a multiple of 32");
+	THR_HARD_ASSERT_LOG(cnt % 32 == 0, "Size must be a multiple of 32");
 	__m256i pack4i_ch = _mm256_set1_epi8(ch);
 
 	for (size_t i = 0; i < cnt; i += 32) {
@@ -62,7 +62,7 @@ THR_INLINE void* alignedMemset(void* dst, int ch, size_t cnt)
 	}
 
 #elif defined(THR_SIMD_SSE2)
-	THR_HARD_ASSERT(cnt % AlignmentBound == 0, "Size must be a multiple of 16");
+	THR_HARD_ASSERT_LOG(cnt % 16 == 0, "Size must be a multiple of 16");
 	__m128i pack2i_ch = _mm_set1_epi8(ch);
 
 	for (size_t i = 0; i < cnt; i += 16) {
@@ -0,0 +1,196 @@
+#include "CommandIndex.hpp"
+#include "logger/Log.hpp"
+#include <algorithm>
+
+namespace Thr
+{
+
+CommandIndex::CommandIndex()
+	: _records()
+	, _folded_cnt(0)
+{}
+
+void CommandIndex::addMark(ShellMark mark, MarkPos pos, int exit_status)
+{
+	const auto now = std::chrono::system_clock::now();
+
+	if (mark == SHELL_MARK_PROMPT) {
+		CommandRecord record = {};
+		record.prompt = pos;
+		record.exit_status = -1;
+		record.flags = COMMAND_NONE;
+
+		_records.push_back(record);
+		return;
+	}
+
+	/* Marks without a prompt (shell integration loaded in the middle
+	*  of the session, or the prompt was evicted) are ignored
+	*/
+	if (_records.empty())
+		return;
+
+	CommandRecord& record = _records.back();
+
+	switch (mark) {
+	case SHELL_MARK_INPUT:
+		record.input = pos;
+		record.flags |= COMMAND_HAS_INPUT;
+		break;
+	case SHELL_MARK_OUTPUT:
+		record.output = pos;
+		record.started = now;
+		record.flags |= COMMAND_HAS_OUTPUT;
+		break;
+	case SHELL_MARK_END: {
+		if (record.flags & COMMAND_FINISHED)
+			break;
+
+		// 'D' after an empty command line comes without the output mark
+		if (!(record.flags & COMMAND_HAS_OUTPUT)) {
+			record.output = pos;
+			record.started = now;
+		}
+
+		record.end = pos;
+		record.finished = now;
+		record.exit_status = exit_status;
+		record.flags |= COMMAND_FINISHED;
+
+		const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(record.finished - record.started);
+
+		THR_LOG_DEBUG("Command finished with status {} after {} ms, output of {} lines",
+					  record.exit_status, duration.count(), record.end.ln - record.output.ln);
+		break;
+	}
+	default: break;
+	}
+}
+
+void CommandIndex::evict(size_t first_ln)
+{
+	while (!_records.empty() && _records.front().prompt.ln < first_ln) {
+		if (_records.front().flags & COMMAND_FOLDED)
+			_folded_cnt--;
+
+		_records.pop_front();
+	}
+}
+
+size_t CommandIndex::getCount() const
+{
+	return _records.size();
+}
+
+const CommandRecord& CommandIndex::get(size_t idx) const
+{
+	THR_ASSERT(idx < _records.size());
+	return _records[idx];
+}
+
+bool CommandIndex::findAt(size_t ln, size_t& idx) const
+{
+	const auto it = std::upper_bound(_records.begin(), _records.end(), ln,
+		[](size_t l, const CommandRecord& r) { return l < r.prompt.ln; });
+
+	if (it == _records.begin())
+		return false;
+
+	idx = static_cast<size_t>(it - _records.begin()) - 1;
+	return true;
+}
+
+bool CommandIndex::findPrev(size_t ln, size_t& idx) const
+{
+	return ln > 0 && findAt(ln - 1, idx);
+}
+
+bool CommandIndex::findNext(size_t ln, size_t& idx) const
+{
+	const auto it = std::upper_bound(_records.begin(), _records.end(), ln,
+		[](size_t l, const CommandRecord& r) { return l < r.prompt.ln; });
+
+	if (it == _records.end())
+		return false;
+
+	idx = static_cast<size_t>(it - _records.begin());
+	return true;
+}
+
+bool CommandIndex::findLastFinished(size_t& idx) const
+{
+	/* Only the most recent record may be unfinished,
+	*  unless the shell skipped the end marks
+	*/
+	for (size_t i = _records.size(); i-- > 0; ) {
+		if (_records[i].flags & COMMAND_FINISHED) {
+			idx = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool CommandIndex::getOutputLines(size_t idx, size_t& first, size_t& last) const
+{
+	const CommandRecord& record = get(idx);
+
+	if (!(record.flags & COMMAND_FINISHED))
+		return false;
+
+	/* Line containing the output mark still shows the command,
+	*  unless the mark is at its very beginning. Line of the end mark
+	*  is kept as well - it may already hold the next prompt.
+	*/
+	first = record.output.ln + (record.output.col > 0 ? 1 : 0);
+
+	if (record.end.ln == 0 || record.end.ln - 1 < first)
+		return false;
+
+	last = record.end.ln - 1;
+	return first > record.prompt.ln;
+}
+
+bool CommandIndex::setFolded(size_t idx, bool folded)
+{
+	THR_ASSERT(idx < _records.size());
+	CommandRecord& record = _records[idx];
+
+	if (((record.flags & COMMAND_FOLDED) != 0) == folded)
+		return false;
+
+	size_t first, last;
+
+	if (folded && !getOutputLines(idx, first, last))
+		return false;
+
+	record.flags ^= COMMAND_FOLDED;
+
+	if (folded)
+		_folded_cnt++;
+	else
+		_folded_cnt--;
+
+	return true;
+}
+
+bool CommandIndex::hasFolded() const
+{
+	return _folded_cnt > 0;
+}
+
+bool CommandIndex::findFolded(size_t ln, size_t& first, size_t& last) const
+{
+	if (_folded_cnt == 0)
+		return false;
+
+	size_t idx;
+
+	if (!findAt(ln, idx) || !(_records[idx].flags & COMMAND_FOLDED))
+		return false;
+
+	return getOutputLines(idx, first, last) && ln >= first && ln <= last;
+}
+
+} // namespace Thr
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Common.hpp"
+#include <deque>
+#include <chrono>
+
+namespace Thr
+{
+
+/* Shell integration marks (OSC 133), in the order emitted by the shell.
+*/
+enum ShellMark : uint32_t
+{
+	// OSC 133 ; A - prompt is about to be printed
+	SHELL_MARK_PROMPT = 0,
+	// OSC 133 ; B - prompt printed, user types the command
+	SHELL_MARK_INPUT  = 1,
+	// OSC 133 ; C - command accepted, its output follows
+	SHELL_MARK_OUTPUT = 2,
+	// OSC 133 ; D [; status] - command finished
+	SHELL_MARK_END    = 3,
+};
+
+/* Position in the Grid - cell 'col' of the logical line 'ln'.
+*/
+struct MarkPos
+{
+	size_t   ln;
+	uint32_t col;
+};
+
+enum CommandFlags : uint32_t
+{
+	COMMAND_NONE       = 0x0,
+	COMMAND_HAS_INPUT  = 0x1,
+	COMMAND_HAS_OUTPUT = 0x2,
+	COMMAND_FINISHED   = 0x4,
+	COMMAND_FOLDED     = 0x8,
+};
+
+/* Single prompt of the shell session and the command run from it.
+*  Positions are valid only if the respective flag is set.
+*/
+struct CommandRecord
+{
+	MarkPos                               prompt;
+	MarkPos                               input;
+	MarkPos                               output;
+	MarkPos                               end;
+	// -1 if the shell didn't report it
+	int                                   exit_status;
+	uint32_t                              flags;
+	std::chrono::system_clock::time_point started;
+	std::chrono::system_clock::time_point finished;
+};
+
+/* Side index of the command boundaries, built from the shell integration marks.
+*  Records are ordered by their prompt line, so looking up the command
+*  around any line is a binary search instead of a scan of the rows.
+*
+*  Output of a finished command - whole lines between the line it starts on
+*  and the line it ends on - can be folded out of the layout.
+*
+*  Expects the Grid lock to be held.
+*/
+class CommandIndex
+{
+public:
+	CommandIndex();
+
+	void addMark(ShellMark mark, MarkPos pos, int exit_status);
+
+	/* Drop records with prompt before 'first_ln'.
+	*/
+	void evict(size_t first_ln);
+
+	size_t getCount() const;
+	const CommandRecord& get(size_t idx) const;
+
+	/* Index of the last record with prompt on or before 'ln',
+	*  returns false if there's none.
+	*/
+	bool findAt(size_t ln, size_t& idx) const;
+
+	/* Index of the closest record with prompt strictly before / after 'ln'.
+	*/
+	bool findPrev(size_t ln, size_t& idx) const;
+	bool findNext(size_t ln, size_t& idx) const;
+
+	bool findLastFinished(size_t& idx) const;
+
+	/* Lines [first, last] of the command output which can be folded.
+	*  Returns false if the command has no such lines.
+	*/
+	bool getOutputLines(size_t idx, size_t& first, size_t& last) const;
+
+	/* Returns false if the state didn't change -
+	*  unfinished command or no output to fold.
+	*/
+	bool setFolded(size_t idx, bool folded);
+
+	/* Folded lines range containing 'ln', if any.
+	*/
+	bool findFolded(size_t ln, size_t& first, size_t& last) const;
+	bool hasFolded() const;
+private:
+	std::deque<CommandRecord> _records;
+	size_t                    _folded_cnt;
+};
+
+} // namespace Thr
@@ -15,15 +15,15 @@ void LinePtrBuf::clear()
 	_v.clear();
 }
 
-void LinePtrBuf::push(Ptr<const Line> ptr)
+void LinePtrBuf::push(RowView row)
 {
-	_v.push_back(ptr);
+	_v.push_back(row);
 }
 
 void LinePtrBuf::reserve(size_t ns)
 {
 	if (ns > _v.capacity()) {
-		THR_LOG_DEBUG("Line pointers buffer reallocation from capacity of {} to {}", 
+		THR_LOG_DEBUG("Line pointers buffer reallocation from capacity of {} to {}",
 					  _v.size(), ns);
 	}
 
@@ -35,127 +35,616 @@ void LinePtrBuf::reverse()
 	std::reverse(_v.begin(), _v.end());
 }
 
-const Vec<Ptr<const Line>>& LinePtrBuf::getVec() const
+const Vec<RowView>& LinePtrBuf::getVec() const
 {
 	return _v;
 }
 
 Grid::Grid()
 	: _ln_width(0)
-	, _start_ln_pos(0)
-	, _write_pos(0)
+	, _first_ln(0)
+	, _last_ln(0)
+	, _row_pool()
 	, _ln_buf{}
 	, _render_fmt{}
 	, _formated(false)
 	, _ln_ptrs(std::make_shared<LinePtrBuf>())
-	, _last_nl_pos(0)
-{}
+	, _modes(TERM_MODE_NONE)
+	, _cursor_shape(CURSOR_SHAPE_BLOCK)
+	, _cursor_blink(true)
+	, _view_ln(0)
+	, _view_sub(0)
+	, _view_follow(true)
+	, _snapshots()
+	, _published_rows()
+	, _snapshot_gen(0)
+	, _wrap_index(*this, _BufSize)
+	, _trigram_index(nullptr)
+	, _commands()
+	, _search(*this)
+	, _export(*this)
+{
+	for (Line& line : _ln_buf)
+		line.attachPool(_row_pool);
+}
+
+Grid::~Grid()
+{
+	_export.cancel();
+	_search.stop();
+	_wrap_index.stop();
+}
 
 void Grid::specifyRenderFormat(const RenderFormat& format)
 {
-	_render_fmt = format;
-	_formated = true;
+	const size_t width = format.getCellCountVertical();
+	const bool reflow = !_formated || width != _ln_width;
 
-	_ln_width = _render_fmt.getCellCountVertical();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
 
-	std::for_each(_ln_buf.begin(), _ln_buf.end(), [&](Line& l) {
-		l.reserve(_ln_width);
-	});
+		_row_pool.setRowWidth(width);
+		_render_fmt = format;
+		_formated = true;
+		_ln_width = width;
+	}
+
+	if (reflow) {
+		// rows of the anchor line differ for new width
+		_view_sub = 0;
+
+		THR_LOG_DEBUG("Reflowing grid to width of {} cells", _ln_width);
+		_wrap_index.rebuild(_ln_width);
+	}
 }
 
 void Grid::putChar(char32_t c, const EscapeState* state)
 {
 	THR_ASSERT_LOG(_formated, "Cannot add char for unknown render format");
 
-	Line& curr_ln = _ln_buf[_write_pos];
-
 	if (c == U'\n') {
 		advanceWriteIdx();
-		++_last_nl_pos;
 		return;
 	}
 
-	bool put_char = true;
-	
-	/* Handle special control characters */
-	switch (c) {
-	case U'\n':
-		_last_nl_pos = _write_pos;
+	Line& curr_ln = getLine(_last_ln);
+
+	/* Split extremely long lines,
+	*  marking the continuation with a soft-wrap marker.
+	*/
+	if (curr_ln.getCellCount() >= _LineLenLimit) {
+		curr_ln.setWrapped(true);
 		advanceWriteIdx();
-		put_char = false;
-		break;
-	//case U'\r':
-	//	processCarriageReturn();
-	//	put_char = false;
-	//	break;
 	}
 
-	if (!put_char)
-		return;
+	getLine(_last_ln).putChar(c, state);
+}
 
-	curr_ln.putChar(c, state);
+void Grid::setMode(TermMode mode, bool value)
+{
+	if (value)
+		_modes |= mode;
+	else
+		_modes &= ~static_cast<uint32_t>(mode);
+}
 
-	if (curr_ln.getPrintableCount() >= _ln_width) {
-		advanceWriteIdx();
-	}
+bool Grid::isModeSet(TermMode mode) const
+{
+	return (_modes & mode) != 0;
+}
+
+void Grid::setCursorStyle(CursorShape shape, bool blink)
+{
+	_cursor_shape = shape;
+	_cursor_blink = blink;
+}
+
+void Grid::lock() const
+{
+	_mutex.lock();
 }
 
-std::shared_ptr<const LinePtrBuf> Grid::getVisibleLines() const
+void Grid::unlock() const
+{
+	_mutex.unlock();
+}
+
+std::shared_ptr<const LinePtrBuf> Grid::getVisibleLines()
 {
 	THR_ASSERT_LOG(_formated, "Cannot specify visible lines for unknown render format");
 
-	const int total_line_cnt = _render_fmt.getCellCountHorizontal();
+	const size_t total_row_cnt = _render_fmt.getCellCountHorizontal();
 
 	_ln_ptrs->clear();
-	_ln_ptrs->reserve(total_line_cnt);
+	_ln_ptrs->reserve(total_row_cnt);
 
-	int line_cnt = 0;
+	size_t row_cnt = 0;
 
-	for (int ln_pos = _write_pos;
-		 ;
-		 ln_pos = (ln_pos - 1) % _BufSize)
-	{
-		const Line& ln = _ln_buf[ln_pos];
-		line_cnt++;
+	if (!_view_follow) {
+		clampView();
+
+		/* Lay out rows forward from the viewport anchor
+		*/
+		for (size_t ln = _view_ln; ln <= _last_ln && row_cnt < total_row_cnt; ln = getNextShownLine(ln)) {
+			const Line& line = getLine(ln);
+			const size_t line_rows = line.getRowStarts(_ln_width, _row_starts);
+			const size_t first_row = (ln == _view_ln) ? _view_sub : 0;
+
+			for (size_t r = first_row; r < line_rows && row_cnt < total_row_cnt; r++) {
+				const uint32_t end = (r + 1 < line_rows) ? _row_starts[r + 1]
+														 : static_cast<uint32_t>(line.getCellCount());
+
+				_ln_ptrs->push(RowView{ std::addressof(line), ln, _row_starts[r], end });
+				row_cnt++;
+			}
+		}
+
+		if (row_cnt >= total_row_cnt)
+			return _ln_ptrs;
+
+		/* Scrolled down to the most recent output - follow it again
+		*/
+		_view_follow = true;
+		_ln_ptrs->clear();
+		row_cnt = 0;
+	}
+
+	/* Lay out only the lines that fit on the screen,
+	*  walking backwards from the most recent one.
+	*/
+	for (size_t ln = _last_ln; ; ln = getPrevShownLine(ln)) {
+		const Line& line = getLine(ln);
+		const size_t line_rows = line.getRowStarts(_ln_width, _row_starts);
+
+		for (size_t r = line_rows; r-- > 0 && row_cnt < total_row_cnt; ) {
+			const uint32_t end = (r + 1 < line_rows) ? _row_starts[r + 1]
+													 : static_cast<uint32_t>(line.getCellCount());
 
-		_ln_ptrs->push(std::addressof(ln));
+			_ln_ptrs->push(RowView{ std::addressof(line), ln, _row_starts[r], end });
+			row_cnt++;
+		}
 
-		if (line_cnt >= total_line_cnt || 
-			ln_pos == static_cast<int>(_start_ln_pos))
+		if (row_cnt >= total_row_cnt || ln == _first_ln)
 			break;
 	}
-	
+
 	_ln_ptrs->reverse();
 	return _ln_ptrs;
 }
 
-THR_FORCEINLINE size_t Grid::advanceWriteIdx() 
+void Grid::publishSnapshot()
 {
-	_write_pos = (_write_pos + 1) % _BufSize;
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	const Vec<RowView>& rows = getVisibleLines()->getVec();
+
+	ScreenSnapshot& snapshot = _snapshots.getBack();
+	snapshot.rows.clear();
+
+	/* Rows of both the previous snapshot and the current layout
+	*  are sorted by (line, first cell), find the unchanged ones in a single pass.
+	*/
+	size_t k = 0;
+
+	for (const RowView& row : rows) {
+		const uint32_t version = row.ln->getVersion();
+
+		while (k < _published_rows.size() &&
+			   (_published_rows[k]->ln_num < row.ln_num ||
+			   (_published_rows[k]->ln_num == row.ln_num && _published_rows[k]->begin < row.begin))) {
+			k++;
+		}
+
+		if (k < _published_rows.size()) {
+			const SnapshotRow& prev = *_published_rows[k];
+
+			if (prev.ln_num == row.ln_num && prev.begin == row.begin &&
+				prev.end == row.end && prev.version == version) {
+				snapshot.rows.push_back(_published_rows[k]);
+				continue;
+			}
+		}
+
+		auto copy = std::make_shared<SnapshotRow>();
+		copy->ln_num = row.ln_num;
+		copy->begin = row.begin;
+		copy->end = row.end;
+		copy->version = version;
+		row.ln->copyCells(row.begin, row.end, copy->chars, copy->attrs);
+
+		snapshot.rows.push_back(std::move(copy));
+	}
+
+	/* Output only appends to the last line, so the cursor follows its last cell.
+	*  Carriage return starts over from the first column, as in the renderers.
+	*/
+	snapshot.cursor = SnapshotCursor{};
+	snapshot.cursor.shape = _cursor_shape;
+	snapshot.cursor.blink = _cursor_blink;
 
-	if (_write_pos == _start_ln_pos)
-		_start_ln_pos = (_start_ln_pos + 1) % _BufSize;
+	if (!snapshot.rows.empty() && _ln_width > 0) {
+		const SnapshotRow& last = *snapshot.rows.back();
 
-	return _write_pos;
+		if (last.ln_num == _last_ln && last.end == getLine(_last_ln).getCellCount()) {
+			uint32_t col = 0;
+
+			for (const char32_t ch : last.chars)
+				col = (ch == U'\r') ? 0 : col + 1;
+
+			// full row keeps the cursor at its last column until the next cell wraps
+			snapshot.cursor.row = static_cast<uint32_t>(snapshot.rows.size() - 1);
+			snapshot.cursor.col = std::min(col, static_cast<uint32_t>(_ln_width - 1));
+			snapshot.cursor.visible = !isModeSet(TERM_MODE_CURSOR_HIDDEN);
+		}
+	}
+
+	// cursor only snapshots keep the generation, there are no rows to submit
+	if (snapshot.rows != _published_rows || _snapshot_gen == 0) {
+		++_snapshot_gen;
+		_published_rows = snapshot.rows;
+	}
+
+	snapshot.generation = _snapshot_gen;
+
+	_snapshots.publish();
+}
+
+const ScreenSnapshot& Grid::acquireSnapshot()
+{
+	return _snapshots.acquire();
+}
+
+void Grid::anchorViewAtBottom()
+{
+	const size_t total_row_cnt = _render_fmt.getCellCountHorizontal();
+	size_t row_cnt = 0;
+
+	_view_ln = _last_ln;
+	_view_sub = 0;
+
+	for (size_t ln = _last_ln; ; ln = getPrevShownLine(ln)) {
+		const size_t line_rows = getLine(ln).getRowCount(_ln_width);
+
+		_view_ln = ln;
+
+		if (row_cnt + line_rows >= total_row_cnt) {
+			_view_sub = row_cnt + line_rows - total_row_cnt;
+			break;
+		}
+
+		row_cnt += line_rows;
+
+		if (ln == _first_ln)
+			break;
+	}
+}
+
+void Grid::clampView()
+{
+	if (_view_ln < _first_ln) {
+		_view_ln = _first_ln;
+		_view_sub = 0;
+	}
+	else if (_view_ln > _last_ln) {
+		_view_ln = _last_ln;
+		_view_sub = 0;
+	}
+
+	/* Anchor line was folded away, show the command instead -
+	*  or the lines past the fold, when there's nothing above it
+	*/
+	size_t first, last;
+
+	if (_commands.findFolded(_view_ln, first, last)) {
+		_view_ln = (first > _first_ln) ? first - 1 : std::min(last + 1, _last_ln);
+		_view_sub = 0;
+	}
+
+	const size_t line_rows = getLine(_view_ln).getRowCount(_ln_width);
+	_view_sub = std::min(_view_sub, line_rows - 1);
 }
 
-size_t Grid::decreaseWriteIdx()
+void Grid::scrollView(long rows)
 {
-	_write_pos = (_write_pos - 1) % _BufSize;
+	THR_ASSERT_LOG(_formated, "Cannot scroll for unknown render format");
+
+	if (rows == 0 || (rows < 0 && _view_follow))
+		return;
+
+	if (_view_follow) {
+		anchorViewAtBottom();
+		_view_follow = false;
+	}
+
+	clampView();
 
-	if (_write_pos == _start_ln_pos)
-		_start_ln_pos = (_start_ln_pos - 1) % _BufSize;
+	if (scrollViewIndexed(rows))
+		return;
+
+	size_t n = static_cast<size_t>(rows > 0 ? rows : -rows);
+
+	if (rows > 0) {
+		while (n > 0) {
+			if (_view_sub > 0) {
+				const size_t step = std::min(n, _view_sub);
+				_view_sub -= step;
+				n -= step;
+				continue;
+			}
 
-	return _write_pos;
+			if (_view_ln == _first_ln)
+				break;
+
+			_view_ln = getPrevShownLine(_view_ln);
+			_view_sub = getLine(_view_ln).getRowCount(_ln_width) - 1;
+			n--;
+		}
+	}
+	else {
+		while (n > 0) {
+			const size_t line_rows = getLine(_view_ln).getRowCount(_ln_width);
+
+			if (_view_sub + 1 < line_rows) {
+				const size_t step = std::min(n, line_rows - 1 - _view_sub);
+				_view_sub += step;
+				n -= step;
+				continue;
+			}
+
+			if (_view_ln == _last_ln)
+				break;
+
+			_view_ln = getNextShownLine(_view_ln);
+			_view_sub = 0;
+			n--;
+		}
+	}
 }
 
-void Grid::processCarriageReturn()
+bool Grid::scrollViewIndexed(long rows)
 {
-	while (_write_pos != _last_nl_pos)
-		decreaseWriteIdx();
+	std::lock_guard<Grid> lock(*this);
+
+	if (!_wrap_index.isComplete() || _wrap_index.getIndexedEnd() != _last_ln || _commands.hasFolded())
+		return false;
+
+	const uint64_t first_row = _wrap_index.getLineRow(_first_ln);
+	const uint64_t last_ln_row = _wrap_index.getLineRow(_last_ln);
+	const uint64_t last_row = last_ln_row + getLine(_last_ln).getRowCount(_ln_width) - 1;
+	const uint64_t row = _wrap_index.getLineRow(_view_ln) + _view_sub;
+
+	uint64_t target;
+
+	if (rows > 0)
+		target = row - std::min<uint64_t>(static_cast<uint64_t>(rows), row - first_row);
+	else
+		target = row + std::min<uint64_t>(static_cast<uint64_t>(-rows), last_row - row);
+
+	size_t ln = _last_ln;
+
+	if (target < last_ln_row && !_wrap_index.findRowLine(target, ln))
+		return false;
+
+	_view_ln = ln;
+	_view_sub = static_cast<size_t>(target - _wrap_index.getLineRow(ln));
+
+	return true;
+}
+
+void Grid::scrollToLine(size_t ln)
+{
+	_view_ln = ln;
+	_view_sub = 0;
+	_view_follow = false;
+}
+
+void Grid::scrollToBottom()
+{
+	_view_follow = true;
+}
+
+bool Grid::isViewAtBottom() const
+{
+	return _view_follow;
+}
+
+GridSearch& Grid::getSearch()
+{
+	return _search;
+}
+
+const GridSearch& Grid::getSearch() const
+{
+	return _search;
+}
+
+GridExport& Grid::getExport()
+{
+	return _export;
+}
+
+void Grid::enableSearchIndex(size_t memory_limit)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_trigram_index != nullptr)
+		return;
+
+	THR_LOG_DEBUG("Search index enabled, memory limit of {} KB", memory_limit / 1024);
+	_trigram_index = std::make_unique<TrigramIndex>(memory_limit);
+}
+
+void Grid::trimScrollback(size_t max_lines)
+{
+	const size_t keep = std::max<size_t>(1, max_lines);
+
+	if (_last_ln - _first_ln < keep)
+		return;
+
+	const size_t first_ln = _last_ln + 1 - keep;
+
+	for (size_t ln = _first_ln; ln < first_ln; ln++)
+		evictLine(ln);
+
+	THR_LOG_DEBUG("Trimmed {} lines of scrollback", first_ln - _first_ln);
+	_first_ln = first_ln;
+
+	if (_trigram_index != nullptr)
+		_trigram_index->evict(_first_ln);
+
+	_commands.evict(_first_ln);
+	_row_pool.trim();
+}
+
+void Grid::clearScrollback()
+{
+	// each line occupies at least a single row
+	trimScrollback(_render_fmt.getCellCountHorizontal());
+}
+
+void Grid::putShellMark(ShellMark mark, int exit_status)
+{
+	const MarkPos pos = {
+		_last_ln,
+		static_cast<uint32_t>(getLine(_last_ln).getCellCount())
+	};
+
+	_commands.addMark(mark, pos, exit_status);
+}
+
+bool Grid::scrollToPrompt(int direction)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_view_follow)
+		anchorViewAtBottom();
+	else
+		clampView();
+
+	size_t idx;
+	const bool found = (direction < 0) ? _commands.findPrev(_view_ln, idx)
+									   : _commands.findNext(_view_ln, idx);
+
+	if (!found) {
+		// nothing below, back to the most recent output
+		if (direction > 0)
+			_view_follow = true;
+
+		return false;
+	}
+
+	_view_ln = _commands.get(idx).prompt.ln;
+	_view_sub = 0;
+	_view_follow = false;
+
+	return true;
+}
+
+bool Grid::copyLastOutput(std::u32string& out) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size_t idx;
+
+	if (!_commands.findLastFinished(idx))
+		return false;
+
+	const CommandRecord& record = _commands.get(idx);
+
+	// beginning of the output was already evicted
+	if (record.output.ln < _first_ln)
+		return false;
+
+	out.clear();
+
+	for (size_t ln = record.output.ln; ln <= record.end.ln; ln++) {
+		const Line& line = getLine(ln);
+		const size_t cell_cnt = line.getCellCount();
+
+		const size_t begin = (ln == record.output.ln) ? std::min<size_t>(record.output.col, cell_cnt) : 0;
+		const size_t end = (ln == record.end.ln) ? std::min<size_t>(record.end.col, cell_cnt) : cell_cnt;
+
+		// carriage returns are stored along with the text
+		std::copy_if(line.getChars() + begin, line.getChars() + end, std::back_inserter(out),
+					 [](char32_t ch) { return ch != U'\r'; });
+
+		/* Newlines are not stored - lines are split at them,
+		*  unless the line was soft-wrapped
+		*/
+		if (ln != record.end.ln && !line.isWrapped())
+			out.push_back(U'\n');
+	}
+
+	return true;
+}
+
+bool Grid::toggleFold()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	size_t idx;
+	bool found;
+
+	if (_view_follow) {
+		found = _commands.findLastFinished(idx);
+	}
+	else {
+		clampView();
+		found = _commands.findAt(_view_ln, idx);
+	}
+
+	if (!found)
+		return false;
+
+	const bool folded = (_commands.get(idx).flags & COMMAND_FOLDED) != 0;
+
+	if (!_commands.setFolded(idx, !folded))
+		return false;
+
+	// keep the viewport out of the folded lines
+	if (!_view_follow)
+		clampView();
+
+	return true;
+}
+
+size_t Grid::advanceWriteIdx()
+{
+	const size_t finalized = _last_ln++;
+
+	// ring is full, evict the oldest line
+	if (_last_ln - _first_ln >= _BufSize) {
+		evictLine(_first_ln);
+		_first_ln++;
+	}
+
+	getLine(_last_ln).clear();
+	_commands.evict(_first_ln);
+	_wrap_index.onLineFinalized(finalized);
+
+	if (_trigram_index != nullptr) {
+		_trigram_index->evict(_first_ln);
+		_trigram_index->addLine(finalized, getLine(finalized));
+	}
+
+	_search.onLineFinalized(finalized);
+
+	return _last_ln;
+}
+
+void Grid::evictLine(size_t ln)
+{
+	Line& line = getLine(ln);
+
+	if (!_export.isPending(ln)) {
+		line.clear();
+		return;
+	}
+
+	const size_t cell_cnt = line.getCellCount();
+	const bool wrapped = line.isWrapped();
 
-	Line& curr_ln = _ln_buf[_write_pos];
-	curr_ln.trimToNewLine();
+	_export.adoptLine(ln, line.detach(), cell_cnt, wrapped);
 }
 
 } // namespace Thr
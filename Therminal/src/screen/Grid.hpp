@@ -1,51 +1,274 @@
 #pragma once
 
 #include "Line.hpp"
+#include "RowPool.hpp"
+#include "WrapIndex.hpp"
+#include "GridSearch.hpp"
+#include "GridExport.hpp"
+#include "TrigramIndex.hpp"
+#include "Snapshot.hpp"
+#include "CommandIndex.hpp"
 #include "memory/CircBuff.hpp"
 #include "io/OutputTranslator.hpp"
 #include "gl/RenderFormat.hpp"
+#include <mutex>
 
 namespace Thr
 {
 
+/* Single physical row on the screen - range of cells
+*  [begin, end) of the soft-wrapped logical line.
+*/
+struct RowView
+{
+	Ptr<const Line> ln;
+	size_t          ln_num;
+	uint32_t        begin;
+	uint32_t        end;
+};
+
 class LinePtrBuf
 {
 public:
 	LinePtrBuf();
 	void clear();
-	void push(Ptr<const Line> ptr);
+	void push(RowView row);
 	void reserve(size_t ns);
 	void reverse();
-	const Vec<Ptr<const Line>>& getVec() const;
+	const Vec<RowView>& getVec() const;
 private:
 	static constexpr size_t _DefaultBufSize = 512;
-	Vec<Ptr<const Line>> _v;
+	Vec<RowView> _v;
+};
+
+/* Terminal modes toggled by the application running inside the shell,
+*  via DEC private mode sequences (DECSET / DECRST).
+*/
+enum TermMode : uint32_t
+{
+	TERM_MODE_NONE        = 0x0,
+	// Synchronized output (DECSET 2026) - the screen is being updated atomically
+	TERM_MODE_SYNC_UPDATE = 0x1,
+	// Cursor hidden (DECTCEM reset)
+	TERM_MODE_CURSOR_HIDDEN = 0x2,
 };
 
+/* Grid stores the scrollback as logical lines - each line ends with a newline
+*  (or is explicitly marked as soft-wrapped when it exceeds the length limit).
+*  Lines are addressed by absolute, monotonically increasing numbers,
+*  so mapping a line number onto its storage is O(1).
+*  Physical rows are derived from logical lines for current width:
+*  lazily for the visible rows and via WrapIndex for the rest.
+*
+*  Viewport state is owned by the UI thread, which is also the only writer,
+*  so it's not protected by the lock.
+*
+*  Grid satisfies BasicLockable. Mutating the grid (see OutputParser::parseToGrid)
+*  and querying the wrap index has to be done under the lock, since the
+*  wrap index is being built on background thread.
+*/
 class Grid
 {
 public:
+	friend class WrapIndex;
+	friend class GridSearch;
+	friend class GridExport;
+	friend class GridSession;
+
 	Grid();
+	~Grid();
 
+	/* Set new render format. On width change, the scrollback
+	*  is reflowed - visible rows are laid out immediately,
+	*  while wrap index for the history is rebuilt in background.
+	*  Must be called without holding the Grid lock.
+	*/
 	void specifyRenderFormat(const RenderFormat& format);
 	void putChar(char32_t c, const EscapeState* state);
 
-	std::shared_ptr<const LinePtrBuf> getVisibleLines() const;
+	void setMode(TermMode mode, bool value);
+	bool isModeSet(TermMode mode) const;
+
+	/* Cursor style (DECSCUSR) published with the snapshots.
+	*/
+	void setCursorStyle(CursorShape shape, bool blink);
+
+	void lock() const;
+	void unlock() const;
+
+	/* Rows visible through the viewport. Unless scrolled back,
+	*  the viewport follows the most recent output. Viewport anchored
+	*  at a line since evicted or folded is moved to a shown one.
+	*/
+	std::shared_ptr<const LinePtrBuf> getVisibleLines();
+
+	/* Publish snapshot of the visible rows for the renderer.
+	*  Only rows changed since the previous snapshot are copied.
+	*  Must be called from the thread parsing the output, without the lock.
+	*/
+	void publishSnapshot();
+
+	/* Most recent published snapshot. Stays valid until the next call,
+	*  must be called from a single (render) thread.
+	*/
+	const ScreenSnapshot& acquireSnapshot();
+
+	/* Scroll the viewport by 'rows' physical rows - positive values
+	*  scroll back into the history. Cost is proportional to the number
+	*  of rows scrolled, not to the size of the history.
+	*/
+	void scrollView(long rows);
+
+	/* Place logical line 'ln' at the top of the viewport.
+	*/
+	void scrollToLine(size_t ln);
+	void scrollToBottom();
+	bool isViewAtBottom() const;
+
+	/* Absolute numbers of the oldest stored
+	*  and the most recent (unfinished) logical line.
+	*/
+	THR_INLINE size_t getFirstLine() const;
+	THR_INLINE size_t getLastLine() const;
+
+	GridSearch& getSearch();
+	const GridSearch& getSearch() const;
+
+	GridExport& getExport();
+
+	/* Maintain trigram index of the finalized lines, used to narrow
+	*  repeated searches. Costs some time per line and up to 'memory_limit'
+	*  bytes, so it's disabled by default.
+	*/
+	void enableSearchIndex(size_t memory_limit);
+
+	/* Drop the oldest lines, so at most 'max_lines' lines remain,
+	*  and return storage no longer used to the system.
+	*  Expects the lock to be held.
+	*/
+	void trimScrollback(size_t max_lines);
+
+	/* Drop the lines scrolled out of the screen.
+	*  Expects the lock to be held.
+	*/
+	void clearScrollback();
+
+	/* Record shell integration mark at the current write position.
+	*  Expects the lock to be held.
+	*/
+	void putShellMark(ShellMark mark, int exit_status);
+
+	/* Move the viewport to the previous (direction < 0) or the next prompt
+	*  relative to the top of the viewport. Returns false if there's none.
+	*/
+	bool scrollToPrompt(int direction);
+
+	/* Copy cells written by the most recently finished command.
+	*  Returns false if no command has finished yet.
+	*/
+	bool copyLastOutput(std::u32string& out) const;
+
+	/* Fold (or unfold) output of the command shown at the top
+	*  of the viewport, or the most recently finished one when following
+	*  the output. Folded lines are skipped by the layout.
+	*/
+	bool toggleFold();
 private:
 	size_t advanceWriteIdx();
-	size_t decreaseWriteIdx();
-	void processCarriageReturn();
+
+	/* Drop line 'ln' leaving the scrollback. If it's yet to be exported,
+	*  the export takes over its storage.
+	*/
+	void evictLine(size_t ln);
+	void anchorViewAtBottom();
+	void clampView();
+
+	/* Scroll through the wrap index in O(log n) - possible only once it
+	*  covers the whole history and no line is folded out of the layout.
+	*  Returns false, leaving the view untouched, otherwise.
+	*/
+	bool scrollViewIndexed(long rows);
+
+	/* Neighbouring lines not folded away */
+	THR_INLINE size_t getNextShownLine(size_t ln) const;
+	THR_INLINE size_t getPrevShownLine(size_t ln) const;
+
+	THR_INLINE const Line& getLine(size_t ln) const;
+	THR_INLINE Line& getLine(size_t ln);
 
 	static constexpr size_t     _BufSize = 0x10000;
+	static constexpr size_t     _BufMask = _BufSize - 1;
+	// Longer lines are split into multiple stored lines marked as soft-wrapped
+	static constexpr size_t     _LineLenLimit = 0x4000;
+
+	THR_STATIC_ASSERT_LOG((_BufSize & _BufMask) == 0, "Buffer size must be a power of two");
+	THR_STATIC_ASSERT_LOG(_LineLenLimit <= RowPool::MaxCells, "Line must fit in a single pool block");
+
 	size_t                		_ln_width;
 	OutputStreamTransl          _utf8_utf32;
-	size_t 						_start_ln_pos;
-	size_t                      _write_pos;
+	size_t 						_first_ln;
+	size_t                      _last_ln;
+	RowPool                     _row_pool;
 	Arr<Line, _BufSize>         _ln_buf;
 	RenderFormat                _render_fmt;
 	bool                        _formated;
 	std::shared_ptr<LinePtrBuf> _ln_ptrs;
-	size_t   					_last_nl_pos;
+	Vec<uint32_t>               _row_starts;
+	uint32_t                    _modes;
+	CursorShape                 _cursor_shape;
+	bool                        _cursor_blink;
+
+	/* Viewport is anchored at its top row - row 'view_sub'
+	*  of logical line 'view_ln', so new output doesn't move it.
+	*/
+	size_t                      _view_ln;
+	size_t                      _view_sub;
+	bool                        _view_follow;
+
+	SnapshotExchange            _snapshots;
+	// rows of the last published snapshot, shared with the next one
+	Vec<std::shared_ptr<const SnapshotRow>> _published_rows;
+	uint64_t                    _snapshot_gen;
+	mutable std::mutex          _mutex;
+	WrapIndex                   _wrap_index;
+	std::unique_ptr<TrigramIndex> _trigram_index;
+	CommandIndex                _commands;
+	GridSearch                  _search;
+	GridExport                  _export;
 };
 
+THR_INLINE const Line& Grid::getLine(size_t ln) const
+{
+	THR_ASSERT(ln >= _first_ln && ln <= _last_ln);
+	return _ln_buf[ln & _BufMask];
+}
+
+THR_INLINE Line& Grid::getLine(size_t ln)
+{
+	THR_ASSERT(ln >= _first_ln && ln <= _last_ln);
+	return _ln_buf[ln & _BufMask];
+}
+
+THR_INLINE size_t Grid::getNextShownLine(size_t ln) const
+{
+	size_t first, last;
+	return _commands.findFolded(ln + 1, first, last) ? last + 1 : ln + 1;
+}
+
+THR_INLINE size_t Grid::getPrevShownLine(size_t ln) const
+{
+	size_t first, last;
+	return _commands.findFolded(ln - 1, first, last) ? first - 1 : ln - 1;
+}
+
+THR_INLINE size_t Grid::getFirstLine() const
+{
+	return _first_ln;
+}
+
+THR_INLINE size_t Grid::getLastLine() const
+{
+	return _last_ln;
+}
+
 } // namespace Thr
@@ -0,0 +1,331 @@
+#include "GridExport.hpp"
+#include "Grid.hpp"
+#include <charconv>
+#include <chrono>
+
+namespace Thr
+{
+
+THR_FORCEINLINE bool isDefaultColor(Color3u8 c)
+{
+	return c.r == 0 && c.g == 0 && c.b == 0;
+}
+
+THR_FORCEINLINE bool isSameAttr(const CellAttr& a, const CellAttr& b)
+{
+	return a.fg.r == b.fg.r && a.fg.g == b.fg.g && a.fg.b == b.fg.b &&
+		   a.bg.r == b.bg.r && a.bg.g == b.bg.g && a.bg.b == b.bg.b;
+}
+
+static void appendNumber(uint32_t v, std::string& out)
+{
+	char digits[10];
+	const auto res = std::to_chars(digits, digits + sizeof(digits), v);
+	out.append(digits, res.ptr);
+}
+
+static void appendColor(const char* prefix, Color3u8 c, std::string& out)
+{
+	out += prefix;
+	appendNumber(c.r, out);
+	out += ';';
+	appendNumber(c.g, out);
+	out += ';';
+	appendNumber(c.b, out);
+}
+
+/* Reset the attributes, then set the non-default colors.
+*  Zeroed color stands for the default one.
+*/
+static void appendSGR(const CellAttr& attr, std::string& out)
+{
+	out += "\x1b[0";
+
+	if (!isDefaultColor(attr.fg))
+		appendColor(";38;2;", attr.fg, out);
+
+	if (!isDefaultColor(attr.bg))
+		appendColor(";48;2;", attr.bg, out);
+
+	out += 'm';
+}
+
+GridExport::GridExport(Grid& grid)
+	: _grid(grid)
+	, _active(false)
+	, _cancelled(false)
+	, _lines_done(0)
+	, _lines_total(0)
+	, _bytes_written(0)
+	, _tail_chars()
+	, _tail_attrs()
+	, _tail_wrapped(false)
+	, _has_tail(false)
+	, _next_ln(0)
+	, _end_ln(0)
+	, _adopted()
+{}
+
+GridExport::~GridExport()
+{
+	cancel();
+}
+
+bool GridExport::start(const FilePath& path, size_t first_ln, size_t last_ln, ExportFormat format)
+{
+	if (_active.load()) {
+		THR_LOG_ERROR("Scrollback export is already running");
+		return false;
+	}
+
+	if (_thr.joinable())
+		_thr.join();
+
+	// the previous export thread is gone, the file is free to reuse
+	if (!_file.open(path))
+		return false;
+
+	_cancelled.store(false);
+	_lines_done.store(0);
+	_bytes_written.store(0);
+
+	size_t end_ln;
+
+	{
+		std::lock_guard<Grid> lock(_grid);
+
+		last_ln = std::min(last_ln, _grid.getLastLine());
+		end_ln = last_ln + 1;
+
+		/* Only the last line is still being written, copy it now
+		*  rather than exporting whatever it grows into
+		*/
+		_has_tail = (last_ln == _grid.getLastLine() && first_ln <= last_ln);
+
+		if (_has_tail) {
+			const Line& tail = _grid.getLine(last_ln);
+			tail.copyCells(0, tail.getCellCount(), _tail_chars, _tail_attrs);
+			_tail_wrapped = tail.isWrapped();
+			end_ln = last_ln;
+		}
+
+		_next_ln = first_ln;
+		_end_ln = end_ln;
+		_active.store(true);
+	}
+
+	THR_LOG_DEBUG("Exporting lines {} to {} into {}", first_ln, last_ln, path.toStr());
+
+	_lines_total.store(last_ln >= first_ln ? last_ln - first_ln + 1 : 0);
+
+	_thr = std::thread(
+		[this, first_ln, end_ln, format]() {
+			this->thrExecution(first_ln, end_ln, format);
+		});
+
+	return true;
+}
+
+void GridExport::cancel()
+{
+	_cancelled.store(true);
+
+	if (_thr.joinable())
+		_thr.join();
+}
+
+bool GridExport::isActive() const
+{
+	return _active.load();
+}
+
+size_t GridExport::getLinesDone() const
+{
+	return _lines_done.load();
+}
+
+size_t GridExport::getLinesTotal() const
+{
+	return _lines_total.load();
+}
+
+uint64_t GridExport::getBytesWritten() const
+{
+	return _bytes_written.load();
+}
+
+bool GridExport::isPending(size_t ln) const
+{
+	return _active.load() && ln >= _next_ln && ln < _end_ln;
+}
+
+void GridExport::adoptLine(size_t ln, RowBlock block, size_t cell_cnt, bool wrapped)
+{
+	_adopted.push_back(AdoptedLine{ ln, block, cell_cnt, wrapped });
+}
+
+void GridExport::unmapAdopted()
+{
+	for (AdoptedLine& adopted : _adopted)
+		_grid._row_pool.unmap(adopted.block, adopted.cell_cnt);
+}
+
+void GridExport::releaseAdopted()
+{
+	for (AdoptedLine& adopted : _adopted)
+		_grid._row_pool.release(adopted.block);
+
+	_adopted.clear();
+}
+
+bool GridExport::flush(std::string& buf)
+{
+	if (!_file.write(buf.data(), buf.size()))
+		return false;
+
+	const uint64_t prev = _bytes_written.fetch_add(buf.size());
+
+	if ((prev + buf.size()) / _ProgressInterval != prev / _ProgressInterval) {
+		THR_LOG_DEBUG("Scrollback export: {} of {} lines, {} MB written",
+					  _lines_done.load(), _lines_total.load(), (prev + buf.size()) >> 20);
+	}
+
+	buf.clear();
+	return true;
+}
+
+void GridExport::thrExecution(size_t first_ln, size_t end_ln, ExportFormat format)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const bool sgr = (format == EXPORT_FORMAT_SGR);
+
+	/* Cells of the lines copied out in a single chunk,
+	*  and end of every line within them
+	*/
+	Vec<char32_t> chars;
+	Vec<CellAttr> attrs;
+	Vec<size_t>   line_ends;
+	Vec<bool>     line_wrapped;
+
+	std::string buf;
+	// single line may exceed the buffer size a bit before being flushed
+	buf.reserve(_WriteBufSize * 2);
+
+	CellAttr curr_attr = {};
+	bool ok = true;
+	size_t next = first_ln;
+	size_t skipped = 0;
+
+	const auto appendLine = [&](const char32_t* line_chars, const CellAttr* line_attrs, size_t cell_cnt, bool wrapped) {
+		chars.insert(chars.end(), line_chars, line_chars + cell_cnt);
+
+		if (sgr)
+			attrs.insert(attrs.end(), line_attrs, line_attrs + cell_cnt);
+
+		line_ends.push_back(chars.size());
+		line_wrapped.push_back(wrapped);
+	};
+
+	const size_t last_ln = _has_tail ? end_ln : end_ln - 1;
+
+	while (ok && next <= last_ln && !_cancelled.load()) {
+		chars.clear();
+		attrs.clear();
+		line_ends.clear();
+		line_wrapped.clear();
+
+		{
+			std::lock_guard<Grid> lock(_grid);
+
+			const size_t first = _grid.getFirstLine();
+
+			while (next < end_ln && line_ends.size() < _ChunkLines && chars.size() < _ChunkCells) {
+				if (next >= first) {
+					const Line& line = _grid.getLine(next++);
+					appendLine(line.getChars(), line.getAttrs(), line.getCellCount(), line.isWrapped());
+					continue;
+				}
+
+				/* Evicted line, taken over by 'adoptLine' - unless it was evicted
+				*  before the export started
+				*/
+				if (_adopted.empty() || _adopted.front().ln != next) {
+					skipped++;
+					next++;
+					continue;
+				}
+
+				AdoptedLine& adopted = _adopted.front();
+				appendLine(adopted.block.chars, adopted.block.attrs, adopted.cell_cnt, adopted.wrapped);
+
+				_grid._row_pool.release(adopted.block);
+				_adopted.pop_front();
+				next++;
+			}
+
+			_next_ln = next;
+		}
+
+		if (_has_tail && next == end_ln && line_ends.size() < _ChunkLines) {
+			appendLine(_tail_chars.data(), _tail_attrs.data(), _tail_chars.size(), _tail_wrapped);
+			next++;
+		}
+
+		if (line_ends.empty())
+			break;
+
+		size_t cell = 0;
+
+		for (size_t i = 0; i < line_ends.size() && ok; i++) {
+			for (; cell < line_ends[i]; cell++) {
+				// carriage returns are stored along with the text
+				if (chars[cell] == U'\r')
+					continue;
+
+				if (sgr && !isSameAttr(attrs[cell], curr_attr)) {
+					curr_attr = attrs[cell];
+					appendSGR(curr_attr, buf);
+				}
+
+				appendUTF8(chars[cell], buf);
+			}
+
+			if (!line_wrapped[i])
+				buf += '\n';
+
+			if (buf.size() >= _WriteBufSize)
+				ok = flush(buf);
+		}
+
+		_lines_done.fetch_add(line_ends.size());
+	}
+
+	if (ok && sgr && !isSameAttr(curr_attr, CellAttr{}))
+		appendSGR(CellAttr{}, buf);
+
+	if (ok)
+		ok = flush(buf);
+
+	ok = _file.close() && ok;
+
+	{
+		std::lock_guard<Grid> lock(_grid);
+
+		// lines adopted after the thread stopped copying
+		releaseAdopted();
+		_active.store(false);
+	}
+
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	const double mb = static_cast<double>(_bytes_written.load()) / (1024. * 1024.);
+
+	if (_cancelled.load())
+		THR_LOG_DEBUG("Scrollback export cancelled after {} lines", _lines_done.load());
+	else if (ok)
+		THR_LOG_DEBUG("Scrollback export done: {} lines, {} MB in {} ms ({} MB/s), {} evicted lines skipped",
+					  _lines_done.load(), mb, ms, ms > 0. ? mb * 1000. / ms : 0., skipped);
+	else
+		THR_LOG_ERROR("Scrollback export failed after {} lines", _lines_done.load());
+}
+
+} // namespace Thr
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Line.hpp"
+#include "RowPool.hpp"
+#include "filesys/WriteFile.hpp"
+#include <string>
+#include <deque>
+#include <thread>
+#include <atomic>
+
+namespace Thr
+{
+
+class Grid;
+
+enum ExportFormat : uint32_t
+{
+	// UTF-8 text only
+	EXPORT_FORMAT_PLAIN = 0,
+	// UTF-8 text with colors as SGR escape sequences
+	EXPORT_FORMAT_SGR   = 1,
+};
+
+/* Writes a range of the Grid logical lines into a file on background thread.
+*  Lines are copied out chunk by chunk (taking the Grid lock for a single chunk only),
+*  then encoded and written without the lock in large sequential writes,
+*  so neither the parser nor the renderer waits for the disk.
+*
+*  Range is exported as it was when the export started, like the snapshots
+*  of the renderer: finished lines never change, so they are read in place
+*  and only the unfinished last line is copied when the export starts.
+*  Lines evicted from the scrollback before the thread got to them are handed
+*  over to the export together with their storage, instead of being recycled.
+*/
+class GridExport
+{
+public:
+	GridExport(Grid& grid);
+	~GridExport();
+
+	GridExport(const GridExport&) = delete;
+	GridExport& operator=(const GridExport&) = delete;
+
+	/* Start exporting lines [first_ln, last_ln] into 'path',
+	*  lines written after the call are not included.
+	*  Returns false if the previous export is still running
+	*  or the file can't be created. Must be called without holding the Grid lock.
+	*/
+	bool start(const FilePath& path, size_t first_ln, size_t last_ln, ExportFormat format);
+
+	/* Stop the export, leaving the file truncated.
+	*/
+	void cancel();
+
+	bool isActive() const;
+
+	/* Progress of the current (or the last) export */
+	size_t getLinesDone() const;
+	size_t getLinesTotal() const;
+	uint64_t getBytesWritten() const;
+
+	/* Whether line 'ln' is still to be exported.
+	*  Expects the Grid lock to be held.
+	*/
+	bool isPending(size_t ln) const;
+
+	/* Take over storage of the pending line 'ln', which is being evicted.
+	*  Expects the Grid lock to be held.
+	*/
+	void adoptLine(size_t ln, RowBlock block, size_t cell_cnt, bool wrapped);
+
+	/* Move the adopted lines pointing into a session mapping into the pool.
+	*  Expects the Grid lock to be held.
+	*/
+	void unmapAdopted();
+private:
+	void thrExecution(size_t first_ln, size_t end_ln, ExportFormat format);
+	bool flush(std::string& buf);
+	void releaseAdopted();
+
+	struct AdoptedLine
+	{
+		size_t   ln;
+		RowBlock block;
+		size_t   cell_cnt;
+		bool     wrapped;
+	};
+
+	static constexpr size_t    _ChunkLines   = 0x400;
+	// bounds the time the Grid lock is held for by a single chunk
+	static constexpr size_t    _ChunkCells   = 0x40000;
+	static constexpr size_t    _WriteBufSize = 0x100000;
+	static constexpr uint64_t  _ProgressInterval = 0x4000000;
+
+	Grid&                      _grid;
+	std::atomic<bool>          _active;
+	std::atomic<bool>          _cancelled;
+	std::atomic<size_t>        _lines_done;
+	std::atomic<size_t>        _lines_total;
+	std::atomic<uint64_t>      _bytes_written;
+	std::thread                _thr;
+	// opened by start(), written and closed by the export thread
+	WriteFile                  _file;
+	/* Copy of the unfinished last line taken by start(), if it's in the range,
+	*  read by the export thread only
+	*/
+	Vec<char32_t>              _tail_chars;
+	Vec<CellAttr>              _tail_attrs;
+	bool                       _tail_wrapped;
+	bool                       _has_tail;
+
+	/* Protected by the Grid lock. Lines [_next_ln, _end_ln) are
+	*  still to be read from the Grid.
+	*/
+	size_t                     _next_ln;
+	size_t                     _end_ln;
+	std::deque<AdoptedLine>    _adopted;
+};
+
+} // namespace Thr
@@ -0,0 +1,443 @@
+#include "GridSearch.hpp"
+#include "Grid.hpp"
+#include "memory/Simd.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace Thr
+{
+
+#if !defined(THR_FORCE_PURE) && (defined(THR_SIMD_AVX512) || defined(THR_SIMD_AVX2))
+#	define THR_SEARCH_AVX2
+#elif !defined(THR_FORCE_PURE) && (defined(THR_SIMD_AVX)    || \
+								   defined(THR_SIMD_SSE4_2) || \
+								   defined(THR_SIMD_SSE4_1) || \
+								   defined(THR_SIMD_SSSE3)  || \
+								   defined(THR_SIMD_SSE3)   || \
+								   defined(THR_SIMD_SSE2))
+#	define THR_SEARCH_SSE2
+#endif
+
+THR_FORCEINLINE uint32_t countTrailingZeros(uint32_t x)
+{
+	THR_ASSERT(x != 0);
+
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, x);
+	return static_cast<uint32_t>(idx);
+#else
+	return static_cast<uint32_t>(__builtin_ctz(x));
+#endif
+}
+
+THR_FORCEINLINE bool matchesAt(const char32_t* s, const char32_t* p, size_t m)
+{
+	return std::memcmp(s, p, m * sizeof(char32_t)) == 0;
+}
+
+/* Find all non-overlapping occurences of 'p' in 's',
+*  until 'on_match' returns false. Candidate positions are filtered by comparing the first and the last
+*  codepoint of the pattern against a whole vector of positions at once,
+*  and only the survivors are compared in full.
+*/
+template <typename OnMatch>
+static void findAll(const char32_t* s, size_t n, const char32_t* p, size_t m, OnMatch&& on_match)
+{
+	THR_ASSERT(m > 0);
+
+	if (n < m)
+		return;
+
+	// last position the pattern may start at
+	const size_t last = n - m;
+	size_t i = 0;
+
+#if defined(THR_SEARCH_AVX2)
+	const __m256i first_ch = _mm256_set1_epi32(static_cast<int>(p[0]));
+	const __m256i last_ch = _mm256_set1_epi32(static_cast<int>(p[m - 1]));
+
+	while (i + 8 <= last + 1) {
+		const __m256i block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+		const __m256i block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + m - 1));
+
+		const __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi32(block_first, first_ch),
+											_mm256_cmpeq_epi32(block_last, last_ch));
+
+		uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
+		size_t next = i + 8;
+
+		while (mask != 0) {
+			const size_t pos = i + countTrailingZeros(mask);
+			mask &= mask - 1;
+
+			if (matchesAt(s + pos, p, m)) {
+				if (!on_match(pos))
+					return;
+
+				next = pos + m;
+				// drop candidates overlapping the match
+				while (mask != 0 && i + countTrailingZeros(mask) < next)
+					mask &= mask - 1;
+			}
+		}
+
+		i = next;
+	}
+
+#elif defined(THR_SEARCH_SSE2)
+	const __m128i first_ch = _mm_set1_epi32(static_cast<int>(p[0]));
+	const __m128i last_ch = _mm_set1_epi32(static_cast<int>(p[m - 1]));
+
+	while (i + 4 <= last + 1) {
+		const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + m - 1));
+
+		const __m128i eq = _mm_and_si128(_mm_cmpeq_epi32(block_first, first_ch),
+										 _mm_cmpeq_epi32(block_last, last_ch));
+
+		uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+		size_t next = i + 4;
+
+		while (mask != 0) {
+			const size_t pos = i + countTrailingZeros(mask);
+			mask &= mask - 1;
+
+			if (matchesAt(s + pos, p, m)) {
+				if (!on_match(pos))
+					return;
+
+				next = pos + m;
+				// drop candidates overlapping the match
+				while (mask != 0 && i + countTrailingZeros(mask) < next)
+					mask &= mask - 1;
+			}
+		}
+
+		i = next;
+	}
+
+#endif
+
+	while (i <= last) {
+		if (s[i] == p[0] && s[i + m - 1] == p[m - 1] && matchesAt(s + i, p, m)) {
+			if (!on_match(i))
+				return;
+
+			i += m;
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+GridSearch::GridSearch(Grid& grid)
+	: _grid(grid)
+	, _active(false)
+	, _version(0)
+	, _generation(0)
+	, _finalized_end(0)
+	, _idle(false)
+{}
+
+GridSearch::~GridSearch()
+{
+	stop();
+}
+
+void GridSearch::start(const std::u32string& pattern)
+{
+	stop();
+
+	if (pattern.empty())
+		return;
+
+	{
+		std::lock_guard<Grid> lock(_grid);
+		_finalized_end.store(_grid.getLastLine());
+	}
+
+	_active = true;
+
+	const uint64_t generation = _generation.load();
+
+	_thr = std::thread(
+		[this, pattern, generation]() {
+			this->thrExecution(pattern, generation);
+		});
+}
+
+void GridSearch::stop()
+{
+	_generation.fetch_add(1);
+
+	{
+		std::lock_guard<std::mutex> lock(_wake_mutex);
+		_wake_cv.notify_all();
+	}
+
+	if (_thr.joinable())
+		_thr.join();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_matches.clear();
+	}
+
+	_active = false;
+	_version.fetch_add(1);
+}
+
+bool GridSearch::isActive() const
+{
+	return _active;
+}
+
+bool GridSearch::isScanning() const
+{
+	return _active && !_idle.load();
+}
+
+void GridSearch::onLineFinalized(size_t ln)
+{
+	_finalized_end.store(ln + 1);
+
+	/* Wake the thread up only when it sleeps -
+	*  while it's scanning, it picks new lines up by itself.
+	*/
+	if (_idle.load()) {
+		std::lock_guard<std::mutex> lock(_wake_mutex);
+		_wake_cv.notify_one();
+	}
+}
+
+uint64_t GridSearch::getVersion() const
+{
+	return _version.load();
+}
+
+size_t GridSearch::getMatchCount() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _matches.size();
+}
+
+void GridSearch::getMatches(size_t first_ln, size_t last_ln, Vec<SearchMatch>& out) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto it = std::lower_bound(_matches.begin(), _matches.end(), first_ln,
+		[](const SearchMatch& match, size_t ln) {
+			return match.ln < ln;
+		});
+
+	for (; it != _matches.end() && it->ln <= last_ln; ++it)
+		out.push_back(*it);
+}
+
+void GridSearch::publish(Vec<SearchMatch>& found, size_t first_ln)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	while (!_matches.empty() && _matches.front().ln < first_ln)
+		_matches.pop_front();
+
+	if (found.empty())
+		return;
+
+	_matches.insert(_matches.end(), found.begin(), found.end());
+	found.clear();
+
+	_version.fetch_add(1);
+}
+
+bool GridSearch::isCancelled(uint64_t generation) const
+{
+	return _generation.load() != generation;
+}
+
+/* Simple regex - literals separated by '.*' have to occur in order.
+*  Each literal is matched at its first occurence after the previous one,
+*  so the shortest match is reported.
+*/
+template <typename OnMatch>
+static void findPattern(const char32_t* s, size_t n, const Vec<std::u32string>& parts, OnMatch&& on_match)
+{
+	if (parts.size() == 1) {
+		const size_t m = parts[0].size();
+
+		findAll(s, n, parts[0].data(), m, [&](size_t pos) {
+			on_match(pos, pos + m);
+			return true;
+		});
+
+		return;
+	}
+
+	size_t pos = 0;
+
+	while (pos < n) {
+		size_t begin = n;
+		size_t end = pos;
+
+		for (const auto& part : parts) {
+			size_t found = n;
+
+			findAll(s + end, n - end, part.data(), part.size(), [&](size_t at) {
+				found = end + at;
+				return false;
+			});
+
+			if (found == n)
+				return;
+
+			begin = std::min(begin, found);
+			end = found + part.size();
+		}
+
+		on_match(begin, end);
+		pos = end;
+	}
+}
+
+static Vec<std::u32string> splitPattern(const std::u32string& pattern)
+{
+	static constexpr std::u32string_view Wildcard = U".*";
+
+	Vec<std::u32string> parts;
+	size_t pos = 0;
+
+	while (pos <= pattern.size()) {
+		const size_t wc = pattern.find(Wildcard, pos);
+		const size_t end = (wc == std::u32string::npos) ? pattern.size() : wc;
+
+		if (end > pos)
+			parts.push_back(pattern.substr(pos, end - pos));
+
+		if (wc == std::u32string::npos)
+			break;
+
+		pos = wc + Wildcard.size();
+	}
+
+	return parts;
+}
+
+void GridSearch::thrExecution(std::u32string pattern, uint64_t generation)
+{
+	const auto start = std::chrono::steady_clock::now();
+	const Vec<std::u32string> parts = splitPattern(pattern);
+
+	if (parts.empty())
+		return;
+
+	Vec<SearchMatch> found;
+	size_t next = 0;
+	size_t scanned = 0;
+	bool initial_scan = true;
+
+	/* Lines in range [indexed_begin, indexed_end) are narrowed
+	*  to candidates through the trigram index.
+	*/
+	Vec<size_t> candidates;
+	size_t candidate = 0;
+	size_t indexed_begin = 0;
+	size_t indexed_end = 0;
+
+	{
+		std::lock_guard<Grid> lock(_grid);
+
+		const TrigramIndex* index = _grid._trigram_index.get();
+
+		if (index != nullptr && index->getCandidates(parts, candidates)) {
+			indexed_begin = index->getIndexedBegin();
+			indexed_end = index->getIndexedEnd();
+
+			THR_LOG_DEBUG("Search index narrowed {} lines to {} candidates",
+						  indexed_end - indexed_begin, candidates.size());
+		}
+	}
+
+	const auto scanLine = [&](size_t ln) {
+		const Line& line = _grid.getLine(ln);
+
+		findPattern(line.getChars(), line.getCellCount(), parts, [&](size_t begin, size_t end) {
+			found.push_back(SearchMatch{
+				ln,
+				static_cast<uint32_t>(begin),
+				static_cast<uint32_t>(end)
+			});
+		});
+
+		scanned++;
+	};
+
+	while (true) {
+		size_t first;
+
+		{
+			std::lock_guard<Grid> lock(_grid);
+
+			if (isCancelled(generation))
+				return;
+
+			first = _grid.getFirstLine();
+			// the last line is still being written to, scan only the finalized ones
+			const size_t finalized_end = _grid.getLastLine();
+
+			next = std::max(next, first);
+
+			for (size_t budget = _ChunkSize; budget > 0 && next < finalized_end; budget--) {
+				if (next < indexed_begin || next >= indexed_end) {
+					scanLine(next++);
+					continue;
+				}
+
+				while (candidate < candidates.size() && candidates[candidate] < next)
+					candidate++;
+
+				if (candidate < candidates.size() && candidates[candidate] < indexed_end) {
+					next = candidates[candidate++];
+					scanLine(next++);
+				}
+				else {
+					next = indexed_end;
+				}
+			}
+		}
+
+		publish(found, first);
+
+		if (next < _finalized_end.load())
+			continue;
+
+		if (initial_scan) {
+			initial_scan = false;
+
+			const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start);
+
+			THR_LOG_DEBUG("Scrollback search scanned {} lines in {} us, {} matches",
+						  scanned, elapsed.count(), getMatchCount());
+		}
+
+		/* Caught up with the output, sleep until new lines are finalized
+		*/
+		std::unique_lock<std::mutex> lock(_wake_mutex);
+		_idle.store(true);
+
+		_wake_cv.wait(lock, [&]() {
+			return isCancelled(generation) || _finalized_end.load() > next;
+		});
+
+		_idle.store(false);
+	}
+}
+
+} // namespace Thr
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Common.hpp"
+#include <string>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace Thr
+{
+
+class Grid;
+class Line;
+
+/* Single occurence of the searched pattern -
+*  range of cells [begin, end) of the logical line 'ln'.
+*/
+struct SearchMatch
+{
+	size_t   ln;
+	uint32_t begin;
+	uint32_t end;
+};
+
+/* Case-sensitive search over the Grid scrollback. Pattern is either a literal,
+*  or a simple regex - literals separated by '.*'.
+*  Search runs on background thread, scanning the stored lines chunk by chunk
+*  (taking the Grid lock for a single chunk only) and publishing matches as
+*  soon as the chunk is done. Once the history is scanned, the thread sleeps
+*  and wakes up to scan lines finalized by new output.
+*
+*  When the Grid maintains trigram index, indexed lines are narrowed
+*  to the candidates containing all the literals before being scanned.
+*
+*  Matches are kept sorted by line number. Matches of lines evicted
+*  from the scrollback are dropped.
+*/
+class GridSearch
+{
+public:
+	GridSearch(Grid& grid);
+	~GridSearch();
+
+	GridSearch(const GridSearch&) = delete;
+	GridSearch& operator=(const GridSearch&) = delete;
+
+	/* Drop current results and start searching for 'pattern'.
+	*  Must be called without holding the Grid lock.
+	*/
+	void start(const std::u32string& pattern);
+
+	/* Stop searching and drop the results.
+	*  Must be called without holding the Grid lock.
+	*/
+	void stop();
+
+	bool isActive() const;
+
+	/* True while the thread scans lines, matches may still be published.
+	*/
+	bool isScanning() const;
+
+	/* Notify about finalized logical line 'ln'.
+	*  Expects the Grid lock to be held.
+	*/
+	void onLineFinalized(size_t ln);
+
+	/* Incremented every time the set of matches changes,
+	*  so the results can be re-queried only when needed.
+	*/
+	uint64_t getVersion() const;
+	size_t getMatchCount() const;
+
+	/* Appends matches from lines in range [first_ln, last_ln] to 'out'.
+	*/
+	void getMatches(size_t first_ln, size_t last_ln, Vec<SearchMatch>& out) const;
+private:
+	void thrExecution(std::u32string pattern, uint64_t generation);
+	void publish(Vec<SearchMatch>& found, size_t first_ln);
+	bool isCancelled(uint64_t generation) const;
+
+	static constexpr size_t         _ChunkSize = 0x1000;
+
+	Grid&                           _grid;
+	mutable std::mutex              _mutex;
+	std::deque<SearchMatch>         _matches;
+	bool                            _active;
+	std::atomic<uint64_t>           _version;
+	std::atomic<uint64_t>           _generation;
+	std::atomic<size_t>             _finalized_end;
+	std::atomic<bool>               _idle;
+	std::mutex                      _wake_mutex;
+	std::condition_variable         _wake_cv;
+	std::thread                     _thr;
+};
+
+} // namespace Thr
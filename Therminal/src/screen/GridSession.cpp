@@ -0,0 +1,266 @@
+#include "GridSession.hpp"
+#include "Grid.hpp"
+#include "filesys/MappedFile.hpp"
+#include "filesys/WriteFile.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+THR_STATIC_ASSERT_LOG(sizeof(CellAttr) == 6, "Session format expects packed cell attributes");
+
+bool GridSession::save(Grid& grid, const FilePath& path)
+{
+	const auto start = std::chrono::steady_clock::now();
+	SessionHeader header = {};
+
+	/* Lines restored from the previous session point into the file
+	*  which is about to be replaced - Windows refuses to replace a mapped file,
+	*  so they're copied into the pool first, which closes the mapping.
+	*/
+	{
+		std::lock_guard<Grid> lock(grid);
+
+		if (grid._row_pool.hasMapping()) {
+			for (size_t ln = grid._first_ln; ln <= grid._last_ln; ln++)
+				grid.getLine(ln).unmapCells();
+
+			grid._export.unmapAdopted();
+		}
+	}
+
+	// replace the previous session only once the new one is complete
+	const bool ok = writeFileAtomic(path, [&](WriteFile& file) {
+		return write(grid, file, header);
+	});
+
+	if (!ok) {
+		THR_LOG_ERROR("Failed to save session into {}", path.toStr());
+		return false;
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Session saved: {} lines, {} KB in {} ms",
+				  header.line_cnt, header.file_size / 1024, elapsed.count());
+
+	return true;
+}
+
+bool GridSession::write(Grid& grid, WriteFile& file, SessionHeader& header)
+{
+	std::lock_guard<Grid> lock(grid);
+
+	header.magic = _Magic;
+	header.version = _Version;
+	header.byte_order = _ByteOrder;
+	header.first_ln = grid._first_ln;
+	header.last_ln = grid._last_ln;
+	// synchronized update and hidden cursor are transient, the application which set them is gone
+	header.modes = grid._modes & ~static_cast<uint32_t>(TERM_MODE_SYNC_UPDATE | TERM_MODE_CURSOR_HIDDEN);
+	header.cursor_shape = grid._cursor_shape;
+	header.cursor_blink = grid._cursor_blink;
+	header.line_cnt = grid._last_ln - grid._first_ln + 1;
+
+	Vec<SessionLine> lines;
+	lines.reserve(header.line_cnt);
+
+	for (size_t ln = grid._first_ln; ln <= grid._last_ln; ln++) {
+		const Line& line = grid.getLine(ln);
+
+		SessionLine rec = {};
+		rec.first_cell = header.cell_cnt;
+		rec.cell_cnt = static_cast<uint32_t>(line.getCellCount());
+		rec.printable_cnt = static_cast<uint32_t>(line.getPrintableCount());
+		rec.wide_cnt = static_cast<uint32_t>(line.getWideCount());
+		rec.flags = line.isWrapped() ? SESSION_LINE_WRAPPED : SESSION_LINE_NONE;
+
+		lines.push_back(rec);
+		header.cell_cnt += rec.cell_cnt;
+	}
+
+	header.lines_offset = alignUp(sizeof(SessionHeader), _SectionAlignment);
+	header.chars_offset = alignUp(header.lines_offset + header.line_cnt * sizeof(SessionLine), _SectionAlignment);
+	header.attrs_offset = alignUp(header.chars_offset + header.cell_cnt * sizeof(char32_t), _SectionAlignment);
+	header.file_size = header.attrs_offset + header.cell_cnt * sizeof(CellAttr);
+
+	/* Sections are gathered in a single buffer,
+	*  so the file is written in large sequential chunks
+	*/
+	Vec<byte> buf;
+	buf.reserve(_WriteBufSize * 2);
+
+	uint64_t offset = 0;
+	bool ok = true;
+
+	const auto append = [&](const void* data, size_t n) {
+		const byte* p = static_cast<const byte*>(data);
+		buf.insert(buf.end(), p, p + n);
+		offset += n;
+
+		if (buf.size() >= _WriteBufSize) {
+			ok = ok && file.write(buf.data(), buf.size());
+			buf.clear();
+		}
+	};
+
+	const auto padTo = [&](uint64_t section_offset) {
+		THR_ASSERT(section_offset >= offset);
+		buf.resize(buf.size() + (section_offset - offset), 0);
+		offset = section_offset;
+	};
+
+	append(&header, sizeof(header));
+	padTo(header.lines_offset);
+	append(lines.data(), lines.size() * sizeof(SessionLine));
+	padTo(header.chars_offset);
+
+	for (size_t ln = grid._first_ln; ln <= grid._last_ln && ok; ln++) {
+		const Line& line = grid.getLine(ln);
+		append(line.getChars(), line.getCellCount() * sizeof(char32_t));
+	}
+
+	padTo(header.attrs_offset);
+
+	for (size_t ln = grid._first_ln; ln <= grid._last_ln && ok; ln++) {
+		const Line& line = grid.getLine(ln);
+		append(line.getAttrs(), line.getCellCount() * sizeof(CellAttr));
+	}
+
+	return ok && file.write(buf.data(), buf.size());
+}
+
+bool GridSession::restore(Grid& grid, const FilePath& path)
+{
+	const auto start = std::chrono::steady_clock::now();
+	auto mapping = std::make_unique<MappedFile>();
+
+	if (!mapping->open(path)) {
+		THR_LOG_DEBUG("No session to restore in {}", path.toStr());
+		return false;
+	}
+
+	byte* const data = mapping->getData();
+	const size_t size = mapping->getSize();
+
+	SessionHeader header;
+
+	if (size < sizeof(header)) {
+		THR_LOG_ERROR("Session file {} is truncated", path.toStr());
+		return false;
+	}
+
+	memCpy(&header, data, sizeof(header));
+
+	if (header.magic != _Magic || header.byte_order != _ByteOrder) {
+		THR_LOG_ERROR("File {} is not a session file", path.toStr());
+		return false;
+	}
+
+	if (header.version != _Version) {
+		THR_LOG_ERROR("Session file version {} is not supported, expected {}", header.version, _Version);
+		return false;
+	}
+
+	/* Validate the layout before pointing anything into the mapping.
+	*  Counts are compared with the space left in their sections, rather than
+	*  multiplied out, so a corrupted count can't wrap the sums around.
+	*/
+	const bool valid_layout =
+		header.file_size == size &&
+		header.cursor_shape <= CURSOR_SHAPE_BAR &&
+		header.cursor_blink <= 1 &&
+		header.last_ln >= header.first_ln &&
+		header.last_ln - header.first_ln < Grid::_BufSize &&
+		header.line_cnt == header.last_ln - header.first_ln + 1 &&
+		header.lines_offset % alignof(SessionLine) == 0 &&
+		header.chars_offset % alignof(char32_t) == 0 &&
+		header.lines_offset <= header.chars_offset &&
+		header.chars_offset <= header.attrs_offset &&
+		header.attrs_offset <= size &&
+		header.line_cnt <= (header.chars_offset - header.lines_offset) / sizeof(SessionLine) &&
+		header.cell_cnt <= (header.attrs_offset - header.chars_offset) / sizeof(char32_t) &&
+		header.cell_cnt <= (size - header.attrs_offset) / sizeof(CellAttr);
+
+	const SessionLine* const lines = reinterpret_cast<const SessionLine*>(data + header.lines_offset);
+	size_t mapped_cnt = 0;
+	bool valid_lines = valid_layout;
+
+	for (size_t i = 0; i < header.line_cnt && valid_lines; i++) {
+		const SessionLine& rec = lines[i];
+
+		valid_lines = rec.cell_cnt <= Grid::_LineLenLimit &&
+					  rec.first_cell <= header.cell_cnt &&
+					  rec.cell_cnt <= header.cell_cnt - rec.first_cell &&
+					  rec.printable_cnt <= rec.cell_cnt &&
+					  rec.wide_cnt <= rec.cell_cnt;
+
+		if (rec.cell_cnt > 0)
+			mapped_cnt++;
+	}
+
+	if (!valid_lines) {
+		THR_LOG_ERROR("Session file {} is corrupted", path.toStr());
+		return false;
+	}
+
+	char32_t* const chars = reinterpret_cast<char32_t*>(data + header.chars_offset);
+	CellAttr* const attrs = reinterpret_cast<CellAttr*>(data + header.attrs_offset);
+
+	{
+		std::lock_guard<Grid> lock(grid);
+
+		for (size_t ln = grid._first_ln; ln <= grid._last_ln; ln++)
+			grid.getLine(ln).clear();
+
+		grid._first_ln = header.first_ln;
+		grid._last_ln = header.last_ln;
+		grid._modes = header.modes;
+		grid._cursor_shape = static_cast<CursorShape>(header.cursor_shape);
+		grid._cursor_blink = header.cursor_blink != 0;
+		grid._view_follow = true;
+
+		for (size_t i = 0; i < header.line_cnt; i++) {
+			const SessionLine& rec = lines[i];
+			const RowBlock block = rec.cell_cnt > 0
+				? RowPool::makeMappedBlock(chars + rec.first_cell, attrs + rec.first_cell, rec.cell_cnt)
+				: RowBlock{};
+
+			grid.getLine(header.first_ln + i).restore(block, rec.cell_cnt, rec.printable_cnt, rec.wide_cnt,
+													  (rec.flags & SESSION_LINE_WRAPPED) != 0);
+		}
+
+		/* Pointers into the mapping are owned by the pool from now on,
+		*  the records above are read from it, so it's handed over only after them -
+		*  pool closes the mapping straight away when no line points into it.
+		*/
+		grid._row_pool.adoptMapping(std::move(mapping), mapped_cnt);
+
+		/* New shell starts on a fresh line below the restored output */
+		if (grid.getLine(grid._last_ln).getCellCount() > 0) {
+			grid._last_ln++;
+
+			if (grid._last_ln - grid._first_ln >= Grid::_BufSize)
+				grid._first_ln++;
+
+			grid.getLine(grid._last_ln).clear();
+		}
+
+		grid._commands.evict(grid._first_ln);
+	}
+
+	// already formatted grid has to lay out the restored lines again
+	if (grid._formated)
+		grid._wrap_index.rebuild(grid._ln_width);
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start);
+
+	THR_LOG_DEBUG("Session restored: {} lines, {} KB mapped in {} us",
+				  header.line_cnt, size / 1024, elapsed.count());
+
+	return true;
+}
+
+} // namespace Thr
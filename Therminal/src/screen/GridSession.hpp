@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Common.hpp"
+#include "filesys/Filepath.hpp"
+
+namespace Thr
+{
+
+class Grid;
+class WriteFile;
+
+/* Saved session layout. Every section is stored exactly as it's kept
+*  in memory, so restoring maps the file and points the lines into it -
+*  nothing is parsed or copied, pages are loaded only when touched:
+*
+*  SessionHeader | SessionLine[line_cnt] | char32_t[cell_cnt] | CellAttr[cell_cnt]
+*
+*  Sections are aligned to the cache line. The format is native-endian,
+*  files written on different architecture are rejected.
+*/
+struct SessionHeader
+{
+	Arr<char, 8> magic;
+	uint32_t     version;
+	uint32_t     byte_order;
+	uint64_t     first_ln;
+	uint64_t     last_ln;
+	uint32_t     modes;
+	uint32_t     cursor_shape;
+	uint32_t     cursor_blink;
+	uint32_t     reserved;
+	uint64_t     line_cnt;
+	uint64_t     cell_cnt;
+	uint64_t     lines_offset;
+	uint64_t     chars_offset;
+	uint64_t     attrs_offset;
+	uint64_t     file_size;
+};
+
+enum SessionLineFlags : uint32_t
+{
+	SESSION_LINE_NONE    = 0x0,
+	SESSION_LINE_WRAPPED = 0x1,
+};
+
+struct SessionLine
+{
+	uint64_t first_cell;
+	uint32_t cell_cnt;
+	uint32_t printable_cnt;
+	uint32_t wide_cnt;
+	uint32_t flags;
+};
+
+/* Saves and restores the Grid lines, modes and cursor style.
+*  Cursor position isn't stored - it follows the last line.
+*/
+class GridSession
+{
+public:
+	/* Write the session into 'path', replacing it atomically.
+	*  Must be called without holding the Grid lock.
+	*/
+	static bool save(Grid& grid, const FilePath& path);
+
+	/* Replace the Grid contents with the session saved in 'path'.
+	*  Returns false, leaving the Grid untouched, if there's no valid session.
+	*  Must be called without holding the Grid lock.
+	*/
+	static bool restore(Grid& grid, const FilePath& path);
+private:
+	// fills in the header while writing it
+	static bool write(Grid& grid, WriteFile& file, SessionHeader& header);
+
+	static constexpr Arr<char, 8> _Magic = { 'T', 'H', 'R', 'S', 'E', 'S', 'S', '\0' };
+	static constexpr uint32_t     _Version = 2;
+	static constexpr uint32_t     _ByteOrder = 0x01020304;
+	static constexpr size_t       _SectionAlignment = 64;
+	static constexpr size_t       _WriteBufSize = 0x100000;
+};
+
+} // namespace Thr
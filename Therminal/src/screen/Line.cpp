@@ -4,12 +4,9 @@
 namespace Thr
 {
 
-Line::Line(size_t width)
-    : _buf_size(width > _BufSizeLimit ? 0 : width)
-    , _ln_num(0)
+void Line::attachPool(RowPool& pool)
 {
-    THR_HARD_ASSERT_LOG(width > 0, "Invalid width value");
-    _ln.reserve(_buf_size);
+    _pool = std::addressof(pool);
 }
 
 size_t Line::getPrintableCount() const
@@ -17,47 +14,190 @@ size_t Line::getPrintableCount() const
     return _printable_cnt;
 }
 
+size_t Line::getCellCount() const
+{
+    return _size;
+}
+
 void Line::clear()
 {
-    _ln.clear();
+    if (_pool != nullptr)
+        _pool->release(_block);
+
+    _size = 0;
     _printable_cnt = 0;
+    _wide_cnt = 0;
+    _wrapped = false;
+    _version++;
 }
 
-void Line::reserve(size_t width)
+RowBlock Line::detach()
 {
-    THR_HARD_ASSERT_LOG(width <= _BufSizeLimit, "Invalid width value");
-    _buf_size = width;
-    _ln.reserve(_buf_size);
+    const RowBlock block = _block;
+    _block = RowBlock{};
+
+    clear();
+    return block;
+}
+
+void Line::restore(RowBlock block, size_t size, size_t printable_cnt, size_t wide_cnt, bool wrapped)
+{
+    THR_ASSERT(size <= block.capacity);
+
+    clear();
+
+    _block = block;
+    _size = size;
+    _printable_cnt = printable_cnt;
+    _wide_cnt = wide_cnt;
+    _wrapped = wrapped;
+}
+
+void Line::unmapCells()
+{
+    if (_pool != nullptr)
+        _pool->unmap(_block, _size);
+}
+
+size_t Line::getWideCount() const
+{
+    return _wide_cnt;
+}
+
+void Line::grow()
+{
+    THR_HARD_ASSERT_LOG(_pool != nullptr, "Line is not attached to a pool");
+
+    const size_t cells = _block.capacity ? std::min<size_t>(_block.capacity * 2, RowPool::MaxCells)
+                                         : _pool->getRowCells();
+    RowBlock block = _pool->allocate(cells);
+
+    if (_size > 0) {
+        std::copy_n(_block.chars, _size, block.chars);
+        std::copy_n(_block.attrs, _size, block.attrs);
+    }
+
+    _pool->release(_block);
+    _block = block;
 }
 
 void Line::putChar(Char32 ch, const EscapeState* state)
 {
-    const Cell cell = { ch, {}, {} };
+    const int width = ch.getWidth();
+
+    if (width > 0)
+        _printable_cnt += width;
+
+    if (width > 1)
+        _wide_cnt++;
 
-    if (ch.isPrintable())
-        _printable_cnt += ch.getWidth();
+    if (_size == _block.capacity)
+        grow();
 
-    _ln.push_back(cell);
+    _block.chars[_size] = ch;
+    _block.attrs[_size] = state != nullptr ? CellAttr{ state->fg, state->bg } : CellAttr{};
+    _size++;
+    _version++;
 }
 
-const Vec<Cell> Line::getVec() const
+const char32_t* Line::getChars() const
 {
-    return _ln;
+    return _block.chars;
 }
 
-void Line::trimToNewLine()
+const CellAttr* Line::getAttrs() const
+{
+    return _block.attrs;
+}
+
+Cell Line::getCell(size_t idx) const
 {
-    const auto it = std::find_if(_ln.rbegin(), _ln.rend(), 
-        [](const Cell& cell) {
-            return cell.ch == U'\n';
-        });
+    THR_ASSERT(idx < _size);
+    return Cell{ _block.chars[idx], _block.attrs[idx].fg, _block.attrs[idx].bg };
+}
+
+void Line::copyCells(size_t begin, size_t end, Vec<char32_t>& chars, Vec<CellAttr>& attrs) const
+{
+    THR_ASSERT(begin <= end && end <= _size);
 
-    if (it != _ln.rend()) {
-        _ln.erase(it.base(), _ln.end());
+    chars.assign(_block.chars + begin, _block.chars + end);
+    attrs.assign(_block.attrs + begin, _block.attrs + end);
+}
+
+size_t Line::getRowCount(size_t width) const
+{
+    THR_ASSERT(width > 0);
+
+    /* Without wide characters no cell can be pushed
+    *  to the next row early, so we don't have to walk the cells.
+    */
+    if (_wide_cnt == 0)
+        return std::max<size_t>(1, (_printable_cnt + width - 1) / width);
+
+    size_t rows = 1;
+    size_t col = 0;
+
+    for (size_t i = 0; i < _size; i++) {
+        const size_t cw = std::max(Char32(_block.chars[i]).getWidth(), 0);
+
+        if (col + cw > width && col > 0) {
+            rows++;
+            col = 0;
+        }
+
+        col += cw;
     }
-    else {
-        _ln.clear();
+
+    return rows;
+}
+
+size_t Line::getRowStarts(size_t width, Vec<uint32_t>& starts) const
+{
+    THR_ASSERT(width > 0);
+
+    starts.clear();
+    starts.push_back(0);
+
+    size_t col = 0;
+
+    for (size_t i = 0; i < _size; i++) {
+        const size_t cw = std::max(Char32(_block.chars[i]).getWidth(), 0);
+
+        if (col + cw > width && col > 0) {
+            starts.push_back(static_cast<uint32_t>(i));
+            col = 0;
+        }
+
+        col += cw;
     }
+
+    return starts.size();
+}
+
+void Line::setWrapped(bool wrapped)
+{
+    _wrapped = wrapped;
+}
+
+bool Line::isWrapped() const
+{
+    return _wrapped;
+}
+
+void Line::trimToNewLine()
+{
+    size_t size = _size;
+
+    while (size > 0 && _block.chars[size - 1] != U'\n')
+        size--;
+
+    _size = size;
+    _version++;
+}
+
+uint32_t Line::getVersion() const
+{
+    return _version;
 }
 
 } // namespace Thr
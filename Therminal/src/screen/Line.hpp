@@ -3,10 +3,11 @@
 #include "Common.hpp"
 #include "col/Color.hpp"
 #include "char/Char.hpp"
+#include "RowPool.hpp"
 
 namespace Thr
 {
-    
+
 struct Cell
 {
     char32_t ch;
@@ -14,35 +15,106 @@ struct Cell
     Color3u8 bg;
 };
 
+struct CellAttr
+{
+    Color3u8 fg;
+    Color3u8 bg;
+};
+
 struct EscapeState;
 
-/* Represent single line of cells.
+/* Represent single logical line of cells.
+*  Logical line is not bounded by the width of the screen -
+*  it's soft-wrapped into physical rows only when laid out
+*  for a specific width, so it can be reflowed on resize.
+*
+*  Codepoints and attributes are stored in separate arrays,
+*  so the codepoints can be scanned linearly (search, layout)
+*  without dragging the colors through the cache.
+*
+*  Cells live in a block of the RowPool, which is acquired on the first
+*  character, swapped for a larger one when full and returned on clear.
 */
 class Line
 {
 public:
     Line() = default;
-    Line(size_t width);
-    
+
+    Line(const Line&) = delete;
+    Line& operator=(const Line&) = delete;
+
+    void attachPool(RowPool& pool);
+
+    /* Remove all the cells, returning storage to the pool.
+    */
     void clear();
 
-    /* Returns number of visible cells in 
+    /* Hand the storage over to the caller, leaving the line empty.
+    *  The block has to be returned to the pool eventually.
+    */
+    RowBlock detach();
+
+    /* Replace the cells with 'size' cells stored in 'block',
+    *  with the counters saved along with them.
+    */
+    void restore(RowBlock block, size_t size, size_t printable_cnt, size_t wide_cnt, bool wrapped);
+
+    /* Move the cells restored from a session mapping into the pool.
+    */
+    void unmapCells();
+    size_t getWideCount() const;
+
+    /* Returns number of visible cells in
     *  current line.
     */
     size_t getPrintableCount() const;
+    size_t getCellCount() const;
 
-    void reserve(size_t width);
     void putChar(Char32 ch, const EscapeState* state);
 
-    const Vec<Cell> getVec() const;
+    /* Codepoints of all the cells, getCellCount() of them.
+    */
+    const char32_t* getChars() const;
+    const CellAttr* getAttrs() const;
+    Cell getCell(size_t idx) const;
+
+    /* Copy cells in range [begin, end) into 'chars' and 'attrs'.
+    */
+    void copyCells(size_t begin, size_t end, Vec<char32_t>& chars, Vec<CellAttr>& attrs) const;
+
+    /* Number of physical rows the line occupies
+    *  when soft-wrapped at 'width' columns.
+    *  Empty line still occupies a single row.
+    */
+    size_t getRowCount(size_t width) const;
+
+    /* Fills 'starts' with index of the first cell of each
+    *  physical row at 'width' columns. Returns number of rows.
+    */
+    size_t getRowStarts(size_t width, Vec<uint32_t>& starts) const;
+
+    /* Soft-wrap marker - the logical line did not end with newline,
+    *  but continues in the next stored line.
+    */
+    void setWrapped(bool wrapped);
+    bool isWrapped() const;
 
     void trimToNewLine();
+
+    /* Incremented on every modification of the cells,
+    *  so the laid out rows can be cached.
+    */
+    uint32_t getVersion() const;
 private:
-    static constexpr size_t _BufSizeLimit = 0x800;
-    size_t                  _buf_size = 0;
+    void grow();
+
+    Ptr<RowPool>            _pool = nullptr;
+    RowBlock                _block;
+    size_t                  _size = 0;
     size_t                  _printable_cnt = 0;
-    Vec<Cell>               _ln;
-    size_t                  _ln_num;
+    size_t                  _wide_cnt = 0;
+    bool                    _wrapped = false;
+    uint32_t                _version = 0;
 };
 
 } // namespace Thr
@@ -0,0 +1,233 @@
+#include "RowPool.hpp"
+#include "Line.hpp"
+#include "logger/Log.hpp"
+#include <algorithm>
+#include <new>
+
+namespace Thr
+{
+
+RowPool::RowPool()
+	: _classes{}
+	, _row_cells(MinCells)
+	, _reserved_bytes(0)
+	, _slab_alloc_cnt(0)
+	, _mapping(nullptr)
+	, _mapped_blocks(0)
+{
+	for (size_t i = 0; i < _ClassCount; i++) {
+		SizeClass& cls = _classes[i];
+
+		cls.free_list = nullptr;
+		cls.block_bytes = getClassCells(i) * (sizeof(char32_t) + sizeof(CellAttr));
+		cls.blocks_per_slab = std::max<size_t>(1, _SlabBytes / cls.block_bytes);
+	}
+}
+
+size_t RowPool::getClassIdx(size_t cells)
+{
+	size_t idx = 0;
+
+	while (idx + 1 < _ClassCount && getClassCells(idx) < cells)
+		idx++;
+
+	return idx;
+}
+
+size_t RowPool::getClassCells(size_t idx)
+{
+	return MinCells << idx;
+}
+
+RowBlock RowPool::allocate(size_t cells)
+{
+	THR_ASSERT_LOG(cells <= MaxCells, "Line exceeds the largest block");
+
+	const size_t idx = getClassIdx(cells);
+	SizeClass& cls = _classes[idx];
+
+	if (cls.free_list == nullptr)
+		allocSlab(idx);
+
+	FreeBlock* free_block = cls.free_list;
+	cls.free_list = free_block->next;
+
+	const uint32_t slab = free_block->slab;
+	cls.slabs[slab].used++;
+
+	const size_t capacity = getClassCells(idx);
+	byte* mem = reinterpret_cast<byte*>(free_block);
+
+	RowBlock block;
+	block.chars = reinterpret_cast<char32_t*>(mem);
+	block.attrs = reinterpret_cast<CellAttr*>(mem + capacity * sizeof(char32_t));
+	block.capacity = static_cast<uint32_t>(capacity);
+	block.slab = slab;
+
+	return block;
+}
+
+void RowPool::release(RowBlock& block)
+{
+	if (block.chars == nullptr)
+		return;
+
+	if (block.slab == MappedSlab) {
+		THR_ASSERT(_mapped_blocks > 0);
+
+		if (--_mapped_blocks == 0) {
+			THR_LOG_DEBUG("All the restored lines are gone, closing the session mapping");
+			_mapping.reset();
+		}
+
+		block = RowBlock{};
+		return;
+	}
+
+	SizeClass& cls = _classes[getClassIdx(block.capacity)];
+	THR_ASSERT(cls.slabs[block.slab].used > 0);
+
+	FreeBlock* free_block = new (block.chars) FreeBlock{ cls.free_list, block.slab };
+	cls.free_list = free_block;
+	cls.slabs[block.slab].used--;
+
+	block = RowBlock{};
+}
+
+void RowPool::adoptMapping(std::unique_ptr<MappedFile> mapping, size_t blocks)
+{
+	THR_HARD_ASSERT_LOG(_mapping == nullptr, "Pool already holds a mapping");
+
+	if (blocks == 0)
+		return;
+
+	_mapping = std::move(mapping);
+	_mapped_blocks = blocks;
+}
+
+RowBlock RowPool::makeMappedBlock(char32_t* chars, CellAttr* attrs, size_t cells)
+{
+	RowBlock block;
+	block.chars = chars;
+	block.attrs = attrs;
+	block.capacity = static_cast<uint32_t>(cells);
+	block.slab = MappedSlab;
+
+	return block;
+}
+
+void RowPool::unmap(RowBlock& block, size_t cells)
+{
+	if (block.slab != MappedSlab)
+		return;
+
+	RowBlock copy = allocate(std::max(cells, _row_cells));
+	std::copy_n(block.chars, cells, copy.chars);
+	std::copy_n(block.attrs, cells, copy.attrs);
+
+	release(block);
+	block = copy;
+}
+
+bool RowPool::hasMapping() const
+{
+	return _mapping != nullptr;
+}
+
+void RowPool::setRowWidth(size_t width)
+{
+	_row_cells = getClassCells(getClassIdx(width));
+}
+
+size_t RowPool::getRowCells() const
+{
+	return _row_cells;
+}
+
+void RowPool::allocSlab(size_t idx)
+{
+	SizeClass& cls = _classes[idx];
+	uint32_t slab;
+
+	if (!cls.empty_ids.empty()) {
+		slab = cls.empty_ids.back();
+		cls.empty_ids.pop_back();
+	}
+	else {
+		slab = static_cast<uint32_t>(cls.slabs.size());
+		cls.slabs.emplace_back();
+	}
+
+	const size_t bytes = cls.block_bytes * cls.blocks_per_slab;
+
+	cls.slabs[slab].mem = std::make_unique<byte[]>(bytes);
+	cls.slabs[slab].used = 0;
+
+	_reserved_bytes += bytes;
+	_slab_alloc_cnt++;
+
+	/* Push blocks in reverse, so they're handed out in address order */
+	byte* mem = cls.slabs[slab].mem.get();
+
+	for (size_t i = cls.blocks_per_slab; i-- > 0; )
+		cls.free_list = new (mem + i * cls.block_bytes) FreeBlock{ cls.free_list, slab };
+}
+
+size_t RowPool::trim()
+{
+	size_t released = 0;
+
+	for (SizeClass& cls : _classes) {
+		const auto isEmpty = [&](uint32_t slab) {
+			return cls.slabs[slab].mem != nullptr && cls.slabs[slab].used == 0;
+		};
+
+		bool any_empty = false;
+
+		for (uint32_t slab = 0; slab < cls.slabs.size() && !any_empty; slab++)
+			any_empty = isEmpty(slab);
+
+		if (!any_empty)
+			continue;
+
+		/* Unlink blocks of the empty slabs, keeping the order of the rest */
+		FreeBlock** link = std::addressof(cls.free_list);
+
+		while (*link != nullptr) {
+			if (isEmpty((*link)->slab))
+				*link = (*link)->next;
+			else
+				link = std::addressof((*link)->next);
+		}
+
+		const size_t bytes = cls.block_bytes * cls.blocks_per_slab;
+
+		for (uint32_t slab = 0; slab < cls.slabs.size(); slab++) {
+			if (!isEmpty(slab))
+				continue;
+
+			cls.slabs[slab].mem.reset();
+			cls.empty_ids.push_back(slab);
+			released += bytes;
+		}
+	}
+
+	_reserved_bytes -= released;
+
+	if (released > 0)
+		THR_LOG_DEBUG("Row pool released {} KB, {} KB still reserved", released / 1024, _reserved_bytes / 1024);
+
+	return released;
+}
+
+size_t RowPool::getReservedBytes() const
+{
+	return _reserved_bytes;
+}
+
+size_t RowPool::getSlabAllocCount() const
+{
+	return _slab_alloc_cnt;
+}
+
+} // namespace Thr
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Common.hpp"
+#include "filesys/MappedFile.hpp"
+#include <memory>
+
+namespace Thr
+{
+
+struct CellAttr;
+
+/* Storage of a single line handed out by the RowPool -
+*  'capacity' codepoints followed by 'capacity' attributes.
+*/
+struct RowBlock
+{
+	char32_t* chars    = nullptr;
+	CellAttr* attrs    = nullptr;
+	uint32_t  capacity = 0;
+	uint32_t  slab     = 0;
+};
+
+/* Slab allocator of the line storage. Blocks come in power of two
+*  size classes, each class carved out of its own slabs of fixed size.
+*  Released blocks are kept on intrusive free list of their class,
+*  so recycling a line of evicted scrollback is O(1) and once the slabs
+*  are warmed up, streaming output does not touch the heap at all.
+*  Slabs left without any used block are freed as a whole by 'trim'.
+*
+*  Blocks may also point into a mapped file (restored session) - such blocks
+*  are never reused, the mapping is closed once all of them are released.
+*
+*  Expects the Grid lock to be held.
+*/
+class RowPool
+{
+public:
+	static constexpr size_t   MinCells = 0x40;
+	static constexpr size_t   MaxCells = 0x4000;
+	// slab index of the blocks pointing into the mapping
+	static constexpr uint32_t MappedSlab = 0xFFFFFFFF;
+
+	RowPool();
+
+	RowPool(const RowPool&) = delete;
+	RowPool& operator=(const RowPool&) = delete;
+
+	/* Block for at least 'cells' cells, at most MaxCells.
+	*/
+	RowBlock allocate(size_t cells);
+	void release(RowBlock& block);
+
+	/* Take over the mapping, which 'blocks' blocks are going to point into.
+	*/
+	void adoptMapping(std::unique_ptr<MappedFile> mapping, size_t blocks);
+	static RowBlock makeMappedBlock(char32_t* chars, CellAttr* attrs, size_t cells);
+
+	/* Copy first 'cells' cells of a block pointing into the mapping
+	*  into a block of the pool, other blocks are left as they are.
+	*/
+	void unmap(RowBlock& block, size_t cells);
+	bool hasMapping() const;
+
+	/* Size of the first block of every line - lines usually
+	*  don't exceed the width of the screen.
+	*/
+	void setRowWidth(size_t width);
+	size_t getRowCells() const;
+
+	/* Free slabs with no used blocks. Returns number of bytes released.
+	*/
+	size_t trim();
+
+	size_t getReservedBytes() const;
+	// number of slabs allocated since the pool was created
+	size_t getSlabAllocCount() const;
+private:
+	/* Header written over the cells of a released block */
+	struct FreeBlock
+	{
+		FreeBlock* next;
+		uint32_t   slab;
+	};
+
+	struct Slab
+	{
+		std::unique_ptr<byte[]> mem;
+		uint32_t                used;
+	};
+
+	struct SizeClass
+	{
+		Vec<Slab>      slabs;
+		Vec<uint32_t>  empty_ids;
+		FreeBlock*     free_list;
+		size_t         block_bytes;
+		size_t         blocks_per_slab;
+	};
+
+	static size_t getClassIdx(size_t cells);
+	static size_t getClassCells(size_t idx);
+
+	void allocSlab(size_t idx);
+
+	static constexpr size_t _ClassCount = 9;
+	static constexpr size_t _SlabBytes  = 0x40000;
+
+	THR_STATIC_ASSERT_LOG((MinCells << (_ClassCount - 1)) == MaxCells, "Size classes must cover all the line lengths");
+
+	Arr<SizeClass, _ClassCount> _classes;
+	size_t                      _row_cells;
+	size_t                      _reserved_bytes;
+	size_t                      _slab_alloc_cnt;
+	std::unique_ptr<MappedFile> _mapping;
+	size_t                      _mapped_blocks;
+};
+
+} // namespace Thr
@@ -0,0 +1,34 @@
+#include "Snapshot.hpp"
+
+namespace Thr
+{
+
+SnapshotExchange::SnapshotExchange()
+	: _slots{}
+	, _middle(1)
+	, _back(0)
+	, _front(2)
+{}
+
+ScreenSnapshot& SnapshotExchange::getBack()
+{
+	return _slots[_back];
+}
+
+void SnapshotExchange::publish()
+{
+	const uint32_t prev = _middle.exchange(_back | _FreshBit, std::memory_order_acq_rel);
+	_back = prev & _IndexMask;
+}
+
+const ScreenSnapshot& SnapshotExchange::acquire()
+{
+	if (_middle.load(std::memory_order_relaxed) & _FreshBit) {
+		const uint32_t prev = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = prev & _IndexMask;
+	}
+
+	return _slots[_front];
+}
+
+} // namespace Thr
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Line.hpp"
+#include <atomic>
+#include <memory>
+
+namespace Thr
+{
+
+/* Immutable copy of a single physical row - range of cells
+*  [begin, end) of the logical line 'ln_num' at line 'version'.
+*/
+struct SnapshotRow
+{
+	size_t        ln_num;
+	uint32_t      begin;
+	uint32_t      end;
+	uint32_t      version;
+	Vec<char32_t> chars;
+	Vec<CellAttr> attrs;
+};
+
+/* Cursor shapes selected by DECSCUSR
+*/
+enum CursorShape : uint32_t
+{
+	CURSOR_SHAPE_BLOCK = 0,
+	CURSOR_SHAPE_UNDERLINE,
+	CURSOR_SHAPE_BAR
+};
+
+/* Cursor sits past the last cell written - at column 'col' of the
+*  snapshot row 'row'. Not visible when that row is out of view.
+*/
+struct SnapshotCursor
+{
+	uint32_t    row     = 0;
+	uint32_t    col     = 0;
+	CursorShape shape   = CURSOR_SHAPE_BLOCK;
+	bool        visible = false;
+	bool        blink   = true;
+};
+
+THR_INLINE bool isSameCursor(const SnapshotCursor& a, const SnapshotCursor& b)
+{
+	return a.row == b.row && a.col == b.col && a.shape == b.shape &&
+		   a.visible == b.visible && a.blink == b.blink;
+}
+
+/* Visible rows of the screen, top to bottom.
+*  Rows which did not change since the previous snapshot
+*  are shared with it instead of being copied. Generation changes
+*  only with the rows, cursor alone doesn't need the rows submitted again.
+*/
+struct ScreenSnapshot
+{
+	uint64_t                                generation = 0;
+	Vec<std::shared_ptr<const SnapshotRow>> rows;
+	SnapshotCursor                          cursor;
+};
+
+/* Hands snapshots from a single writer (parser side)
+*  over to a single reader (renderer) through three slots:
+*  writer fills the back slot and swaps it with the middle one,
+*  reader swaps its front slot with the middle one when it's fresh.
+*  Both sides use a single atomic exchange, so neither ever waits.
+*
+*  Reclamation is deterministic - slot handed back by the reader is
+*  the only one the writer may rewrite, and the rows are reference
+*  counted by the snapshots, which are modified by the writer only.
+*/
+class SnapshotExchange
+{
+public:
+	SnapshotExchange();
+
+	SnapshotExchange(const SnapshotExchange&) = delete;
+	SnapshotExchange& operator=(const SnapshotExchange&) = delete;
+
+	/* Writer side */
+	ScreenSnapshot& getBack();
+	void publish();
+
+	/* Reader side. Returns the most recent published snapshot,
+	*  which stays valid until the next 'acquire'.
+	*/
+	const ScreenSnapshot& acquire();
+private:
+	static constexpr uint32_t _IndexMask = 0x3;
+	static constexpr uint32_t _FreshBit  = 0x4;
+
+	Arr<ScreenSnapshot, 3>    _slots;
+	// index of the middle slot, with fresh bit set by the writer
+	std::atomic<uint32_t>     _middle;
+	uint32_t                  _back;
+	uint32_t                  _front;
+};
+
+} // namespace Thr
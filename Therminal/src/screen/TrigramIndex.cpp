@@ -0,0 +1,209 @@
+#include "TrigramIndex.hpp"
+#include "Line.hpp"
+#include "logger/Log.hpp"
+#include <algorithm>
+
+namespace Thr
+{
+
+TrigramIndex::TrigramIndex(size_t memory_limit)
+	: _memory_limit(memory_limit)
+	, _bytes(0)
+	, _indexed_bytes(0)
+	, _logged_bytes(0)
+	, _build_time(0)
+{}
+
+uint64_t TrigramIndex::makeTrigram(char32_t a, char32_t b, char32_t c)
+{
+	// codepoints fit in 21 bits
+	return (static_cast<uint64_t>(a & 0x1FFFFF) << 42) |
+		   (static_cast<uint64_t>(b & 0x1FFFFF) << 21) |
+		    static_cast<uint64_t>(c & 0x1FFFFF);
+}
+
+void TrigramIndex::startBlock(size_t ln)
+{
+	_blocks.push_back(Block{ ln, ln, {}, 0 });
+}
+
+void TrigramIndex::addLine(size_t ln, const Line& line)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	/* Start new block when the current one is full,
+	*  or when lines were skipped (index enabled in the middle of session)
+	*/
+	if (_blocks.empty() ||
+		_blocks.back().end_ln != ln ||
+		_blocks.back().end_ln - _blocks.back().first_ln >= _BlockLines) {
+		startBlock(ln);
+	}
+
+	Block& block = _blocks.back();
+	block.end_ln = ln + 1;
+
+	const char32_t* chars = line.getChars();
+	const size_t cell_cnt = line.getCellCount();
+
+	_line_trigrams.clear();
+
+	for (size_t i = 2; i < cell_cnt; i++)
+		_line_trigrams.push_back(makeTrigram(chars[i - 2], chars[i - 1], chars[i]));
+
+	std::sort(_line_trigrams.begin(), _line_trigrams.end());
+	_line_trigrams.erase(std::unique(_line_trigrams.begin(), _line_trigrams.end()), _line_trigrams.end());
+
+	const uint32_t offset = static_cast<uint32_t>(ln - block.first_ln);
+	const size_t block_bytes = block.bytes;
+
+	for (const uint64_t trigram : _line_trigrams) {
+		auto [it, inserted] = block.postings.try_emplace(trigram);
+		Posting& posting = it->second;
+
+		if (inserted)
+			block.bytes += _EntryOverhead;
+
+		/* First delta is relative to the beginning of the block */
+		uint32_t delta = offset - (posting.deltas.empty() ? 0 : posting.last);
+		posting.last = offset;
+
+		do {
+			const byte b = static_cast<byte>(delta & 0x7F);
+			delta >>= 7;
+			posting.deltas.push_back(delta ? (b | 0x80) : b);
+			block.bytes++;
+		} while (delta);
+	}
+
+	_bytes += block.bytes - block_bytes;
+
+	/* Keep within the memory limit, the newest block always stays */
+	while (_bytes > _memory_limit && _blocks.size() > 1) {
+		_bytes -= _blocks.front().bytes;
+		_blocks.pop_front();
+	}
+
+	_build_time += std::chrono::steady_clock::now() - start;
+	// count a codepoint as a byte of output, which is exact for ASCII
+	_indexed_bytes += cell_cnt;
+
+	if (_indexed_bytes - _logged_bytes >= _StatsInterval)
+		logStats();
+}
+
+void TrigramIndex::evict(size_t first_ln)
+{
+	while (!_blocks.empty() && _blocks.front().end_ln <= first_ln) {
+		_bytes -= _blocks.front().bytes;
+		_blocks.pop_front();
+	}
+}
+
+size_t TrigramIndex::getIndexedBegin() const
+{
+	return _blocks.empty() ? 0 : _blocks.front().first_ln;
+}
+
+size_t TrigramIndex::getIndexedEnd() const
+{
+	return _blocks.empty() ? 0 : _blocks.back().end_ln;
+}
+
+size_t TrigramIndex::getMemoryUsage() const
+{
+	return _bytes;
+}
+
+void TrigramIndex::decode(const Posting& posting, size_t first_ln, Vec<size_t>& lines)
+{
+	size_t ln = first_ln;
+	uint32_t delta = 0;
+	uint32_t shift = 0;
+
+	for (const byte b : posting.deltas) {
+		delta |= static_cast<uint32_t>(b & 0x7F) << shift;
+
+		if (b & 0x80) {
+			shift += 7;
+			continue;
+		}
+
+		ln += delta;
+		lines.push_back(ln);
+
+		delta = 0;
+		shift = 0;
+	}
+}
+
+bool TrigramIndex::getCandidates(const Vec<std::u32string>& literals, Vec<size_t>& lines) const
+{
+	Vec<uint64_t> trigrams;
+
+	for (const auto& lit : literals) {
+		for (size_t i = 2; i < lit.size(); i++)
+			trigrams.push_back(makeTrigram(lit[i - 2], lit[i - 1], lit[i]));
+	}
+
+	if (trigrams.empty())
+		return false;
+
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+	Vec<const Posting*> postings(trigrams.size());
+	Vec<size_t> other;
+	Vec<size_t> merged;
+
+	for (const Block& block : _blocks) {
+		bool missing = false;
+
+		for (size_t i = 0; i < trigrams.size() && !missing; i++) {
+			const auto it = block.postings.find(trigrams[i]);
+			missing = (it == block.postings.end());
+			postings[i] = missing ? nullptr : std::addressof(it->second);
+		}
+
+		if (missing)
+			continue;
+
+		/* Start from the shortest posting, so the intersection
+		*  only ever shrinks from the smallest set
+		*/
+		std::sort(postings.begin(), postings.end(), [](const Posting* a, const Posting* b) {
+			return a->deltas.size() < b->deltas.size();
+		});
+
+		const size_t block_begin = lines.size();
+		decode(*postings[0], block.first_ln, lines);
+
+		for (size_t i = 1; i < postings.size() && lines.size() > block_begin; i++) {
+			other.clear();
+			merged.clear();
+			decode(*postings[i], block.first_ln, other);
+
+			std::set_intersection(lines.begin() + block_begin, lines.end(),
+								  other.begin(), other.end(),
+								  std::back_inserter(merged));
+
+			lines.resize(block_begin);
+			lines.insert(lines.end(), merged.begin(), merged.end());
+		}
+	}
+
+	return true;
+}
+
+void TrigramIndex::logStats()
+{
+	_logged_bytes = _indexed_bytes;
+
+	const double mb = static_cast<double>(_indexed_bytes) / (1024. * 1024.);
+	const double ms = std::chrono::duration<double, std::milli>(_build_time).count();
+
+	THR_LOG_DEBUG("Trigram index: {} MB of output indexed, {} ms per MB, {} KB of postings in {} blocks",
+				  mb, ms / mb, _bytes / 1024, _blocks.size());
+}
+
+} // namespace Thr
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Common.hpp"
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+
+namespace Thr
+{
+
+class Line;
+
+/* Trigram index of the Grid logical lines.
+*  For every trigram (three consecutive codepoints) we keep the posting list -
+*  sorted numbers of lines containing it, stored as varint-encoded deltas.
+*  Lines are indexed as they are finalized, in blocks of consecutive lines,
+*  each block having its own postings. Blocks of evicted lines are dropped
+*  as a whole, as are the oldest blocks once the memory limit is exceeded -
+*  lines outside the index simply have to be scanned.
+*
+*  Expects the Grid lock to be held.
+*/
+class TrigramIndex
+{
+public:
+	TrigramIndex(size_t memory_limit);
+
+	TrigramIndex(const TrigramIndex&) = delete;
+	TrigramIndex& operator=(const TrigramIndex&) = delete;
+
+	void addLine(size_t ln, const Line& line);
+
+	/* Drop blocks containing only lines before 'first_ln'.
+	*/
+	void evict(size_t first_ln);
+
+	/* Lines in range [indexed begin, indexed end) are indexed.
+	*/
+	size_t getIndexedBegin() const;
+	size_t getIndexedEnd() const;
+
+	/* Fills 'lines' with sorted numbers of the indexed lines that may contain
+	*  all the 'literals'. Returns false when the literals are too short
+	*  to narrow the search - every line is a candidate then.
+	*/
+	bool getCandidates(const Vec<std::u32string>& literals, Vec<size_t>& lines) const;
+
+	size_t getMemoryUsage() const;
+private:
+	struct Posting
+	{
+		Vec<byte> deltas;
+		uint32_t  last = 0;
+	};
+
+	struct Block
+	{
+		size_t                                first_ln;
+		size_t                                end_ln;
+		std::unordered_map<uint64_t, Posting> postings;
+		size_t                                bytes;
+	};
+
+	static uint64_t makeTrigram(char32_t a, char32_t b, char32_t c);
+	static void decode(const Posting& posting, size_t first_ln, Vec<size_t>& lines);
+
+	void startBlock(size_t ln);
+	void logStats();
+
+	static constexpr size_t       _BlockLines = 0x1000;
+	// rough cost of a single hash map entry besides its deltas
+	static constexpr size_t       _EntryOverhead = 64;
+	static constexpr size_t       _StatsInterval = 0x1000000;
+
+	const size_t                  _memory_limit;
+	std::deque<Block>             _blocks;
+	size_t                        _bytes;
+	Vec<uint64_t>                 _line_trigrams;
+
+	/* Build cost statistics */
+	size_t                        _indexed_bytes;
+	size_t                        _logged_bytes;
+	std::chrono::nanoseconds      _build_time;
+};
+
+} // namespace Thr
@@ -0,0 +1,157 @@
+#include "WrapIndex.hpp"
+#include "Grid.hpp"
+#include <chrono>
+
+namespace Thr
+{
+
+WrapIndex::WrapIndex(Grid& grid, size_t capacity)
+	: _grid(grid)
+	, _capacity(capacity)
+	, _row_start(std::make_unique<uint64_t[]>(capacity))
+	, _width(0)
+	, _indexed_begin(0)
+	, _indexed_end(0)
+	, _complete(false)
+	, _generation(0)
+{
+	THR_HARD_ASSERT_LOG(_capacity > 0, "Invalid wrap index capacity");
+}
+
+WrapIndex::~WrapIndex()
+{
+	stop();
+}
+
+void WrapIndex::stop()
+{
+	_generation.fetch_add(1, std::memory_order_relaxed);
+
+	if (_thr.joinable())
+		_thr.join();
+}
+
+void WrapIndex::rebuild(size_t width)
+{
+	THR_HARD_ASSERT_LOG(width > 0, "Invalid line width");
+
+	/* Cancel indexing for the previous width */
+	stop();
+
+	{
+		std::lock_guard<Grid> lock(_grid);
+
+		_width = width;
+		_indexed_begin = _grid.getFirstLine();
+		_indexed_end = _indexed_begin;
+		_row_start[_indexed_end % _capacity] = 0;
+		_complete = false;
+	}
+
+	const uint64_t generation = _generation.load(std::memory_order_relaxed);
+
+	_thr = std::thread(
+		[this, width, generation]() {
+			this->thrExecution(width, generation);
+		});
+}
+
+void WrapIndex::onLineFinalized(size_t ln)
+{
+	if (!_complete)
+		return;
+
+	THR_ASSERT(ln == _indexed_end);
+
+	const uint64_t row = _row_start[ln % _capacity];
+	_row_start[(ln + 1) % _capacity] = row + _grid.getLine(ln).getRowCount(_width);
+
+	_indexed_end = ln + 1;
+	_indexed_begin = std::max(_indexed_begin, _grid.getFirstLine());
+}
+
+bool WrapIndex::isComplete() const
+{
+	return _complete;
+}
+
+size_t WrapIndex::getIndexedEnd() const
+{
+	return _indexed_end;
+}
+
+uint64_t WrapIndex::getLineRow(size_t ln) const
+{
+	THR_ASSERT(ln >= _indexed_begin && ln <= _indexed_end);
+	return _row_start[ln % _capacity];
+}
+
+bool WrapIndex::findRowLine(uint64_t row, size_t& ln) const
+{
+	size_t lo = std::max(_indexed_begin, _grid.getFirstLine());
+	size_t hi = _indexed_end;
+
+	if (lo >= hi ||
+		row < _row_start[lo % _capacity] ||
+		row >= _row_start[hi % _capacity])
+		return false;
+
+	/* Find last line starting at or before 'row' */
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (_row_start[mid % _capacity] <= row)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	ln = lo;
+	return true;
+}
+
+void WrapIndex::thrExecution(size_t width, uint64_t generation)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	while (true) {
+		std::lock_guard<Grid> lock(_grid);
+
+		if (_generation.load(std::memory_order_relaxed) != generation)
+			return;
+
+		const size_t first = _grid.getFirstLine();
+		const size_t last = _grid.getLastLine();
+
+		/* We fell behind the scrollback eviction -
+		*  continue numbering rows from the oldest line still stored.
+		*/
+		if (_indexed_end < first) {
+			_row_start[first % _capacity] = _row_start[_indexed_end % _capacity];
+			_indexed_end = first;
+		}
+
+		_indexed_begin = std::max(_indexed_begin, first);
+
+		const size_t end = std::min(last, _indexed_end + _ChunkSize);
+
+		for (size_t ln = _indexed_end; ln < end; ln++) {
+			const uint64_t row = _row_start[ln % _capacity];
+			_row_start[(ln + 1) % _capacity] = row + _grid.getLine(ln).getRowCount(width);
+		}
+
+		_indexed_end = end;
+
+		if (_indexed_end == last) {
+			_complete = true;
+
+			const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start);
+
+			THR_LOG_DEBUG("Wrap index for width {} built in {} us", width, elapsed.count());
+			return;
+		}
+	}
+}
+
+} // namespace Thr
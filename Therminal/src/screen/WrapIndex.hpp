@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Common.hpp"
+#include <thread>
+#include <atomic>
+#include <memory>
+
+namespace Thr
+{
+
+class Grid;
+
+/* Index of physical rows of the Grid logical lines, soft-wrapped
+*  at the current line width.
+*  For every indexed logical line we store absolute number of the first
+*  physical row it starts at, so mapping a line onto rows is O(1)
+*  and mapping a row onto line is a binary search.
+*
+*  Rebuilding the index (on resize) is done on background thread, chunk by chunk,
+*  so the UI thread never walks the entire history. Once complete, index
+*  is extended incrementally as lines are finalized.
+*
+*  All the methods except 'rebuild' and 'stop' expect the Grid lock to be held.
+*/
+class WrapIndex
+{
+public:
+	WrapIndex(Grid& grid, size_t capacity);
+	~WrapIndex();
+
+	WrapIndex(const WrapIndex&) = delete;
+	WrapIndex& operator=(const WrapIndex&) = delete;
+
+	/* Drop current index and start indexing lines at new 'width'.
+	*  Must be called without holding the Grid lock.
+	*/
+	void rebuild(size_t width);
+	void stop();
+
+	/* Notify the index about finalized logical line 'ln'.
+	*/
+	void onLineFinalized(size_t ln);
+
+	/* Returns true when every finalized line is indexed.
+	*/
+	bool isComplete() const;
+
+	/* Lines in range [first line, indexed end) have valid rows.
+	*/
+	size_t getIndexedEnd() const;
+
+	/* Absolute number of the first physical row of logical line 'ln'.
+	*  Valid for 'ln' up to (and including) indexed end only.
+	*/
+	uint64_t getLineRow(size_t ln) const;
+
+	/* Finds logical line containing absolute physical row 'row'
+	*  among the indexed lines. Returns false when 'row' is not covered.
+	*/
+	bool findRowLine(uint64_t row, size_t& ln) const;
+private:
+	void thrExecution(size_t width, uint64_t generation);
+
+	static constexpr size_t      _ChunkSize = 0x1000;
+
+	Grid&                        _grid;
+	const size_t                 _capacity;
+	std::unique_ptr<uint64_t[]>  _row_start;
+	size_t                       _width;
+	size_t                       _indexed_begin;
+	size_t                       _indexed_end;
+	bool                         _complete;
+	std::atomic<uint64_t>        _generation;
+	std::thread                  _thr;
+};
+
+} // namespace Thr
@@ -33,6 +33,18 @@ void onSigTerm(THR_UNUSED int sig)
 namespace Thr
 {
 
+#if !defined(THR_PLATFORM_WINDOWS)
+static void fillWinsize(const RenderFormat& fmt, struct winsize& ws)
+{
+	const glm::ivec2 window_size = fmt.getWindowSize();
+
+	ws.ws_col = static_cast<unsigned short>(fmt.getCellCountVertical());
+	ws.ws_row = static_cast<unsigned short>(fmt.getCellCountHorizontal());
+	ws.ws_xpixel = static_cast<unsigned short>(window_size.x);
+	ws.ws_ypixel = static_cast<unsigned short>(window_size.y);
+}
+#endif
+
 Shell::Shell()
     : _io_bridge(nullptr)
     , _fdm(-1)
@@ -45,6 +57,10 @@ Shell::Shell()
 		1
 	    )
     , _initialized(false)
+    , _winsize_dirty(false)
+    , _sent_cols(0)
+    , _sent_rows(0)
+    , _winsize_sent_at()
 {}
 
 Shell::~Shell()
@@ -117,8 +133,11 @@ void Shell::createFork()
 		THR_LOG_ERROR("Failed to generate interactive termios");
 	}
 
-	slave_winsize.ws_col = _render_fmt.getCellCountHorizontal();
-	slave_winsize.ws_row = _render_fmt.getCellCountVertical();
+	fillWinsize(_render_fmt, slave_winsize);
+
+	_sent_cols = slave_winsize.ws_col;
+	_sent_rows = slave_winsize.ws_row;
+	_winsize_sent_at = std::chrono::steady_clock::now();
 
 	pid = pty_fork(std::addressof(_fdm), slave_name, sizeof(slave_name),
 				   std::addressof(slave_termios), std::addressof(slave_winsize));
@@ -169,6 +188,61 @@ void Shell::createFork()
 #endif // THR_PLATFORM_WINDOWS
 }
 
+void Shell::resize(const RenderFormat& fmt)
+{
+	_render_fmt = fmt;
+	_winsize_dirty = true;
+}
+
+void Shell::update()
+{
+	if (!_winsize_dirty || _fdm < 0)
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	/* Drag-resizing generates storm of size changes,
+	*  don't flood the child with SIGWINCH for every one of them.
+	*/
+	if (now - _winsize_sent_at < _WinsizeSettleInterval)
+		return;
+
+	_winsize_dirty = false;
+
+#if defined(THR_PLATFORM_WINDOWS)
+
+// WINDOWS IMPLEMENTATION HERE
+
+#else
+
+	struct winsize ws;
+	fillWinsize(_render_fmt, ws);
+
+	if (ws.ws_col == _sent_cols && ws.ws_row == _sent_rows)
+		return;
+
+	if (tty_set(_fdm, nullptr, std::addressof(ws)) < 0) {
+		THR_LOG_ERROR("Failed to set shell window size");
+		return;
+	}
+
+	THR_LOG_DEBUG("Shell window size set to {}x{}", ws.ws_col, ws.ws_row);
+
+	_sent_cols = ws.ws_col;
+	_sent_rows = ws.ws_row;
+	_winsize_sent_at = now;
+
+#endif // THR_PLATFORM_WINDOWS
+}
+
+std::chrono::steady_clock::time_point Shell::getWinsizeDeadline() const
+{
+	if (!_winsize_dirty || _fdm < 0)
+		return std::chrono::steady_clock::time_point::max();
+
+	return _winsize_sent_at + _WinsizeSettleInterval;
+}
+
 bool Shell::running()
 {
     return SharedData.running;
@@ -4,6 +4,7 @@
 #include "io/IOBridge.hpp"
 #include "gl/RenderFormat.hpp"
 #include "io/Worker.hpp"
+#include <chrono>
 
 namespace Thr
 {
@@ -21,14 +22,32 @@ public:
 
 	void createFork();
 
+	/* Schedule new window size for the shell.
+	*  The size is delivered to the child (TIOCSWINSZ, followed by SIGWINCH
+	*  sent by the kernel) by 'update', at most once per settle interval.
+	*/
+	void resize(const RenderFormat& fmt);
+	void update();
+
+	/* Time 'update' delivers the scheduled window size at,
+	*  time_point::max() when there's none.
+	*/
+	std::chrono::steady_clock::time_point getWinsizeDeadline() const;
+
 	bool running();
 private:
-	std::shared_ptr<IOBridge> _io_bridge;
-	IOShellClient             _client;
-	int 					  _fdm;
-	RenderFormat 			  _render_fmt;
-	bool 					  _initialized;
-	ThreadWorker			  _io_worker;
+	static constexpr std::chrono::milliseconds _WinsizeSettleInterval{ 100 };
+
+	std::shared_ptr<IOBridge>             _io_bridge;
+	IOShellClient                         _client;
+	int 					              _fdm;
+	RenderFormat 			              _render_fmt;
+	bool 					              _initialized;
+	ThreadWorker			              _io_worker;
+	bool                                  _winsize_dirty;
+	int                                   _sent_cols;
+	int                                   _sent_rows;
+	std::chrono::steady_clock::time_point _winsize_sent_at;
 };
 
 } // namespace Thr
@@ -0,0 +1,381 @@
+#include "OffscreenContext.hpp"
+#include "logger/Log.hpp"
+#include "memory/Memory.hpp"
+
+#if defined(THR_PLATFORM_LINUX)
+#  include <dlfcn.h>
+#endif
+
+namespace Thr
+{
+
+/* Subset of EGL 1.5 used to create the context. Declared here, so
+*  the build doesn't need EGL headers and the binary doesn't link libEGL.
+*/
+using EGLint     = int32_t;
+using EGLenum    = unsigned int;
+using EGLBoolean = unsigned int;
+using EGLDisplay = void*;
+using EGLConfig  = void*;
+using EGLContext = void*;
+using EGLSurface = void*;
+
+static constexpr EGLint  EGL_NONE                             = 0x3038;
+static constexpr EGLint  EGL_EXTENSIONS                       = 0x3055;
+static constexpr EGLint  EGL_RENDERABLE_TYPE                  = 0x3040;
+static constexpr EGLint  EGL_SURFACE_TYPE                     = 0x3033;
+static constexpr EGLint  EGL_OPENGL_BIT                       = 0x0008;
+static constexpr EGLint  EGL_CONTEXT_MAJOR_VERSION            = 0x3098;
+static constexpr EGLint  EGL_CONTEXT_MINOR_VERSION            = 0x30FB;
+static constexpr EGLint  EGL_CONTEXT_OPENGL_PROFILE_MASK      = 0x30FD;
+static constexpr EGLint  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT  = 0x0001;
+static constexpr EGLenum EGL_OPENGL_API                       = 0x30A2;
+static constexpr EGLenum EGL_PLATFORM_SURFACELESS_MESA        = 0x31DD;
+
+struct OffscreenContext::EglApi
+{
+	using GetProcAddress		= void* (*)(const char*);
+	using GetPlatformDisplayEXT = EGLDisplay (*)(EGLenum, void*, const EGLint*);
+	using GetDisplay			= EGLDisplay (*)(void*);
+	using Initialize			= EGLBoolean (*)(EGLDisplay, EGLint*, EGLint*);
+	using Terminate				= EGLBoolean (*)(EGLDisplay);
+	using QueryString			= const char* (*)(EGLDisplay, EGLint);
+	using BindAPI				= EGLBoolean (*)(EGLenum);
+	using ChooseConfig			= EGLBoolean (*)(EGLDisplay, const EGLint*, EGLConfig*, EGLint, EGLint*);
+	using CreateContext			= EGLContext (*)(EGLDisplay, EGLConfig, EGLContext, const EGLint*);
+	using DestroyContext		= EGLBoolean (*)(EGLDisplay, EGLContext);
+	using MakeCurrent			= EGLBoolean (*)(EGLDisplay, EGLSurface, EGLSurface, EGLContext);
+	using GetError				= EGLint (*)();
+
+	void*				  lib = nullptr;
+	GetProcAddress		  getProcAddress = nullptr;
+	GetPlatformDisplayEXT getPlatformDisplayEXT = nullptr;
+	GetDisplay			  getDisplay = nullptr;
+	Initialize			  initialize = nullptr;
+	Terminate			  terminate = nullptr;
+	QueryString			  queryString = nullptr;
+	BindAPI				  bindAPI = nullptr;
+	ChooseConfig		  chooseConfig = nullptr;
+	CreateContext		  createContext = nullptr;
+	DestroyContext		  destroyContext = nullptr;
+	MakeCurrent			  makeCurrent = nullptr;
+	GetError			  getError = nullptr;
+
+	bool load();
+	void unload();
+};
+
+#if defined(THR_PLATFORM_LINUX)
+
+template<typename Fn>
+THR_INTERNAL bool loadEglSymbol(void* lib, const char* name, Fn& fn)
+{
+	fn = reinterpret_cast<Fn>(::dlsym(lib, name));
+	return fn != nullptr;
+}
+
+bool OffscreenContext::EglApi::load()
+{
+	lib = ::dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+
+	if (lib == nullptr) {
+		THR_LOG_ERROR("Failed to load libEGL: {}", ::dlerror());
+		return false;
+	}
+
+	const bool loaded =
+		loadEglSymbol(lib, "eglGetProcAddress", getProcAddress) &&
+		loadEglSymbol(lib, "eglGetDisplay", getDisplay) &&
+		loadEglSymbol(lib, "eglInitialize", initialize) &&
+		loadEglSymbol(lib, "eglTerminate", terminate) &&
+		loadEglSymbol(lib, "eglQueryString", queryString) &&
+		loadEglSymbol(lib, "eglBindAPI", bindAPI) &&
+		loadEglSymbol(lib, "eglChooseConfig", chooseConfig) &&
+		loadEglSymbol(lib, "eglCreateContext", createContext) &&
+		loadEglSymbol(lib, "eglDestroyContext", destroyContext) &&
+		loadEglSymbol(lib, "eglMakeCurrent", makeCurrent) &&
+		loadEglSymbol(lib, "eglGetError", getError);
+
+	if (!loaded) {
+		THR_LOG_ERROR("libEGL is missing EGL 1.4 entry points");
+		unload();
+		return false;
+	}
+
+	// extension, not exported by every libEGL
+	getPlatformDisplayEXT = reinterpret_cast<GetPlatformDisplayEXT>(getProcAddress("eglGetPlatformDisplayEXT"));
+	return true;
+}
+
+void OffscreenContext::EglApi::unload()
+{
+	/* Library itself stays loaded - drivers keep global state alive
+	*  past eglTerminate and don't expect to be unmapped
+	*/
+	*this = EglApi{};
+}
+
+#else
+
+bool OffscreenContext::EglApi::load()
+{
+	THR_LOG_ERROR("Offscreen rendering is supported on Linux only");
+	return false;
+}
+
+void OffscreenContext::EglApi::unload()
+{}
+
+#endif
+
+THR_INTERNAL bool hasEglExtension(const char* extensions, std::string_view name)
+{
+	if (extensions == nullptr)
+		return false;
+
+	std::string_view list(extensions);
+
+	for (size_t pos = list.find(name); pos != std::string_view::npos; pos = list.find(name, pos + 1)) {
+		const size_t end = pos + name.size();
+
+		if ((pos == 0 || list[pos - 1] == ' ') && (end == list.size() || list[end] == ' '))
+			return true;
+	}
+
+	return false;
+}
+
+OffscreenContext::OffscreenContext()
+	: _egl(std::make_unique<EglApi>())
+	, _display(nullptr)
+	, _context(nullptr)
+	, _fbo_id(0)
+	, _color_rb_id(0)
+	, _width(0)
+	, _height(0)
+	, _initialized(false)
+{}
+
+OffscreenContext::~OffscreenContext()
+{
+	if (_initialized)
+		destroyFramebuffer();
+
+	destroyContext();
+}
+
+bool OffscreenContext::init(uint width, uint height)
+{
+	THR_HARD_ASSERT_LOG(!_initialized, "Offscreen context is already initialized");
+
+	if (!createContext()) {
+		destroyContext();
+		return false;
+	}
+
+	if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(_egl->getProcAddress))) {
+		THR_LOG_ERROR("Failed to intialize GLAD");
+		destroyContext();
+		return false;
+	}
+
+	_width = static_cast<int>(width);
+	_height = static_cast<int>(height);
+
+	if (!createFramebuffer()) {
+		destroyFramebuffer();
+		destroyContext();
+		return false;
+	}
+
+	_initialized = true;
+
+	THR_LOG_INFO("Offscreen context created: {}x{}, renderer {}", _width, _height, getRenderer());
+	return true;
+}
+
+bool OffscreenContext::createContext()
+{
+	if (!_egl->load())
+		return false;
+
+	const char* client_extensions = _egl->queryString(nullptr, EGL_EXTENSIONS);
+
+	/* Surfaceless platform needs no display server at all, the default display
+	*  is tried when libEGL doesn't support it
+	*/
+	if (_egl->getPlatformDisplayEXT != nullptr &&
+		hasEglExtension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+		_display = _egl->getPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, nullptr, nullptr);
+	}
+
+	if (_display == nullptr)
+		_display = _egl->getDisplay(nullptr);
+
+	EGLint major = 0;
+	EGLint minor = 0;
+
+	if (_display == nullptr || !_egl->initialize(_display, &major, &minor)) {
+		THR_LOG_ERROR("Failed to initialize EGL display, err: {}", _egl->getError());
+		_display = nullptr;
+		return false;
+	}
+
+	const char* extensions = _egl->queryString(_display, EGL_EXTENSIONS);
+
+	if (!hasEglExtension(extensions, "EGL_KHR_surfaceless_context")) {
+		THR_LOG_ERROR("EGL {}.{} display doesn't support surfaceless contexts", major, minor);
+		return false;
+	}
+
+	if (!_egl->bindAPI(EGL_OPENGL_API)) {
+		THR_LOG_ERROR("EGL display doesn't support desktop OpenGL");
+		return false;
+	}
+
+	EGLConfig config = nullptr;
+
+	if (!hasEglExtension(extensions, "EGL_KHR_no_config_context")) {
+		const EGLint config_attribs[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_SURFACE_TYPE, 0,
+			EGL_NONE
+		};
+
+		EGLint config_cnt = 0;
+
+		if (!_egl->chooseConfig(_display, config_attribs, &config, 1, &config_cnt) || config_cnt == 0) {
+			THR_LOG_ERROR("No EGL config supports desktop OpenGL");
+			return false;
+		}
+	}
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, _GlMajorVersion,
+		EGL_CONTEXT_MINOR_VERSION, _GlMinorVersion,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	_context = _egl->createContext(_display, config, nullptr, context_attribs);
+
+	if (_context == nullptr) {
+		THR_LOG_ERROR("Failed to create OpenGL {}.{} core context, err: {}",
+					  _GlMajorVersion, _GlMinorVersion, _egl->getError());
+		return false;
+	}
+
+	if (!_egl->makeCurrent(_display, nullptr, nullptr, _context)) {
+		THR_LOG_ERROR("Failed to make offscreen context current, err: {}", _egl->getError());
+		return false;
+	}
+
+	return true;
+}
+
+void OffscreenContext::destroyContext()
+{
+	if (_display != nullptr) {
+		_egl->makeCurrent(_display, nullptr, nullptr, nullptr);
+
+		if (_context != nullptr)
+			_egl->destroyContext(_display, _context);
+
+		_egl->terminate(_display);
+	}
+
+	_display = nullptr;
+	_context = nullptr;
+	_egl->unload();
+}
+
+bool OffscreenContext::createFramebuffer()
+{
+	glGenRenderbuffers(1, std::addressof(_color_rb_id));
+	glBindRenderbuffer(GL_RENDERBUFFER, _color_rb_id);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+
+	glGenFramebuffers(1, std::addressof(_fbo_id));
+	glBindFramebuffer(GL_FRAMEBUFFER, _fbo_id);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _color_rb_id);
+
+	const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		THR_LOG_ERROR("Offscreen framebuffer {}x{} is incomplete, status: {}", _width, _height, status);
+		return false;
+	}
+
+	glViewport(0, 0, _width, _height);
+	return true;
+}
+
+void OffscreenContext::destroyFramebuffer()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (_fbo_id != 0)
+		glDeleteFramebuffers(1, std::addressof(_fbo_id));
+
+	if (_color_rb_id != 0)
+		glDeleteRenderbuffers(1, std::addressof(_color_rb_id));
+
+	_fbo_id = 0;
+	_color_rb_id = 0;
+}
+
+bool OffscreenContext::resize(uint width, uint height)
+{
+	THR_HARD_ASSERT(_initialized);
+
+	if (static_cast<int>(width) == _width && static_cast<int>(height) == _height)
+		return true;
+
+	destroyFramebuffer();
+
+	_width = static_cast<int>(width);
+	_height = static_cast<int>(height);
+
+	return createFramebuffer();
+}
+
+void OffscreenContext::readPixels(Vec<byte>& rgba) const
+{
+	THR_HARD_ASSERT(_initialized);
+
+	const size_t pitch = static_cast<size_t>(_width) * 4;
+	rgba.resize(pitch * _height);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+	/* GL rows go from the bottom up */
+	Vec<byte> row(pitch);
+
+	for (int top = 0, bottom = _height - 1; top < bottom; top++, bottom--) {
+		byte* const top_row = rgba.data() + top * pitch;
+		byte* const bottom_row = rgba.data() + bottom * pitch;
+
+		memCpy(row.data(), top_row, pitch);
+		memCpy(top_row, bottom_row, pitch);
+		memCpy(bottom_row, row.data(), pitch);
+	}
+}
+
+int OffscreenContext::getWidth() const
+{
+	return _width;
+}
+
+int OffscreenContext::getHeight() const
+{
+	return _height;
+}
+
+std::string_view OffscreenContext::getRenderer() const
+{
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	return renderer != nullptr ? reinterpret_cast<const char*>(renderer) : "unknown";
+}
+
+} // namespace Thr
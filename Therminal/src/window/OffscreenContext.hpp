@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Common.hpp"
+#include <memory>
+
+namespace Thr
+{
+
+/* OpenGL context without any window, rendering into a framebuffer object.
+*  Used by the headless mode - benchmarks and pixel comparisons on machines
+*  without a display.
+*
+*  Context is created through EGL on a surfaceless Mesa display (llvmpipe
+*  when there is no GPU), libEGL is loaded at runtime so the windowed
+*  application doesn't depend on it. Only a single context is supported,
+*  it stays current on the thread that initialized it.
+*/
+class OffscreenContext
+{
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	OffscreenContext(const OffscreenContext&) = delete;
+	OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+	/* Create the context, load GL functions and bind the framebuffer
+	*  of the given size.
+	*/
+	bool init(uint width, uint height);
+	bool resize(uint width, uint height);
+
+	/* Wait for the rendering to finish and copy the framebuffer into 'rgba',
+	*  4 bytes per pixel, rows from top to bottom.
+	*/
+	void readPixels(Vec<byte>& rgba) const;
+
+	int getWidth() const;
+	int getHeight() const;
+
+	/* Name of the GL renderer, as reported by the driver */
+	std::string_view getRenderer() const;
+private:
+	struct EglApi;
+
+	bool createContext();
+	bool createFramebuffer();
+	void destroyFramebuffer();
+	void destroyContext();
+
+	static constexpr int _GlMajorVersion = 4;
+	static constexpr int _GlMinorVersion = 2;
+
+	std::unique_ptr<EglApi> _egl;
+	void*					_display;
+	void*					_context;
+	GLuint					_fbo_id;
+	GLuint					_color_rb_id;
+	int						_width;
+	int						_height;
+	bool					_initialized;
+};
+
+} // namespace Thr
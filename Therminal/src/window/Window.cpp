@@ -135,10 +135,30 @@ bool Window::init(uint width, uint height, const std::string& title)
 }
 
 void Window::update()
+{
+	swapBuffers();
+	processEvents(0.);
+}
+
+void Window::swapBuffers()
 {
 	THR_HARD_ASSERT(_initialized);
 	glfwSwapBuffers(_native_window);
-	_input->pollEvents();
+}
+
+void Window::processEvents(double timeout)
+{
+	THR_HARD_ASSERT(_initialized);
+
+	if (timeout > 0.)
+		_input->waitEvents(timeout);
+	else
+		_input->pollEvents();
+}
+
+void Window::postEmptyEvent()
+{
+	glfwPostEmptyEvent();
 }
 
 bool Window::isOpen() const
@@ -163,6 +183,12 @@ int Window::getHeight() const
 	return _height;
 }
 
+void Window::setClipboardText(const std::string& text)
+{
+	THR_HARD_ASSERT(_initialized);
+	glfwSetClipboardString(_native_window, text.c_str());
+}
+
 void Window::__setWidth(uint width)
 {
 	THR_ASSERT(_initialized);
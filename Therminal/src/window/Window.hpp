@@ -69,12 +69,29 @@ public:
     *  We use glfwWaitEvent() here.
     */
     void update();
+
+    /* Present the rendered frame.
+    */
+    void swapBuffers();
+
+    /* Process the received events, waiting for them at most 'timeout' seconds.
+    *  Events are only polled with zero timeout.
+    */
+    void processEvents(double timeout);
+
+    /* Wake up the thread waiting in processEvents, callable from any thread.
+    */
+    static void postEmptyEvent();
     bool isOpen() const;
     bool isSuspended() const;
 
     int getWidth() const;
     int getHeight() const;
 
+    /* Put UTF-8 encoded text into the system clipboard.
+    */
+    void setClipboardText(const std::string& text);
+
     /* __setWidth / __setHeight methods do not really *resize* the window, but
     *  rather change internal state fields to match the actual size.
     *  Used internally by callbacks function on resize event.